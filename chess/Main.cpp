@@ -1,36 +1,265 @@
 // This is the Main.cpp  file which holds the main() funcion.
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "archive.h"
+#include "batch.h"
 #include "bridge.h"
 #include "chess.h"
+#include "epd.h"
+#include "explorer.h"
+#include "mate.h"
+#include "pgn.h"
+#include "posindex.h"
+#include "review.h"
+#include "server.h"
+#include "tablebase.h"
 
 void printMoves(bool color, const ChessGame& game);
 void printMoveList(const std::vector<ChessMove>& moves);
+void printMate(const ChessGame& game, int maxMoves, uint64_t maxNodes);
+int runReview(const char* fen, const ReviewOptions& options, bool pgn);
+int runPgnCheck(const char* path, int threads);
+int runPgnToArchive(const char* pgnPath, const char* archivePath, int threads,
+                    ArchiveEncoding encoding);
+int runBuildPositionIndex(const char* pgnPath, const char* indexPath, int threads, int maxPly);
+int runBuildExplorer(const char* pgnPath, const char* explorerPath, int threads, int maxPly);
+int runBatchMode(const char* path, const BatchOptions& options);
+int runEpdSuiteMode(const char* path, const EpdSuiteOptions& options);
 
 int main(int argc, char* argv[]) {
-    // Check for --json-bridge flag
+    // Non-interactive modes: --json-bridge [--tb-path DIR] [--stats-interval SEC]
+    //   [--position-index FILE] (enables find_games) [--explorer FILE]
+    //   [--ponder] (analyze the replies while waiting for the next command),
+    // --serve SOCKET (same options; many clients over a Unix domain socket),
+    //   both taking --bridge-format=json|cbor|msgpack (binary formats are
+    //   length-prefixed),
+    // --tb-generate DIR SIGNATURE... [--threads N]
+    // --review [--fen FEN] [--nodes N] [--movetime MS] [--threads N] [--pgn]
+    //   reads a move list from stdin (SAN/LAN tokens, or a JSON array such
+    //   as the bridge's moveHistory) and prints the review.
+    // --pgn-check FILE [--threads N] parses and replays every game of a PGN
+    //   file, reporting bad games on stderr and a summary on stdout.
+    // --pgn-to-archive PGN ARCHIVE [--threads N] [--move16] converts a PGN
+    //   file to the binary game archive (archive.h), skipping bad games.
+    // --build-position-index PGN INDEX [--threads N] [--max-ply N] indexes
+    //   the positions of every game for find_games.
+    // --build-explorer PGN FILE [--threads N] [--max-ply N] aggregates move
+    //   statistics for the explorer command.
+    // --batch [FILE] [--output moves|san|status|perft|eval] [--depth N]
+    //   [--threads N] [--window N] reads FEN or EPD lines from FILE (default
+    //   stdin) and writes one NDJSON record per line, in input order.
+    // --epd-suite FILE [--nodes N] [--movetime MS] [--depth N] [--threads N]
+    //   runs an EPD test suite (bm, am and perft operations) and prints the
+    //   pass rate and speed; exits with 2 if a position failed.
+    // Interactive play starts from --fen FEN when given.
+    bool bridge = false;
+    bool review = false;
+    bool reviewPgn = false;
+    ReviewOptions reviewOptions;
+    const char* startFen = nullptr;
+    const char* tbPath = nullptr;
+    const char* servePath = nullptr;
+    const char* bridgeFormat = "json";
+    const char* tbGenerateDir = nullptr;
+    const char* pgnCheckPath = nullptr;
+    const char* archiveInput = nullptr;
+    const char* archiveOutput = nullptr;
+    ArchiveEncoding archiveEncoding = ArchiveEncoding::MoveIndex;
+    const char* indexInput = nullptr;
+    const char* indexPath = nullptr;
+    const char* explorerInput = nullptr;
+    const char* explorerPath = nullptr;
+    int maxPly = 0;
+    std::vector<std::string> tbSignatures;
+    int threads = 0;  // 0 = one per hardware thread
+    int statsInterval = 0;
+    bool ponder = false;
+    bool batch = false;
+    const char* batchPath = nullptr;
+    BatchOptions batchOptions;
+    const char* epdSuitePath = nullptr;
+    int depth = -1;
     for (int i = 1; i < argc; i++) {
         if (std::strcmp(argv[i], "--json-bridge") == 0) {
-            runBridgeLoop();
+            bridge = true;
+        } else if (std::strncmp(argv[i], "--bridge-format=", 16) == 0) {
+            bridgeFormat = argv[i] + 16;
+        } else if (std::strcmp(argv[i], "--bridge-format") == 0 && i + 1 < argc) {
+            bridgeFormat = argv[++i];
+        } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            servePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--tb-path") == 0 && i + 1 < argc) {
+            tbPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            statsInterval = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--ponder") == 0) {
+            ponder = true;
+        } else if (std::strcmp(argv[i], "--review") == 0) {
+            review = true;
+        } else if (std::strcmp(argv[i], "--pgn") == 0) {
+            reviewPgn = true;
+        } else if (std::strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) {
+            reviewOptions.nodes = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--movetime") == 0 && i + 1 < argc) {
+            reviewOptions.movetimeMs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--fen") == 0 && i + 1 < argc) {
+            startFen = argv[++i];
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--pgn-check") == 0 && i + 1 < argc) {
+            pgnCheckPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--pgn-to-archive") == 0 && i + 2 < argc) {
+            archiveInput = argv[++i];
+            archiveOutput = argv[++i];
+        } else if (std::strcmp(argv[i], "--build-position-index") == 0 && i + 2 < argc) {
+            indexInput = argv[++i];
+            indexPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--position-index") == 0 && i + 1 < argc) {
+            indexPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--build-explorer") == 0 && i + 2 < argc) {
+            explorerInput = argv[++i];
+            explorerPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--explorer") == 0 && i + 1 < argc) {
+            explorerPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--max-ply") == 0 && i + 1 < argc) {
+            maxPly = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--move16") == 0) {
+            archiveEncoding = ArchiveEncoding::Move16;
+        } else if (std::strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+            if (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) batchPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            if (!parseBatchOutput(argv[++i], batchOptions.output)) {
+                fprintf(stderr, "unknown batch output: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            depth = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--epd-suite") == 0 && i + 1 < argc) {
+            epdSuitePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            batchOptions.window = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--tb-generate") == 0 && i + 1 < argc) {
+            tbGenerateDir = argv[++i];
+            while (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0)
+                tbSignatures.push_back(argv[++i]);
+        }
+    }
+
+    if (tbGenerateDir != nullptr) {
+        for (const auto& sig : tbSignatures) {
+            std::string error;
+            if (!Tablebases::generate(tbGenerateDir, sig, threads, error, &std::cerr)) {
+                fprintf(stderr, "tablebase generation failed: %s\n", error.c_str());
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    if (pgnCheckPath != nullptr) {
+        return runPgnCheck(pgnCheckPath, threads);
+    }
+
+    if (archiveInput != nullptr) {
+        return runPgnToArchive(archiveInput, archiveOutput, threads, archiveEncoding);
+    }
+
+    if (indexInput != nullptr) {
+        return runBuildPositionIndex(indexInput, indexPath, threads, maxPly);
+    }
+
+    if (explorerInput != nullptr) {
+        return runBuildExplorer(explorerInput, explorerPath, threads, maxPly);
+    }
+
+    if (batch) {
+        batchOptions.threads = threads;
+        if (depth >= 0) batchOptions.depth = depth;
+        return runBatchMode(batchPath, batchOptions);
+    }
+
+    if (epdSuitePath != nullptr) {
+        EpdSuiteOptions suiteOptions;
+        suiteOptions.nodes = reviewOptions.nodes;
+        suiteOptions.movetimeMs = reviewOptions.movetimeMs;
+        suiteOptions.depth = std::max(depth, 0);
+        suiteOptions.threads = threads;
+        return runEpdSuiteMode(epdSuitePath, suiteOptions);
+    }
+
+    if (review) {
+        reviewOptions.threads = threads;
+        return runReview(startFen, reviewOptions, reviewPgn);
+    }
+
+    if (bridge || servePath != nullptr) {
+        BridgeContext ctx;
+        if (tbPath != nullptr) ctx.tablebases = std::make_shared<Tablebases>(tbPath);
+        if (indexPath != nullptr) {
+            auto index = std::make_shared<PositionIndex>();
+            std::string error;
+            if (!index->open(indexPath, error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+            ctx.positionIndex = index;
+        }
+        if (explorerPath != nullptr) {
+            auto explorer = std::make_shared<OpeningExplorer>();
+            std::string error;
+            if (!explorer->open(explorerPath, error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+            ctx.explorer = explorer;
+        }
+        ctx.statsInterval = std::chrono::seconds(statsInterval);
+        if (!parseBridgeFormat(bridgeFormat, ctx.format)) {
+            fprintf(stderr, "unknown bridge format: %s\n", bridgeFormat);
+            return 1;
+        }
+        if (servePath == nullptr) {
+            if (ponder) ctx.ponderer = std::make_unique<Ponderer>();
+            runBridgeLoop(ctx);
             return 0;
         }
+        std::string error;
+        if (!runBridgeServer(servePath, ctx, error)) {
+            fprintf(stderr, "cannot serve on %s: %s\n", servePath, error.c_str());
+            return 1;
+        }
+        return 0;
     }
 
     srand(time(nullptr));  // initialize random number generator
     bool print = true;
-    ChessGame game = ChessGame();
+    auto gamePtr = startFen ? ChessGame::fromFen(startFen) : std::make_unique<ChessGame>();
+    if (!gamePtr) {
+        fprintf(stderr, "invalid FEN: %s\n", startFen);
+        return 1;
+    }
+    ChessGame& game = *gamePtr;
     std::string input;
 
     printf("Chess Version 1.0\n\n");
     printf("Commands:\nNf3, e4, O-O\tSAN move\nx#-x#\t\tLAN move\nend\t\texit\n");
-    printf("moves\t\tshow moves\nmoves x#\tshow moves at x#\nrand\t\trandom move\n\n");
+    printf("moves\t\tshow moves\nmoves x#\tshow moves at x#\nrand\t\trandom move\n");
+    printf("undo\t\ttake back the last move\n");
+    printf("find_mate N [nodes]\tsearch for mate in N\n\n");
 
     while (true) {
         if (print) {
@@ -77,6 +306,20 @@ int main(int argc, char* argv[]) {
                 printMoveList(moves);
                 printf("\n");
             }
+        } else if (input.substr(0, 10) == "find_mate ") {
+            int maxMoves = 0;
+            unsigned long long maxNodes = 1000000;
+            if (sscanf(input.c_str() + 10, "%d %llu", &maxMoves, &maxNodes) >= 1 &&
+                maxMoves > 0) {
+                printMate(game, maxMoves, maxNodes);
+            }
+            printf("\n");
+        } else if (input == "undo") {
+            if (game.undoMove()) {
+                print = true;
+            } else {
+                printf("Nothing to undo.\n\n");
+            }
         } else if (input == "rand") {
             auto moves = game.getMoves(game.getTurn());
             int l = (int)moves.size();
@@ -130,3 +373,285 @@ void printMoveList(const std::vector<ChessMove>& moves) {
         printf("%s\n", m.toString());
     }
 }
+
+void printMate(const ChessGame& game, int maxMoves, uint64_t maxNodes) {
+    Position pos;
+    Position::fromGame(game, pos);
+    MateResult result = findMate(pos, maxMoves, maxNodes);
+    if (!result.found) {
+        printf("%s (%llu nodes)\n",
+               result.disproven ? "No forced mate found" : "Node limit reached",
+               static_cast<unsigned long long>(result.nodes));
+        return;
+    }
+    printf("Mate in %d (%llu nodes):", result.moves,
+           static_cast<unsigned long long>(result.nodes));
+    for (const auto& san : sanLine(game, result.line)) printf(" %s", san.c_str());
+    printf("\n");
+}
+
+int runReview(const char* fen, const ReviewOptions& options, bool pgn) {
+    std::string input((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+    std::vector<std::string> moves;
+    size_t start = input.find_first_not_of(" \t\r\n");
+    if (start != std::string::npos && input[start] == '[') {
+        auto parsed = nlohmann::json::parse(input, nullptr, false);
+        if (!parsed.is_array()) {
+            fprintf(stderr, "invalid JSON move list\n");
+            return 1;
+        }
+        for (const auto& m : parsed) {
+            if (m.is_string()) moves.push_back(m);
+        }
+    } else {
+        std::istringstream in(input);
+        for (std::string token; in >> token;) moves.push_back(token);
+    }
+
+    GameReview review;
+    std::string error;
+    std::string startFen =
+        fen ? fen : "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    if (!reviewGame(startFen, moves, options, review, error)) {
+        fprintf(stderr, "review failed: %s\n", error.c_str());
+        return 1;
+    }
+    if (pgn) {
+        printf("%s", reviewToPgn(review).c_str());
+    } else {
+        printf("%s\n", reviewToJson(review).dump(2).c_str());
+    }
+    return 0;
+}
+
+int runPgnCheck(const char* path, int threads) {
+    MappedFile file;
+    std::string error;
+    if (!file.open(path, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+    std::vector<std::string_view> parts = splitPgn(file.text(), std::max(threads, 1));
+
+    struct Counts {
+        uint64_t games = 0, bad = 0, plies = 0;
+        std::string errors;
+    };
+    std::vector<Counts> counts(parts.size());
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < parts.size(); t++) {
+        pool.emplace_back([&, t] {
+            PgnReader reader(parts[t]);
+            PgnGame game;
+            Counts& c = counts[t];
+            size_t base = parts[t].data() - file.text().data();
+            while (reader.next(game)) {
+                c.games++;
+                c.plies += game.moves.size();
+                if (!game.error.empty()) {
+                    c.bad++;
+                    c.errors += "game at byte " + std::to_string(base + game.offset) + ": " +
+                                game.error + "\n";
+                }
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+
+    Counts total;
+    for (const Counts& c : counts) {
+        total.games += c.games;
+        total.bad += c.bad;
+        total.plies += c.plies;
+        fputs(c.errors.c_str(), stderr);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s\n", nlohmann::json({{"games", total.games},
+                                   {"bad_games", total.bad},
+                                   {"plies", total.plies},
+                                   {"seconds", seconds}})
+                       .dump()
+                       .c_str());
+    return total.bad == 0 ? 0 : 2;
+}
+
+int runPgnToArchive(const char* pgnPath, const char* archivePath, int threads,
+                    ArchiveEncoding encoding) {
+    MappedFile file;
+    ArchiveWriter writer(encoding);
+    std::string error;
+    if (!file.open(pgnPath, error) || !writer.open(archivePath, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(threads, 1);
+    // Many more parts than threads: parts are encoded a wave at a time and
+    // written in order, so only one wave of records is held in memory.
+    std::vector<std::string_view> parts = splitPgn(file.text(), threads * 16);
+
+    struct Encoded {
+        std::string records;
+        std::vector<size_t> ends;  // end of each record in records
+        uint64_t games = 0, skipped = 0, plies = 0;
+        std::string errors;
+    };
+    Encoded total;
+    for (size_t wave = 0; wave < parts.size(); wave += threads) {
+        size_t count = std::min(parts.size() - wave, static_cast<size_t>(threads));
+        std::vector<Encoded> encoded(count);
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < count; t++) {
+            pool.emplace_back([&, t] {
+                std::string_view part = parts[wave + t];
+                PgnReader reader(part);
+                PgnGame game;
+                Encoded& e = encoded[t];
+                size_t base = part.data() - file.text().data();
+                std::string why;
+                while (reader.next(game)) {
+                    e.games++;
+                    if (game.error.empty() && ArchiveWriter::encode(game, encoding, e.records, why)) {
+                        e.ends.push_back(e.records.size());
+                        e.plies += game.moves.size();
+                        continue;
+                    }
+                    e.skipped++;
+                    e.errors += "game at byte " + std::to_string(base + game.offset) + ": " +
+                                (game.error.empty() ? why : game.error) + "\n";
+                }
+            });
+        }
+        for (auto& t : pool) t.join();
+        for (const Encoded& e : encoded) {
+            size_t begin = 0;
+            for (size_t end : e.ends) {
+                if (!writer.addRecord(std::string_view(e.records).substr(begin, end - begin), error)) {
+                    fprintf(stderr, "%s\n", error.c_str());
+                    return 1;
+                }
+                begin = end;
+            }
+            total.games += e.games;
+            total.skipped += e.skipped;
+            total.plies += e.plies;
+            fputs(e.errors.c_str(), stderr);
+        }
+    }
+    if (!writer.close(error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s\n", nlohmann::json({{"games", total.games - total.skipped},
+                                   {"skipped", total.skipped},
+                                   {"plies", total.plies},
+                                   {"seconds", seconds}})
+                       .dump()
+                       .c_str());
+    return 0;
+}
+
+int runBuildPositionIndex(const char* pgnPath, const char* indexPath, int threads, int maxPly) {
+    MappedFile file;
+    std::string error;
+    if (!file.open(pgnPath, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    PositionIndexStats stats;
+    if (!buildPositionIndex(file.text(), indexPath, threads, maxPly, error, &stats)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s\n", nlohmann::json({{"games", stats.games},
+                                   {"bad_games", stats.badGames},
+                                   {"positions", stats.keys},
+                                   {"postings", stats.postings},
+                                   {"seconds", seconds}})
+                       .dump()
+                       .c_str());
+    return 0;
+}
+
+int runBuildExplorer(const char* pgnPath, const char* explorerPath, int threads, int maxPly) {
+    MappedFile file;
+    std::string error;
+    if (!file.open(pgnPath, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    ExplorerStats stats;
+    if (!buildExplorer(file.text(), explorerPath, threads, maxPly, error, &stats)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s\n", nlohmann::json({{"games", stats.games},
+                                   {"skipped", stats.skipped},
+                                   {"entries", stats.entries},
+                                   {"seconds", seconds}})
+                       .dump()
+                       .c_str());
+    return 0;
+}
+
+int runBatchMode(const char* path, const BatchOptions& options) {
+    if (options.depth < 0 || options.depth > 10) {
+        fprintf(stderr, "perft depth must be between 0 and 10\n");
+        return 1;
+    }
+    std::ifstream file;
+    if (path != nullptr && std::strcmp(path, "-") != 0) {
+        file.open(path);
+        if (!file) {
+            fprintf(stderr, "cannot open %s\n", path);
+            return 1;
+        }
+    }
+    std::ios::sync_with_stdio(false);
+    auto start = std::chrono::steady_clock::now();
+    BatchStats stats = runBatch(file.is_open() ? file : std::cin, std::cout, options);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // stdout carries the records, so the summary goes to stderr.
+    fprintf(stderr, "%s\n", nlohmann::json({{"records", stats.records},
+                                            {"errors", stats.errors},
+                                            {"seconds", seconds}})
+                                .dump()
+                                .c_str());
+    return 0;
+}
+
+int runEpdSuiteMode(const char* path, const EpdSuiteOptions& options) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    std::vector<EpdRecord> records;
+    uint64_t lineNumber = 0, bad = 0;
+    std::string error;
+    for (std::string line; std::getline(file, line);) {
+        lineNumber++;
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        EpdRecord record;
+        if (!parseEpd(line, record, error)) {
+            fprintf(stderr, "line %llu: %s\n", static_cast<unsigned long long>(lineNumber),
+                    error.c_str());
+            bad++;
+            continue;
+        }
+        records.push_back(std::move(record));
+    }
+    EpdSuiteReport report = runEpdSuite(records, options);
+    nlohmann::json summary = epdReportToJson(records, report);
+    summary["bad_lines"] = bad;
+    printf("%s\n", summary.dump(2).c_str());
+    return bad == 0 && report.passed == report.tested ? 0 : 2;
+}
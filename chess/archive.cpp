@@ -0,0 +1,330 @@
+// Binary game archive reader and writer.
+
+#include "archive.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+const char headerMagic[4] = {'C', 'H', 'G', 'A'};
+const char trailerMagic[4] = {'C', 'H', 'G', 'I'};
+const uint32_t formatVersion = 1;
+const size_t headerSize = 32;   // magic, version, encoding, block size
+const size_t trailerSize = 32;  // magic, pad, game count, block count, index offset
+const size_t recordHeaderSize = 10;  // length, plies, result, flags, tag bytes
+
+const uint8_t FLAG_FEN = 1;
+
+const std::string_view kInitialFen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// Result byte values; 0 is a game without a termination marker.
+const std::string_view results[] = {"", "1-0", "0-1", "1/2-1/2", "*"};
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T get(const char* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+const Position& initialPosition() {
+    static const Position initial = [] {
+        Position p;
+        Position::fromFen(kInitialFen, p);
+        return p;
+    }();
+    return initial;
+}
+
+}  // namespace
+
+ArchiveWriter::ArchiveWriter(ArchiveEncoding encoding, uint32_t blockSize)
+    : enc(encoding), blockSize(blockSize) {}
+
+ArchiveWriter::~ArchiveWriter() {
+    if (out.is_open()) {
+        out.close();
+        std::error_code ec;
+        std::filesystem::remove(tmp, ec);
+    }
+}
+
+bool ArchiveWriter::open(const std::string& target, std::string& error) {
+    path = target;
+    tmp = path + ".tmp" + std::to_string(getpid());
+    out.open(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = "cannot create " + tmp;
+        return false;
+    }
+    written = 0;
+    offsets.clear();
+    blockFirst.clear();
+    char header[headerSize] = {};
+    std::memcpy(header, headerMagic, 4);
+    std::memcpy(header + 4, &formatVersion, sizeof(formatVersion));
+    header[8] = static_cast<char>(enc);
+    std::memcpy(header + 12, &blockSize, sizeof(blockSize));
+    return write(header, headerSize, error);
+}
+
+bool ArchiveWriter::encode(const PgnGame& game, ArchiveEncoding encoding, std::string& out,
+                           std::string& error) {
+    size_t start = out.size();
+    if (game.moves.size() > UINT16_MAX) {
+        error = "game too long for the archive";
+        return false;
+    }
+    uint8_t result = 0;
+    for (uint8_t r = 1; r < std::size(results); r++) {
+        if (game.result == results[r]) result = r;
+    }
+    std::string fen = game.start.toFen();
+    bool hasFen = fen != kInitialFen;
+
+    put<uint32_t>(out, 0);  // length, filled in below
+    put<uint16_t>(out, static_cast<uint16_t>(game.moves.size()));
+    put<uint8_t>(out, result);
+    put<uint8_t>(out, hasFen ? FLAG_FEN : 0);
+    put<uint16_t>(out, 0);  // tag bytes, filled in below
+    size_t tagStart = out.size();
+    for (const PgnTag& t : game.tags) {
+        out += t.name;
+        out += '\0';
+        out += t.value;
+        out += '\0';
+    }
+    size_t tagBytes = out.size() - tagStart;
+    if (tagBytes > UINT16_MAX) {
+        out.resize(start);
+        error = "tags too long for the archive";
+        return false;
+    }
+    uint16_t tagLength = static_cast<uint16_t>(tagBytes);
+    std::memcpy(&out[start + 8], &tagLength, sizeof(tagLength));
+    if (hasFen) {
+        put<uint8_t>(out, static_cast<uint8_t>(fen.size()));
+        out += fen;
+    }
+
+    if (encoding == ArchiveEncoding::Move16) {
+        for (const PosMove& m : game.moves) {
+            put<uint16_t>(out, static_cast<uint16_t>(m.from | m.to << 6 | m.promo << 12));
+        }
+    } else {
+        Position pos = game.start;
+        MoveList list;
+        for (const PosMove& m : game.moves) {
+            pos.generateLegal(list);
+            int index = 0;
+            while (index < list.size && !(list.moves[index] == m)) index++;
+            if (index == list.size) {
+                out.resize(start);
+                error = "illegal move at ply " + std::to_string(&m - game.moves.data() + 1);
+                return false;
+            }
+            put<uint8_t>(out, static_cast<uint8_t>(index));
+            pos.make(m);
+        }
+    }
+    uint32_t length = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t));
+    std::memcpy(&out[start], &length, sizeof(length));
+    return true;
+}
+
+bool ArchiveWriter::add(const PgnGame& game, std::string& error) {
+    scratch.clear();
+    return encode(game, enc, scratch, error) && addRecord(scratch, error);
+}
+
+bool ArchiveWriter::addRecord(std::string_view record, std::string& error) {
+    // Block-relative position of the record; the header counts as block data.
+    uint64_t used = written % blockSize;
+    if (used != 0 && used + record.size() > blockSize) {
+        // Pad to the next block rather than split the record.
+        static const char zeros[4096] = {};
+        for (uint64_t pad = blockSize - used; pad > 0;) {
+            size_t n = std::min<uint64_t>(pad, sizeof(zeros));
+            if (!write(zeros, n, error)) return false;
+            pad -= n;
+        }
+    }
+    while (blockFirst.size() <= written / blockSize) blockFirst.push_back(offsets.size());
+    offsets.push_back(written);
+    if (!write(record.data(), record.size(), error)) return false;
+    // Blocks wholly covered by an oversized record start no game.
+    while (blockFirst.size() < (written + blockSize - 1) / blockSize) {
+        blockFirst.push_back(offsets.size());
+    }
+    return true;
+}
+
+bool ArchiveWriter::close(std::string& error) {
+    uint64_t indexOffset = written;
+    std::string index;
+    index.reserve((offsets.size() + blockFirst.size()) * sizeof(uint64_t) + trailerSize);
+    for (uint64_t off : offsets) put<uint64_t>(index, off);
+    for (uint64_t first : blockFirst) put<uint64_t>(index, first);
+    index.append(trailerMagic, 4);
+    put<uint32_t>(index, 0);
+    put<uint64_t>(index, offsets.size());
+    put<uint64_t>(index, blockFirst.size());
+    put<uint64_t>(index, indexOffset);
+    if (!write(index.data(), index.size(), error)) return false;
+    out.close();
+    if (!out) {
+        error = "failed to write " + tmp;
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        error = "failed to rename " + tmp + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+bool ArchiveWriter::write(const char* data, size_t size, std::string& error) {
+    out.write(data, static_cast<std::streamsize>(size));
+    if (!out) {
+        error = "failed to write " + tmp;
+        return false;
+    }
+    written += size;
+    return true;
+}
+
+bool ArchiveReader::open(const std::string& path, std::string& error) {
+    gameCount = blockCount = 0;
+    if (!file.open(path, error)) return false;
+    base = file.text().data();
+    fileSize = file.text().size();
+    if (fileSize < headerSize + trailerSize || std::memcmp(base, headerMagic, 4) != 0 ||
+        get<uint32_t>(base + 4) != formatVersion || static_cast<uint8_t>(base[8]) > 1) {
+        error = path + " is not a game archive (or has an unsupported version)";
+        return false;
+    }
+    enc = static_cast<ArchiveEncoding>(base[8]);
+    const char* trailer = base + fileSize - trailerSize;
+    uint64_t games = get<uint64_t>(trailer + 8);
+    uint64_t blocks = get<uint64_t>(trailer + 16);
+    uint64_t indexOffset = get<uint64_t>(trailer + 24);
+    uint64_t indexEnd = fileSize - trailerSize;
+    if (std::memcmp(trailer, trailerMagic, 4) != 0 || indexOffset > indexEnd ||
+        (indexEnd - indexOffset) / sizeof(uint64_t) < games ||
+        indexEnd - indexOffset != (games + blocks) * sizeof(uint64_t)) {
+        error = path + " has a damaged index";
+        return false;
+    }
+    gameCount = games;
+    blockCount = blocks;
+    offsetTable = base + indexOffset;
+    blockTable = offsetTable + games * sizeof(uint64_t);
+    return true;
+}
+
+uint64_t ArchiveReader::firstGameOfBlock(uint64_t b) const {
+    if (b >= blockCount) return gameCount;
+    return get<uint64_t>(blockTable + b * sizeof(uint64_t));
+}
+
+bool ArchiveReader::read(uint64_t index, PgnGame& game, bool withMoves) const {
+    game.tags.clear();
+    game.moves.clear();
+    game.result = {};
+    game.error.clear();
+    game.number = index + 1;
+    if (index >= gameCount) {
+        game.error = "no game " + std::to_string(index);
+        return false;
+    }
+    uint64_t offset = get<uint64_t>(offsetTable + index * sizeof(uint64_t));
+    game.offset = offset;
+    const char* indexStart = offsetTable;
+    auto corrupt = [&] {
+        game.error = "corrupt record for game " + std::to_string(index);
+        return false;
+    };
+    if (offset < headerSize ||
+        offset + recordHeaderSize > static_cast<uint64_t>(indexStart - base)) {
+        return corrupt();
+    }
+    const char* p = base + offset;
+    uint32_t length = get<uint32_t>(p);
+    const char* end = p + sizeof(uint32_t) + length;
+    if (length < recordHeaderSize - sizeof(uint32_t) || end > indexStart) return corrupt();
+    uint16_t plies = get<uint16_t>(p + 4);
+    uint8_t result = static_cast<uint8_t>(p[6]);
+    uint8_t flags = static_cast<uint8_t>(p[7]);
+    uint16_t tagBytes = get<uint16_t>(p + 8);
+    p += recordHeaderSize;
+    if (result >= std::size(results) || tagBytes > end - p) return corrupt();
+    game.result = results[result];
+
+    const char* tagsEnd = p + tagBytes;
+    while (p < tagsEnd) {
+        const char* nameEnd = static_cast<const char*>(std::memchr(p, '\0', tagsEnd - p));
+        if (nameEnd == nullptr) return corrupt();
+        const char* valueEnd =
+            static_cast<const char*>(std::memchr(nameEnd + 1, '\0', tagsEnd - nameEnd - 1));
+        if (valueEnd == nullptr) return corrupt();
+        game.tags.push_back({std::string_view(p, nameEnd - p),
+                             std::string_view(nameEnd + 1, valueEnd - nameEnd - 1)});
+        p = valueEnd + 1;
+    }
+    if (!withMoves) return true;
+
+    if (flags & FLAG_FEN) {
+        if (p >= end || static_cast<uint8_t>(*p) > end - p - 1) return corrupt();
+        size_t fenLength = static_cast<uint8_t>(*p);
+        if (parseFen(std::string_view(p + 1, fenLength), game.start) != FenError::None) {
+            return corrupt();
+        }
+        p += 1 + fenLength;
+    } else {
+        game.start = initialPosition();
+    }
+
+    Position pos = game.start;
+    game.moves.reserve(plies);
+    if (enc == ArchiveEncoding::Move16) {
+        if (end - p != plies * 2) return corrupt();
+        for (int i = 0; i < plies; i++, p += 2) {
+            uint16_t code = get<uint16_t>(p);
+            PosMove m;
+            m.from = code & 63;
+            m.to = code >> 6 & 63;
+            m.promo = static_cast<uint8_t>(code >> 12 & 7);
+            // Cheap sanity checks only: a full legality test would cost what
+            // this encoding saves.
+            int8_t piece = pos.board[m.from];
+            int8_t target = pos.board[m.to];
+            if (piece == 0 || (piece > 0) != pos.whiteTurn || m.promo > QUEEN ||
+                (target != 0 && (target > 0) == (piece > 0))) {
+                return corrupt();
+            }
+            pos.make(m);
+            game.moves.push_back(m);
+        }
+    } else {
+        if (end - p != plies) return corrupt();
+        MoveList list;
+        for (int i = 0; i < plies; i++, p++) {
+            pos.generateLegal(list);
+            uint8_t k = static_cast<uint8_t>(*p);
+            if (k >= list.size) return corrupt();
+            pos.make(list.moves[k]);
+            game.moves.push_back(list.moves[k]);
+        }
+    }
+    return true;
+}
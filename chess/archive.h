@@ -0,0 +1,129 @@
+// Binary game archive: a compact, indexed alternative to PGN for large game
+// collections.
+//
+// File layout (integers little-endian, as written by the host):
+//
+//   header   32 bytes: magic "CHGA", version, move encoding, block size
+//   blocks   records packed into fixed-size blocks; a record never crosses
+//            a block boundary unless it is larger than a block, in which
+//            case it starts one. The rest of a block is zero padding.
+//   index    one 64-bit file offset per game, then the number of the first
+//            game starting in each block
+//   trailer  32 bytes: magic "CHGI", game count, block count, index offset
+//
+// A record is a 32-bit length (of the rest of the record), 16-bit ply count,
+// result byte, flags byte, 16-bit length of the tag section, the tags as
+// NUL-terminated name/value pairs, the FEN (length byte and text) when the
+// game did not start from the initial position, and the moves.
+//
+// Moves are stored either as the index of the move in Position::generateLegal
+// order, one byte per ply, or as 16 bits (from, to and promotion) that decode
+// without move generation. A change to the generation order needs a new
+// format version.
+
+#ifndef CHESS_ARCHIVE_H
+#define CHESS_ARCHIVE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include "pgn.h"
+
+enum class ArchiveEncoding : uint8_t {
+    MoveIndex = 0,  // index into the legal moves: 1 byte per ply
+    Move16 = 1,     // from | to << 6 | promotion << 12: 2 bytes per ply
+};
+
+/**
+ * Writes an archive to a temporary file, renamed into place by close().
+ * Games are added in order and numbered from 0.
+ */
+class ArchiveWriter {
+   public:
+    static constexpr uint32_t kDefaultBlockSize = 1 << 16;
+
+    explicit ArchiveWriter(ArchiveEncoding encoding = ArchiveEncoding::MoveIndex,
+                           uint32_t blockSize = kDefaultBlockSize);
+    /** Removes the temporary file if close() was not reached. */
+    ~ArchiveWriter();
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+
+    /**
+     * Adds a game's tags, start position, mainline and result. Returns false
+     * and sets error for a game that cannot be stored (more than 65535 plies
+     * or tag bytes) or on an I/O failure.
+     */
+    bool add(const PgnGame& game, std::string& error);
+
+    /**
+     * Appends the record of game to out, as add() would store it, so that
+     * several threads can encode games for one writer. Returns false and
+     * sets error for a game that cannot be stored.
+     */
+    static bool encode(const PgnGame& game, ArchiveEncoding encoding, std::string& out,
+                       std::string& error);
+    /** Adds a record made by encode() with this writer's encoding. */
+    bool addRecord(std::string_view record, std::string& error);
+
+    /** Writes the index and trailer and moves the file into place. */
+    bool close(std::string& error);
+
+    ArchiveEncoding encoding() const { return enc; }
+    uint64_t games() const { return offsets.size(); }
+
+   private:
+    bool write(const char* data, size_t size, std::string& error);
+
+    ArchiveEncoding enc;
+    uint32_t blockSize;
+    std::string path;
+    std::string tmp;
+    std::ofstream out;
+    uint64_t written = 0;
+    std::vector<uint64_t> offsets;     // per game
+    std::vector<uint64_t> blockFirst;  // per block
+    std::string scratch;               // add()'s record buffer
+};
+
+/**
+ * Reads a memory-mapped archive. Any game is reached in O(1) through the
+ * offset index; read() only touches that game's record. Reading is
+ * thread-safe.
+ */
+class ArchiveReader {
+   public:
+    /** Maps and validates path. Returns false and sets error on failure. */
+    bool open(const std::string& path, std::string& error);
+
+    uint64_t size() const { return gameCount; }
+    ArchiveEncoding encoding() const { return enc; }
+    uint64_t blocks() const { return blockCount; }
+    /** The first game starting in block b, or size() if none does. */
+    uint64_t firstGameOfBlock(uint64_t b) const;
+
+    /**
+     * Decodes game `index` (0-based) into game, whose number is index + 1
+     * and offset the record's file offset. Tags and result are views into
+     * the mapping. With withMoves false only the tags and result are read.
+     * Returns false, with game.error set, for an index out of range or a
+     * corrupt record.
+     */
+    bool read(uint64_t index, PgnGame& game, bool withMoves = true) const;
+
+   private:
+    MappedFile file;
+    const char* base = nullptr;
+    size_t fileSize = 0;
+    ArchiveEncoding enc = ArchiveEncoding::MoveIndex;
+    uint64_t gameCount = 0;
+    uint64_t blockCount = 0;
+    const char* offsetTable = nullptr;  // gameCount 64-bit offsets
+    const char* blockTable = nullptr;   // blockCount 64-bit game numbers
+};
+
+#endif  // CHESS_ARCHIVE_H
@@ -0,0 +1,203 @@
+// Bulk position processing.
+
+#include "batch.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "epd.h"
+#include "position.h"
+#include "search.h"
+
+namespace {
+
+const size_t kChunkLines = 256;  // at most; fewer when the window is small
+
+// A run of input lines and, once a worker has processed them, their records.
+struct Chunk {
+    std::string text;               // the lines, each ended by '\n'
+    std::vector<uint64_t> numbers;  // the line number of each
+    std::string out;
+    uint64_t errors = 0;
+    bool done = false;
+};
+
+}  // namespace
+
+bool parseBatchOutput(std::string_view name, BatchOutput& output) {
+    static const std::pair<std::string_view, BatchOutput> kOutputs[] = {
+        {"moves", BatchOutput::Moves},   {"san", BatchOutput::San},
+        {"status", BatchOutput::Status}, {"perft", BatchOutput::Perft},
+        {"eval", BatchOutput::Eval},
+    };
+    for (const auto& [n, o] : kOutputs) {
+        if (name == n) {
+            output = o;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool processBatchLine(std::string_view line, uint64_t lineNumber, const BatchOptions& options,
+                      std::string& out) {
+    Position pos;
+    std::string_view operations;
+    std::string error;
+    if (!readEpdPosition(line, pos, operations, error)) {
+        out += "{\"line\":";
+        out += std::to_string(lineNumber);
+        out += ",\"error\":\"";
+        out += error;
+        out += "\"}\n";
+        return false;
+    }
+    MoveList list;
+    switch (options.output) {
+        case BatchOutput::Moves:
+        case BatchOutput::San:
+            pos.generateLegal(list);
+            out += "{\"moves\":[";
+            for (int k = 0; k < list.size; k++) {
+                if (k > 0) out += ',';
+                out += '"';
+                if (options.output == BatchOutput::San) {
+                    appendSan(pos, list.moves[k], out);
+                } else {
+                    out += list.moves[k].toChessMove().toString();
+                }
+                out += '"';
+            }
+            out += "]}\n";
+            break;
+        case BatchOutput::Status: {
+            pos.generateLegal(list);
+            bool check = pos.inCheck();
+            const char* status = list.size > 0 ? "ongoing" : check ? "checkmate" : "stalemate";
+            out += "{\"status\":\"";
+            out += status;
+            out += check ? "\",\"in_check\":true" : "\",\"in_check\":false";
+            out += ",\"legal_moves\":";
+            out += std::to_string(list.size);
+            out += "}\n";
+            break;
+        }
+        case BatchOutput::Perft:
+            out += "{\"depth\":";
+            out += std::to_string(options.depth);
+            out += ",\"nodes\":";
+            out += std::to_string(pos.perft(options.depth));
+            out += "}\n";
+            break;
+        case BatchOutput::Eval:
+            out += "{\"eval\":";
+            out += std::to_string(evaluate(pos));
+            out += "}\n";
+            break;
+    }
+    return true;
+}
+
+BatchStats runBatch(std::istream& in, std::ostream& out, const BatchOptions& options) {
+    int threads = options.threads > 0 ? options.threads
+                                      : static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(threads, 1);
+    // Chunks shrink with the window so that it holds one per worker: the
+    // window bounds the records in flight and still feeds every thread.
+    size_t windowLines = std::max<size_t>(options.window, 1);
+    size_t chunkLines =
+        std::min(kChunkLines, std::max<size_t>(windowLines / static_cast<size_t>(threads), 1));
+    size_t maxChunks = std::max<size_t>(windowLines / chunkLines, 1);
+
+    std::mutex mutex;
+    std::condition_variable work;      // a chunk is pending, or input has ended
+    std::condition_variable finished;  // a chunk is done
+    std::deque<std::unique_ptr<Chunk>> window;  // read and not yet written, in order
+    std::deque<Chunk*> pending;                 // not yet picked up by a worker
+    bool ended = false;
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([&] {
+            for (;;) {
+                Chunk* chunk;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    work.wait(lock, [&] { return ended || !pending.empty(); });
+                    if (pending.empty()) return;
+                    chunk = pending.front();
+                    pending.pop_front();
+                }
+                size_t begin = 0;
+                for (uint64_t number : chunk->numbers) {
+                    size_t end = chunk->text.find('\n', begin);
+                    std::string_view line(chunk->text.data() + begin, end - begin);
+                    if (!processBatchLine(line, number, options, chunk->out)) chunk->errors++;
+                    begin = end + 1;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    chunk->done = true;
+                }
+                finished.notify_all();
+            }
+        });
+    }
+
+    BatchStats stats;
+    // Writes the finished chunks at the head of the window, waiting for
+    // unfinished ones while more than keep chunks are in flight.
+    auto flush = [&](size_t keep) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!window.empty()) {
+            if (!window.front()->done) {
+                if (window.size() <= keep) break;
+                finished.wait(lock, [&] { return window.front()->done; });
+            }
+            std::unique_ptr<Chunk> chunk = std::move(window.front());
+            window.pop_front();
+            lock.unlock();
+            out.write(chunk->out.data(), static_cast<std::streamsize>(chunk->out.size()));
+            stats.records += chunk->numbers.size();
+            stats.errors += chunk->errors;
+            lock.lock();
+        }
+    };
+
+    uint64_t lineNumber = 0;
+    std::string line;
+    while (in) {
+        auto chunk = std::make_unique<Chunk>();
+        while (chunk->numbers.size() < chunkLines && std::getline(in, line)) {
+            lineNumber++;
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            chunk->text += line;
+            chunk->text += '\n';
+            chunk->numbers.push_back(lineNumber);
+        }
+        if (chunk->numbers.empty()) continue;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(chunk.get());
+            window.push_back(std::move(chunk));
+        }
+        work.notify_one();
+        flush(maxChunks - 1);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ended = true;
+    }
+    work.notify_all();
+    flush(0);
+    for (auto& t : pool) t.join();
+    out.flush();
+    return stats;
+}
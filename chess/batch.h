@@ -0,0 +1,56 @@
+// Bulk position processing: one FEN or EPD line in, one NDJSON record out,
+// with the records computed on a thread pool and written in input order.
+
+#ifndef CHESS_BATCH_H
+#define CHESS_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+enum class BatchOutput { Moves, San, Status, Perft, Eval };
+
+struct BatchOptions {
+    BatchOutput output = BatchOutput::Moves;
+    int depth = 1;         // perft depth
+    int threads = 0;       // worker threads; 0 = one per hardware thread
+    size_t window = 65536;  // records read but not yet written, at most
+};
+
+/** Parses "moves", "san", "status", "perft" or "eval". */
+bool parseBatchOutput(std::string_view name, BatchOutput& output);
+
+/**
+ * Appends the NDJSON record for one input line, newline included:
+ *
+ *   moves   {"moves":["e2e4",...]}   legal moves in coordinate notation
+ *   san     {"moves":["e4",...]}
+ *   status  {"status":"ongoing"|"checkmate"|"stalemate","in_check":false,"legal_moves":20}
+ *   perft   {"depth":3,"nodes":8902}
+ *   eval    {"eval":12}               static evaluation, side to move's view
+ *
+ * The line is a FEN, or an EPD record whose first four fields are taken as
+ * a FEN with the move counters reset. An unusable line gives
+ * {"line":N,"error":"..."} instead, with N its 1-based line number, and
+ * returns false.
+ */
+bool processBatchLine(std::string_view line, uint64_t lineNumber, const BatchOptions& options,
+                      std::string& out);
+
+struct BatchStats {
+    uint64_t records = 0;
+    uint64_t errors = 0;
+};
+
+/**
+ * Processes every non-blank line of in and writes one record per line to
+ * out, in input order. Lines are read in chunks that worker threads process
+ * while the caller's thread keeps reading and writes finished chunks in
+ * order; reading pauses while options.window records are in flight, so
+ * memory stays bounded however long the input.
+ */
+BatchStats runBatch(std::istream& in, std::ostream& out, const BatchOptions& options);
+
+#endif  // CHESS_BATCH_H
@@ -2,166 +2,1184 @@
 
 #include "bridge.h"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+
+#include "mate.h"
+#include "pgn.h"
+#include "position.h"
+#include "review.h"
+#include "search.h"
 
 using json = nlohmann::json;
 
 namespace {
 
-// Convert the engine's toJson() output to a proper nlohmann::json object.
-// The engine builds JSON manually as a string, so we parse it.
-json gameStateToJson(const ChessGame& game) {
-    return json::parse(game.toJson());
-}
+/**
+ * Streams one response object into the context's reusable buffer. Every
+ * response is serialized exactly once, in the session's encoding: game
+ * state is written directly by ChessGame::writeState, so no intermediate
+ * DOM or JSON text is built for it.
+ *
+ * A handler calls ok() or error() first, then adds fields; the dispatcher
+ * closes the object.
+ */
+class ResponseWriter {
+   public:
+    // Writes one response object with doc; a batch writes several writers'
+    // objects into one array.
+    explicit ResponseWriter(DocumentWriter& doc) : doc(doc), start(doc.mark()) {}
 
-json makeError(const std::string& msg) {
-    return {{"ok", false}, {"error", msg}};
-}
+    void ok() {
+        doc.rewind(start);
+        doc.beginObject();
+        field("ok", true);
+    }
 
-json makeOk() {
-    return {{"ok", true}};
-}
+    void error(std::string_view message) {
+        doc.rewind(start);
+        doc.beginObject();
+        field("ok", false);
+        field("error", message);
+    }
+
+    // Arrays of objects: beginArray(key), then beginObject()/fields/endObject()
+    // per element, then endArray().
+    void beginArray(std::string_view key) {
+        doc.key(key);
+        doc.beginArray();
+    }
+    void beginObject() { doc.beginObject(); }
+    void endObject() { doc.endObject(); }
+    void endArray() { doc.endArray(); }
+
+    void field(std::string_view key, std::string_view value) {
+        doc.key(key);
+        doc.string(value);
+    }
+
+    template <typename T>
+        requires std::is_integral_v<T>
+    void field(std::string_view key, T value) {
+        doc.key(key);
+        if constexpr (std::is_same_v<T, bool>) {
+            doc.boolean(value);
+        } else if constexpr (std::is_signed_v<T>) {
+            doc.number(static_cast<int64_t>(value));
+        } else {
+            doc.number(static_cast<uint64_t>(value));
+        }
+    }
+
+    void field(std::string_view key, const std::vector<std::string>& values) {
+        doc.key(key);
+        doc.beginArray();
+        for (const std::string& value : values) doc.string(value);
+        doc.endArray();
+    }
+
+    /** For the rarely used commands whose payload is built as a DOM. */
+    void fieldJson(std::string_view key, const json& value) {
+        doc.key(key);
+        switch (doc.getEncoding()) {
+            case Encoding::Json: doc.raw(value.dump()); break;
+            case Encoding::Cbor: raw(json::to_cbor(value)); break;
+            case Encoding::MsgPack: raw(json::to_msgpack(value)); break;
+        }
+    }
+
+    /** A member whose value is already encoded, e.g. a job's response. */
+    void fieldRaw(std::string_view key, std::string_view encoded) {
+        doc.key(key);
+        doc.raw(encoded);
+    }
+
+    void state(const ChessGame& game, uint32_t fields = STATE_ALL) {
+        doc.key("state");
+        doc.beginObject();
+        game.writeState(doc, stateFields & fields);
+        if (sanFields & kSanLegalMoves) {
+            Position pos;
+            Position::fromGame(game, pos);
+            field("legalMovesSan", sanOf(pos, game.getMoves(game.getTurn())));
+        }
+        if (sanFields & kSanMoveHistory) field("moveHistorySan", historySan(game));
+        doc.endObject();
+        field("state_version", game.getStateVersion());
+    }
+
+    /** A board square's content as in the state's board array: object or null. */
+    void piece(std::string_view key, const ChessPiece* p) {
+        doc.key(key);
+        if (p == nullptr) {
+            doc.null();
+            return;
+        }
+        static const char* const kNames[] = {"pawn", "rook", "knight", "bishop", "king", "queen"};
+        doc.beginObject();
+        field("type", kNames[p->getType()]);
+        field("color", p->getWhite() ? "white" : "black");
+        doc.endObject();
+    }
+
+    /** Restricts state() to these StateField members (the "fields" parameter). */
+    void setStateFields(uint32_t fields) { stateFields = fields; }
+
+    // SAN members that state() adds only on request, being computed by the
+    // bridge rather than ChessGame::writeState().
+    static constexpr uint32_t kSanLegalMoves = 1;
+    static constexpr uint32_t kSanMoveHistory = 2;
+    void setSanFields(uint32_t fields) { sanFields = fields; }
+
+    void finish() { doc.endObject(); }
+
+    Encoding getEncoding() const { return doc.getEncoding(); }
+
+   private:
+    void raw(const std::vector<uint8_t>& bytes) {
+        doc.raw(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+    }
+
+    DocumentWriter& doc;
+    DocumentWriter::Mark start;
+    uint32_t stateFields = STATE_ALL;
+    uint32_t sanFields = 0;
+};
 
-json handleNewGame(BridgeContext& ctx) {
-    ctx.game = std::make_unique<ChessGame>();
-    json resp = makeOk();
-    resp["state"] = gameStateToJson(*ctx.game);
-    return resp;
+// gameId 0 addresses the context's default game, anything else a session.
+void handleNewGame(BridgeContext& ctx, uint32_t gameId, ResponseWriter& w) {
+    if (gameId != 0) {
+        ctx.sessions.reset(gameId, "");
+    } else {
+        ctx.game = std::make_unique<ChessGame>();
+    }
+    w.ok();
+    w.state(gameId != 0 ? *ctx.sessions.get(gameId) : *ctx.game);
 }
 
-json handleFromFen(BridgeContext& ctx, const json& cmd) {
+void handleFromFen(BridgeContext& ctx, uint32_t gameId, const json& cmd, ResponseWriter& w) {
     if (!cmd.contains("fen") || !cmd["fen"].is_string()) {
-        return makeError("missing or invalid 'fen' parameter");
+        return w.error("missing or invalid 'fen' parameter");
+    }
+    const std::string& fen = cmd["fen"].get_ref<const std::string&>();
+    // A session would take "" as the initial position; here it is no FEN.
+    FenError error = FenError::FieldCount;
+    if (gameId != 0) {
+        if (fen.empty() || !ctx.sessions.reset(gameId, fen, &error)) {
+            return w.error(std::string("invalid FEN string: ") + fenErrorMessage(error));
+        }
+        w.ok();
+        w.state(*ctx.sessions.get(gameId));
+        return;
     }
-    std::string fen = cmd["fen"];
-    auto game = ChessGame::fromFen(fen);
+    auto game = ChessGame::fromFen(fen, &error);
     if (!game) {
-        return makeError("invalid FEN string");
+        return w.error(std::string("invalid FEN string: ") + fenErrorMessage(error));
     }
     ctx.game = std::move(game);
-    json resp = makeOk();
-    resp["state"] = gameStateToJson(*ctx.game);
-    return resp;
+    w.ok();
+    w.state(*ctx.game);
 }
 
-json handleMakeMove(BridgeContext& ctx, const json& cmd) {
-    if (!ctx.game) {
-        return makeError("no active game");
+// State members sent by a delta make_move: everything except the board
+// and the history, which the client patches from "changed" and move_lan.
+constexpr uint32_t kDeltaFields = STATE_ALL & ~(STATE_BOARD | STATE_MOVE_HISTORY);
+
+uint8_t squareCode(const ChessPiece* p) {
+    return p == nullptr ? 0 : static_cast<uint8_t>((p->getType() + 1) | (p->getWhite() ? 8 : 0));
+}
+
+void handleMakeMove(ChessGame* game, const json& cmd, ResponseWriter& w) {
+    if (!game) {
+        return w.error("no active game");
     }
     if (!cmd.contains("move") || !cmd["move"].is_string()) {
-        return makeError("missing or invalid 'move' parameter");
+        return w.error("missing or invalid 'move' parameter");
+    }
+    const std::string& moveStr = cmd["move"].get_ref<const std::string&>();
+    bool delta = false;
+    if (cmd.contains("delta")) {
+        if (!cmd["delta"].is_boolean()) {
+            return w.error("invalid 'delta' parameter");
+        }
+        delta = cmd["delta"];
+    }
+
+    // Square contents before the move, for the delta's changed squares.
+    uint8_t before[64] = {};
+    if (delta) {
+        for (int sq = 0; sq < 64; sq++) before[sq] = squareCode(game->getPiece(sq / 8, sq % 8));
+    }
+    uint64_t baseVersion = game->getStateVersion();
+
+    // One Position serves both the SAN parse and, once the move has been
+    // made, the move's SAN; it still holds the position before the move.
+    Position pos;
+    if (!Position::fromGame(*game, pos)) {
+        return w.error("illegal or invalid move: " + moveStr);
+    }
+    PosMove parsed;
+    ChessMove move =
+        parseSan(pos, moveStr, parsed) ? parsed.toChessMove() : ChessGame::parseLan(moveStr);
+    if (move.isEnd() || !game->makeMove(move)) {
+        return w.error("illegal or invalid move: " + moveStr);
+    }
+
+    w.ok();
+    if (delta) {
+        // Applies to a client copy at base_version; anything else means a
+        // missed update, and get_state resynchronizes.
+        w.field("base_version", baseVersion);
+        w.beginArray("changed");
+        for (int sq = 0; sq < 64; sq++) {
+            const ChessPiece* p = game->getPiece(sq / 8, sq % 8);
+            if (squareCode(p) == before[sq]) continue;
+            char name[2] = {static_cast<char>('a' + sq % 8), static_cast<char>('1' + sq / 8)};
+            w.beginObject();
+            w.field("square", std::string_view(name, 2));
+            w.piece("piece", p);
+            w.endObject();
+        }
+        w.endArray();
+        w.state(*game, kDeltaFields);
+    } else {
+        w.state(*game);
+    }
+    // Return the LAN and SAN of the move that was made
+    w.field("move_lan", move.toString());
+    w.field("move_san", sanOf(pos, PosMove::fromChessMove(move)));
+}
+
+void handleUndo(ChessGame* game, const json& cmd, ResponseWriter& w) {
+    if (!game) {
+        return w.error("no active game");
+    }
+    uint64_t count = 1;
+    if (cmd.contains("count")) {
+        if (!cmd["count"].is_number_unsigned() || cmd["count"] == 0) {
+            return w.error("invalid 'count' parameter");
+        }
+        count = cmd["count"];
+    }
+    // All or nothing: a partial takeback would leave the caller guessing.
+    if (count > game->undoableMoves()) {
+        return w.error("cannot undo " + std::to_string(count) + " moves; " +
+                       std::to_string(game->undoableMoves()) + " available");
+    }
+    for (uint64_t i = 0; i < count; i++) game->undoMove();
+    w.ok();
+    w.state(*game);
+}
+
+void handleGetState(ChessGame* game, ResponseWriter& w) {
+    if (!game) {
+        return w.error("no active game");
     }
-    std::string moveStr = cmd["move"];
+    w.ok();
+    w.state(*game);
+}
 
-    // Try SAN first, fall back to LAN (same logic as Main.cpp)
-    ChessMove move = ctx.game->parseSan(moveStr);
+void handleParseSan(ChessGame* game, const json& cmd, ResponseWriter& w) {
+    if (!game) {
+        return w.error("no active game");
+    }
+    if (!cmd.contains("san") || !cmd["san"].is_string()) {
+        return w.error("missing or invalid 'san' parameter");
+    }
+    const std::string& san = cmd["san"].get_ref<const std::string&>();
+    ChessMove move = game->parseSan(san);
     if (move.isEnd()) {
-        // Validate LAN format before constructing ChessMove.
-        // Canonical LAN: "a1b2" or with promotion "a7a8q" (no separator).
-        // Also accept hyphenated/spaced forms ("a1-b2", "a1 b2") by stripping the separator.
-        std::string lanStr = moveStr;
-        if (lanStr.size() >= 3 && (lanStr[2] == '-' || lanStr[2] == ' ')) {
-            lanStr.erase(2, 1);  // strip separator to canonical form
+        return w.error("SAN not recognized: " + san);
+    }
+    w.ok();
+    w.field("lan", move.toString());
+}
+
+void handleTbProbe(BridgeContext& ctx, ChessGame* game, ResponseWriter& w) {
+    if (!game) {
+        return w.error("no active game");
+    }
+    if (!ctx.tablebases) {
+        return w.error("tablebases not configured (start with --tb-path)");
+    }
+    TbResult result;
+    ChessMove best = ctx.tablebases->bestMove(*game, &result);
+    w.ok();
+    w.field("found", result.found);
+    if (!result.found) {
+        return;
+    }
+    w.field("wdl", result.wdl > 0 ? "win" : (result.wdl < 0 ? "loss" : "draw"));
+    w.field("dtm", result.dtm);
+    if (!best.isEnd()) {
+        w.field("bestMove", game->toSan(best));
+        w.field("bestMoveLan", best.toString());
+    }
+}
+
+void handleFindMate(ChessGame* game, const json& cmd, ResponseWriter& w,
+                    const std::atomic<bool>* stop = nullptr) {
+    if (!game) {
+        return w.error("no active game");
+    }
+    int maxMoves = 3;
+    uint64_t maxNodes = 1000000;
+    bool checksOnly = true;
+    if (cmd.contains("max_moves")) {
+        if (!cmd["max_moves"].is_number_integer() || cmd["max_moves"] < 1) {
+            return w.error("invalid 'max_moves' parameter");
         }
-        bool validLan = false;
-        if (lanStr.size() >= 4 && lanStr.size() <= 5) {
-            char f1 = lanStr[0], r1 = lanStr[1], f2 = lanStr[2], r2 = lanStr[3];
-            validLan = (f1 >= 'a' && f1 <= 'h' && r1 >= '1' && r1 <= '8' &&
-                        f2 >= 'a' && f2 <= 'h' && r2 >= '1' && r2 <= '8');
+        maxMoves = cmd["max_moves"];
+    }
+    if (cmd.contains("max_nodes")) {
+        if (!cmd["max_nodes"].is_number_integer() || cmd["max_nodes"] < 1) {
+            return w.error("invalid 'max_nodes' parameter");
         }
-        if (!validLan) {
-            return makeError("illegal or invalid move: " + moveStr);
+        maxNodes = cmd["max_nodes"];
+    }
+    if (cmd.contains("checks_only")) {
+        if (!cmd["checks_only"].is_boolean()) {
+            return w.error("invalid 'checks_only' parameter");
         }
-        move = ChessMove(lanStr.c_str());
+        checksOnly = cmd["checks_only"];
+    }
+
+    Position pos;
+    Position::fromGame(*game, pos);
+    MateResult result = findMate(pos, maxMoves, maxNodes, checksOnly, stop);
+    w.ok();
+    w.field("found", result.found);
+    w.field("nodes", result.nodes);
+    if (!result.found) {
+        // Distinguishes "no mate within max_moves" from "ran out of nodes".
+        w.field("disproven", result.disproven);
+        return;
     }
+    w.field("mate_in", result.moves);
+    w.field("line", sanLine(*game, result.line));
+    std::vector<std::string> lan;
+    for (const PosMove& m : result.line) lan.push_back(m.toChessMove().toString());
+    w.field("line_lan", lan);
+}
 
-    if (!ctx.game->makeMove(move)) {
-        return makeError("illegal or invalid move: " + moveStr);
+// Node budget for analyze when the request sets no limit of its own.
+constexpr uint64_t kDefaultAnalyzeNodes = 200000;
+
+void handleAnalyze(ChessGame* game, const json& cmd, ResponseWriter& w,
+                   const std::atomic<bool>* stop = nullptr, const Ponderer* ponderer = nullptr) {
+    if (!game) {
+        return w.error("no active game");
+    }
+    bool limited = false;
+    for (const char* key : {"depth", "nodes", "movetime_ms"}) {
+        if (!cmd.contains(key)) continue;
+        if (!cmd[key].is_number_integer() || cmd[key] < 1) {
+            return w.error(std::string("invalid '") + key + "' parameter");
+        }
+        limited = true;
     }
+    SearchLimits limits;
+    limits.depth = std::min(cmd.value("depth", limits.depth), MAX_PLY - 1);
+    limits.nodes = cmd.value("nodes", limited ? uint64_t(0) : kDefaultAnalyzeNodes);
+    limits.movetimeMs = cmd.value("movetime_ms", 0);
+    limits.stop = stop;
 
-    json resp = makeOk();
-    resp["state"] = gameStateToJson(*ctx.game);
-    // Return the LAN of the move that was made
-    resp["move_lan"] = std::string(move.toString());
-    return resp;
+    Position pos;
+    Position::fromGame(*game, pos);
+    SearchResult result;
+    bool pondered = ponderer != nullptr && ponderer->lookup(pos, limits, result);
+    if (!pondered) {
+        result = search(pos, limits);
+    }
+    if (!result.hasMove) {
+        return w.error("no legal moves");
+    }
+    w.ok();
+    if (pondered) {
+        w.field("pondered", true);
+    }
+    w.field("best", game->toSan(result.best.toChessMove()));
+    w.field("best_lan", result.best.toChessMove().toString());
+    // From the side to move's point of view, as UCI engines report it.
+    w.fieldJson("score", isMateScore(result.score) ? json{{"mate", mateInMoves(result.score)}}
+                                                   : json{{"cp", result.score}});
+    w.field("depth", result.depth);
+    w.field("nodes", result.nodes);
+    w.field("pv", sanLine(*game, result.pv));
+    std::vector<std::string> lan;
+    for (const PosMove& m : result.pv) lan.push_back(m.toChessMove().toString());
+    w.field("pv_lan", lan);
 }
 
-json handleGetState(BridgeContext& ctx) {
-    if (!ctx.game) {
-        return makeError("no active game");
+constexpr int kMaxPerftDepth = 10;
+
+void handlePerft(ChessGame* game, const json& cmd, ResponseWriter& w,
+                 const std::atomic<bool>* stop = nullptr) {
+    if (!game) {
+        return w.error("no active game");
+    }
+    if (!cmd.contains("depth") || !cmd["depth"].is_number_integer() || cmd["depth"] < 0 ||
+        cmd["depth"] > kMaxPerftDepth) {
+        return w.error("missing or invalid 'depth' parameter");
     }
-    json resp = makeOk();
-    resp["state"] = gameStateToJson(*ctx.game);
-    return resp;
+    int depth = cmd["depth"];
+    Position pos;
+    Position::fromGame(*game, pos);
+    uint64_t nodes = pos.perft(depth, stop);
+    w.ok();
+    w.field("depth", depth);
+    w.field("nodes", nodes);
 }
 
-json handleParseSan(BridgeContext& ctx, const json& cmd) {
-    if (!ctx.game) {
-        return makeError("no active game");
+void handleReviewGame(const json& cmd, ResponseWriter& w, const std::atomic<bool>* stop = nullptr) {
+    if (!cmd.contains("moves") || !cmd["moves"].is_array()) {
+        return w.error("missing or invalid 'moves' parameter");
     }
-    if (!cmd.contains("san") || !cmd["san"].is_string()) {
-        return makeError("missing or invalid 'san' parameter");
+    std::vector<std::string> moves;
+    for (const auto& m : cmd["moves"]) {
+        if (!m.is_string()) {
+            return w.error("missing or invalid 'moves' parameter");
+        }
+        moves.push_back(m);
     }
-    std::string san = cmd["san"];
-    ChessMove move = ctx.game->parseSan(san);
-    if (move.isEnd()) {
-        return makeError("SAN not recognized: " + san);
+    std::string fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    if (cmd.contains("fen")) {
+        if (!cmd["fen"].is_string()) {
+            return w.error("missing or invalid 'fen' parameter");
+        }
+        fen = cmd["fen"];
+    }
+    ReviewOptions options;
+    for (const char* key : {"nodes", "movetime_ms", "threads"}) {
+        if (cmd.contains(key) && (!cmd[key].is_number_integer() || cmd[key] < 0)) {
+            return w.error(std::string("invalid '") + key + "' parameter");
+        }
+    }
+    options.nodes = cmd.value("nodes", options.nodes);
+    options.movetimeMs = cmd.value("movetime_ms", options.movetimeMs);
+    options.threads = cmd.value("threads", options.threads);
+    options.stop = stop;
+    std::string format = "json";
+    if (cmd.contains("format")) {
+        format = cmd["format"].is_string() ? cmd["format"].get<std::string>() : "";
+    }
+    if (format != "json" && format != "pgn") {
+        return w.error("invalid 'format' parameter (expected \"json\" or \"pgn\")");
+    }
+
+    GameReview review;
+    std::string error;
+    if (!reviewGame(fen, moves, options, review, error)) {
+        return w.error(error);
+    }
+    w.ok();
+    if (format == "pgn") {
+        w.field("pgn", reviewToPgn(review));
+    } else {
+        w.fieldJson("review", reviewToJson(review));
     }
-    json resp = makeOk();
-    resp["lan"] = std::string(move.toString());
-    return resp;
 }
 
-}  // namespace
+void handleExportPgn(BridgeContext& ctx, const ChessGame* game, const json& cmd,
+                     ResponseWriter& w) {
+    if (!game) {
+        return w.error("no active game");
+    }
+    PgnWriteOptions options;
+    if (cmd.contains("tags")) {
+        const json& tags = cmd["tags"];
+        if (!tags.is_object()) {
+            return w.error("invalid 'tags' parameter");
+        }
+        for (auto it = tags.begin(); it != tags.end(); ++it) {
+            const std::string& name = it.key();
+            bool symbol = !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+                return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+            });
+            if (!symbol || !it->is_string()) {
+                return w.error("invalid tag: " + name);
+            }
+            options.tags.push_back({name, it->get_ref<const std::string&>()});
+        }
+    }
+    if (cmd.contains("clocks")) {
+        if (!cmd["clocks"].is_array()) {
+            return w.error("invalid 'clocks' parameter");
+        }
+        for (const json& c : cmd["clocks"]) {
+            if (!c.is_null() && (!c.is_number_integer() || c < 0)) {
+                return w.error("invalid 'clocks' parameter");
+            }
+            options.clocksMs.push_back(c.is_null() ? -1 : c.get<int64_t>());
+        }
+    }
+    if (cmd.contains("evals")) {
+        if (!cmd["evals"].is_array()) {
+            return w.error("invalid 'evals' parameter");
+        }
+        // Centipawns, or {"cp":N} / {"mate":N} as analyze reports them, but
+        // from White's point of view.
+        for (const json& e : cmd["evals"]) {
+            int score = PGN_NO_EVAL;
+            if (e.is_number_integer() && std::abs(e.get<int64_t>()) < MATE_SCORE - 1000) {
+                score = e;
+            } else if (e.is_object() && e.size() == 1 && e.contains("cp") &&
+                       e["cp"].is_number_integer() &&
+                       std::abs(e["cp"].get<int64_t>()) < MATE_SCORE - 1000) {
+                score = e["cp"];
+            } else if (e.is_object() && e.size() == 1 && e.contains("mate") &&
+                       e["mate"].is_number_integer() && e["mate"] != 0 &&
+                       std::abs(e["mate"].get<int64_t>()) < 500) {
+                score = mateScoreIn(e["mate"]);
+            } else if (!e.is_null()) {
+                return w.error("invalid 'evals' parameter");
+            }
+            options.evals.push_back(score);
+        }
+    }
+    std::string result;
+    if (cmd.contains("result")) {
+        result = cmd["result"].is_string() ? cmd["result"].get<std::string>() : "";
+        if (result != "1-0" && result != "0-1" && result != "1/2-1/2" && result != "*") {
+            return w.error("invalid 'result' parameter");
+        }
+        options.result = result;
+    }
 
-std::string handleBridgeCommand(const std::string& input, BridgeContext& ctx, bool& should_quit) {
-    should_quit = false;
+    ctx.pgn.clear();
+    writePgn(*game, options, ctx.pgn);
+    w.ok();
+    w.field("pgn", ctx.pgn);
+}
 
-    json cmd;
-    try {
-        cmd = json::parse(input);
-    } catch (const json::parse_error& e) {
-        return makeError(std::string("invalid JSON: ") + e.what()).dump();
+// Reads the position of a database query: the optional "fen", else the
+// game's current position. Returns false, having written the error, if
+// there is neither.
+bool parseQueryPosition(const ChessGame* game, const json& cmd, Position& pos, ResponseWriter& w) {
+    if (cmd.contains("fen")) {
+        if (!cmd["fen"].is_string()) {
+            w.error("missing or invalid 'fen' parameter");
+            return false;
+        }
+        FenError error = parseFen(cmd["fen"].get_ref<const std::string&>(), pos);
+        if (error != FenError::None) {
+            w.error(std::string("invalid FEN string: ") + fenErrorMessage(error));
+            return false;
+        }
+        return true;
     }
+    if (!game || !Position::fromGame(*game, pos)) {
+        w.error("no active game");
+        return false;
+    }
+    return true;
+}
+
+// find_games: the indexed games that reached a position, a page at a time.
+void handleFindGames(BridgeContext& ctx, const ChessGame* game, const json& cmd,
+                     ResponseWriter& w) {
+    if (!ctx.positionIndex) {
+        return w.error("position index not configured (start with --position-index)");
+    }
+    Position pos;
+    if (!parseQueryPosition(game, cmd, pos, w)) {
+        return;
+    }
+    for (const char* key : {"limit", "offset"}) {
+        if (cmd.contains(key) && !cmd[key].is_number_unsigned()) {
+            return w.error(std::string("invalid '") + key + "' parameter");
+        }
+    }
+    uint64_t limit = cmd.value("limit", uint64_t{100});
+    uint64_t offset = cmd.value("offset", uint64_t{0});
+
+    std::span<const PositionIndex::Posting> found = ctx.positionIndex->find(pos.key);
+    w.ok();
+    w.field("total", static_cast<uint64_t>(found.size()));
+    w.beginArray("games");
+    for (uint64_t i = offset; i < found.size() && i - offset < limit; i++) {
+        w.beginObject();
+        w.field("game", found[i].game);
+        w.field("ply", found[i].ply);
+        w.endObject();
+    }
+    w.endArray();
+}
+
+// explorer: the moves played from a position in the explorer's games, most
+// played first, with how those games ended.
+void handleExplorer(BridgeContext& ctx, const ChessGame* game, const json& cmd,
+                    ResponseWriter& w) {
+    if (!ctx.explorer) {
+        return w.error("explorer not configured (start with --explorer)");
+    }
+    Position pos;
+    if (!parseQueryPosition(game, cmd, pos, w)) {
+        return;
+    }
+    std::span<const OpeningExplorer::Entry> found = ctx.explorer->find(pos.key);
+    // Only moves legal here: anything else would be a hash collision.
+    MoveList legal;
+    pos.generateLegal(legal);
+    std::vector<const OpeningExplorer::Entry*> moves;
+    uint64_t total = 0;
+    for (const OpeningExplorer::Entry& e : found) {
+        PosMove m = e.toMove();
+        if (std::find(legal.moves, legal.moves + legal.size, m) == legal.moves + legal.size) {
+            continue;
+        }
+        moves.push_back(&e);
+        total += e.games();
+    }
+    std::stable_sort(moves.begin(), moves.end(), [](const auto* a, const auto* b) {
+        return a->games() > b->games();
+    });
+
+    w.ok();
+    w.field("games", total);
+    w.beginArray("moves");
+    for (const OpeningExplorer::Entry* e : moves) {
+        PosMove m = e->toMove();
+        w.beginObject();
+        w.field("san", sanOf(pos, m));
+        w.field("lan", m.toChessMove().toString());
+        w.field("games", e->games());
+        w.field("white", e->white);
+        w.field("draws", e->draws);
+        w.field("black", e->black);
+        w.endObject();
+    }
+    w.endArray();
+}
+
+void handleStats(BridgeContext& ctx, const json& cmd, ResponseWriter& w) {
+    if (cmd.contains("reset") && !cmd["reset"].is_boolean()) {
+        return w.error("invalid 'reset' parameter");
+    }
+    w.ok();
+    w.fieldJson("stats", ctx.stats.toJson());
+    if (cmd.value("reset", false)) {
+        ctx.stats.reset();
+    }
+}
+
+void handleCreate(BridgeContext& ctx, const json& cmd, ResponseWriter& w) {
+    std::string fen;
+    if (cmd.contains("fen")) {
+        if (!cmd["fen"].is_string() || cmd["fen"].get_ref<const std::string&>().empty()) {
+            return w.error("missing or invalid 'fen' parameter");
+        }
+        fen = cmd["fen"];
+    }
+    FenError error;
+    uint32_t id = ctx.sessions.create(fen, &error);
+    if (id == 0) {
+        return w.error(std::string("invalid FEN string: ") + fenErrorMessage(error));
+    }
+    w.ok();
+    w.field("game_id", id);
+    w.state(*ctx.sessions.get(id));
+}
+
+void handleList(BridgeContext& ctx, ResponseWriter& w) {
+    w.ok();
+    w.field("count", ctx.sessions.size());
+    w.beginArray("games");
+    for (const auto& game : ctx.sessions.list()) {
+        w.beginObject();
+        w.field("game_id", game.id);
+        w.field("plies", game.plies);
+        w.field("turn", game.whiteToMove ? "white" : "black");
+        w.endObject();
+    }
+    w.endArray();
+}
+
+// Reads the optional "game_id" of cmd; 0 selects the default game. Returns
+// false, having written the error, for an invalid or unknown ID.
+bool parseGameId(const json& cmd, BridgeContext& ctx, uint32_t& gameId, ResponseWriter& w) {
+    gameId = 0;
+    if (!cmd.contains("game_id")) {
+        return true;
+    }
+    const json& id = cmd["game_id"];
+    if (!id.is_number_unsigned() || id == 0 || id > UINT32_MAX) {
+        w.error("invalid 'game_id' parameter");
+        return false;
+    }
+    gameId = id;
+    if (!ctx.sessions.contains(gameId)) {
+        w.error("unknown game_id: " + std::to_string(gameId));
+        return false;
+    }
+    return true;
+}
+
+// Commands that start_job accepts: the ones that can run for a long time.
+bool isJobCommand(const std::string& command) {
+    return command == "find_mate" || command == "analyze" || command == "perft" ||
+           command == "review_game";
+}
+
+// Runs a job's command on a worker thread, against the job's own game.
+void runJobCommand(const std::string& command, const json& cmd, ChessGame* game,
+                   const std::atomic<bool>* stop, ResponseWriter& w) {
+    if (command == "find_mate") {
+        handleFindMate(game, cmd, w, stop);
+    } else if (command == "analyze") {
+        handleAnalyze(game, cmd, w, stop);
+    } else if (command == "perft") {
+        handlePerft(game, cmd, w, stop);
+    } else {
+        handleReviewGame(cmd, w, stop);
+    }
+}
+
+// An independent copy of a game, made by replaying its moves, so a job is
+// not disturbed by moves played while it runs.
+std::shared_ptr<ChessGame> copyGame(const ChessGame& game) {
+    std::shared_ptr<ChessGame> copy = ChessGame::fromFen(game.getStartFen());
+    const std::vector<ChessMove>& history = game.getHistory();
+    for (size_t i = copy->getHistory().size(); i < history.size(); i++) {
+        copy->makeMove(history[i]);
+    }
+    return copy;
+}
+
+void handleStartJob(BridgeContext& ctx, const json& cmd, ResponseWriter& w) {
+    if (!cmd.contains("job") || !cmd["job"].is_object() || !cmd["job"].contains("command") ||
+        !cmd["job"]["command"].is_string()) {
+        return w.error("missing or invalid 'job' parameter");
+    }
+    const json& job = cmd["job"];
+    std::string command = job["command"];
+    if (!isJobCommand(command)) {
+        return w.error("command cannot run as a job: " + command);
+    }
+    if (cmd.contains("notify") && !cmd["notify"].is_boolean()) {
+        return w.error("invalid 'notify' parameter");
+    }
+    bool notify = cmd.value("notify", false);
+
+    std::shared_ptr<ChessGame> game;
+    if (command != "review_game") {
+        uint32_t gameId;
+        if (!parseGameId(job, ctx, gameId, w)) {
+            return;
+        }
+        ChessGame* current = gameId != 0 ? ctx.sessions.get(gameId) : ctx.game.get();
+        if (!current) {
+            return w.error("no active game");
+        }
+        game = copyGame(*current);
+    }
+    uint32_t id = ctx.jobs.start(
+        [job, command, game, format = w.getEncoding()](const std::atomic<bool>& cancelled) {
+            std::string out;
+            DocumentWriter doc(out, format);
+            ResponseWriter jw(doc);
+            runJobCommand(command, job, game.get(), &cancelled, jw);
+            jw.finish();
+            return out;
+        },
+        ctx.client, notify);
+    w.ok();
+    w.field("job_id", id);
+}
+
+bool parseJobId(const json& cmd, uint32_t& id, ResponseWriter& w) {
+    if (!cmd.contains("job_id") || !cmd["job_id"].is_number_unsigned() ||
+        cmd["job_id"] > UINT32_MAX) {
+        w.error("missing or invalid 'job_id' parameter");
+        return false;
+    }
+    id = cmd["job_id"];
+    return true;
+}
+
+void handlePollJob(BridgeContext& ctx, const json& cmd, ResponseWriter& w) {
+    uint32_t id;
+    if (!parseJobId(cmd, id, w)) {
+        return;
+    }
+    JobStatus status;
+    std::string result;
+    if (!ctx.jobs.poll(id, status, result)) {
+        return w.error("unknown job_id: " + std::to_string(id));
+    }
+    w.ok();
+    w.field("job_id", id);
+    w.field("status", jobStatusName(status));
+    if (status == JobStatus::Done) {
+        w.fieldRaw("result", result);
+    }
+}
+
+void handleCancelJob(BridgeContext& ctx, const json& cmd, ResponseWriter& w) {
+    uint32_t id;
+    if (!parseJobId(cmd, id, w)) {
+        return;
+    }
+    if (!ctx.jobs.cancel(id)) {
+        return w.error("unknown or finished job: " + std::to_string(id));
+    }
+    w.ok();
+    w.field("job_id", id);
+}
+
+// Every command dispatchCommand() runs.
+bool isBridgeCommand(const std::string& command) {
+    static const std::unordered_set<std::string> kCommands = {
+        "new_game", "from_fen", "make_move", "undo", "get_state", "parse_san", "tb_probe",
+        "find_mate", "analyze", "perft", "create", "destroy", "list", "review_game",
+        "export_pgn", "find_games", "explorer", "start_job", "poll_job", "cancel_job", "stats",
+        "quit"};
+    return kCommands.count(command) != 0;
+}
+
+// Runs one parsed command. `command` receives the command name for the
+// latency statistics: "invalid" when there is none and "unknown" for a name
+// that is not a command, so client input cannot add statistics entries.
+void dispatchCommand(const json& cmd, BridgeContext& ctx, bool& should_quit,
+                     std::string& command, ResponseWriter& w) {
+    command = "invalid";
+    if (!cmd.is_object() || !cmd.contains("command") || !cmd["command"].is_string()) {
+        return w.error("missing or invalid 'command' field");
+    }
+    const std::string& name = cmd["command"].get_ref<const std::string&>();
+    if (!isBridgeCommand(name)) {
+        command = "unknown";
+        return w.error("unknown command: " + name);
+    }
+    command = name;
 
-    if (!cmd.contains("command") || !cmd["command"].is_string()) {
-        return makeError("missing or invalid 'command' field").dump();
+    // Optional session selector; without it commands use ctx.game.
+    uint32_t gameId;
+    if (!parseGameId(cmd, ctx, gameId, w)) {
+        return;
     }
+    auto target = [&]() { return gameId != 0 ? ctx.sessions.get(gameId) : ctx.game.get(); };
 
-    std::string command = cmd["command"];
+    // Optional subset of the state members, e.g. ["fen","isCheckmate"].
+    if (cmd.contains("fields")) {
+        const json& fields = cmd["fields"];
+        if (!fields.is_array()) {
+            return w.error("invalid 'fields' parameter");
+        }
+        uint32_t mask = 0, san = 0;
+        for (const json& name : fields) {
+            if (name == "legalMovesSan") {
+                san |= ResponseWriter::kSanLegalMoves;
+                continue;
+            }
+            if (name == "moveHistorySan") {
+                san |= ResponseWriter::kSanMoveHistory;
+                continue;
+            }
+            uint32_t field = name.is_string() ? ChessGame::stateField(name) : 0;
+            if (field == 0) {
+                return w.error("unknown state field: " + name.dump());
+            }
+            mask |= field;
+        }
+        w.setStateFields(mask);
+        w.setSanFields(san);
+    }
 
-    json resp;
     if (command == "new_game") {
-        resp = handleNewGame(ctx);
+        handleNewGame(ctx, gameId, w);
     } else if (command == "from_fen") {
-        resp = handleFromFen(ctx, cmd);
+        handleFromFen(ctx, gameId, cmd, w);
     } else if (command == "make_move") {
-        resp = handleMakeMove(ctx, cmd);
+        handleMakeMove(target(), cmd, w);
+        if (gameId != 0) ctx.sessions.sync(gameId);
+    } else if (command == "undo") {
+        handleUndo(target(), cmd, w);
+        if (gameId != 0) ctx.sessions.sync(gameId);
     } else if (command == "get_state") {
-        resp = handleGetState(ctx);
+        handleGetState(target(), w);
     } else if (command == "parse_san") {
-        resp = handleParseSan(ctx, cmd);
+        handleParseSan(target(), cmd, w);
+    } else if (command == "tb_probe") {
+        handleTbProbe(ctx, target(), w);
+    } else if (command == "find_mate") {
+        handleFindMate(target(), cmd, w);
+    } else if (command == "analyze") {
+        handleAnalyze(target(), cmd, w, nullptr, ctx.ponderer.get());
+    } else if (command == "perft") {
+        handlePerft(target(), cmd, w);
+    } else if (command == "create") {
+        handleCreate(ctx, cmd, w);
+    } else if (command == "destroy") {
+        if (gameId == 0) {
+            return w.error("missing or invalid 'game_id' parameter");
+        }
+        ctx.sessions.destroy(gameId);
+        w.ok();
+    } else if (command == "list") {
+        handleList(ctx, w);
+    } else if (command == "review_game") {
+        handleReviewGame(cmd, w);
+    } else if (command == "export_pgn") {
+        handleExportPgn(ctx, target(), cmd, w);
+    } else if (command == "find_games") {
+        handleFindGames(ctx, target(), cmd, w);
+    } else if (command == "explorer") {
+        handleExplorer(ctx, target(), cmd, w);
+    } else if (command == "start_job") {
+        handleStartJob(ctx, cmd, w);
+    } else if (command == "poll_job") {
+        handlePollJob(ctx, cmd, w);
+    } else if (command == "cancel_job") {
+        handleCancelJob(ctx, cmd, w);
+    } else if (command == "stats") {
+        handleStats(ctx, cmd, w);
     } else if (command == "quit") {
         should_quit = true;
-        resp = makeOk();
+        w.ok();
+    } else {
+        w.error("unknown command: " + command);
+        command = "unknown";
+    }
+}
+
+// Runs one command, writing its response object with doc, and records it
+// in the statistics.
+void runOne(const json& cmd, BridgeContext& ctx, DocumentWriter& doc, bool& should_quit) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t movesBefore = ChessGame::legalMovesGenerated();
+
+    std::string command;
+    ResponseWriter w(doc);
+    dispatchCommand(cmd, ctx, should_quit, command, w);
+    w.finish();
+
+    BridgeStats& stats = ctx.stats;
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    stats.latency[command].record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    stats.legalMovesGenerated += ChessGame::legalMovesGenerated() - movesBefore;
+}
+
+// Runs a parsed request, a single command or a batch, into ctx.response.
+void runRequest(const json& cmd, BridgeContext& ctx, DocumentWriter& doc, bool& should_quit) {
+    if (cmd.is_array()) {
+        // A batch: run in order, answer with one array of responses.
+        // Commands after a quit are not run.
+        doc.beginArray();
+        for (const json& element : cmd) {
+            runOne(element, ctx, doc, should_quit);
+            if (should_quit) break;
+        }
+        doc.endArray();
+    } else {
+        runOne(cmd, ctx, doc, should_quit);
+    }
+}
+
+// Answers input that could not be decoded at all.
+void rejectInput(const std::string& message, BridgeContext& ctx, DocumentWriter& doc,
+                 std::chrono::steady_clock::time_point start) {
+    ResponseWriter w(doc);
+    w.error(message);
+    w.finish();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ctx.stats.latency["invalid"].record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+}  // namespace
+
+const std::string& handleBridgeCommand(const std::string& input, BridgeContext& ctx,
+                                       bool& should_quit) {
+    should_quit = false;
+    ctx.response.clear();
+    auto start = std::chrono::steady_clock::now();
+
+    DocumentWriter doc(ctx.response, Encoding::Json);
+    json cmd;
+    bool parsed = true;
+    try {
+        cmd = json::parse(input);
+    } catch (const json::parse_error& e) {
+        rejectInput(std::string("invalid JSON: ") + e.what(), ctx, doc, start);
+        parsed = false;
+    }
+    if (parsed) runRequest(cmd, ctx, doc, should_quit);
+    ctx.stats.bytesWritten += ctx.response.size() + 1;  // plus the newline the loop writes
+    return ctx.response;
+}
+
+bool parseBridgeFormat(std::string_view name, BridgeFormat& format) {
+    if (name == "json") {
+        format = BridgeFormat::Json;
+    } else if (name == "cbor") {
+        format = BridgeFormat::Cbor;
+    } else if (name == "msgpack") {
+        format = BridgeFormat::MsgPack;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const std::string& handleBridgeMessage(const std::vector<uint8_t>& message, BridgeContext& ctx,
+                                       bool& should_quit) {
+    should_quit = false;
+    ctx.response.clear();
+    auto start = std::chrono::steady_clock::now();
+
+    DocumentWriter doc(ctx.response, ctx.format);
+    bool cbor = ctx.format == BridgeFormat::Cbor;
+    json cmd = cbor ? json::from_cbor(message, true, false)
+                    : json::from_msgpack(message, true, false);
+    if (cmd.is_discarded()) {
+        rejectInput(cbor ? "invalid CBOR message" : "invalid MessagePack message", ctx, doc, start);
     } else {
-        resp = makeError("unknown command: " + command);
+        runRequest(cmd, ctx, doc, should_quit);
     }
 
-    return resp.dump();
+    ctx.stats.bytesWritten += ctx.response.size() + 4;  // plus the length prefix
+    return ctx.response;
+}
+
+void appendJobEvent(const JobQueue::Finished& job, BridgeFormat format, std::string& out) {
+    // A binary frame's length prefix is filled in once the event is written.
+    size_t header = out.size();
+    if (format != BridgeFormat::Json) out.append(4, '\0');
+    DocumentWriter doc(out, format);
+    doc.beginObject();
+    doc.key("event");
+    doc.string("job_finished");
+    doc.key("job_id");
+    doc.number(static_cast<uint64_t>(job.id));
+    doc.key("status");
+    doc.string(jobStatusName(job.status));
+    if (job.status == JobStatus::Done) {
+        doc.key("result");
+        doc.raw(job.result);  // written by the job in this format
+    }
+    doc.endObject();
+    if (format == BridgeFormat::Json) {
+        out += '\n';
+        return;
+    }
+    uint32_t n = static_cast<uint32_t>(out.size() - header - 4);
+    for (int i = 0; i < 4; i++) out[header + i] = static_cast<char>(n >> (24 - 8 * i));
 }
 
 void runBridgeLoop() {
     BridgeContext ctx;
+    runBridgeLoop(ctx);
+}
+
+namespace {
+
+// Frames larger than this are treated as a corrupt stream.
+constexpr uint32_t kMaxFrameBytes = 64 << 20;
+
+// Reads one length-prefixed message: a 4-byte big-endian size, then the
+// payload. Returns false at end of input or on a truncated or oversized frame.
+bool readFrame(std::istream& in, std::vector<uint8_t>& message) {
+    unsigned char header[4];
+    if (!in.read(reinterpret_cast<char*>(header), 4)) return false;
+    uint32_t size = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) |
+                    (uint32_t(header[2]) << 8) | uint32_t(header[3]);
+    if (size > kMaxFrameBytes) return false;
+    message.resize(size);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(message.data()), size));
+}
+
+void writeFrame(std::ostream& out, const std::string& message) {
+    uint32_t size = static_cast<uint32_t>(message.size());
+    char header[4] = {static_cast<char>(size >> 24), static_cast<char>(size >> 16),
+                      static_cast<char>(size >> 8), static_cast<char>(size)};
+    out.write(header, 4);
+    out.write(message.data(), static_cast<std::streamsize>(message.size()));
+}
+
+}  // namespace
+
+void runBridgeLoop(BridgeContext& ctx) {
     std::string line;
+    std::vector<uint8_t> message;
+    auto lastDump = std::chrono::steady_clock::now();
+
+    // Responses are flushed only once no further input is already buffered,
+    // so a client that pipelines many requests pays for one flush, not one each.
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    // Job events are written by whichever thread gets the output first. A
+    // job finishing while a command runs leaves its event to the command
+    // loop, so the event never precedes the response that started the job.
+    std::mutex outputMutex;
+    std::atomic<bool> eventsPending{false};
+    auto writeEvents = [&] {  // with outputMutex held
+        eventsPending = false;
+        std::string events;
+        for (const JobQueue::Finished& job : ctx.jobs.takeNotifications()) {
+            appendJobEvent(job, ctx.format, events);
+        }
+        std::cout << events;
+        return !events.empty();
+    };
+    // cancel_job runs the callback on this thread, inside a command, with
+    // outputMutex already held; the loop below writes those events.
+    const std::thread::id commandThread = std::this_thread::get_id();
+    ctx.jobs.setWakeup([&] {
+        eventsPending = true;
+        if (std::this_thread::get_id() == commandThread) return;
+        std::unique_lock<std::mutex> lock(outputMutex, std::try_to_lock);
+        if (lock.owns_lock() && writeEvents()) std::cout.flush();
+    });
 
-    while (std::getline(std::cin, line)) {
+    bool text = ctx.format == BridgeFormat::Json;
+    while (text ? static_cast<bool>(std::getline(std::cin, line)) : readFrame(std::cin, message)) {
+        if (ctx.ponderer) ctx.ponderer->stop();
         bool quit = false;
-        std::string response = handleBridgeCommand(line, ctx, quit);
-        std::cout << response << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            if (text) {
+                const std::string& response = handleBridgeCommand(line, ctx, quit);
+                std::cout << response << '\n';
+            } else {
+                writeFrame(std::cout, handleBridgeMessage(message, ctx, quit));
+            }
+            writeEvents();
+            if (quit || std::cin.rdbuf()->in_avail() <= 0) std::cout.flush();
+        }
+        // An event that arrived while the lock was held is written here.
+        while (eventsPending) {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            if (writeEvents()) std::cout.flush();
+        }
+        // About to block on input: think about the opponent's replies meanwhile.
+        Position pos;
+        if (ctx.ponderer && !quit && ctx.game && std::cin.rdbuf()->in_avail() <= 0 &&
+            Position::fromGame(*ctx.game, pos)) {
+            ctx.ponderer->start(pos);
+        }
+        // The dump is checked between commands, so an idle bridge stays quiet.
+        if (ctx.statsInterval.count() > 0 &&
+            std::chrono::steady_clock::now() - lastDump >= ctx.statsInterval) {
+            std::cerr << ctx.stats.toJson().dump() << std::endl;
+            lastDump = std::chrono::steady_clock::now();
+        }
         if (quit) {
             break;
         }
     }
+    if (ctx.ponderer) ctx.ponderer->stop();
+    ctx.jobs.setWakeup(nullptr);
 }
@@ -4,37 +4,122 @@
 #ifndef CHESS_BRIDGE_H
 #define CHESS_BRIDGE_H
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "chess.h"
+#include "encoding.h"
+#include "explorer.h"
+#include "jobs.h"
+#include "ponder.h"
+#include "posindex.h"
+#include "sessions.h"
+#include "stats.h"
+#include "tablebase.h"
 #include <nlohmann/json.hpp>
 
 /**
- * Holds the bridge session state (the current game).
+ * Wire encoding of bridge requests and responses: one JSON text document
+ * per line, or a 4-byte big-endian length, then a CBOR or MessagePack
+ * document.
+ */
+using BridgeFormat = Encoding;
+
+/** Parses "json", "cbor" or "msgpack". Returns false for anything else. */
+bool parseBridgeFormat(std::string_view name, BridgeFormat& format);
+
+/**
+ * Holds the bridge session state: the default game used by commands without
+ * a game_id, plus any games created with the "create" command.
  * handleBridgeCommand() operates on this context.
  */
 struct BridgeContext {
     std::unique_ptr<ChessGame> game;
+    GameSessions sessions;
+    std::shared_ptr<const Tablebases> tablebases;  // optional; enables tb_probe
+    std::shared_ptr<const PositionIndex> positionIndex;  // optional; enables find_games
+    std::shared_ptr<const OpeningExplorer> explorer;     // optional; enables explorer
+    BridgeStats stats;  // per-command latency and counters; see the stats command
+    std::chrono::seconds statsInterval{0};  // periodic stats dump to stderr; 0 = off
+    BridgeFormat format = BridgeFormat::Json;  // encoding used by runBridgeLoop()
+    std::string response;  // output buffer in ctx.format, reused across commands
+    std::string pgn;       // export_pgn buffer, reused across commands
+    JobQueue jobs;        // background commands started with start_job
+    uint64_t client = 0;  // owner tag for jobs started by the current command
+    std::unique_ptr<Ponderer> ponderer;  // set to ponder while runBridgeLoop() waits
 };
 
 /**
- * Process a single JSON bridge command and return a JSON response.
+ * Process one line of JSON bridge input and return the JSON response.
  *
  * Protocol:
  *   Input:  {"command":"X", ...params}
  *   Output: {"ok":true, ...data} or {"ok":false, "error":"..."}
  *
- * Commands: new_game, from_fen, make_move, get_state, parse_san, quit.
+ * A line may also hold an array of commands, run in order; the response is
+ * an array with one result per command. A failing command does not stop
+ * the batch, but commands after "quit" are not run.
+ *
+ * Commands: new_game, from_fen, make_move, undo, get_state, parse_san,
+ *           tb_probe, find_mate, analyze, perft, review_game, export_pgn,
+ *           find_games, explorer, start_job, poll_job, cancel_job, stats,
+ *           create, destroy, list, quit.
+ *
+ * Game commands take an optional "game_id" (returned by "create") to act on
+ * one of many hosted games instead of the default game. Commands returning
+ * a "state" take an optional "fields" array naming the state members to
+ * compute and return (default: all), and report the game's "state_version".
+ * make_move with "delta":true returns only the squares that changed, plus
+ * the state without board and moveHistory, and the "base_version" the
+ * delta applies to.
+ *
+ * start_job runs find_mate, analyze, perft or review_game in the background
+ * and returns a "job_id" at once: {"command":"start_job","job":{<command>}}.
+ * The job sees its game as it was when started. poll_job returns the job's
+ * "status" and, once done, the command's response as "result"; cancel_job
+ * stops it. A job started with "notify":true is instead announced, when it
+ * finishes, by an event written between responses:
+ *   {"event":"job_finished","job_id":N,"status":"done","result":{...}}
  *
- * Returns: JSON response string. For "quit", returns the response and sets
- *          the should_quit output parameter to true.
+ * Returns: JSON response string, held in ctx.response and valid until the
+ *          next call. For "quit", returns the response and sets the
+ *          should_quit output parameter to true.
  */
-std::string handleBridgeCommand(const std::string& input, BridgeContext& ctx, bool& should_quit);
+const std::string& handleBridgeCommand(const std::string& input, BridgeContext& ctx,
+                                       bool& should_quit);
+
+/**
+ * Binary counterpart of handleBridgeCommand(): decodes one CBOR or
+ * MessagePack request (per ctx.format) and returns the response in the
+ * same encoding, held in ctx.response. Requests and responses have the
+ * same structure as their JSON text forms; responses are encoded directly,
+ * not converted from JSON text.
+ */
+const std::string& handleBridgeMessage(const std::vector<uint8_t>& message, BridgeContext& ctx,
+                                       bool& should_quit);
+
+/**
+ * Appends the event announcing a finished job to out, framed for the given
+ * format: a line of JSON text, or a length-prefixed CBOR/MessagePack frame.
+ */
+void appendJobEvent(const JobQueue::Finished& job, BridgeFormat format, std::string& out);
 
 /**
  * Run the JSON bridge main loop: read JSON lines from stdin, write responses to stdout.
+ * With a binary ctx.format, requests and responses are length-prefixed frames instead.
+ * Output is flushed when no more input is waiting, so pipelined requests share a flush.
+ * Job events are written as soon as the job finishes, even while waiting for input.
+ *
+ * With ctx.ponderer set, the replies to the default game's position are
+ * analyzed while the loop waits for input, and stopped when input arrives;
+ * an analyze command whose position was pondered deeply enough is answered
+ * from that work, marked "pondered":true.
  */
 void runBridgeLoop();
+void runBridgeLoop(BridgeContext& ctx);
 
 #endif  // CHESS_BRIDGE_H
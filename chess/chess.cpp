@@ -2,9 +2,16 @@
 
 #include "chess.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <charconv>
 #include <cstdlib>
 #include <sstream>
+#include <utility>
+
+#include "encoding.h"
+#include "position.h"
 
 using std::abs;
 
@@ -211,6 +218,15 @@ double ChessPiece::getValue() {
     return value;
 }
 
+std::vector<ChessMove> ChessPiece::getMoves() const {
+    std::vector<ChessMove> ret;
+    for (int i = 0, n = targetCount(); i < n; i++) {
+        MoveTarget t = target(i);
+        if (canMove(t.x, t.y)) ret.emplace_back(getPosX(), getPosY(), t.x, t.y, t.promo);
+    }
+    return ret;
+}
+
 //////
 // PAWN
 
@@ -314,30 +330,32 @@ bool Pawn::canMove(int x, int y, bool chkchk) const {
         return true;
 }
 
-std::vector<ChessMove> Pawn::getMoves() const {
+int Pawn::targetCount() const {
+    int sign = isWhite ? 1 : -1;
+    // On reaching the back rank, each direction once per promotion type.
+    return getPosX() + sign == 0 || getPosX() + sign == 7 ? 12 : 4;
+}
+
+MoveTarget Pawn::target(int i) const {
     int x = getPosX();
     int y = getPosY();
-
     int sign = isWhite ? 1 : -1;
-    std::vector<ChessMove> ret;
 
-    if (x + sign == 0 || x + sign == 7) {
-        // Pawn reaches back rank — emit one move per promotion type per direction
-        for (PieceType p : {QUEEN, ROOK, KNIGHT, BISHOP}) {
-            if (canMove(x + sign, y)) ret.emplace_back(x, y, x + sign, y, p);
-            if (canMove(x + sign, y + 1)) ret.emplace_back(x, y, x + sign, y + 1, p);
-            if (canMove(x + sign, y - 1)) ret.emplace_back(x, y, x + sign, y - 1, p);
-        }
-    } else {
-        if (canMove(x + sign, y)) ret.emplace_back(x, y, x + sign, y);
-        if (canMove(x + 2 * sign, y)) ret.emplace_back(x, y, x + 2 * sign, y);
-        if (canMove(x + sign, y + 1)) ret.emplace_back(x, y, x + sign, y + 1);
-        if (canMove(x + sign, y - 1)) ret.emplace_back(x, y, x + sign, y - 1);
+    if (targetCount() == 12) {
+        static const PieceType promos[4] = {QUEEN, ROOK, KNIGHT, BISHOP};
+        static const int dy[3] = {0, 1, -1};
+        return {x + sign, y + dy[i % 3], promos[i / 3]};
+    }
+    switch (i) {
+        case 0: return {x + sign, y};
+        case 1: return {x + 2 * sign, y};
+        case 2: return {x + sign, y + 1};
+        default: return {x + sign, y - 1};
     }
-    return ret;
 }
 
 bool Pawn::getMoved() const { return hasMoved; }
+void Pawn::setMoved(bool moved) { hasMoved = moved; }
 bool Pawn::getEnPassant() const { return enPassant; }
 void Pawn::setEnPassant(bool b) { enPassant = b; }
 
@@ -430,22 +448,31 @@ bool Rook::canMove(int x, int y, bool chkchk) const {
         return true;
 }
 
-std::vector<ChessMove> Rook::getMoves() const {
-    int x = getPosX();
-    int y = getPosY();
+namespace {
 
-    std::vector<ChessMove> ret;
+// Target i of 16 along a rook's rank, then its file, in square order; the
+// piece's own square is among them and is refused by canMove().
+MoveTarget lineTarget(int x, int y, int i) {
+    return i < 8 ? MoveTarget{x, i} : MoveTarget{i - 8, y};
+}
+
+// Target i of 32 along a bishop's four diagonals, each walked outward from
+// the piece's own square; squares past the edge are refused by canMove().
+MoveTarget diagonalTarget(int x, int y, int i) {
+    static const int dx[4] = {1, -1, 1, -1};
+    static const int dy[4] = {1, -1, -1, 1};
+    int d = i / 8, j = i % 8;
+    return {x + dx[d] * j, y + dy[d] * j};
+}
 
-    for (int i = 0; i < 8; i++)  // moves in the same row
-        if (y != i && canMove(x, i)) ret.emplace_back(x, y, x, i);
+}  // namespace
 
-    for (int i = 0; i < 8; i++)  // moves in the same column
-        if (x != i && canMove(i, y)) ret.emplace_back(x, y, i, y);
+int Rook::targetCount() const { return 16; }
 
-    return ret;
-}
+MoveTarget Rook::target(int i) const { return lineTarget(getPosX(), getPosY(), i); }
 
 bool Rook::getMoved() const { return hasMoved; }
+void Rook::setMoved(bool moved) { hasMoved = moved; }
 
 bool Rook::move(int x, int y) {
     bool b = ChessPiece::move(x, y);
@@ -505,16 +532,10 @@ bool Knight::canMove(int x, int y, bool chkchk) const {
         return true;
 }
 
-std::vector<ChessMove> Knight::getMoves() const {
-    int x = getPosX();
-    int y = getPosY();
-
-    std::vector<ChessMove> ret;
-    for (int i = 0; i < 8; i++)
-        if (canMove(x + xOffsets[i], y + yOffsets[i]))
-            ret.emplace_back(x, y, x + xOffsets[i], y + yOffsets[i]);
+int Knight::targetCount() const { return 8; }
 
-    return ret;
+MoveTarget Knight::target(int i) const {
+    return {getPosX() + xOffsets[i], getPosY() + yOffsets[i]};
 }
 
 PieceType Knight::getType() const { return KNIGHT; }
@@ -582,26 +603,9 @@ bool Bishop::canMove(int x, int y, bool chkchk) const {
         return true;
 }
 
-std::vector<ChessMove> Bishop::getMoves() const {
-    int x = getPosX();
-    int y = getPosY();
-
-    std::vector<ChessMove> ret;
-
-    for (int j = 0; (x + j < 8 && y + j < 8); j++)
-        if (canMove(x + j, y + j)) ret.emplace_back(x, y, x + j, y + j);
-
-    for (int j = 0; (x - j >= 0 && y - j >= 0); j++)
-        if (canMove(x - j, y - j)) ret.emplace_back(x, y, x - j, y - j);
-
-    for (int j = 0; (x + j < 8 && y - j >= 0); j++)
-        if (canMove(x + j, y - j)) ret.emplace_back(x, y, x + j, y - j);
+int Bishop::targetCount() const { return 32; }
 
-    for (int j = 0; (x - j >= 0 && y + j < 8); j++)
-        if (canMove(x - j, y + j)) ret.emplace_back(x, y, x - j, y + j);
-
-    return ret;
-}
+MoveTarget Bishop::target(int i) const { return diagonalTarget(getPosX(), getPosY(), i); }
 
 PieceType Bishop::getType() const { return BISHOP; }
 
@@ -700,16 +704,10 @@ bool King::canMove(int x, int y, bool chkchk) const {
         return true;
 }
 
-std::vector<ChessMove> King::getMoves() const {
-    int x = getPosX();
-    int y = getPosY();
-
-    std::vector<ChessMove> ret;
-    for (int i = 0; i < 10; i++)
-        if (canMove(x + xOffsets[i], y + yOffsets[i]))
-            ret.emplace_back(x, y, x + xOffsets[i], y + yOffsets[i]);
+int King::targetCount() const { return 10; }
 
-    return ret;
+MoveTarget King::target(int i) const {
+    return {getPosX() + xOffsets[i], getPosY() + yOffsets[i]};
 }
 
 bool King::move(int x, int y) {
@@ -755,6 +753,7 @@ bool King::inCheck() const {
 }
 
 bool King::getMoved() const { return hasMoved; }
+void King::setMoved(bool moved) { hasMoved = moved; }
 void King::markMoved() { hasMoved = true; }
 
 PieceType King::getType() const { return KING; }
@@ -849,31 +848,11 @@ bool Queen::canMove(int x, int y, bool chkchk) const {
         return true;
 }
 
-std::vector<ChessMove> Queen::getMoves() const {
-    int x = getPosX();
-    int y = getPosY();
-
-    std::vector<ChessMove> ret;
+int Queen::targetCount() const { return 48; }
 
-    for (int i = 0; i < 8; i++)  // same row
-        if (y != i && canMove(x, i)) ret.emplace_back(x, y, x, i);
-
-    for (int i = 0; i < 8; i++)  // same column
-        if (x != i && canMove(i, y)) ret.emplace_back(x, y, i, y);
-
-    for (int j = 0; (x + j < 8 && y + j < 8); j++)
-        if (canMove(x + j, y + j)) ret.emplace_back(x, y, x + j, y + j);
-
-    for (int j = 0; (x - j >= 0 && y - j >= 0); j++)
-        if (canMove(x - j, y - j)) ret.emplace_back(x, y, x - j, y - j);
-
-    for (int j = 0; (x + j < 8 && y - j >= 0); j++)
-        if (canMove(x + j, y - j)) ret.emplace_back(x, y, x + j, y - j);
-
-    for (int j = 0; (x - j >= 0 && y + j < 8); j++)
-        if (canMove(x - j, y + j)) ret.emplace_back(x, y, x - j, y + j);
-
-    return ret;
+MoveTarget Queen::target(int i) const {
+    return i < 16 ? lineTarget(getPosX(), getPosY(), i)
+                  : diagonalTarget(getPosX(), getPosY(), i - 16);
 }
 
 PieceType Queen::getType() const { return QUEEN; }
@@ -920,6 +899,8 @@ ChessBoard::ChessBoard() {
     place(7, 7, std::make_unique<Rook>(BLACK, true, *this, 0));
 }
 
+ChessBoard::ChessBoard(Empty) {}
+
 ChessBoard::~ChessBoard() {}  // unique_ptrs in grid[] clean up automatically
 
 bool ChessBoard::getCastlingRight(bool isWhite, bool isKingSide) const {
@@ -1095,6 +1076,12 @@ bool ChessBoard::checkCheck(bool isW) const {
 
 ChessGame::ChessGame() : rulesOn(true), whiteTurn(true), board(ChessBoard()) {
     positionHistory.push_back(positionKey());
+    bumpStateVersion();
+}
+
+ChessGame::ChessGame(EmptyBoard)
+    : rulesOn(true), whiteTurn(true), board(ChessBoard::Empty{}) {
+    bumpStateVersion();
 }
 
 void ChessGame::setRules(bool on) { rulesOn = on; }
@@ -1104,28 +1091,77 @@ ChessGame::~ChessGame() {}
 
 bool ChessGame::checkmate(bool white) const {
     if (!board.checkCheck(white)) return false;
-    return getMoves(white).empty();
+    return !hasLegalMove(white);
 }
 
 bool ChessGame::stalemate(bool turn) const {
     if (board.checkCheck(turn)) return false;
-    return getMoves(turn).empty();
+    return !hasLegalMove(turn);
 }
 
+namespace {
+// Per thread, so a bridge command's count is not mixed with the work of
+// job workers or the ponder thread running alongside it.
+thread_local uint64_t movesGenerated = 0;
+}  // namespace
+
 std::vector<ChessMove> ChessGame::getMoves(bool white) const {
     std::vector<ChessMove> all;
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            const ChessPiece* p = board.getPiece(i, j);
-            if (p && p->getWhite() == white) {
-                auto m = p->getMoves();
-                all.insert(all.end(), m.begin(), m.end());
-            }
+    for (const ChessMove& m : legalMoves(white)) all.push_back(m);
+    movesGenerated += all.size();
+    return all;
+}
+
+LegalMoves ChessGame::legalMoves(bool white) const { return LegalMoves(board, white); }
+
+bool ChessGame::hasLegalMove(bool white) const {
+    LegalMoves moves = legalMoves(white);
+    if (moves.begin() == moves.end()) return false;
+    movesGenerated++;
+    return true;
+}
+
+int ChessGame::countLegalMoves(bool white) const {
+    int count = 0;
+    for (auto it = legalMoves(white).begin(); it != std::default_sentinel; ++it) count++;
+    movesGenerated += count;
+    return count;
+}
+
+LegalMoves::iterator::iterator(const ChessBoard& board, bool white)
+    : board(&board), white(white) {
+    seek();
+}
+
+void LegalMoves::iterator::seek() {
+    for (;;) {
+        while (++index < count) {
+            MoveTarget t = piece->target(index);
+            if (piece->canMove(t.x, t.y)) return;
         }
+        do {
+            if (++square == 64) return;
+            piece = board->getPiece(square >> 3, square & 7);
+        } while (piece == nullptr || piece->getWhite() != white);
+        index = -1;
+        count = piece->targetCount();
     }
-    return all;
 }
 
+ChessMove LegalMoves::iterator::operator*() const {
+    MoveTarget t = piece->target(index);
+    return ChessMove(square >> 3, square & 7, t.x, t.y, t.promo);
+}
+
+LegalMoves::iterator& LegalMoves::iterator::operator++() {
+    seek();
+    return *this;
+}
+
+uint64_t ChessGame::legalMovesGenerated() { return movesGenerated; }
+
+void ChessGame::addLegalMovesGenerated(uint64_t moves) { movesGenerated += moves; }
+
 std::unique_ptr<ChessPiece> ChessGame::makePiece(PieceType type, bool white, int y) {
     bool ks = (y > 3);
     int idx = white ? whiteProms : blackProms;
@@ -1148,6 +1184,33 @@ bool ChessGame::getTurn() const { return whiteTurn; }
 
 const std::vector<ChessMove>& ChessGame::getHistory() const { return history; }
 
+std::string ChessGame::getStartFen() const {
+    return startFen.empty() ? "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" : startFen;
+}
+
+namespace {
+
+// hasMoved of the piece types that track it; false for the others.
+bool movedFlag(const ChessPiece* p) {
+    switch (p->getType()) {
+        case PAWN: return dynamic_cast<const Pawn*>(p)->getMoved();
+        case ROOK: return dynamic_cast<const Rook*>(p)->getMoved();
+        case KING: return dynamic_cast<const King*>(p)->getMoved();
+        default: return false;
+    }
+}
+
+void setMovedFlag(ChessPiece* p, bool moved) {
+    switch (p->getType()) {
+        case PAWN: dynamic_cast<Pawn*>(p)->setMoved(moved); break;
+        case ROOK: dynamic_cast<Rook*>(p)->setMoved(moved); break;
+        case KING: dynamic_cast<King*>(p)->setMoved(moved); break;
+        default: break;
+    }
+}
+
+}  // namespace
+
 bool ChessGame::makeMove(const ChessMove& cm) {
     if (rulesOn) {
         ChessPiece* piece = board.getMoveablePiece(cm.getStartX(), cm.getStartY());
@@ -1155,7 +1218,36 @@ bool ChessGame::makeMove(const ChessMove& cm) {
         bool isPawnMove = (piece->getType() == PAWN);
         bool isCapture = (board.getPiece(cm.getEndX(), cm.getEndY()) != nullptr);
         // En passant is also a capture (destination is empty but a pawn is taken).
-        if (isPawnMove && !isCapture && cm.getStartY() != cm.getEndY()) isCapture = true;
+        bool isEnPassant = isPawnMove && !isCapture && cm.getStartY() != cm.getEndY();
+        if (isEnPassant) isCapture = true;
+
+        // Everything the move may change, for undoMove().
+        UndoRecord undo;
+        undo.halfmoveClock = halfmoveClock;
+        std::copy(&board.castlingRights[0][0], &board.castlingRights[0][0] + 4,
+                  &undo.castlingRights[0][0]);
+        undo.moverMoved = movedFlag(piece);
+        undo.moverEnPassant = isPawnMove && dynamic_cast<Pawn*>(piece)->getEnPassant();
+        if (isCapture) {
+            undo.capturedX = static_cast<int8_t>(isEnPassant ? cm.getStartX() : cm.getEndX());
+            undo.capturedY = static_cast<int8_t>(cm.getEndY());
+            const ChessPiece* victim = board.getPiece(undo.capturedX, undo.capturedY);
+            if (victim != nullptr) {
+                undo.capturedType = static_cast<int8_t>(victim->getType());
+                undo.capturedWhite = victim->getWhite();
+                undo.capturedKingSide = victim->getKingSide();
+                undo.capturedIndex = victim->getIndex();
+                undo.capturedMoved = movedFlag(victim);
+                undo.capturedEnPassant =
+                    victim->getType() == PAWN && dynamic_cast<const Pawn*>(victim)->getEnPassant();
+            }
+        }
+        if (piece->getType() == KING && std::abs(cm.getStartY() - cm.getEndY()) == 2) {
+            const ChessPiece* rook =
+                board.getPiece(cm.getStartX(), cm.getEndY() > cm.getStartY() ? 7 : 0);
+            if (rook != nullptr) undo.rookMoved = movedFlag(rook);
+        }
+
         bool b = piece->move(cm.getEndX(), cm.getEndY());
         if (b) {
             history.push_back(cm);
@@ -1189,6 +1281,7 @@ bool ChessGame::makeMove(const ChessMove& cm) {
             // rather than routing through setPiece() to avoid the rulesOn guard.
             if (cm.getPromotion() != PAWN) {
                 int endX = cm.getEndX(), endY = cm.getEndY();
+                undo.promotedPawn = std::move(board.grid[endX][endY]);  // kept for undoMove()
                 board.place(endX, endY, makePiece(cm.getPromotion(), movedColor, endY));
                 if (movedColor) whiteProms++;
                 else blackProms++;
@@ -1205,20 +1298,85 @@ bool ChessGame::makeMove(const ChessMove& cm) {
                         ChessPiece* p = board.getMoveablePiece(i, j);
                         if (p->getType() == PAWN) {
                             Pawn* pawn = dynamic_cast<Pawn*>(p);
+                            if (pawn->getEnPassant()) undo.clearedEnPassant |= 1ULL << (i * 8 + j);
                             pawn->setEnPassant(false);
                         }
                     }
                 }
             }
             positionHistory.push_back(positionKey());
+            undoRecords.push_back(std::move(undo));
+            bumpStateVersion();
         }
         return b;
     } else {
         (void)board.movePiece(cm);  // displaced piece auto-deleted by unique_ptr
+        bumpStateVersion();
         return true;
     }
 }
 
+bool ChessGame::undoMove() {
+    if (undoRecords.empty()) return false;
+    UndoRecord& undo = undoRecords.back();
+    const ChessMove& cm = history.back();
+    int sx = cm.getStartX(), sy = cm.getStartY(), ex = cm.getEndX(), ey = cm.getEndY();
+
+    whiteTurn = !whiteTurn;
+    for (int sq = 0; sq < 64; sq++) {
+        if (undo.clearedEnPassant >> sq & 1)
+            dynamic_cast<Pawn*>(board.getMoveablePiece(sq / 8, sq % 8))->setEnPassant(true);
+    }
+    if (undo.promotedPawn) {
+        board.place(ex, ey, std::move(undo.promotedPawn));
+        if (whiteTurn) whiteProms--;
+        else blackProms--;
+    }
+
+    ChessPiece* piece = board.getMoveablePiece(ex, ey);
+    if (piece->getType() == KING && std::abs(sy - ey) == 2) {
+        int rookFrom = ey > sy ? 7 : 0, rookTo = ey > sy ? 5 : 3;
+        (void)board.movePiece(ChessMove(sx, rookTo, sx, rookFrom));
+        setMovedFlag(board.getMoveablePiece(sx, rookFrom), undo.rookMoved);
+    }
+    (void)board.movePiece(ChessMove(ex, ey, sx, sy));
+    setMovedFlag(piece, undo.moverMoved);
+    if (piece->getType() == PAWN) dynamic_cast<Pawn*>(piece)->setEnPassant(undo.moverEnPassant);
+
+    // Captured pieces were destroyed; an identical one is rebuilt.
+    if (undo.capturedType >= 0) {
+        bool white = undo.capturedWhite, ks = undo.capturedKingSide;
+        int idx = undo.capturedIndex;
+        std::unique_ptr<ChessPiece> p;
+        switch (static_cast<PieceType>(undo.capturedType)) {
+            case PAWN: {
+                auto pawn = std::make_unique<Pawn>(white, ks, board, idx);
+                pawn->setEnPassant(undo.capturedEnPassant);
+                p = std::move(pawn);
+                break;
+            }
+            case ROOK: p = std::make_unique<Rook>(white, ks, board, idx); break;
+            case KNIGHT: p = std::make_unique<Knight>(white, ks, board, idx); break;
+            case BISHOP: p = std::make_unique<Bishop>(white, ks, board, idx); break;
+            case QUEEN: p = std::make_unique<Queen>(white, board, idx, ks); break;
+            case KING: p = std::make_unique<King>(white, board); break;
+        }
+        setMovedFlag(p.get(), undo.capturedMoved);
+        board.place(undo.capturedX, undo.capturedY, std::move(p));
+    }
+
+    std::copy(&undo.castlingRights[0][0], &undo.castlingRights[0][0] + 4,
+              &board.castlingRights[0][0]);
+    halfmoveClock = undo.halfmoveClock;
+    history.pop_back();
+    positionHistory.pop_back();
+    undoRecords.pop_back();
+    bumpStateVersion();
+    return true;
+}
+
+size_t ChessGame::undoableMoves() const { return undoRecords.size(); }
+
 const char* ChessGame::getBoard() { return board.toString(); }
 
 const ChessPiece* ChessGame::getPiece(int x, int y) const { return board.getPiece(x, y); }
@@ -1227,10 +1385,26 @@ void ChessGame::setPiece(int x, int y, std::unique_ptr<ChessPiece> piece) {
     if (rulesOn) return;
     if (x < 0 || x > 7 || y < 0 || y > 7) return;
     board.place(x, y, std::move(piece));
+    bumpStateVersion();
 }
 
+namespace {
+std::atomic<uint64_t> lastStateVersion{0};
+}  // namespace
+
+void ChessGame::bumpStateVersion() { stateVersion = lastStateVersion.fetch_add(1) + 1; }
+
+uint64_t ChessGame::getStateVersion() const { return stateVersion; }
+
+void ChessGame::setStateVersion(uint64_t version) { stateVersion = version; }
+
 std::string ChessGame::toFen() const {
-    std::string fen;
+    char buf[FEN_BUFFER_SIZE];
+    return std::string(buf, writeFen(buf));
+}
+
+size_t ChessGame::writeFen(char* buf) const {
+    char* out = buf;
 
     // 1. Piece placement (rank 8 down to rank 1 = x=7 down to x=0)
     for (int x = 7; x >= 0; x--) {
@@ -1239,42 +1413,43 @@ std::string ChessGame::toFen() const {
             const ChessPiece* p = board.getPiece(x, y);
             if (p == nullptr) {
                 empty++;
-            } else {
-                if (empty > 0) {
-                    fen += std::to_string(empty);
-                    empty = 0;
-                }
-                char c;
-                switch (p->getType()) {
-                    case PAWN: c = 'p'; break;
-                    case ROOK: c = 'r'; break;
-                    case KNIGHT: c = 'n'; break;
-                    case BISHOP: c = 'b'; break;
-                    case QUEEN: c = 'q'; break;
-                    case KING: c = 'k'; break;
-                }
-                if (p->getWhite()) c = c - 32;  // uppercase for white
-                fen += c;
+                continue;
+            }
+            if (empty > 0) {
+                *out++ = static_cast<char>('0' + empty);
+                empty = 0;
             }
+            char c;
+            switch (p->getType()) {
+                case PAWN: c = 'p'; break;
+                case ROOK: c = 'r'; break;
+                case KNIGHT: c = 'n'; break;
+                case BISHOP: c = 'b'; break;
+                case QUEEN: c = 'q'; break;
+                case KING: c = 'k'; break;
+            }
+            if (p->getWhite()) c = c - 32;  // uppercase for white
+            *out++ = c;
         }
-        if (empty > 0) fen += std::to_string(empty);
-        if (x > 0) fen += '/';
+        if (empty > 0) *out++ = static_cast<char>('0' + empty);
+        if (x > 0) *out++ = '/';
     }
 
     // 2. Active color
-    fen += whiteTurn ? " w" : " b";
+    *out++ = ' ';
+    *out++ = whiteTurn ? 'w' : 'b';
 
     // 3. Castling availability — uses independent flags on ChessBoard.
-    std::string castling;
-    if (board.getCastlingRight(true, true)) castling += 'K';
-    if (board.getCastlingRight(true, false)) castling += 'Q';
-    if (board.getCastlingRight(false, true)) castling += 'k';
-    if (board.getCastlingRight(false, false)) castling += 'q';
-    fen += ' ';
-    fen += castling.empty() ? "-" : castling;
+    *out++ = ' ';
+    const char* castling = out;
+    if (board.getCastlingRight(true, true)) *out++ = 'K';
+    if (board.getCastlingRight(true, false)) *out++ = 'Q';
+    if (board.getCastlingRight(false, true)) *out++ = 'k';
+    if (board.getCastlingRight(false, false)) *out++ = 'q';
+    if (out == castling) *out++ = '-';
 
     // 4. En passant target square
-    std::string ep = "-";
+    char ep[2] = {'-', 0};
     for (int y = 0; y < 8; y++) {
         // En passant target is on the square "behind" the pawn that just double-advanced.
         // Check pawns that have the enPassant flag set.
@@ -1286,577 +1461,222 @@ std::string ChessGame::toFen() const {
                 const Pawn* pawn = dynamic_cast<const Pawn*>(p);
                 if (pawn->getEnPassant()) {
                     int targetX = pawn->getWhite() ? (x - 1) : (x + 1);
-                    ep = "";
-                    ep += ChessMove::fileLetters[y];
-                    ep += std::to_string(targetX + 1);
+                    ep[0] = ChessMove::fileLetters[y];
+                    ep[1] = static_cast<char>('1' + targetX);
                 }
             }
         }
     }
-    fen += ' ';
-    fen += ep;
+    *out++ = ' ';
+    *out++ = ep[0];
+    if (ep[1] != 0) *out++ = ep[1];
 
     // 5. Halfmove clock
-    fen += ' ';
-    fen += std::to_string(halfmoveClock);
+    *out++ = ' ';
+    out = std::to_chars(out, buf + FEN_BUFFER_SIZE, halfmoveClock).ptr;
 
     // 6. Fullmove number
-    fen += ' ';
-    fen += std::to_string(1 + (int)history.size() / 2);
-
-    return fen;
-}
-
-ChessMove ChessGame::parseSan(const std::string& san) const {
-    if (san.empty()) return ChessMove();
-
-    // Strip and record check/checkmate suffix (+, #).
-    // Only one suffix character is canonical; reject ++, ##, +#, etc.
-    std::string s = san;
-    bool hasCheck = false, hasCheckmate = false;
-    if (!s.empty() && (s.back() == '+' || s.back() == '#')) {
-        if (s.back() == '#') hasCheckmate = true;
-        else hasCheck = true;
-        s.pop_back();
-        // Reject if another suffix character follows (non-canonical).
-        if (!s.empty() && (s.back() == '+' || s.back() == '#'))
-            return ChessMove();
-    }
-    if (s.empty()) return ChessMove();
-
-    // Helper: validate check/checkmate suffix against the actual move result.
-    auto validateSuffix = [&](const ChessMove& m) -> ChessMove {
-        if (!hasCheck && !hasCheckmate) return m;
-        auto copy = ChessGame::fromFen(toFen());
-        if (!copy) return ChessMove();
-        if (!copy->makeMove(ChessMove(m.getStartX(), m.getStartY(),
-                                       m.getEndX(), m.getEndY(), m.getPromotion())))
-            return ChessMove();
-        bool opponent = !whiteTurn;  // the side being checked is the one not moving
-        bool givesCheck = copy->board.checkCheck(opponent);
-        bool givesCheckmate = copy->checkmate(opponent);
-        if (hasCheckmate && !givesCheckmate) return ChessMove();
-        if (hasCheck && !givesCheck) return ChessMove();
-        return m;
-    };
+    *out++ = ' ';
+    out = std::to_chars(out, buf + FEN_BUFFER_SIZE, 1 + static_cast<int>(history.size()) / 2).ptr;
 
-    // Castling.
-    if (s == "O-O") {
-        int rank = whiteTurn ? 0 : 7;
-        ChessMove cm(rank, 4, rank, 6);
-        auto moves = getMoves(whiteTurn);
-        for (const auto& m : moves) {
-            if (m.getStartX() == cm.getStartX() && m.getStartY() == cm.getStartY() &&
-                m.getEndX() == cm.getEndX() && m.getEndY() == cm.getEndY())
-                return validateSuffix(m);
-        }
-        return ChessMove();
-    }
-    if (s == "O-O-O") {
-        int rank = whiteTurn ? 0 : 7;
-        ChessMove cm(rank, 4, rank, 2);
-        auto moves = getMoves(whiteTurn);
-        for (const auto& m : moves) {
-            if (m.getStartX() == cm.getStartX() && m.getStartY() == cm.getStartY() &&
-                m.getEndX() == cm.getEndX() && m.getEndY() == cm.getEndY())
-                return validateSuffix(m);
-        }
-        return ChessMove();
-    }
+    return static_cast<size_t>(out - buf);
+}
 
-    // Parse promotion suffix (e.g., "=Q", "=N").
-    PieceType promo = PAWN;
-    {
-        size_t eq = s.find('=');
-        if (eq != std::string::npos && eq + 1 < s.size()) {
-            char pc = s[eq + 1];
-            switch (pc) {
-                case 'Q': promo = QUEEN; break;
-                case 'R': promo = ROOK; break;
-                case 'B': promo = BISHOP; break;
-                case 'N': promo = KNIGHT; break;
-                default: return ChessMove();
-            }
-            s = s.substr(0, eq);
-        }
-    }
+namespace {
 
-    // Determine piece type and strip the piece letter.
-    PieceType pieceType = PAWN;
-    if (!s.empty() && s[0] >= 'A' && s[0] <= 'Z') {
-        switch (s[0]) {
-            case 'K': pieceType = KING; break;
-            case 'Q': pieceType = QUEEN; break;
-            case 'R': pieceType = ROOK; break;
-            case 'B': pieceType = BISHOP; break;
-            case 'N': pieceType = KNIGHT; break;
-            default: return ChessMove();
-        }
-        s = s.substr(1);
-    }
+// The game as a Position for reading and writing SAN. A board set up without
+// both kings has no checks to test, so it is refused.
+bool sanPosition(const ChessGame& game, Position& pos) {
+    return Position::fromGame(game, pos) && pos.kingSq[0] >= 0 && pos.kingSq[1] >= 0;
+}
 
-    // Remove and record 'x' capture indicator.
-    bool hasCapture = false;
-    std::string cleaned;
-    for (char c : s) {
-        if (c == 'x') hasCapture = true;
-        else cleaned += c;
-    }
-    s = cleaned;
-
-    // Now s should be one of:
-    //   "e4"       — destination only (pawn or piece)
-    //   "fe4"      — file disambiguation + destination (pawn capture or piece)
-    //   "1e4"      — rank disambiguation + destination
-    //   "f1e4"     — full disambiguation (file+rank) + destination
-
-    if (s.size() < 2) return ChessMove();
-
-    // Destination is always the last two characters.
-    int endY = s[s.size() - 2] - 'a';
-    int endX = s[s.size() - 1] - '1';
-    if (endX < 0 || endX > 7 || endY < 0 || endY > 7) return ChessMove();
-
-    // Disambiguation from remaining characters.
-    int disambigFile = -1;  // 0-7 if specified
-    int disambigRank = -1;  // 0-7 if specified
-    std::string prefix = s.substr(0, s.size() - 2);
-    for (char c : prefix) {
-        if (c >= 'a' && c <= 'h') disambigFile = c - 'a';
-        else if (c >= '1' && c <= '8') disambigRank = c - '1';
-        else return ChessMove();
-    }
+}  // namespace
 
-    // Find matching legal move.
-    auto moves = getMoves(whiteTurn);
-    ChessMove match;
-    int matchCount = 0;
-    for (const auto& m : moves) {
-        if (m.getEndX() != endX || m.getEndY() != endY) continue;
-        const ChessPiece* p = board.getPiece(m.getStartX(), m.getStartY());
-        if (p == nullptr || p->getType() != pieceType) continue;
-        if (disambigFile >= 0 && m.getStartY() != disambigFile) continue;
-        if (disambigRank >= 0 && m.getStartX() != disambigRank) continue;
-        // For promotion moves, check that the promotion type matches.
-        if (promo != PAWN) {
-            if (m.getPromotion() != promo) continue;
-        } else {
-            // If no promotion specified, skip promotion moves.
-            if (m.getPromotion() != PAWN) continue;
-        }
-        match = m;
-        matchCount++;
-    }
+ChessMove ChessGame::parseSan(std::string_view san) const {
+    Position pos;
+    PosMove m;
+    if (!sanPosition(*this, pos) || !::parseSan(pos, san, m)) return ChessMove();
+    return m.toChessMove();
+}
 
-    if (matchCount != 1) return ChessMove();  // ambiguous or no match
+ChessMove ChessGame::parseMove(const std::string& text) const {
+    ChessMove move = parseSan(text);
+    return move.isEnd() ? parseLan(text) : move;
+}
 
-    // Validate capture annotation: 'x' must correspond to an actual capture.
-    // A capture occurs when the destination is occupied, or for en passant
-    // (pawn moves diagonally to an empty square).
-    if (hasCapture) {
-        bool isCapture = (board.getPiece(endX, endY) != nullptr);
-        if (!isCapture && pieceType == PAWN && match.getStartY() != match.getEndY())
-            isCapture = true;  // en passant
-        if (!isCapture) return ChessMove();
+ChessMove ChessGame::parseLan(const std::string& text) {
+    // Canonical LAN: "a1b2" or with promotion "a7a8q" (no separator).
+    // Also accept hyphenated/spaced forms ("a1-b2", "a1 b2").
+    std::string lan = text;
+    if (lan.size() >= 3 && (lan[2] == '-' || lan[2] == ' ')) lan.erase(2, 1);
+    if (lan.size() < 4 || lan.size() > 5) return ChessMove();
+    char f1 = lan[0], r1 = lan[1], f2 = lan[2], r2 = lan[3];
+    if (f1 < 'a' || f1 > 'h' || r1 < '1' || r1 > '8' || f2 < 'a' || f2 > 'h' || r2 < '1' ||
+        r2 > '8') {
+        return ChessMove();
     }
-
-    return validateSuffix(match);
+    return ChessMove(lan.c_str());
 }
 
 std::string ChessGame::toSan(const ChessMove& move) const {
     if (move.isEnd()) return "";
-
-    int sx = move.getStartX(), sy = move.getStartY();
-    int ex = move.getEndX(),   ey = move.getEndY();
-    const ChessPiece* piece = board.getPiece(sx, sy);
-    if (piece == nullptr) return "";
-
-    PieceType type = piece->getType();
-    bool isWhite = piece->getWhite();
-
-    std::string san;
-
-    // Castling.
-    if (type == KING && std::abs(sy - ey) == 2) {
-        san = (ey > sy) ? "O-O" : "O-O-O";
-    } else {
-        // Piece letter prefix (not for pawns).
-        const char pieceLetters[] = {'?', 'R', 'N', 'B', 'K', 'Q'};
-        if (type != PAWN) {
-            san += pieceLetters[type];
-
-            // Disambiguation: find all same-type, same-color pieces that can
-            // geometrically reach the destination (canMove with chkchk=false).
-            bool needFile = false, needRank = false;
-            bool sameFile = false, sameRank = false;
-            int ambigCount = 0;
-            for (int x = 0; x < 8; x++) {
-                for (int y = 0; y < 8; y++) {
-                    if (x == sx && y == sy) continue;
-                    const ChessPiece* other = board.getPiece(x, y);
-                    if (other == nullptr) continue;
-                    if (other->getType() != type || other->getWhite() != isWhite) continue;
-                    if (!other->canMove(ex, ey, false)) continue;
-                    ambigCount++;
-                    if (y == sy) sameFile = true;
-                    if (x == sx) sameRank = true;
-                }
-            }
-            if (ambigCount > 0) {
-                if (!sameFile) {
-                    needFile = true;
-                } else if (!sameRank) {
-                    needRank = true;
-                } else {
-                    needFile = true;
-                    needRank = true;
-                }
-            }
-            if (needFile) san += static_cast<char>('a' + sy);
-            if (needRank) san += static_cast<char>('1' + sx);
-        }
-
-        // Capture indicator.
-        bool isCapture = (board.getPiece(ex, ey) != nullptr);
-        // En passant: pawn moves diagonally to empty square.
-        if (type == PAWN && sy != ey && !isCapture) isCapture = true;
-        if (isCapture) {
-            if (type == PAWN) san += static_cast<char>('a' + sy);  // pawn source file
-            san += 'x';
-        }
-
-        // Destination square.
-        san += static_cast<char>('a' + ey);
-        san += static_cast<char>('1' + ex);
-
-        // Promotion.
-        if (move.getPromotion() != PAWN) {
-            san += '=';
-            san += pieceLetters[move.getPromotion()];
-        }
-    }
-
-    // Check/checkmate suffix: simulate the move to test.
-    // Make a copy via FEN round-trip to avoid mutating this game.
-    auto copy = ChessGame::fromFen(toFen());
-    if (copy && copy->makeMove(ChessMove(sx, sy, ex, ey, move.getPromotion()))) {
-        bool opponentColor = !isWhite;
-        if (copy->checkmate(opponentColor)) {
-            san += '#';
-        } else if (copy->board.checkCheck(opponentColor)) {
-            san += '+';
-        }
-    }
-
-    return san;
+    Position pos;
+    if (!sanPosition(*this, pos)) return "";
+    return sanOf(pos, PosMove::fromChessMove(move));
 }
 
-std::string ChessGame::normalizeSan(const std::string& san) {
-    std::string s = san;
-
-    // 0. Strip leading/trailing whitespace first so other steps work on clean input.
-    {
-        size_t start = s.find_first_not_of(" \t\n\r");
-        if (start == std::string::npos) return "";
-        size_t end = s.find_last_not_of(" \t\n\r");
-        s = s.substr(start, end - start + 1);
-    }
+std::string ChessGame::normalizeSan(std::string_view san) {
+    auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    auto trim = [&](std::string_view v) {
+        while (!v.empty() && isSpace(v.front())) v.remove_prefix(1);
+        while (!v.empty() && isSpace(v.back())) v.remove_suffix(1);
+        return v;
+    };
+    // The steps below only shorten the move or change characters in place,
+    // so the result is the one allocation.
+    san = trim(san);
+    std::string s;
+    s.reserve(san.size());
 
     // 1. Strip NAGs: '$' followed by digits.
-    {
-        std::string result;
-        for (size_t i = 0; i < s.size(); i++) {
-            if (s[i] == '$') {
-                // Skip $ and following digits.
-                i++;
-                while (i < s.size() && s[i] >= '0' && s[i] <= '9') i++;
-                i--;  // loop increment
-            } else {
-                result += s[i];
-            }
+    for (size_t i = 0; i < san.size(); i++) {
+        if (san[i] != '$') {
+            s += san[i];
+            continue;
         }
-        s = result;
+        while (i + 1 < san.size() && san[i + 1] >= '0' && san[i + 1] <= '9') i++;
     }
 
-    // 2. Strip move assessment glyphs (longest first): !!, ??, !?, ?!, !, ?
-    {
-        // Strip from the end, after any check/checkmate suffix.
-        // First, save and strip check/checkmate suffixes.
-        std::string suffix;
-        while (!s.empty() && (s.back() == '+' || s.back() == '#')) {
-            suffix = s.back() + suffix;
-            s.pop_back();
-        }
-        // Now strip assessment glyphs from the end.
-        bool changed = true;
-        while (changed && !s.empty()) {
-            changed = false;
-            for (const char* glyph : {"!!", "??", "!?", "?!", "!", "?"}) {
-                size_t glen = strlen(glyph);
-                if (s.size() >= glen && s.substr(s.size() - glen) == glyph) {
-                    s.resize(s.size() - glen);
-                    changed = true;
-                    break;
-                }
-            }
-        }
-        s += suffix;
-    }
+    // 2. Strip move assessment glyphs (!!, ??, !?, ?!, !, ?) from the end,
+    //    keeping any check/checkmate suffix after them.
+    size_t suffix = s.size();
+    while (suffix > 0 && (s[suffix - 1] == '+' || s[suffix - 1] == '#')) suffix--;
+    size_t glyphs = suffix;
+    while (glyphs > 0 && (s[glyphs - 1] == '!' || s[glyphs - 1] == '?')) glyphs--;
+    s.erase(glyphs, suffix - glyphs);
 
     // 3. Convert digit-zero castling to letter-O.
-    if (s == "0-0" || s == "0-0+" || s == "0-0#") {
-        s = "O-O" + s.substr(3);
-    } else if (s == "0-0-0" || s == "0-0-0+" || s == "0-0-0#") {
-        s = "O-O-O" + s.substr(5);
-    }
-
-    // 4. Strip leading/trailing whitespace.
-    size_t start = s.find_first_not_of(" \t\n\r");
-    if (start == std::string::npos) return "";
-    size_t end = s.find_last_not_of(" \t\n\r");
-    s = s.substr(start, end - start + 1);
-
-    return s;
-}
-
-std::unique_ptr<ChessGame> ChessGame::fromFen(const std::string& fen) {
-    // Split into exactly 6 space-separated fields.
-    std::vector<std::string> fields;
-    {
-        std::istringstream ss(fen);
-        std::string token;
-        while (ss >> token) fields.push_back(token);
-    }
-    if (fields.size() != 6) return nullptr;
-
-    const std::string& placement = fields[0];
-    const std::string& activeColor = fields[1];
-    const std::string& castling = fields[2];
-    const std::string& enPassant = fields[3];
-
-    // Validate halfmove clock and fullmove number (must be non-negative integers).
-    int halfmove, fullmove;
-    try {
-        size_t pos;
-        halfmove = std::stoi(fields[4], &pos);
-        if (pos != fields[4].size()) return nullptr;  // trailing chars
-        fullmove = std::stoi(fields[5], &pos);
-        if (pos != fields[5].size()) return nullptr;
-    } catch (...) {
-        return nullptr;
-    }
-    if (halfmove < 0) return nullptr;
-    if (fullmove < 1) return nullptr;
-
-    // Validate active color.
-    if (activeColor != "w" && activeColor != "b") return nullptr;
-
-    // Validate castling field: must be "-" or a subset of "KQkq" in order.
-    if (castling != "-") {
-        const std::string allowed = "KQkq";
-        size_t prev = 0;
-        for (char c : castling) {
-            size_t idx = allowed.find(c);
-            if (idx == std::string::npos) return nullptr;
-            if (idx < prev) return nullptr;  // wrong order
-            prev = idx + 1;
+    for (std::string_view castle : {"0-0-0", "0-0"}) {
+        std::string_view rest = std::string_view(s).substr(std::min(castle.size(), s.size()));
+        if (std::string_view(s).substr(0, castle.size()) == castle &&
+            (rest.empty() || rest == "+" || rest == "#")) {
+            for (size_t i = 0; i < castle.size(); i += 2) s[i] = 'O';
+            break;
         }
     }
 
-    // Validate en passant field.
-    if (enPassant != "-") {
-        if (enPassant.size() != 2) return nullptr;
-        if (enPassant[0] < 'a' || enPassant[0] > 'h') return nullptr;
-        if (enPassant[1] < '1' || enPassant[1] > '8') return nullptr;
-        // ep target must be on rank 3 or 6
-        if (enPassant[1] != '3' && enPassant[1] != '6') return nullptr;
-        // ep rank must be consistent with active color:
-        // rank 3 target means white just double-pushed (e2→e4, target e3), so it's black's turn.
-        // rank 6 target means black just double-pushed (d7→d5, target d6), so it's white's turn.
-        if (enPassant[1] == '3' && activeColor != "b") return nullptr;
-        if (enPassant[1] == '6' && activeColor != "w") return nullptr;
+    // 4. Strip whitespace the NAGs left behind.
+    std::string_view trimmed = trim(s);
+    if (trimmed.size() != s.size()) {
+        s.erase(0, static_cast<size_t>(trimmed.data() - s.data()));
+        s.resize(trimmed.size());
     }
+    return s;
+}
 
-    // Validate and parse piece placement.
-    // Split by '/' — must have exactly 8 ranks.
-    std::vector<std::string> ranks;
-    {
-        std::string rank;
-        for (char c : placement) {
-            if (c == '/') {
-                ranks.push_back(rank);
-                rank.clear();
-            } else {
-                rank += c;
-            }
-        }
-        ranks.push_back(rank);
-    }
-    if (ranks.size() != 8) return nullptr;
-
-    // Validate each rank: no consecutive digits, exactly 8 squares, valid piece chars.
-    // Also count kings, pawns, and total pieces; check for pawns on back ranks.
-    int whiteKings = 0, blackKings = 0;
-    int whitePieces = 0, blackPieces = 0;
-    int whitePawns = 0, blackPawns = 0;
-    int whiteKingX = -1, whiteKingY = -1, blackKingX = -1, blackKingY = -1;
-
-    // Build a piece map: ranks[0] = rank 8 (x=7), ranks[7] = rank 1 (x=0).
-    struct PlacedPiece { int x; int y; char letter; bool isWhite; };
-    std::vector<PlacedPiece> pieces;
-
-    for (int ri = 0; ri < 8; ri++) {
-        int boardX = 7 - ri;  // rank 8 → x=7, rank 1 → x=0
-        int squares = 0;
-        bool lastWasDigit = false;
-        for (char c : ranks[ri]) {
-            if (c >= '1' && c <= '8') {
-                if (lastWasDigit) return nullptr;  // consecutive digits
-                squares += (c - '0');
-                lastWasDigit = true;
-            } else {
-                lastWasDigit = false;
-                bool isWhite = (c >= 'A' && c <= 'Z');
-                char lower = isWhite ? static_cast<char>(c + 32) : c;
-                if (lower != 'p' && lower != 'r' && lower != 'n' &&
-                    lower != 'b' && lower != 'q' && lower != 'k')
-                    return nullptr;  // invalid piece letter
-
-                // Pawn on back rank check
-                if (lower == 'p' && (boardX == 0 || boardX == 7))
-                    return nullptr;
-
-                // Count kings
-                if (lower == 'k') {
-                    if (isWhite) { whiteKings++; whiteKingX = boardX; whiteKingY = squares; }
-                    else         { blackKings++; blackKingX = boardX; blackKingY = squares; }
-                }
-
-                // Count pieces and pawns per side.
-                if (isWhite) { whitePieces++; if (lower == 'p') whitePawns++; }
-                else         { blackPieces++; if (lower == 'p') blackPawns++; }
-
-                pieces.push_back({boardX, squares, lower, isWhite});
-                squares++;
-            }
-        }
-        if (squares != 8) return nullptr;  // rank doesn't have exactly 8 squares
+const char* fenErrorMessage(FenError error) {
+    switch (error) {
+        case FenError::None: return "no error";
+        case FenError::FieldCount: return "a FEN has six fields";
+        case FenError::Placement: return "invalid piece placement";
+        case FenError::SideToMove: return "invalid side to move";
+        case FenError::Castling: return "invalid castling rights";
+        case FenError::EnPassant: return "invalid en passant square";
+        case FenError::HalfmoveClock: return "invalid halfmove clock";
+        case FenError::FullmoveNumber: return "invalid fullmove number";
+        case FenError::KingCount: return "each side needs exactly one king";
+        case FenError::PieceCount: return "more than 16 pieces or 8 pawns for a side";
+        case FenError::PawnOnBackRank: return "pawn on a back rank";
+        case FenError::AdjacentKings: return "kings are adjacent";
+        case FenError::OpponentInCheck: return "side not to move is in check";
     }
-
-    // Exactly one king per side.
-    if (whiteKings != 1 || blackKings != 1) return nullptr;
-
-    // No more than 16 pieces per side, no more than 8 pawns per side.
-    if (whitePieces > 16 || blackPieces > 16) return nullptr;
-    if (whitePawns > 8 || blackPawns > 8) return nullptr;
-
-    // Kings must not be adjacent.
-    if (std::abs(whiteKingX - blackKingX) <= 1 && std::abs(whiteKingY - blackKingY) <= 1)
-        return nullptr;
-
-    // --- All validation passed; build the game. ---
-
-    auto game = std::unique_ptr<ChessGame>(new ChessGame());
-    game->setRules(false);
-
-    // Clear the board
-    for (int rx = 0; rx < 8; rx++)
-        for (int ry = 0; ry < 8; ry++)
-            game->setPiece(rx, ry, nullptr);
-
-    // Place pieces.
-    for (const auto& pp : pieces) {
-        bool isKingSide = (pp.y > 3);
-        int pawnIdx = isKingSide ? (pp.y - 3) : (4 - pp.y);
+    return "invalid FEN";
+}
+
+std::unique_ptr<ChessGame> ChessGame::fromFen(std::string_view fen, FenError* error) {
+    Position pos;
+    FenError status = parseFen(fen, pos);
+    if (error != nullptr) *error = status;
+    if (status != FenError::None) return nullptr;
+
+    // Build the game on an empty board: the only pieces allocated are the
+    // ones the FEN places.
+    auto game = std::unique_ptr<ChessGame>(new ChessGame(EmptyBoard{}));
+    for (int sq = 0; sq < 64; sq++) {
+        int8_t code = pos.board[sq];
+        if (code == 0) continue;
+        int x = rowOf(sq), y = colOf(sq);
+        bool isWhite = code > 0;
+        bool isKingSide = (y > 3);
+        int pawnIdx = isKingSide ? (y - 3) : (4 - y);
         std::unique_ptr<ChessPiece> piece;
-        switch (pp.letter) {
-            case 'p': piece = std::make_unique<Pawn>(pp.isWhite, isKingSide, game->board, pawnIdx); break;
-            case 'r': piece = std::make_unique<Rook>(pp.isWhite, isKingSide, game->board, 0); break;
-            case 'n': piece = std::make_unique<Knight>(pp.isWhite, isKingSide, game->board, 0); break;
-            case 'b': piece = std::make_unique<Bishop>(pp.isWhite, isKingSide, game->board, 0); break;
-            case 'q': piece = std::make_unique<Queen>(pp.isWhite, game->board, 0, isKingSide); break;
-            case 'k': piece = std::make_unique<King>(pp.isWhite, game->board); break;
+        switch (typeOfCode(code)) {
+            case PAWN: piece = std::make_unique<Pawn>(isWhite, isKingSide, game->board, pawnIdx); break;
+            case ROOK: piece = std::make_unique<Rook>(isWhite, isKingSide, game->board, 0); break;
+            case KNIGHT: piece = std::make_unique<Knight>(isWhite, isKingSide, game->board, 0); break;
+            case BISHOP: piece = std::make_unique<Bishop>(isWhite, isKingSide, game->board, 0); break;
+            case QUEEN: piece = std::make_unique<Queen>(isWhite, game->board, 0, isKingSide); break;
+            case KING: piece = std::make_unique<King>(isWhite, game->board); break;
         }
-        game->board.place(pp.x, pp.y, std::move(piece));
+        game->board.place(x, y, std::move(piece));
     }
 
     // Active color.
-    game->whiteTurn = (activeColor == "w");
+    game->whiteTurn = pos.whiteTurn;
 
     // Castling rights — default is all true; clear the ones not present.
-    if (castling.find('K') == std::string::npos)
-        game->board.clearCastlingRight(true, true);
-    if (castling.find('Q') == std::string::npos)
-        game->board.clearCastlingRight(true, false);
-    if (castling.find('k') == std::string::npos)
-        game->board.clearCastlingRight(false, true);
-    if (castling.find('q') == std::string::npos)
-        game->board.clearCastlingRight(false, false);
-
-    // En passant target square.
-    if (enPassant != "-") {
-        int epY = enPassant[0] - 'a';
-        int epX = enPassant[1] - '1';
-        int pawnX = (activeColor == "b") ? (epX + 1) : (epX - 1);
-        ChessPiece* p = game->board.getMoveablePiece(pawnX, epY);
+    if (!(pos.castling & CASTLE_WK)) game->board.clearCastlingRight(true, true);
+    if (!(pos.castling & CASTLE_WQ)) game->board.clearCastlingRight(true, false);
+    if (!(pos.castling & CASTLE_BK)) game->board.clearCastlingRight(false, true);
+    if (!(pos.castling & CASTLE_BQ)) game->board.clearCastlingRight(false, false);
+
+    // En passant target square: flag the pawn that just double-pushed.
+    if (pos.epSquare >= 0) {
+        int epX = rowOf(pos.epSquare);
+        int pawnX = pos.whiteTurn ? (epX - 1) : (epX + 1);
+        ChessPiece* p = game->board.getMoveablePiece(pawnX, colOf(pos.epSquare));
         if (p != nullptr && p->getType() == PAWN)
             dynamic_cast<Pawn*>(p)->setEnPassant(true);
     }
 
     // Halfmove clock.
-    game->halfmoveClock = halfmove;
+    game->halfmoveClock = pos.halfmoveClock;
 
     // Fullmove number — derive history size so toFen() reproduces it.
-    int histSize = (fullmove - 1) * 2 + (activeColor == "b" ? 1 : 0);
-    game->history.clear();
-    for (int i = 0; i < histSize; i++)
-        game->history.push_back(ChessMove());
-
-    // Side not to move must not be in check.
-    game->setRules(true);
-    bool notToMove = !game->whiteTurn;
-    if (game->board.checkCheck(notToMove)) return nullptr;
+    int histSize = (pos.fullmoveNumber - 1) * 2 + (pos.whiteTurn ? 0 : 1);
+    game->history.assign(histSize, ChessMove());
 
     // Initialize position history with the current position.
-    game->positionHistory.clear();
     game->positionHistory.push_back(game->positionKey());
+    game->startFen = game->toFen();
 
     return game;
 }
 
 std::string ChessGame::positionKey() const {
-    std::string fen = toFen();
-    // Extract first 4 space-separated fields (piece placement, active color,
+    char fen[FEN_BUFFER_SIZE];
+    std::string_view key(fen, writeFen(fen));
+    // Keep the first 4 space-separated fields (piece placement, active color,
     // castling, en passant) — halfmove clock and fullmove number are not part
     // of position identity.
+    size_t epStart = 0;
     int spaces = 0;
-    size_t end = fen.size();
-    for (size_t i = 0; i < fen.size(); i++) {
-        if (fen[i] == ' ') {
-            spaces++;
-            if (spaces == 4) { end = i; break; }
+    for (size_t i = 0; i < key.size(); i++) {
+        if (key[i] == ' ' && ++spaces == 3) epStart = i + 1;
+        if (spaces == 4) {
+            key = key.substr(0, i);
+            break;
         }
     }
-    std::string key = fen.substr(0, end);
 
     // Per SPEC 4.3: the en passant target is only part of position identity
     // when a fully legal en passant capture exists. If no legal capture is
     // available, replace the ep field with "-" so positions match.
-    // Find the ep field (after 3rd space).
-    size_t epStart = 0;
-    int sp = 0;
-    for (size_t i = 0; i < key.size(); i++) {
-        if (key[i] == ' ') {
-            sp++;
-            if (sp == 3) { epStart = i + 1; break; }
-        }
-    }
-    std::string ep = key.substr(epStart);
-    if (ep != "-") {
+    if (key[epStart] != '-') {
         // Check if any legal en passant capture exists.
         bool hasLegalEp = false;
-        int epY = ep[0] - 'a';  // file
-        int epX = ep[1] - '1';  // rank (0-indexed)
+        int epY = key[epStart] - 'a';      // file
+        int epX = key[epStart + 1] - '1';  // rank (0-indexed)
         // The capturing pawn must be on the same rank as the pawn that double-pushed,
         // i.e., one rank "behind" the ep target from the capturing side's perspective.
         // If white to move, ep target is on rank 5 (epX=5), capturing pawn on rank 4.
@@ -1875,10 +1695,11 @@ std::string ChessGame::positionKey() const {
             }
         }
         if (!hasLegalEp) {
-            key = key.substr(0, epStart) + "-";
+            fen[epStart] = '-';
+            key = key.substr(0, epStart + 1);
         }
     }
-    return key;
+    return std::string(key);
 }
 
 // O(n) scan over full history. Could be improved by only scanning back
@@ -1896,16 +1717,15 @@ int ChessGame::positionCount() const {
 
 bool ChessGame::canClaimDraw() const {
     // Per SPEC 4.5: checkmate and stalemate have priority over claimable draws.
-    // Only the side to move can be in checkmate or stalemate.
-    if (checkmate(whiteTurn) || stalemate(whiteTurn)) return false;
-    return halfmoveClock >= 100 || positionCount() >= 3;
+    // Only the side to move can be in checkmate or stalemate, and either way
+    // it has no legal move; that is only looked for once a draw is due.
+    return (halfmoveClock >= 100 || positionCount() >= 3) && hasLegalMove(whiteTurn);
 }
 
 bool ChessGame::isAutomaticDraw() const {
     // Per SPEC 4.5: checkmate and stalemate have priority over automatic draws.
     // Only the side to move can be in checkmate or stalemate.
-    if (checkmate(whiteTurn) || stalemate(whiteTurn)) return false;
-    return halfmoveClock >= 150 || positionCount() >= 5;
+    return (halfmoveClock >= 150 || positionCount() >= 5) && hasLegalMove(whiteTurn);
 }
 
 bool ChessGame::insufficientMaterial() const {
@@ -1958,96 +1778,125 @@ bool ChessGame::insufficientMaterial() const {
 }
 
 std::string ChessGame::toJson() const {
-    std::string json = "{";
+    std::string json;
+    appendJson(json);
+    return json;
+}
+
+uint32_t ChessGame::stateField(const std::string& key) {
+    static const std::pair<const char*, uint32_t> kFields[] = {
+        {"fen", STATE_FEN},
+        {"turn", STATE_TURN},
+        {"board", STATE_BOARD},
+        {"legalMoves", STATE_LEGAL_MOVES},
+        {"inCheck", STATE_IN_CHECK},
+        {"isCheckmate", STATE_IS_CHECKMATE},
+        {"isStalemate", STATE_IS_STALEMATE},
+        {"canClaimDraw", STATE_CAN_CLAIM_DRAW},
+        {"isAutomaticDraw", STATE_IS_AUTOMATIC_DRAW},
+        {"halfmoveClock", STATE_HALFMOVE_CLOCK},
+        {"fullmoveNumber", STATE_FULLMOVE_NUMBER},
+        {"moveHistory", STATE_MOVE_HISTORY},
+    };
+    for (const auto& [name, field] : kFields) {
+        if (key == name) return field;
+    }
+    return 0;
+}
+
+void ChessGame::appendJson(std::string& json, uint32_t fields) const {
+    DocumentWriter w(json, Encoding::Json);
+    w.beginObject();
+    writeState(w, fields);
+    w.endObject();
+}
+
+void ChessGame::writeState(DocumentWriter& w, uint32_t fields) const {
+    // Written straight to the writer; no temporaries beyond the move strings.
+    auto writeMoves = [&](const char* key, const std::vector<ChessMove>& moves) {
+        w.key(key);
+        w.beginArray();
+        for (const ChessMove& m : moves) w.string(m.toString());
+        w.endArray();
+    };
 
-    // fen
-    json += "\"fen\":\"" + toFen() + "\"";
+    if (fields & STATE_FEN) {
+        char fen[FEN_BUFFER_SIZE];
+        w.key("fen");
+        w.string(std::string_view(fen, writeFen(fen)));
+    }
 
-    // turn
-    json += ",\"turn\":\"";
-    json += whiteTurn ? "white" : "black";
-    json += "\"";
+    if (fields & STATE_TURN) {
+        w.key("turn");
+        w.string(whiteTurn ? "white" : "black");
+    }
 
     // board: 8x8 array, rank 8 (x=7) to rank 1 (x=0)
-    json += ",\"board\":[";
-    for (int x = 7; x >= 0; x--) {
-        json += "[";
-        for (int y = 0; y < 8; y++) {
-            const ChessPiece* p = board.getPiece(x, y);
-            if (p == nullptr) {
-                json += "null";
-            } else {
-                json += "{\"type\":\"";
+    if (fields & STATE_BOARD) {
+        w.key("board");
+        w.beginArray();
+        for (int x = 7; x >= 0; x--) {
+            w.beginArray();
+            for (int y = 0; y < 8; y++) {
+                const ChessPiece* p = board.getPiece(x, y);
+                if (p == nullptr) {
+                    w.null();
+                    continue;
+                }
+                w.beginObject();
+                w.key("type");
                 switch (p->getType()) {
-                    case PAWN: json += "pawn"; break;
-                    case ROOK: json += "rook"; break;
-                    case KNIGHT: json += "knight"; break;
-                    case BISHOP: json += "bishop"; break;
-                    case QUEEN: json += "queen"; break;
-                    case KING: json += "king"; break;
+                    case PAWN: w.string("pawn"); break;
+                    case ROOK: w.string("rook"); break;
+                    case KNIGHT: w.string("knight"); break;
+                    case BISHOP: w.string("bishop"); break;
+                    case QUEEN: w.string("queen"); break;
+                    case KING: w.string("king"); break;
                 }
-                json += "\",\"color\":\"";
-                json += p->getWhite() ? "white" : "black";
-                json += "\"}";
+                w.key("color");
+                w.string(p->getWhite() ? "white" : "black");
+                w.endObject();
             }
-            if (y < 7) json += ",";
+            w.endArray();
         }
-        json += "]";
-        if (x > 0) json += ",";
+        w.endArray();
     }
-    json += "]";
 
-    // legalMoves
+    // legalMoves; generated once and reused for the mate/stalemate flags.
+    // The flags alone only need to know whether there is a move at all.
     bool currentTurn = whiteTurn;
-    std::vector<ChessMove> moves = getMoves(currentTurn);
-    json += ",\"legalMoves\":[";
-    for (size_t i = 0; i < moves.size(); i++) {
-        json += "\"";
-        json += moves[i].toString();
-        json += "\"";
-        if (i + 1 < moves.size()) json += ",";
+    bool anyMove = false;
+    if (fields & STATE_LEGAL_MOVES) {
+        std::vector<ChessMove> moves = getMoves(currentTurn);
+        anyMove = !moves.empty();
+        writeMoves("legalMoves", moves);
+    } else if (fields & (STATE_IS_CHECKMATE | STATE_IS_STALEMATE)) {
+        anyMove = hasLegalMove(currentTurn);
     }
-    json += "]";
-
-    // inCheck
-    bool inChk = board.checkCheck(currentTurn);
-    json += ",\"inCheck\":";
-    json += inChk ? "true" : "false";
-
-    // isCheckmate
-    json += ",\"isCheckmate\":";
-    json += checkmate(currentTurn) ? "true" : "false";
-
-    // isStalemate
-    json += ",\"isStalemate\":";
-    json += stalemate(currentTurn) ? "true" : "false";
-
-    // canClaimDraw
-    json += ",\"canClaimDraw\":";
-    json += canClaimDraw() ? "true" : "false";
-
-    // isAutomaticDraw
-    json += ",\"isAutomaticDraw\":";
-    json += isAutomaticDraw() ? "true" : "false";
-
-    // halfmoveClock
-    json += ",\"halfmoveClock\":" + std::to_string(halfmoveClock);
-
-    // fullmoveNumber
-    json += ",\"fullmoveNumber\":" + std::to_string(1 + static_cast<int>(history.size()) / 2);
-
-    // moveHistory
-    json += ",\"moveHistory\":[";
-    for (size_t i = 0; i < history.size(); i++) {
-        json += "\"";
-        json += history[i].toString();
-        json += "\"";
-        if (i + 1 < history.size()) json += ",";
+
+    auto writeBool = [&](const char* key, bool value) {
+        w.key(key);
+        w.boolean(value);
+    };
+    if (fields & (STATE_IN_CHECK | STATE_IS_CHECKMATE | STATE_IS_STALEMATE)) {
+        bool inChk = board.checkCheck(currentTurn);
+        if (fields & STATE_IN_CHECK) writeBool("inCheck", inChk);
+        if (fields & STATE_IS_CHECKMATE) writeBool("isCheckmate", inChk && !anyMove);
+        if (fields & STATE_IS_STALEMATE) writeBool("isStalemate", !inChk && !anyMove);
     }
-    json += "]";
+    if (fields & STATE_CAN_CLAIM_DRAW) writeBool("canClaimDraw", canClaimDraw());
+    if (fields & STATE_IS_AUTOMATIC_DRAW) writeBool("isAutomaticDraw", isAutomaticDraw());
 
-    json += "}";
-    return json;
+    if (fields & STATE_HALFMOVE_CLOCK) {
+        w.key("halfmoveClock");
+        w.number(static_cast<int64_t>(halfmoveClock));
+    }
+    if (fields & STATE_FULLMOVE_NUMBER) {
+        w.key("fullmoveNumber");
+        w.number(static_cast<int64_t>(1 + history.size() / 2));
+    }
+
+    if (fields & STATE_MOVE_HISTORY) writeMoves("moveHistory", history);
 }
 
 ChessBoard& ChessGame::getPieceBoard() { return board; }
@@ -12,8 +12,10 @@
 
 #include <cstdint>
 #include <cstring>
+#include <iterator>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 ///////////
@@ -35,6 +37,7 @@ class Queen;
 class ChessBoard;
 class ChessMove;
 class ChessGame;
+class DocumentWriter;  // encoding.h
 
 // Board coordinate convention:
 //   x = row  (0 = white back rank, 7 = black back rank)
@@ -43,6 +46,54 @@ class ChessGame;
 
 enum PieceType { PAWN, ROOK, KNIGHT, BISHOP, KING, QUEEN };
 
+// Members of the toJson() state object, for selecting a subset with
+// ChessGame::appendJson(). Values combine with |.
+enum StateField : uint32_t {
+    STATE_FEN = 1 << 0,
+    STATE_TURN = 1 << 1,
+    STATE_BOARD = 1 << 2,
+    STATE_LEGAL_MOVES = 1 << 3,
+    STATE_IN_CHECK = 1 << 4,
+    STATE_IS_CHECKMATE = 1 << 5,
+    STATE_IS_STALEMATE = 1 << 6,
+    STATE_CAN_CLAIM_DRAW = 1 << 7,
+    STATE_IS_AUTOMATIC_DRAW = 1 << 8,
+    STATE_HALFMOVE_CLOCK = 1 << 9,
+    STATE_FULLMOVE_NUMBER = 1 << 10,
+    STATE_MOVE_HISTORY = 1 << 11,
+    STATE_ALL = (1 << 12) - 1,
+};
+
+// Why a FEN was rejected by ChessGame::fromFen() or parseFen().
+enum class FenError : uint8_t {
+    None,
+    FieldCount,      // not exactly six fields
+    Placement,       // malformed piece placement
+    SideToMove,
+    Castling,        // not "-" or a subset of "KQkq" in that order
+    EnPassant,       // not "-" or a third/sixth rank square matching the side to move
+    HalfmoveClock,
+    FullmoveNumber,
+    KingCount,       // not exactly one king per side
+    PieceCount,      // more than 16 pieces or 8 pawns for a side
+    PawnOnBackRank,
+    AdjacentKings,
+    OpponentInCheck,  // the side not to move is in check
+};
+
+/** A short description of error, e.g. "kings are adjacent". */
+const char* fenErrorMessage(FenError error);
+
+// Room for the longest FEN ChessGame::writeFen() and writeFen() produce.
+constexpr size_t FEN_BUFFER_SIZE = 128;
+
+// A square a piece might move to, with the promotion piece (PAWN for none).
+struct MoveTarget {
+    int x;
+    int y;
+    PieceType promo = PAWN;
+};
+
 ///////////////////////
 // CLASS HEADERS IN FULL
 
@@ -95,9 +146,18 @@ class ChessPiece  // ADT
     virtual bool canMove(int x, int y, bool chkchk = true) const = 0;
 
     /**
-     * Returns all legal moves for this piece as a vector.
+     * Returns all legal moves for this piece as a vector: each target(i)
+     * that canMove() accepts, in order.
+     */
+    std::vector<ChessMove> getMoves() const;
+
+    /**
+     * The i-th square this piece might move to, for i below targetCount();
+     * possibly off the board. canMove() decides whether the move is legal,
+     * so LegalMoves can test one candidate at a time.
      */
-    virtual std::vector<ChessMove> getMoves() const = 0;
+    virtual int targetCount() const = 0;
+    virtual MoveTarget target(int i) const = 0;
     virtual bool move(int x, int y);
     virtual PieceType getType() const = 0;
 
@@ -130,8 +190,10 @@ class Pawn : public ChessPiece {
     Pawn(bool isW, bool isKS, ChessBoard& b, int i);
     ~Pawn() override;
     bool canMove(int x, int y, bool chkchk = true) const override;
-    std::vector<ChessMove> getMoves() const override;
+    int targetCount() const override;
+    MoveTarget target(int i) const override;
     bool getMoved() const;
+    void setMoved(bool moved);
     bool getEnPassant() const;
     void setEnPassant(bool b);
     bool move(int x, int y) override;
@@ -147,8 +209,10 @@ class Rook : public ChessPiece {
     Rook(bool isW, bool isKS, ChessBoard& b, int i = 0);
     ~Rook() override;
     bool canMove(int x, int y, bool chkchk = true) const override;
-    std::vector<ChessMove> getMoves() const override;
+    int targetCount() const override;
+    MoveTarget target(int i) const override;
     bool getMoved() const;
+    void setMoved(bool moved);
     bool move(int x, int y) override;
     void markMoved();
     PieceType getType() const override;
@@ -162,7 +226,8 @@ class Knight : public ChessPiece {
     Knight(bool isW, bool isKS, ChessBoard& b, int i = 0);
     ~Knight() override;
     bool canMove(int x, int y, bool chkchk = true) const override;
-    std::vector<ChessMove> getMoves() const override;
+    int targetCount() const override;
+    MoveTarget target(int i) const override;
     PieceType getType() const override;
     const static int xOffsets[8];
     const static int yOffsets[8];
@@ -173,7 +238,8 @@ class Bishop : public ChessPiece {
     Bishop(bool isW, bool isKS, ChessBoard& b, int i = 0);
     ~Bishop() override;
     bool canMove(int x, int y, bool chkchk = true) const override;
-    std::vector<ChessMove> getMoves() const override;
+    int targetCount() const override;
+    MoveTarget target(int i) const override;
     PieceType getType() const override;
 };
 
@@ -182,8 +248,10 @@ class King : public ChessPiece {
     King(bool isW, ChessBoard& b);
     ~King() override;
     bool canMove(int x, int y, bool chkchk = true) const override;
-    std::vector<ChessMove> getMoves() const override;
+    int targetCount() const override;
+    MoveTarget target(int i) const override;
     bool getMoved() const;
+    void setMoved(bool moved);
     void markMoved();
     bool move(int x, int y) override;
     bool inCheck() const;
@@ -200,7 +268,8 @@ class Queen : public ChessPiece {
     Queen(bool isW, ChessBoard& b, int i = 0, bool isKS = false);
     ~Queen() override;
     bool canMove(int x, int y, bool chkchk = true) const override;
-    std::vector<ChessMove> getMoves() const override;
+    int targetCount() const override;
+    MoveTarget target(int i) const override;
     PieceType getType() const override;
 };
 
@@ -236,6 +305,9 @@ class ChessBoard {
     friend class ChessGame;
 
    private:
+    struct Empty {};
+    /** A board with no pieces, for ChessGame::fromFen() to fill in. */
+    explicit ChessBoard(Empty);
     bool castlingRights[2][2] = {{true, true}, {true, true}};  // [white/black][kingside/queenside]
     void clearCastlingRight(bool isWhite, bool isKingSide);
     std::unique_ptr<ChessPiece> grid[8][8];
@@ -294,6 +366,46 @@ class ChessMove {
     char repr[8];
 };
 
+/**
+ * A side's legal moves, produced one at a time in ChessGame::getMoves()
+ * order. Each step tests candidates with canMove() only up to the next
+ * legal move, so a caller that stops early pays for the moves it looked at
+ * and no more. The board must not change while a range is being walked.
+ */
+class LegalMoves {
+   public:
+    class iterator {
+       public:
+        using value_type = ChessMove;
+        using difference_type = std::ptrdiff_t;
+
+        ChessMove operator*() const;
+        iterator& operator++();
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const { return square == 64; }
+
+       private:
+        friend class LegalMoves;
+        iterator(const ChessBoard& board, bool white);
+        void seek();  // advances to the next legal move
+
+        const ChessBoard* board;
+        bool white;
+        int square = -1;  // x * 8 + y of the piece being walked; 64 at the end
+        const ChessPiece* piece = nullptr;
+        int index = -1;  // its current target
+        int count = 0;   // its targetCount()
+    };
+
+    LegalMoves(const ChessBoard& board, bool white) : board(board), white(white) {}
+    iterator begin() const { return iterator(board, white); }
+    std::default_sentinel_t end() const { return {}; }
+
+   private:
+    const ChessBoard& board;
+    bool white;
+};
+
 /**
  * Top-level game controller. Enforces turn order, manages en passant
  * expiry after each move, and detects checkmate/stalemate.
@@ -323,8 +435,31 @@ class ChessGame {
     bool stalemate(bool turn) const;
 
     std::vector<ChessMove> getMoves(bool white) const;
+    /** The side's legal moves, generated lazily as the range is walked. */
+    LegalMoves legalMoves(bool white) const;
+    /** True if the side has a legal move; stops at the first one. */
+    bool hasLegalMove(bool white) const;
+    /** The number of legal moves the side has, without building a list. */
+    int countLegalMoves(bool white) const;
+    /**
+     * Total legal moves produced on the calling thread by getMoves(bool),
+     * hasLegalMove() and countLegalMoves(), and by Position's
+     * generateLegal() and hasLegalMove().
+     */
+    static uint64_t legalMovesGenerated();
+    /** Adds to the calling thread's legalMovesGenerated(); for Position. */
+    static void addLegalMovesGenerated(uint64_t moves);
 
     bool makeMove(const ChessMove& cm);
+    /**
+     * Takes back the last move made with rules on, restoring the board,
+     * castling and en passant rights, halfmove clock and repetition history
+     * exactly. O(1): each move keeps an undo record. Returns false if there
+     * is nothing to undo (moves before a fromFen() position cannot be).
+     */
+    bool undoMove();
+    /** Number of moves undoMove() can take back. */
+    size_t undoableMoves() const;
 
     const char* getBoard();
     const ChessPiece* getPiece(int x, int y) const;
@@ -333,9 +468,20 @@ class ChessGame {
     bool getTurn() const;
 
     const std::vector<ChessMove>& getHistory() const;
+    /** FEN of the position the game started from (the initial position unless set up by fromFen). */
+    std::string getStartFen() const;
 
     std::string toFen() const;
-    static std::unique_ptr<ChessGame> fromFen(const std::string& fen);
+    /**
+     * Writes the FEN into buf, which must hold FEN_BUFFER_SIZE chars, and
+     * returns its length (no terminating NUL). Allocates nothing.
+     */
+    size_t writeFen(char* buf) const;
+    /**
+     * Sets up a game from a FEN, validated in one pass by parseFen(). Returns
+     * nullptr on failure, with the reason in *error when error is given.
+     */
+    static std::unique_ptr<ChessGame> fromFen(std::string_view fen, FenError* error = nullptr);
 
     bool canClaimDraw() const;
     bool isAutomaticDraw() const;
@@ -343,13 +489,48 @@ class ChessGame {
 
     /** Returns a JSON string representing the full game state. */
     std::string toJson() const;
+    /**
+     * Appends the toJson() object to out, so callers can reuse one buffer.
+     * Only the StateField members in fields are computed and written, in
+     * their usual order; moves are generated in full only for legalMoves,
+     * and the checkmate/stalemate flags stop at the first legal move.
+     */
+    void appendJson(std::string& out, uint32_t fields = STATE_ALL) const;
+    /**
+     * Writes the members of the toJson() object, selected as for
+     * appendJson(), into the object w has open, in w's encoding.
+     */
+    void writeState(DocumentWriter& w, uint32_t fields = STATE_ALL) const;
+    /** The StateField for a toJson() key such as "legalMoves"; 0 if unknown. */
+    static uint32_t stateField(const std::string& key);
 
-    ChessMove parseSan(const std::string& san) const;
+    /**
+     * Reads SAN as parseSan() in position.h does, on a Position built from
+     * the game; ChessMove::end if it is not one legal move here.
+     */
+    ChessMove parseSan(std::string_view san) const;
+    /**
+     * Parses SAN, falling back to LAN ("e2e4", "e7e8q", "e2-e4"). Returns
+     * ChessMove::end if neither form matches; LAN legality is left to
+     * makeMove().
+     */
+    ChessMove parseMove(const std::string& text) const;
+    /** The LAN half of parseMove(), for callers that have tried SAN already. */
+    static ChessMove parseLan(const std::string& text);
     std::string toSan(const ChessMove& move) const;
-    static std::string normalizeSan(const std::string& san);
+    static std::string normalizeSan(std::string_view san);
 
     ChessBoard& getPieceBoard();
 
+    /**
+     * Changes whenever a move is made or a piece is set. Versions come from
+     * one process-wide counter, so they only ever increase, even across
+     * games replaced by a new one.
+     */
+    uint64_t getStateVersion() const;
+    /** Restores the version of a game rebuilt from storage. */
+    void setStateVersion(uint64_t version);
+
    private:
     bool rulesOn;
     bool whiteTurn;
@@ -357,12 +538,38 @@ class ChessGame {
     int whiteProms = 0;
     int blackProms = 0;
     int halfmoveClock = 0;
+    uint64_t stateVersion = 0;
+    std::string startFen;  // empty = standard initial position
     std::vector<ChessMove> history;
     std::vector<std::string> positionHistory;  // FEN position keys (first 4 fields)
+
+    // What makeMove() changed beyond the history, so undoMove() can revert it.
+    struct UndoRecord {
+        int8_t capturedType = -1;  // PieceType of the captured piece; -1 if none
+        int8_t capturedX = 0, capturedY = 0;  // differs from the destination for en passant
+        bool capturedWhite = false;
+        bool capturedKingSide = false;
+        int capturedIndex = 0;
+        bool capturedMoved = false;
+        bool capturedEnPassant = false;
+        bool moverMoved = false;  // hasMoved of a moving pawn, rook or king
+        bool moverEnPassant = false;
+        bool rookMoved = false;   // hasMoved of the rook in a castling move
+        std::unique_ptr<ChessPiece> promotedPawn;
+        bool castlingRights[2][2];
+        int halfmoveClock = 0;
+        uint64_t clearedEnPassant = 0;  // squares (x * 8 + y) of pawns whose flag expired
+    };
+    std::vector<UndoRecord> undoRecords;
     std::unique_ptr<ChessPiece> makePiece(PieceType type, bool white, int y);
 
+    struct EmptyBoard {};
+    /** A game on an empty board with no position history, for fromFen(). */
+    explicit ChessGame(EmptyBoard);
+
     std::string positionKey() const;
     int positionCount() const;
+    void bumpStateVersion();
 };
 
 #endif  // def _CHESS_H
@@ -0,0 +1,262 @@
+// Streaming document writer: JSON text, CBOR and MessagePack.
+
+#include "encoding.h"
+
+#include <charconv>
+
+namespace {
+
+void appendBigEndian(std::string& out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) out += static_cast<char>(value >> (8 * i));
+}
+
+// A CBOR initial byte for the major type, with its argument.
+void appendHead(std::string& out, uint8_t major, uint64_t value) {
+    uint8_t type = static_cast<uint8_t>(major << 5);
+    if (value < 24) {
+        out += static_cast<char>(type | value);
+    } else if (value <= 0xff) {
+        out += static_cast<char>(type | 24);
+        appendBigEndian(out, value, 1);
+    } else if (value <= 0xffff) {
+        out += static_cast<char>(type | 25);
+        appendBigEndian(out, value, 2);
+    } else if (value <= 0xffffffff) {
+        out += static_cast<char>(type | 26);
+        appendBigEndian(out, value, 4);
+    } else {
+        out += static_cast<char>(type | 27);
+        appendBigEndian(out, value, 8);
+    }
+}
+
+}  // namespace
+
+// Called before every value: separates array elements in JSON text and
+// counts them toward the enclosing array's header in the binary encodings.
+void DocumentWriter::beginValue() {
+    if (encoding == Encoding::Json) {
+        if (needComma) out += ',';
+        needComma = true;
+    } else if (!open.empty() && !open.back().object) {
+        open.back().count++;
+    }
+}
+
+void DocumentWriter::beginContainer(bool object) {
+    beginValue();
+    if (encoding == Encoding::Json) {
+        out += object ? '{' : '[';
+        needComma = false;
+        return;
+    }
+    open.push_back({out.size(), 0, object});
+    out += '\0';  // header, written by endContainer()
+}
+
+void DocumentWriter::endContainer() {
+    Container c = open.back();
+    open.pop_back();
+    std::string header;
+    if (encoding == Encoding::Cbor) {
+        appendHead(header, c.object ? 5 : 4, c.count);
+    } else if (c.count < 16) {
+        header += static_cast<char>((c.object ? 0x80 : 0x90) | c.count);
+    } else if (c.count <= 0xffff) {
+        header += static_cast<char>(c.object ? 0xde : 0xdc);
+        appendBigEndian(header, c.count, 2);
+    } else {
+        header += static_cast<char>(c.object ? 0xdf : 0xdd);
+        appendBigEndian(header, c.count, 4);
+    }
+    out[c.header] = header[0];
+    if (header.size() > 1) out.insert(c.header + 1, header, 1);
+}
+
+void DocumentWriter::beginObject() {
+    beginContainer(true);
+}
+
+void DocumentWriter::endObject() {
+    if (encoding == Encoding::Json) {
+        out += '}';
+        needComma = true;
+        return;
+    }
+    endContainer();
+}
+
+void DocumentWriter::beginArray() {
+    beginContainer(false);
+}
+
+void DocumentWriter::endArray() {
+    if (encoding == Encoding::Json) {
+        out += ']';
+        needComma = true;
+        return;
+    }
+    endContainer();
+}
+
+void DocumentWriter::key(std::string_view name) {
+    if (encoding == Encoding::Json) {
+        beginValue();
+        appendString(name);
+        out += ':';
+        needComma = false;
+        return;
+    }
+    open.back().count++;  // objects count members at their key
+    appendString(name);
+}
+
+void DocumentWriter::string(std::string_view value) {
+    beginValue();
+    appendString(value);
+}
+
+void DocumentWriter::appendString(std::string_view value) {
+    switch (encoding) {
+        case Encoding::Json: {
+            static const char kHex[] = "0123456789abcdef";
+            out += '"';
+            for (char c : value) {
+                switch (c) {
+                    case '"': out += "\\\""; break;
+                    case '\\': out += "\\\\"; break;
+                    case '\n': out += "\\n"; break;
+                    case '\r': out += "\\r"; break;
+                    case '\t': out += "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            out += "\\u00";
+                            out += kHex[(c >> 4) & 0xf];
+                            out += kHex[c & 0xf];
+                        } else {
+                            out += c;
+                        }
+                }
+            }
+            out += '"';
+            return;
+        }
+        case Encoding::Cbor:
+            appendHead(out, 3, value.size());
+            break;
+        case Encoding::MsgPack:
+            if (value.size() < 32) {
+                out += static_cast<char>(0xa0 | value.size());
+            } else if (value.size() <= 0xff) {
+                out += '\xd9';
+                appendBigEndian(out, value.size(), 1);
+            } else if (value.size() <= 0xffff) {
+                out += '\xda';
+                appendBigEndian(out, value.size(), 2);
+            } else {
+                out += '\xdb';
+                appendBigEndian(out, value.size(), 4);
+            }
+            break;
+    }
+    out += value;
+}
+
+void DocumentWriter::boolean(bool value) {
+    beginValue();
+    switch (encoding) {
+        case Encoding::Json: out += value ? "true" : "false"; break;
+        case Encoding::Cbor: out += value ? '\xf5' : '\xf4'; break;
+        case Encoding::MsgPack: out += value ? '\xc3' : '\xc2'; break;
+    }
+}
+
+void DocumentWriter::number(uint64_t value) {
+    beginValue();
+    switch (encoding) {
+        case Encoding::Json: {
+            char buf[24];
+            auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+            out.append(buf, end);
+            break;
+        }
+        case Encoding::Cbor:
+            appendHead(out, 0, value);
+            break;
+        case Encoding::MsgPack:
+            if (value < 128) {
+                out += static_cast<char>(value);
+            } else if (value <= 0xff) {
+                out += '\xcc';
+                appendBigEndian(out, value, 1);
+            } else if (value <= 0xffff) {
+                out += '\xcd';
+                appendBigEndian(out, value, 2);
+            } else if (value <= 0xffffffff) {
+                out += '\xce';
+                appendBigEndian(out, value, 4);
+            } else {
+                out += '\xcf';
+                appendBigEndian(out, value, 8);
+            }
+            break;
+    }
+}
+
+void DocumentWriter::number(int64_t value) {
+    if (value >= 0) return number(static_cast<uint64_t>(value));
+    beginValue();
+    switch (encoding) {
+        case Encoding::Json: {
+            char buf[24];
+            auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+            out.append(buf, end);
+            break;
+        }
+        case Encoding::Cbor:
+            appendHead(out, 1, static_cast<uint64_t>(-(value + 1)));
+            break;
+        case Encoding::MsgPack:
+            if (value >= -32) {
+                out += static_cast<char>(value);
+            } else if (value >= INT8_MIN) {
+                out += '\xd0';
+                appendBigEndian(out, static_cast<uint64_t>(value), 1);
+            } else if (value >= INT16_MIN) {
+                out += '\xd1';
+                appendBigEndian(out, static_cast<uint64_t>(value), 2);
+            } else if (value >= INT32_MIN) {
+                out += '\xd2';
+                appendBigEndian(out, static_cast<uint64_t>(value), 4);
+            } else {
+                out += '\xd3';
+                appendBigEndian(out, static_cast<uint64_t>(value), 8);
+            }
+            break;
+    }
+}
+
+void DocumentWriter::null() {
+    beginValue();
+    switch (encoding) {
+        case Encoding::Json: out += "null"; break;
+        case Encoding::Cbor: out += '\xf6'; break;
+        case Encoding::MsgPack: out += '\xc0'; break;
+    }
+}
+
+void DocumentWriter::raw(std::string_view encoded) {
+    beginValue();
+    out += encoded;
+}
+
+DocumentWriter::Mark DocumentWriter::mark() const {
+    return {out.size(), open.size(), open.empty() ? 0 : open.back().count, needComma};
+}
+
+void DocumentWriter::rewind(const Mark& m) {
+    out.resize(m.size);
+    open.resize(m.depth);
+    if (!open.empty()) open.back().count = m.count;
+    needComma = m.needComma;
+}
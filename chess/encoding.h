@@ -0,0 +1,80 @@
+// Streaming writer for JSON-shaped documents: JSON text, CBOR or MessagePack.
+
+#ifndef CHESS_ENCODING_H
+#define CHESS_ENCODING_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** How a document is encoded on the wire. */
+enum class Encoding {
+    Json,     // JSON text
+    Cbor,     // RFC 8949 CBOR
+    MsgPack,  // MessagePack
+};
+
+/**
+ * Appends one document to a buffer as it is described, in any Encoding, so
+ * a response is serialized once in the form the client asked for, with no
+ * DOM and no text round trip.
+ *
+ * Objects are written as alternating key() and value calls between
+ * beginObject() and endObject(). The binary encodings put the member count
+ * before the members: a container gets a one-byte header when opened, and
+ * endObject()/endArray() fill it in, widening it when the count does not
+ * fit. Output is the shortest form, as nlohmann::json would write.
+ */
+class DocumentWriter {
+   public:
+    DocumentWriter(std::string& out, Encoding encoding) : out(out), encoding(encoding) {}
+
+    Encoding getEncoding() const { return encoding; }
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void key(std::string_view name);
+    void string(std::string_view value);
+    void boolean(bool value);
+    void number(int64_t value);
+    void number(uint64_t value);
+    void null();
+    /** A complete value already encoded in this writer's encoding. */
+    void raw(std::string_view encoded);
+
+    /**
+     * Where the writer is; rewind() drops everything written since, e.g. a
+     * half-written response that turns into an error.
+     */
+    struct Mark {
+        size_t size;
+        size_t depth;
+        uint32_t count;
+        bool needComma;
+    };
+    Mark mark() const;
+    void rewind(const Mark& m);
+
+   private:
+    struct Container {
+        size_t header;  // offset of its header byte in out
+        uint32_t count;
+        bool object;
+    };
+
+    void beginValue();
+    void beginContainer(bool object);
+    void endContainer();
+    void appendString(std::string_view value);  // no separator, not counted
+
+    std::string& out;
+    Encoding encoding;
+    std::vector<Container> open;
+    bool needComma = false;  // JSON text only
+};
+
+#endif  // CHESS_ENCODING_H
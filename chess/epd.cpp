@@ -0,0 +1,267 @@
+// EPD parsing and test-suite runs.
+
+#include "epd.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "search.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+bool isDigits(std::string_view s) {
+    return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+template <typename T>
+bool parseNumber(std::string_view s, T& out) {
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+std::string_view trim(std::string_view s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) return {};
+    return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+}
+
+/** The next whitespace-separated token of s, removed from s; quotes group. */
+std::string_view nextOperand(std::string_view& s) {
+    s = trim(s);
+    if (s.empty()) return {};
+    size_t end;
+    if (s[0] == '"') {
+        end = s.find('"', 1);
+        end = end == std::string_view::npos ? s.size() : end + 1;
+    } else {
+        end = std::min(s.find_first_of(" \t"), s.size());
+    }
+    std::string_view token = s.substr(0, end);
+    s.remove_prefix(end);
+    return token;
+}
+
+std::string_view unquote(std::string_view s) {
+    if (s.size() >= 2 && s.front() == '"' && s.back() == '"') return s.substr(1, s.size() - 2);
+    return s;
+}
+
+bool parseMoves(Position& pos, std::string_view operands, std::vector<PosMove>& out,
+                std::string_view opcode, std::string& error) {
+    SanMoveTable table(pos);
+    for (std::string_view san; !(san = nextOperand(operands)).empty();) {
+        std::string_view bare = san;
+        while (!bare.empty() && (bare.back() == '!' || bare.back() == '?')) bare.remove_suffix(1);
+        PosMove m;
+        if (!parseSan(pos, table, bare, m)) {
+            error = std::string(opcode) + ": illegal or invalid move " + std::string(san);
+            return false;
+        }
+        out.push_back(m);
+    }
+    if (out.empty()) {
+        error = std::string(opcode) + ": no moves";
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool readEpdPosition(std::string_view line, Position& pos, std::string_view& operations,
+                     std::string& error) {
+    std::string_view fields[6];
+    int n = 0;
+    size_t i = 0;
+    while (n < 6) {
+        i = line.find_first_not_of(" \t\r", i);
+        if (i == std::string_view::npos) break;
+        size_t end = std::min(line.find_first_of(" \t\r;", i), line.size());
+        if (end == i) break;  // an operation starts here
+        fields[n++] = line.substr(i, end - i);
+        i = end;
+    }
+    if (n < 4) {
+        error = "invalid FEN";
+        return false;
+    }
+    // Six fields ending in two numbers are a FEN; anything else after the
+    // first four is EPD operations.
+    char fen[FEN_BUFFER_SIZE];
+    size_t length = 0;
+    int used = n == 6 && isDigits(fields[4]) && isDigits(fields[5]) ? 6 : 4;
+    for (int f = 0; f < used; f++) {
+        if (length + fields[f].size() + 5 > sizeof(fen)) {
+            error = "invalid FEN";
+            return false;
+        }
+        std::memcpy(fen + length, fields[f].data(), fields[f].size());
+        length += fields[f].size();
+        fen[length++] = ' ';
+    }
+    if (used == 4) {
+        std::memcpy(fen + length, "0 1", 3);
+        length += 3;
+    } else {
+        length--;
+    }
+    const char* rest = fields[used - 1].data() + fields[used - 1].size();
+    operations = line.substr(rest - line.data());
+    FenError status = parseFen(std::string_view(fen, length), pos);
+    if (status != FenError::None) {
+        error = status == FenError::FieldCount ? "invalid FEN" : fenErrorMessage(status);
+        return false;
+    }
+    return true;
+}
+
+bool parseEpd(std::string_view line, EpdRecord& out, std::string& error) {
+    out = EpdRecord();
+    std::string_view operations;
+    if (!readEpdPosition(line, out.pos, operations, error)) return false;
+    while (!operations.empty()) {
+        // One operation runs to the next semicolon outside quotes.
+        size_t end = 0;
+        for (bool quoted = false; end < operations.size() && (quoted || operations[end] != ';');
+             end++) {
+            if (operations[end] == '"') quoted = !quoted;
+        }
+        std::string_view operands = operations.substr(0, end);
+        operations.remove_prefix(std::min(end + 1, operations.size()));
+        std::string_view opcode = nextOperand(operands);
+        if (opcode.empty()) continue;
+
+        if (opcode == "bm" || opcode == "am") {
+            if (!parseMoves(out.pos, operands, opcode == "bm" ? out.best : out.avoid, opcode,
+                            error)) {
+                return false;
+            }
+        } else if (opcode == "id") {
+            out.id = unquote(trim(operands));
+        } else if (opcode == "c0") {
+            out.comment = unquote(trim(operands));
+        } else if (opcode == "perft" || (opcode.size() >= 2 && opcode[0] == 'D' &&
+                                         isDigits(opcode.substr(1)))) {
+            EpdPerft p;
+            bool ok = opcode == "perft" ? parseNumber(nextOperand(operands), p.depth)
+                                        : parseNumber(opcode.substr(1), p.depth);
+            ok = ok && parseNumber(nextOperand(operands), p.nodes) && trim(operands).empty();
+            if (!ok || p.depth < 0) {
+                error = "invalid perft operation";
+                return false;
+            }
+            out.perft.push_back(p);
+        }
+    }
+    return true;
+}
+
+EpdSuiteReport runEpdSuite(const std::vector<EpdRecord>& records,
+                           const EpdSuiteOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    SearchLimits limits;
+    if (options.depth > 0) limits.depth = std::min(options.depth, MAX_PLY - 1);
+    limits.nodes = options.nodes;
+    limits.movetimeMs = options.movetimeMs;
+    limits.stop = options.stop;
+
+    EpdSuiteReport report;
+    report.results.resize(records.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < records.size();) {
+            if (options.stop != nullptr && options.stop->load()) return;
+            const EpdRecord& record = records[i];
+            EpdResult& result = report.results[i];
+            Position pos = record.pos;
+            bool ok = true;
+            if (!record.best.empty() || !record.avoid.empty()) {
+                SearchResult s = search(pos, limits);
+                auto played = [&s](const std::vector<PosMove>& moves) {
+                    return std::find(moves.begin(), moves.end(), s.best) != moves.end();
+                };
+                result.searched = true;
+                result.hasMove = s.hasMove;
+                result.move = s.best;
+                result.score = s.score;
+                result.depth = s.depth;
+                result.nodes = s.nodes;
+                ok = s.hasMove && (record.best.empty() || played(record.best)) &&
+                     !played(record.avoid);
+            }
+            for (const EpdPerft& p : record.perft) {
+                result.perftNodes.push_back(pos.perft(p.depth, options.stop));
+                ok = ok && result.perftNodes.back() == p.nodes;
+            }
+            result.passed = ok && record.tested() &&
+                            !(options.stop != nullptr && options.stop->load());
+        }
+    };
+    int threads = options.threads > 0 ? options.threads
+                                      : static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::clamp(threads, 1, std::max(static_cast<int>(records.size()), 1));
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const EpdResult& result = report.results[i];
+        if (records[i].tested()) report.tested++;
+        if (result.passed) report.passed++;
+        report.nodes += result.nodes;
+        for (uint64_t n : result.perftNodes) report.perftNodes += n;
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+json epdReportToJson(const std::vector<EpdRecord>& records, const EpdSuiteReport& report) {
+    json failures = json::array();
+    for (size_t i = 0; i < records.size(); i++) {
+        const EpdRecord& record = records[i];
+        const EpdResult& result = report.results[i];
+        if (result.passed || !record.tested()) continue;
+        Position pos = record.pos;
+        auto sanList = [&pos](const std::vector<PosMove>& moves) {
+            json list = json::array();
+            for (const PosMove& m : moves) list.push_back(sanOf(pos, m));
+            return list;
+        };
+        json failure = {{"index", i}, {"id", record.id}, {"fen", pos.toFen()}};
+        if (result.searched) {
+            failure["move"] = result.hasMove ? json(sanOf(pos, result.move)) : json();
+            failure["score"] = result.score;
+            failure["depth"] = result.depth;
+            if (!record.best.empty()) failure["expected"] = sanList(record.best);
+            if (!record.avoid.empty()) failure["avoid"] = sanList(record.avoid);
+        }
+        if (!record.perft.empty()) {
+            json perft = json::array();
+            for (size_t k = 0; k < record.perft.size(); k++) {
+                json entry = {{"depth", record.perft[k].depth},
+                              {"expected", record.perft[k].nodes}};
+                entry["nodes"] = k < result.perftNodes.size() ? json(result.perftNodes[k]) : json();
+                perft.push_back(entry);
+            }
+            failure["perft"] = perft;
+        }
+        failures.push_back(failure);
+    }
+    double passRate = report.tested > 0 ? static_cast<double>(report.passed) / report.tested : 0;
+    double nps = report.seconds > 0 ? report.nodes / report.seconds : 0;
+    return {{"positions", records.size()},
+            {"tested", report.tested},
+            {"passed", report.passed},
+            {"pass_rate", passRate},
+            {"seconds", report.seconds},
+            {"nodes", report.nodes},
+            {"nps", static_cast<uint64_t>(nps)},
+            {"perft_nodes", report.perftNodes},
+            {"failures", failures}};
+}
@@ -0,0 +1,100 @@
+// EPD records and test-suite runs. A suite is a list of positions with
+// opcodes saying what the engine should find: bm (best moves), am (moves to
+// avoid) or perft node counts. Running one gives a pass rate and the search
+// speed, to track strength and performance across builds.
+
+#ifndef CHESS_EPD_H
+#define CHESS_EPD_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "position.h"
+
+struct EpdPerft {
+    int depth = 0;
+    uint64_t nodes = 0;
+};
+
+struct EpdRecord {
+    Position pos;
+    std::string id;                // id opcode
+    std::string comment;           // c0 opcode
+    std::vector<PosMove> best;     // bm: any of these passes
+    std::vector<PosMove> avoid;    // am: none of these may be played
+    std::vector<EpdPerft> perft;   // "perft D N", or "DD N" as in perftsuite.epd
+
+    /** True when the record has something to check (bm, am or perft). */
+    bool tested() const { return !best.empty() || !avoid.empty() || !perft.empty(); }
+};
+
+/**
+ * Reads the position of a FEN, or of an EPD line (four fields, move
+ * counters reset), into pos and points operations at the rest of the line.
+ * The position is validated as parseFen() does. Returns false and sets
+ * error (fenErrorMessage(), or "invalid FEN" for too few fields) on
+ * failure.
+ */
+bool readEpdPosition(std::string_view line, Position& pos, std::string_view& operations,
+                     std::string& error);
+
+/**
+ * Parses an EPD line with its bm, am, id, c0 and perft operations; other
+ * opcodes are ignored. Moves are SAN, as parseSan() reads them, with any
+ * trailing "!" or "?" annotation dropped. Returns false and sets error if
+ * the position or an operation is invalid.
+ */
+bool parseEpd(std::string_view line, EpdRecord& out, std::string& error);
+
+struct EpdSuiteOptions {
+    uint64_t nodes = 200000;  // per-position node budget; 0 = unlimited
+    int movetimeMs = 0;       // per-position time budget; 0 = unlimited
+    int depth = 0;            // per-position depth limit; 0 = unlimited
+    int threads = 0;          // worker threads; 0 = one per hardware thread
+    const std::atomic<bool>* stop = nullptr;  // set to abandon the run early
+};
+
+struct EpdResult {
+    bool passed = false;  // every check of a tested record held
+    bool searched = false;  // searched for a bm or am check
+    bool hasMove = false;   // false when the position has no legal move
+    PosMove move;           // the search's choice, if hasMove
+    int score = 0;          // side to move's point of view
+    int depth = 0;
+    uint64_t nodes = 0;
+    std::vector<uint64_t> perftNodes;  // one per EpdRecord::perft entry
+};
+
+struct EpdSuiteReport {
+    std::vector<EpdResult> results;  // one per record, in order
+    uint64_t tested = 0;
+    uint64_t passed = 0;
+    uint64_t nodes = 0;        // searched, over all positions
+    uint64_t perftNodes = 0;   // perft leaves, over all positions
+    double seconds = 0;        // wall time of the whole run
+};
+
+/**
+ * Runs every record: a search with the per-position budget when it has bm
+ * or am, and its perft counts. Records are spread over a pool of worker
+ * threads, one search per thread, so wall time shrinks with the thread
+ * count while each search sees the same budget as a serial run would.
+ */
+EpdSuiteReport runEpdSuite(const std::vector<EpdRecord>& records,
+                           const EpdSuiteOptions& options);
+
+/**
+ * {"positions", "tested", "passed", "pass_rate", "seconds", "nodes", "nps",
+ *  "perft_nodes", "failures":[{"index", "id", "fen", "move", "expected",
+ *  "avoid", "perft"}]}, nps being searched nodes per second of wall time;
+ * "move" is null when the side to move had no legal move.
+ */
+nlohmann::json epdReportToJson(const std::vector<EpdRecord>& records,
+                               const EpdSuiteReport& report);
+
+#endif  // CHESS_EPD_H
@@ -0,0 +1,190 @@
+// Opening explorer builder and reader.
+
+#include "explorer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "keytable.h"
+
+namespace {
+
+const char magic[4] = {'C', 'H', 'E', 'X'};
+const uint32_t formatVersion = 1;
+
+using Entry = OpeningExplorer::Entry;
+static_assert(sizeof(Entry) == 24, "explorer entries are written as they are laid out");
+
+// A (position, move) pair while counting.
+struct EntryKey {
+    uint64_t key;
+    uint16_t move;
+
+    bool operator==(const EntryKey& o) const { return key == o.key && move == o.move; }
+};
+
+struct EntryKeyHash {
+    size_t operator()(const EntryKey& k) const {
+        // Zobrist keys are already uniform; the move only needs mixing in.
+        return static_cast<size_t>(k.key ^ (uint64_t{k.move} * 0x9E3779B97F4A7C15ULL));
+    }
+};
+
+struct Counts {
+    uint32_t white = 0, draws = 0, black = 0;
+};
+
+using CountMap = std::unordered_map<EntryKey, Counts, EntryKeyHash>;
+
+uint16_t moveCode(const PosMove& m) {
+    return static_cast<uint16_t>(m.from | m.to << 6 | m.promo << 12);
+}
+
+}  // namespace
+
+PosMove OpeningExplorer::Entry::toMove() const {
+    PosMove m;
+    m.from = move & 63;
+    m.to = move >> 6 & 63;
+    m.promo = static_cast<uint8_t>(move >> 12 & 7);
+    return m;
+}
+
+bool buildExplorer(std::string_view pgn, const std::string& path, int threads, int maxPly,
+                   std::string& error, ExplorerStats* stats) {
+    if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(threads, 1);
+    std::vector<std::string_view> parts = splitPgn(pgn, threads);
+    size_t shards = static_cast<size_t>(threads);
+
+    // Count: every parsing thread owns one map per shard.
+    struct Part {
+        std::vector<CountMap> shards;
+        uint64_t games = 0, skipped = 0;
+    };
+    std::vector<Part> parsed(parts.size());
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < parts.size(); t++) {
+        pool.emplace_back([&, t] {
+            Part& part = parsed[t];
+            part.shards.resize(shards);
+            PgnReader reader(parts[t]);
+            PgnGame game;
+            while (reader.next(game)) {
+                int outcome = -1;  // 0: White won, 1: drawn, 2: Black won
+                if (game.result == "1-0") outcome = 0;
+                if (game.result == "1/2-1/2") outcome = 1;
+                if (game.result == "0-1") outcome = 2;
+                if (!game.error.empty() || outcome < 0) {
+                    part.skipped++;
+                    continue;
+                }
+                part.games++;
+                Position pos = game.start;
+                size_t plies = game.moves.size();
+                if (maxPly > 0) plies = std::min(plies, static_cast<size_t>(maxPly));
+                for (size_t ply = 0; ply < plies; ply++) {
+                    const PosMove& m = game.moves[ply];
+                    Counts& c = part.shards[keyShard(pos.key, shards)][{pos.key, moveCode(m)}];
+                    (outcome == 0 ? c.white : outcome == 1 ? c.draws : c.black)++;
+                    pos.make(m);
+                }
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+    pool.clear();
+
+    uint64_t games = 0, skipped = 0;
+    for (const Part& part : parsed) {
+        games += part.games;
+        skipped += part.skipped;
+    }
+
+    // Merge: each shard sums its maps from every part and sorts the result.
+    std::vector<std::vector<Entry>> sorted(shards);
+    for (size_t s = 0; s < shards; s++) {
+        pool.emplace_back([&, s] {
+            CountMap merged;
+            for (size_t t = 0; t < parsed.size(); t++) {
+                for (const auto& [k, c] : parsed[t].shards[s]) {
+                    Counts& total = merged[k];
+                    total.white += c.white;
+                    total.draws += c.draws;
+                    total.black += c.black;
+                }
+                CountMap().swap(parsed[t].shards[s]);
+            }
+            std::vector<Entry>& out = sorted[s];
+            out.reserve(merged.size());
+            for (const auto& [k, c] : merged) {
+                out.push_back({k.key, k.move, 0, c.white, c.draws, c.black});
+            }
+            std::sort(out.begin(), out.end(), [](const Entry& a, const Entry& b) {
+                return a.key != b.key ? a.key < b.key : a.move < b.move;
+            });
+        });
+    }
+    for (auto& t : pool) t.join();
+
+    // Write: shards are already in key order.
+    BucketDirectory directory;
+    for (const auto& shard : sorted) {
+        for (const Entry& e : shard) directory.add(e.key);
+    }
+    directory.finish();
+    uint64_t entryCount = directory.records();
+
+    KeyTableHeader header = {};
+    std::memcpy(header.magic, magic, 4);
+    header.version = formatVersion;
+    header.maxPly = static_cast<uint32_t>(std::max(maxPly, 0));
+    header.counts[0] = entryCount;
+    header.counts[1] = games;
+    auto writeBody = [&](std::ofstream& out) {
+        for (auto& shard : sorted) {
+            out.write(reinterpret_cast<const char*>(shard.data()),
+                      static_cast<std::streamsize>(shard.size() * sizeof(Entry)));
+            std::vector<Entry>().swap(shard);
+        }
+    };
+    if (!writeKeyTable(path, header, directory, writeBody, error)) return false;
+    if (stats != nullptr) *stats = {games, skipped, entryCount};
+    return true;
+}
+
+bool OpeningExplorer::open(const std::string& path, std::string& error) {
+    entryCount = gameCount = 0;
+    if (!file.open(path, error, false)) return false;
+    KeyTableView view;
+    if (!openKeyTable(file.text(), path, magic, formatVersion, "an explorer table", view, error)) {
+        return false;
+    }
+    uint64_t nentries = view.header.counts[0];
+    if (view.body.size() / sizeof(Entry) != nentries || view.body.size() % sizeof(Entry) != 0) {
+        error = path + " is truncated or damaged";
+        return false;
+    }
+    buckets = view.buckets;
+    entries = reinterpret_cast<const Entry*>(view.body.data());
+    entryCount = nentries;
+    gameCount = view.header.counts[1];
+    plyLimit = static_cast<int>(view.header.maxPly);
+    return true;
+}
+
+std::span<const OpeningExplorer::Entry> OpeningExplorer::find(uint64_t key) const {
+    if (entryCount == 0) return {};
+    size_t bucket = keyBucket(key);
+    const Entry* begin = entries + buckets[bucket];
+    const Entry* end = entries + buckets[bucket + 1];
+    auto lo = std::lower_bound(begin, end, key,
+                               [](const Entry& e, uint64_t value) { return e.key < value; });
+    auto hi = std::upper_bound(lo, end, key,
+                               [](uint64_t value, const Entry& e) { return value < e.key; });
+    return {lo, hi};
+}
@@ -0,0 +1,79 @@
+// Opening explorer: how often each move was played from a position in a game
+// collection, and how those games ended.
+//
+// File layout (integers little-endian, as written by the host):
+//
+//   header    64 bytes: magic "CHEX", version, max ply, entry count, game
+//             count
+//   buckets   kBuckets + 1 64-bit entries: the first entry whose key has top
+//             16 bits >= the bucket number
+//   entries   {key, move, white wins, draws, black wins}, sorted by key and
+//             move; a move is from | to << 6 | promotion << 12
+//
+// Keys are Position::key, so transpositions share their statistics. A game
+// that plays the same move from a position twice counts twice.
+
+#ifndef CHESS_EXPLORER_H
+#define CHESS_EXPLORER_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "pgn.h"
+
+struct ExplorerStats {
+    uint64_t games = 0;    // games aggregated
+    uint64_t skipped = 0;  // bad games, and games without a decisive or drawn result
+    uint64_t entries = 0;  // distinct (position, move) pairs
+};
+
+/**
+ * Aggregates every game of pgn with a 1-0, 0-1 or 1/2-1/2 result into
+ * (position, move) counts, for the first maxPly plies of each game (0 for
+ * whole games), and writes them to path.
+ *
+ * Games are parsed on `threads` threads. Each thread counts into hash maps
+ * of its own, one per shard of the key range, so there is no shared state
+ * while parsing; each shard's maps are then merged and sorted by one thread,
+ * and the shards, being in key order, are written back to back. Returns
+ * false and sets error on an I/O failure.
+ */
+bool buildExplorer(std::string_view pgn, const std::string& path, int threads, int maxPly,
+                   std::string& error, ExplorerStats* stats = nullptr);
+
+/** A memory-mapped explorer table. Lookups are thread-safe. */
+class OpeningExplorer {
+   public:
+    struct Entry {
+        uint64_t key;
+        uint16_t move;
+        uint16_t reserved;
+        uint32_t white;  // games won by White
+        uint32_t draws;
+        uint32_t black;  // games won by Black
+
+        PosMove toMove() const;
+        uint64_t games() const { return uint64_t{white} + draws + black; }
+    };
+
+    /** Maps and validates path. Returns false and sets error on failure. */
+    bool open(const std::string& path, std::string& error);
+
+    /** The moves played from the position with this key, ordered by move code. */
+    std::span<const Entry> find(uint64_t key) const;
+
+    uint64_t games() const { return gameCount; }
+    int maxPly() const { return plyLimit; }
+
+   private:
+    MappedFile file;
+    const uint64_t* buckets = nullptr;
+    const Entry* entries = nullptr;
+    uint64_t entryCount = 0;
+    uint64_t gameCount = 0;
+    int plyLimit = 0;
+};
+
+#endif  // CHESS_EXPLORER_H
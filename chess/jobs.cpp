@@ -0,0 +1,147 @@
+// Background job pool for the bridge.
+
+#include "jobs.h"
+
+#include <algorithm>
+
+const char* jobStatusName(JobStatus status) {
+    switch (status) {
+        case JobStatus::Queued: return "queued";
+        case JobStatus::Running: return "running";
+        case JobStatus::Done: return "done";
+        case JobStatus::Cancelled: return "cancelled";
+    }
+    return "unknown";
+}
+
+JobQueue::JobQueue(int threads, size_t maxFinished)
+    : threadCount(threads), maxFinished(std::max<size_t>(maxFinished, 1)) {
+    if (threadCount <= 0) threadCount = static_cast<int>(std::thread::hardware_concurrency());
+    threadCount = std::max(threadCount, 1);
+}
+
+JobQueue::~JobQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (auto& [id, job] : jobs) job->cancelled = true;
+    }
+    ready.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+uint32_t JobQueue::start(Work work, uint64_t owner, bool notify) {
+    auto job = std::make_shared<Job>();
+    job->owner = owner;
+    job->notify = notify;
+    job->work = std::move(work);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // After the counter wraps, skip IDs that are still in use.
+        do {
+            job->id = nextId++;
+            if (nextId == 0) nextId = 1;
+        } while (jobs.count(job->id) != 0);
+        jobs[job->id] = job;
+        queue.push_back(job);
+        if (workers.size() < static_cast<size_t>(threadCount) && workers.size() < queue.size()) {
+            workers.emplace_back(&JobQueue::workerLoop, this);
+        }
+    }
+    ready.notify_one();
+    return job->id;
+}
+
+bool JobQueue::poll(uint32_t id, JobStatus& status, std::string& result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = jobs.find(id);
+    if (it == jobs.end()) return false;
+    status = it->second->status;
+    if (status == JobStatus::Done || status == JobStatus::Cancelled) {
+        result = std::move(it->second->result);
+        jobs.erase(it);
+        // Collected here, so it is no longer announced.
+        std::erase_if(notifications, [id](const Finished& f) { return f.id == id; });
+    }
+    return true;
+}
+
+bool JobQueue::cancel(uint32_t id) {
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = jobs.find(id);
+        if (it == jobs.end()) return false;
+        job = it->second;
+        if (job->status == JobStatus::Done || job->status == JobStatus::Cancelled) return false;
+        job->cancelled = true;
+        if (job->status == JobStatus::Running) return true;
+        queue.erase(std::find(queue.begin(), queue.end(), job));
+    }
+    finish(job, {});  // never started
+    return true;
+}
+
+std::vector<JobQueue::Finished> JobQueue::takeNotifications() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Finished> taken;
+    taken.swap(notifications);
+    for (const Finished& f : taken) jobs.erase(f.id);
+    return taken;
+}
+
+void JobQueue::setWakeup(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(wakeupMutex);
+    wakeup = std::move(callback);
+}
+
+size_t JobQueue::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.size();
+}
+
+void JobQueue::workerLoop() {
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+            job = queue.front();
+            queue.pop_front();
+            job->status = JobStatus::Running;
+        }
+        std::string result = job->work(job->cancelled);
+        job->work = nullptr;  // release captured state (e.g. a game snapshot)
+        finish(job, std::move(result));
+    }
+}
+
+void JobQueue::finish(const std::shared_ptr<Job>& job, std::string result) {
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // A cancelled job reports no result, even one that completed.
+        job->status = job->cancelled ? JobStatus::Cancelled : JobStatus::Done;
+        if (!job->cancelled) job->result = std::move(result);
+        notify = job->notify && jobs.count(job->id) != 0;
+        if (notify) notifications.push_back({job->id, job->owner, job->status, job->result});
+        // Past maxFinished, the oldest finished job is forgotten if it is
+        // still uncollected.
+        finishedIds.push_back(job->id);
+        if (finishedIds.size() > maxFinished) {
+            uint32_t id = finishedIds.front();
+            finishedIds.pop_front();
+            auto it = jobs.find(id);
+            if (it != jobs.end() && (it->second->status == JobStatus::Done ||
+                                     it->second->status == JobStatus::Cancelled)) {
+                jobs.erase(it);
+                std::erase_if(notifications, [id](const Finished& f) { return f.id == id; });
+            }
+        }
+    }
+    if (notify) {
+        std::lock_guard<std::mutex> lock(wakeupMutex);
+        if (wakeup) wakeup();
+    }
+}
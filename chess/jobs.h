@@ -0,0 +1,117 @@
+// Background jobs for the bridge: long analyses run on a worker pool while
+// the command loop keeps answering.
+
+#ifndef CHESS_JOBS_H
+#define CHESS_JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class JobStatus { Queued, Running, Done, Cancelled };
+
+/** "queued", "running", "done" or "cancelled". */
+const char* jobStatusName(JobStatus status);
+
+/**
+ * A pool of worker threads running submitted work in FIFO order. Each job
+ * produces one result string (for the bridge, the response text the same
+ * command would have returned synchronously). Workers start on the first
+ * submission, so a queue that is never used costs no threads.
+ *
+ * A finished job is kept until its result is collected, either by poll()
+ * or, for jobs started with notify, by takeNotifications(), or until
+ * maxFinished later jobs have finished: results nobody collects are dropped
+ * oldest first, so the queue stays bounded. All methods are thread-safe.
+ */
+class JobQueue {
+   public:
+    // Runs on a worker thread; should return early once cancelled is set.
+    using Work = std::function<std::string(const std::atomic<bool>& cancelled)>;
+
+    /** threads = 0 means one worker per hardware thread. */
+    explicit JobQueue(int threads = 0, size_t maxFinished = 1024);
+    /** Cancels every job and joins the workers. */
+    ~JobQueue();
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+    /**
+     * Queues work and returns its job ID (never 0, nor the ID of a job still
+     * kept). owner is an opaque tag passed back with the job's notification,
+     * e.g. a client connection.
+     */
+    uint32_t start(Work work, uint64_t owner = 0, bool notify = false);
+
+    /**
+     * Status of a job; for a finished job also its result (empty when
+     * cancelled), after which the job is forgotten. Returns false for an
+     * unknown ID.
+     */
+    bool poll(uint32_t id, JobStatus& status, std::string& result);
+
+    /**
+     * Asks a job to stop. A queued job is cancelled at once, a running one
+     * when its work returns. Returns false for an unknown or finished job.
+     */
+    bool cancel(uint32_t id);
+
+    struct Finished {
+        uint32_t id;
+        uint64_t owner;
+        JobStatus status;  // Done or Cancelled
+        std::string result;
+    };
+    /** Removes and returns the finished jobs that asked for notification. */
+    std::vector<Finished> takeNotifications();
+
+    /**
+     * Called whenever a notifying job finishes, e.g. to wake up an event
+     * loop; it may call takeNotifications(). It runs on the worker thread, or
+     * on the caller of cancel() for a job that had not started. Pass nullptr
+     * to remove it: once setWakeup() returns, the old callback is not running.
+     */
+    void setWakeup(std::function<void()> wakeup);
+
+    /** Jobs not yet collected, in any state. */
+    size_t size() const;
+
+   private:
+    struct Job {
+        uint32_t id;
+        uint64_t owner;
+        bool notify;
+        JobStatus status = JobStatus::Queued;
+        std::atomic<bool> cancelled{false};
+        Work work;
+        std::string result;
+    };
+
+    void workerLoop();
+    void finish(const std::shared_ptr<Job>& job, std::string result);
+
+    int threadCount;
+    size_t maxFinished;
+    mutable std::mutex mutex;
+    std::condition_variable ready;
+    std::map<uint32_t, std::shared_ptr<Job>> jobs;
+    std::deque<std::shared_ptr<Job>> queue;
+    std::vector<Finished> notifications;
+    std::deque<uint32_t> finishedIds;  // the last maxFinished to finish, oldest first
+    std::vector<std::thread> workers;
+    uint32_t nextId = 1;
+    bool stopping = false;
+
+    std::mutex wakeupMutex;  // held while the callback runs or is replaced
+    std::function<void()> wakeup;
+};
+
+#endif  // CHESS_JOBS_H
@@ -0,0 +1,60 @@
+// Sorted key tables on disk.
+
+#include "keytable.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+void BucketDirectory::finish() {
+    // first[b + 1] holds one past the last record of bucket b so far; a
+    // prefix maximum turns that into "first record of bucket b + 1".
+    for (size_t b = 1; b <= kKeyBuckets; b++) first[b] = std::max(first[b], first[b - 1]);
+}
+
+bool writeKeyTable(const std::string& path, const KeyTableHeader& header,
+                   const BucketDirectory& directory,
+                   const std::function<void(std::ofstream&)>& writeBody, std::string& error) {
+    std::string tmp = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        const std::vector<uint64_t>& buckets = directory.entries();
+        out.write(reinterpret_cast<const char*>(buckets.data()),
+                  static_cast<std::streamsize>(buckets.size() * sizeof(uint64_t)));
+        writeBody(out);
+        if (!out) {
+            error = "failed to write " + tmp;
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        error = "failed to rename " + tmp + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+bool openKeyTable(std::string_view data, const std::string& path, const char (&magic)[4],
+                  uint32_t version, const char* kind, KeyTableView& view, std::string& error) {
+    if (data.size() >= sizeof(KeyTableHeader)) {
+        std::memcpy(&view.header, data.data(), sizeof(KeyTableHeader));
+    }
+    if (data.size() < sizeof(KeyTableHeader) || std::memcmp(view.header.magic, magic, 4) != 0 ||
+        view.header.version != version) {
+        error = path + " is not " + kind + " (or has an unsupported version)";
+        return false;
+    }
+    size_t tables = sizeof(KeyTableHeader) + (kKeyBuckets + 1) * sizeof(uint64_t);
+    if (data.size() < tables) {
+        error = path + " is truncated or damaged";
+        return false;
+    }
+    view.buckets = reinterpret_cast<const uint64_t*>(data.data() + sizeof(KeyTableHeader));
+    view.body = data.substr(tables);
+    return true;
+}
@@ -0,0 +1,95 @@
+// Sorted key tables on disk: the layout the position index and the opening
+// explorer share.
+//
+// File layout (integers little-endian, as written by the host):
+//
+//   header    64 bytes: magic, version, max ply, then up to six counts that
+//             are the table's own
+//   buckets   kBuckets + 1 64-bit entries: the first record whose key has
+//             top 16 bits >= the bucket number, so a lookup searches one
+//             bucket
+//   body      the table's records, sorted by key
+//
+// Tables are built in shards of the key range, one thread per shard, and the
+// shards are written back to back.
+
+#ifndef CHESS_KEYTABLE_H
+#define CHESS_KEYTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+constexpr int kKeyBucketBits = 16;
+constexpr size_t kKeyBuckets = size_t{1} << kKeyBucketBits;
+
+/**
+ * Shard of a key among n: monotonic in the key, so shards concatenate in key
+ * order.
+ */
+inline size_t keyShard(uint64_t key, size_t n) {
+    return static_cast<size_t>((key >> 32) * n >> 32);
+}
+
+inline size_t keyBucket(uint64_t key) {
+    return static_cast<size_t>(key >> (64 - kKeyBucketBits));
+}
+
+struct KeyTableHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t maxPly;
+    uint32_t reserved;
+    uint64_t counts[6];
+};
+static_assert(sizeof(KeyTableHeader) == 64, "key table headers are written as they are laid out");
+
+/** The bucket directory of a table, filled in as its records are written. */
+class BucketDirectory {
+   public:
+    BucketDirectory() : first(kKeyBuckets + 1, 0) {}
+
+    /** Counts the next record; keys must be added in ascending order. */
+    void add(uint64_t key) { first[keyBucket(key) + 1] = ++count; }
+
+    /** Completes the directory once every record has been added. */
+    void finish();
+
+    uint64_t records() const { return count; }
+    const std::vector<uint64_t>& entries() const { return first; }
+
+   private:
+    std::vector<uint64_t> first;
+    uint64_t count = 0;
+};
+
+/**
+ * Writes header, directory and whatever writeBody() writes to a temporary
+ * file beside path and renames it over path, so readers never map a
+ * half-written table. Returns false and sets error on an I/O failure.
+ */
+bool writeKeyTable(const std::string& path, const KeyTableHeader& header,
+                   const BucketDirectory& directory,
+                   const std::function<void(std::ofstream&)>& writeBody, std::string& error);
+
+/** A table in memory: its header, bucket directory and body. */
+struct KeyTableView {
+    KeyTableHeader header = {};
+    const uint64_t* buckets = nullptr;
+    std::string_view body;
+};
+
+/**
+ * Checks data, the contents of path, against magic and version and splits
+ * it into view. kind names the table in errors ("a position index"). The
+ * body's size is for the caller to check. Returns false and sets error if
+ * data is not such a table.
+ */
+bool openKeyTable(std::string_view data, const std::string& path, const char (&magic)[4],
+                  uint32_t version, const char* kind, KeyTableView& view, std::string& error);
+
+#endif  // CHESS_KEYTABLE_H
@@ -0,0 +1,205 @@
+// Mate-in-N solver: proof-number search with iterative deepening on N.
+
+#include "mate.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint32_t kInfinity = 1u << 30;
+
+uint32_t saturatingAdd(uint32_t a, uint32_t b) {
+    return (a >= kInfinity - b) ? kInfinity : a + b;
+}
+
+// Tree node. Children of a node are stored contiguously; nodes at even plies
+// are OR nodes (attacker to move), odd plies are AND nodes (defender).
+struct Node {
+    PosMove move;  // move leading to this node
+    bool expanded = false;
+    uint16_t numChildren = 0;
+    int32_t parent = -1;
+    int32_t firstChild = -1;
+    uint32_t pn = 1;  // proof number: leaves to expand to prove mate
+    uint32_t dn = 1;  // disproof number: leaves to expand to refute it
+};
+
+int countLegal(Position& pos) {
+    MoveList list;
+    pos.generateLegal(list);
+    return list.size;
+}
+
+class Solver {
+   public:
+    Solver(const Position& root, uint64_t maxNodes, bool checksOnly,
+           const std::atomic<bool>* stop)
+        : pos(root), maxNodes(maxNodes), checksOnly(checksOnly), stop(stop) {}
+
+    // Result of a search for mate within the given number of moves.
+    enum Outcome { PROVEN, DISPROVEN, OUT_OF_NODES };
+
+    Outcome solve(int moves) {
+        limit = moves;
+        tree.clear();
+        tree.emplace_back();
+        while (tree[0].pn != 0 && tree[0].dn != 0) {
+            if (created >= maxNodes) return OUT_OF_NODES;
+            if (stop != nullptr && stop->load(std::memory_order_relaxed)) return OUT_OF_NODES;
+
+            // Descend to the most-proving node.
+            int cur = 0, ply = 0;
+            while (tree[cur].expanded) {
+                cur = select(cur, ply % 2 == 0);
+                undo[ply] = pos.make(tree[cur].move);
+                ply++;
+            }
+            expand(cur, ply);
+
+            // Back the new numbers up to the root, restoring the position.
+            while (true) {
+                update(cur, ply % 2 == 0);
+                if (cur == 0) break;
+                ply--;
+                pos.unmake(tree[cur].move, undo[ply]);
+                cur = tree[cur].parent;
+            }
+        }
+        return tree[0].pn == 0 ? PROVEN : DISPROVEN;
+    }
+
+    // The forcing line of a proven tree: shortest mate for the attacker,
+    // longest resistance for the defender.
+    std::vector<PosMove> line() {
+        choice.assign(tree.size(), -1);
+        proofLength(0, true);
+        std::vector<PosMove> out;
+        for (int cur = choice[0]; cur >= 0; cur = choice[cur]) out.push_back(tree[cur].move);
+        return out;
+    }
+
+    uint64_t nodes() const { return created; }
+
+   private:
+    int select(int idx, bool orNode) const {
+        const Node& n = tree[idx];
+        int best = n.firstChild;
+        for (int c = n.firstChild + 1; c < n.firstChild + n.numChildren; c++) {
+            if (orNode ? tree[c].pn < tree[best].pn : tree[c].dn < tree[best].dn) best = c;
+        }
+        return best;
+    }
+
+    void expand(int idx, int ply) {
+        bool attacker = ply % 2 == 0;
+        // Attacker moves used once a move from this node has been played.
+        int used = ply / 2 + 1;
+        bool onlyChecks = checksOnly || used == limit;
+        bool mover = pos.whiteTurn;
+
+        MoveList pseudo;
+        pos.generatePseudo(pseudo);
+        int32_t first = static_cast<int32_t>(tree.size());
+        for (const PosMove& m : pseudo) {
+            PosUndo u = pos.make(m);
+            if (pos.attacked(pos.kingSq[mover ? 0 : 1], !mover)) {
+                pos.unmake(m, u);
+                continue;
+            }
+            Node child;
+            child.move = m;
+            child.parent = idx;
+            if (attacker) {
+                bool check = pos.inCheck();
+                if (onlyChecks && !check) {
+                    pos.unmake(m, u);
+                    continue;
+                }
+                int replies = countLegal(pos);
+                if (replies == 0) {
+                    child.pn = check ? 0 : kInfinity;  // mate, or stalemate
+                    child.dn = check ? kInfinity : 0;
+                } else if (used == limit) {
+                    child.pn = kInfinity;
+                    child.dn = 0;
+                } else {
+                    // Fewer replies means a cheaper proof.
+                    child.pn = static_cast<uint32_t>(replies);
+                }
+            }
+            pos.unmake(m, u);
+            tree.push_back(child);
+        }
+        Node& n = tree[idx];
+        n.expanded = true;
+        n.firstChild = first;
+        n.numChildren = static_cast<uint16_t>(tree.size() - first);
+        created += n.numChildren;
+    }
+
+    void update(int idx, bool orNode) {
+        Node& n = tree[idx];
+        if (!n.expanded) return;
+        uint32_t minimum = kInfinity, sum = 0;
+        for (int c = n.firstChild; c < n.firstChild + n.numChildren; c++) {
+            const Node& child = tree[c];
+            minimum = std::min(minimum, orNode ? child.pn : child.dn);
+            sum = saturatingAdd(sum, orNode ? child.dn : child.pn);
+        }
+        // An OR node without candidate moves is refuted (minimum stays
+        // infinite, sum stays zero).
+        n.pn = orNode ? minimum : sum;
+        n.dn = orNode ? sum : minimum;
+    }
+
+    // Plies to mate within the proof below a proven node, recording the
+    // chosen child of every node on the way.
+    int proofLength(int idx, bool orNode) {
+        const Node& n = tree[idx];
+        if (!n.expanded) return 0;  // mated leaf
+        int best = orNode ? kInfinity : -1;
+        for (int c = n.firstChild; c < n.firstChild + n.numChildren; c++) {
+            if (tree[c].pn != 0) continue;
+            int len = 1 + proofLength(c, !orNode);
+            if (orNode ? len < best : len > best) {
+                best = len;
+                choice[idx] = c;
+            }
+        }
+        return best;
+    }
+
+    Position pos;
+    uint64_t maxNodes;
+    bool checksOnly;
+    const std::atomic<bool>* stop;
+    int limit = 0;
+    uint64_t created = 0;
+    std::vector<Node> tree;
+    std::vector<int32_t> choice;
+    PosUndo undo[256];
+};
+
+}  // namespace
+
+MateResult findMate(const Position& root, int maxMoves, uint64_t maxNodes, bool checksOnly,
+                    const std::atomic<bool>* stop) {
+    MateResult result;
+    maxMoves = std::clamp(maxMoves, 0, 100);
+    Solver solver(root, maxNodes, checksOnly, stop);
+    result.disproven = true;
+    for (int n = 1; n <= maxMoves; n++) {
+        Solver::Outcome outcome = solver.solve(n);
+        if (outcome == Solver::PROVEN) {
+            result.found = true;
+            result.moves = n;
+            result.line = solver.line();
+        }
+        if (outcome != Solver::DISPROVEN) {
+            result.disproven = false;
+            break;
+        }
+    }
+    result.nodes = solver.nodes();
+    return result;
+}
@@ -71,8 +71,8 @@ class ChessEngine:
         await self._process.wait()
         self._process = None
 
-    async def _send_command(self, cmd: dict[str, Any]) -> dict[str, Any]:
-        """Send a JSON command and read the JSON response line."""
+    async def _send_command(self, cmd: Any) -> Any:
+        """Send a JSON command (or a list of them) and read the JSON response line."""
         if self._process is None:
             raise EngineError("Engine not started")
         if self._process.returncode is not None:
@@ -103,7 +103,15 @@ class ChessEngine:
                 + (f": {stderr}" if stderr else "")
             )
 
-        return json.loads(response_line)  # type: ignore[no-any-return]
+        return json.loads(response_line)
+
+    async def batch(self, cmds: list[dict[str, Any]]) -> list[dict[str, Any]]:
+        """Run several commands in one round trip; returns one response per command.
+
+        Commands run in order and a failing command does not stop the rest,
+        e.g. replaying a recorded game is a single batch of make_move commands.
+        """
+        return await self._send_command(cmds)  # type: ignore[no-any-return]
 
     async def new_game(self) -> EngineState:
         """Start a new game from the initial position."""
@@ -120,13 +128,14 @@ class ChessEngine:
         return _parse_state(resp["state"])
 
     async def make_move(self, move: str) -> MoveResult:
-        """Make a move (SAN or LAN). Returns the resulting state and the LAN of the move."""
+        """Make a move (SAN or LAN). Returns the resulting state and the LAN and SAN of the move."""
         resp = await self._send_command({"command": "make_move", "move": move})
         if not resp.get("ok"):
             raise EngineError(resp.get("error", "unknown error"))
         return MoveResult(
             state=_parse_state(resp["state"]),
             move_lan=_normalize_lan(resp["move_lan"]),
+            move_san=resp["move_san"],
         )
 
     async def get_state(self) -> EngineState:
@@ -12,7 +12,6 @@ from typing import Any
 from .clock import ChessClock, create_clock
 from .engine import ChessEngine
 from .material import is_insufficient_material
-from .notation import lan_to_san
 from .pgn import generate_pgn
 from .types import (
     EngineState,
@@ -333,23 +332,11 @@ class GameManager:
         if self._draw_offered_by == session_id:
             self._draw_offered_by = None
 
-        # Get state before move for SAN generation
-        fen_before = self._engine_state.fen
-        legal_moves_before = list(self._engine_state.legal_moves)
-
-        # Make the move via engine
+        # Make the move via engine; it also reports the SAN
         result = await self._engine.make_move(move)
         self._engine_state = result.state
         self._last_activity = time.monotonic()
-
-        # Generate SAN
-        san = lan_to_san(
-            lan=result.move_lan,
-            fen_before=fen_before,
-            legal_moves=legal_moves_before,
-            in_check_after=result.state.in_check,
-            is_checkmate_after=result.state.is_checkmate,
-        )
+        san = result.move_san
 
         # Update clock
         clock_ms: int | None = None
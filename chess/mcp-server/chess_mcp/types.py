@@ -29,6 +29,7 @@ class MoveResult:
 
     state: EngineState
     move_lan: str  # unhyphenated LAN of the move made
+    move_san: str  # SAN of the move made, computed by the engine
 
 
 class EngineError(Exception):
@@ -45,6 +45,7 @@ async def test_make_move_lan(engine: ChessEngine) -> None:
     result = await engine.make_move("e2e4")
     assert result.state.turn == "black"
     assert result.move_lan == "e2e4"
+    assert result.move_san == "e4"
 
 
 async def test_illegal_move_raises(engine: ChessEngine) -> None:
@@ -110,3 +111,17 @@ async def test_get_state(engine: ChessEngine) -> None:
     state = await engine.get_state()
     assert state.turn == "black"
     assert len(state.move_history) == 1
+
+
+async def test_batch_runs_commands_in_one_round_trip(engine: ChessEngine) -> None:
+    moves = ["e4", "e5", "Nf3", "Nc6", "Bb5"]
+    responses = await engine.batch(
+        [{"command": "new_game"}]
+        + [{"command": "make_move", "move": m} for m in moves]
+        + [{"command": "make_move", "move": "e4"}]
+    )
+    assert len(responses) == len(moves) + 2
+    assert all(r["ok"] for r in responses[:-1])
+    assert not responses[-1]["ok"]
+    state = await engine.get_state()
+    assert state.move_history == ["e2e4", "e7e5", "g1f3", "b8c6", "f1b5"]
@@ -0,0 +1,441 @@
+// Streaming PGN reader and PGN writer.
+
+#include "pgn.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#include "search.h"
+
+MappedFile::~MappedFile() {
+    if (size > 0) munmap(const_cast<char*>(data), size);
+}
+
+bool MappedFile::open(const std::string& path, std::string& error, bool sequential) {
+    if (size > 0) munmap(const_cast<char*>(data), size);
+    data = nullptr;
+    size = 0;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        error = "cannot stat " + path + ": " + std::strerror(errno);
+        close(fd);
+        return false;
+    }
+    if (st.st_size > 0) {
+        void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            error = "cannot map " + path + ": " + std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        madvise(base, st.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        data = static_cast<const char*>(base);
+        size = static_cast<size_t>(st.st_size);
+    }
+    close(fd);
+    return true;
+}
+
+std::string_view PgnGame::tag(std::string_view name) const {
+    for (const PgnTag& t : tags) {
+        if (t.name == name) return t.value;
+    }
+    return {};
+}
+
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\v';
+}
+
+// Characters that end a movetext token.
+bool isDelimiter(char c) {
+    return isSpace(c) || c == '{' || c == '}' || c == '(' || c == ')' || c == ';' || c == '[' ||
+           c == ']' || c == '$';
+}
+
+bool isResult(std::string_view token) {
+    return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+}
+
+}  // namespace
+
+PgnReader::PgnReader(std::string_view text) : text(text) {}
+
+void PgnReader::skipSpace() {
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (isSpace(c)) {
+            pos++;
+        } else if (c == '%' && (pos == 0 || text[pos - 1] == '\n')) {
+            // Escape line: ignored up to the end of the line.
+            size_t nl = text.find('\n', pos);
+            pos = nl == std::string_view::npos ? text.size() : nl + 1;
+        } else if (!skipComment()) {
+            return;
+        }
+    }
+}
+
+// Skips a brace or rest-of-line comment at pos, if there is one.
+bool PgnReader::skipComment() {
+    char c = text[pos];
+    size_t end;
+    if (c == '{') {
+        end = text.find('}', pos);
+    } else if (c == ';') {
+        end = text.find('\n', pos);
+    } else {
+        return false;
+    }
+    pos = end == std::string_view::npos ? text.size() : end + 1;
+    return true;
+}
+
+bool PgnReader::readTag(PgnGame& game) {
+    // [Name "value"]
+    pos++;
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) pos++;
+    size_t nameStart = pos;
+    while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) ||
+                                 text[pos] == '_')) {
+        pos++;
+    }
+    std::string_view name = text.substr(nameStart, pos - nameStart);
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) pos++;
+    bool ok = !name.empty() && pos < text.size() && text[pos] == '"';
+    if (ok) {
+        size_t valueStart = ++pos;
+        while (pos < text.size() && text[pos] != '"' && text[pos] != '\n') {
+            pos += text[pos] == '\\' ? 2 : 1;
+        }
+        ok = pos < text.size() && text[pos] == '"';
+        if (ok) {
+            std::string_view value = text.substr(valueStart, pos - valueStart);
+            pos++;
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) pos++;
+            ok = pos < text.size() && text[pos] == ']';
+            if (ok) {
+                pos++;
+                game.tags.push_back({name, value});
+            }
+        }
+    }
+    if (!ok) {
+        // Resynchronize at the next line.
+        size_t nl = text.find('\n', pos);
+        pos = nl == std::string_view::npos ? text.size() : nl + 1;
+    }
+    return ok;
+}
+
+bool PgnReader::next(PgnGame& game) {
+    skipSpace();
+    if (pos >= text.size()) return false;
+
+    game.number = ++count;
+    game.offset = pos;
+    game.tags.clear();
+    game.moves.clear();
+    game.result = {};
+    game.error.clear();
+
+    while (pos < text.size() && text[pos] == '[') {
+        if (!readTag(game) && game.error.empty()) game.error = "malformed tag";
+        skipSpace();
+    }
+
+    static const Position kInitial = [] {
+        Position p;
+        Position::fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", p);
+        return p;
+    }();
+    std::string_view fen = game.tag("FEN");
+    if (fen.empty()) {
+        game.start = kInitial;
+    } else if (parseFen(fen, game.start) != FenError::None && game.error.empty()) {
+        game.error = "invalid FEN tag";
+    }
+    readMovetext(game);
+    return true;
+}
+
+void PgnReader::readMovetext(PgnGame& game) {
+    Position cur = game.start;
+    int depth = 0;  // variation nesting
+    while (true) {
+        skipSpace();
+        if (pos >= text.size()) return;
+        char c = text[pos];
+        if (c == '[') return;  // the next game's tags; this one had no result
+        if (c == '(') {
+            depth++;
+            pos++;
+            continue;
+        }
+        if (c == ')') {
+            if (depth > 0) depth--;
+            pos++;
+            continue;
+        }
+        if (c == '$' || c == ']' || c == '}') {
+            pos++;
+            while (pos < text.size() && !isDelimiter(text[pos])) pos++;
+            continue;
+        }
+
+        size_t start = pos;
+        while (pos < text.size() && !isDelimiter(text[pos])) pos++;
+        std::string_view token = text.substr(start, pos - start);
+        if (depth > 0) continue;
+        if (isResult(token)) {
+            game.result = token;
+            return;
+        }
+        if (!game.error.empty()) continue;
+
+        // Move numbers ("12.", "12...") may be glued to the move.
+        if (token[0] >= '0' && token[0] <= '9' && token.substr(0, 3) != "0-0") {
+            size_t i = 0;
+            while (i < token.size() && token[i] >= '0' && token[i] <= '9') i++;
+            if (i == token.size() || token[i] == '.') token.remove_prefix(i);
+        }
+        while (!token.empty() && token[0] == '.') token.remove_prefix(1);
+        if (token.empty()) continue;
+        // Annotation glyphs: "e4!", "Nf3?!".
+        while (!token.empty() && (token.back() == '!' || token.back() == '?')) {
+            token.remove_suffix(1);
+        }
+
+        // Castling is sometimes written with zeros.
+        char castle[8];
+        if (token.size() <= sizeof(castle) && token.substr(0, 3) == "0-0") {
+            for (size_t k = 0; k < token.size(); k++) castle[k] = token[k] == '0' ? 'O' : token[k];
+            token = std::string_view(castle, token.size());
+        }
+
+        PosMove m;
+        if (!parseSan(cur, token, m)) {
+            game.error = "illegal or invalid move '" + std::string(text.substr(start, pos - start)) +
+                         "' at ply " + std::to_string(game.moves.size() + 1);
+            continue;
+        }
+        cur.make(m);
+        game.moves.push_back(m);
+    }
+}
+
+namespace {
+
+// Whether the line at start opens with a whole tag, [Name "value"], as
+// readTag() reads it: a comment line such as [%clk 0:01:00] does not.
+bool isTagLine(std::string_view text, size_t start) {
+    size_t i = start;
+    if (i >= text.size() || text[i++] != '[') return false;
+    while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) i++;
+    size_t nameStart = i;
+    while (i < text.size() &&
+           (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_')) {
+        i++;
+    }
+    if (i == nameStart || i >= text.size() || (text[i] != ' ' && text[i] != '\t')) return false;
+    while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) i++;
+    if (i >= text.size() || text[i++] != '"') return false;
+    while (i < text.size() && text[i] != '"' && text[i] != '\n') i += text[i] == '\\' ? 2 : 1;
+    if (i >= text.size() || text[i++] != '"') return false;
+    while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) i++;
+    return i < text.size() && text[i] == ']';
+}
+
+}  // namespace
+
+std::vector<std::string_view> splitPgn(std::string_view text, int parts) {
+    std::vector<std::string_view> ranges;
+    size_t begin = 0;
+    for (int i = 1; i < parts && begin < text.size(); i++) {
+        size_t target = text.size() / parts * i;
+        if (target <= begin) continue;
+        // A game starts with a tag line that does not follow another tag line.
+        size_t at = target;
+        size_t cut = text.size();
+        while ((at = text.find("\n[", at)) != std::string_view::npos) {
+            size_t lineEnd = at;
+            while (lineEnd > 0 && text[lineEnd - 1] == '\r') lineEnd--;
+            size_t lineStart = text.rfind('\n', lineEnd == 0 ? 0 : lineEnd - 1);
+            lineStart = lineStart == std::string_view::npos ? 0 : lineStart + 1;
+            if (isTagLine(text, at + 1) && (lineStart >= lineEnd || !isTagLine(text, lineStart))) {
+                cut = at + 1;
+                break;
+            }
+            at++;
+        }
+        if (cut >= text.size()) break;
+        ranges.push_back(text.substr(begin, cut - begin));
+        begin = cut;
+    }
+    if (begin < text.size()) ranges.push_back(text.substr(begin));
+    return ranges;
+}
+
+void appendEvalTag(int whiteScore, std::string& out) {
+    char buf[32];
+    if (isMateScore(whiteScore)) {
+        snprintf(buf, sizeof(buf), "[%%eval #%d]", mateInMoves(whiteScore));
+    } else {
+        snprintf(buf, sizeof(buf), "[%%eval %.2f]", whiteScore / 100.0);
+    }
+    out += buf;
+}
+
+void appendClockTag(int64_t ms, std::string& out) {
+    int64_t tenths = ms / 100;
+    char buf[48];
+    snprintf(buf, sizeof(buf), "[%%clk %lld:%02d:%02d.%d]", static_cast<long long>(tenths / 36000),
+             static_cast<int>(tenths / 600 % 60), static_cast<int>(tenths / 10 % 60),
+             static_cast<int>(tenths % 10));
+    out += buf;
+}
+
+namespace {
+
+constexpr size_t kLineWidth = 80;
+
+// Appends movetext tokens to a buffer, breaking lines at kLineWidth.
+class MovetextWriter {
+   public:
+    explicit MovetextWriter(std::string& out) : out(out), lineStart(out.size()) {}
+
+    // Starts a token; its text is then appended to out directly.
+    void begin() {
+        separator = std::string::npos;
+        if (out.size() > lineStart) {
+            separator = out.size();
+            out += ' ';
+        }
+    }
+    // Moves the finished token to a new line if it overflowed this one.
+    void end() {
+        if (out.size() - lineStart > kLineWidth && separator != std::string::npos) {
+            out[separator] = '\n';
+            lineStart = separator + 1;
+        }
+    }
+    // "12." or "12...", kept on the line of the move that follows.
+    void number(int moveNumber, bool black) {
+        char buf[16];
+        auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), moveNumber);
+        out.append(buf, end);
+        out += black ? "... " : ". ";
+    }
+
+   private:
+    std::string& out;
+    size_t lineStart;
+    size_t separator = std::string::npos;
+};
+
+void appendTag(std::string_view name, std::string_view value, std::string& out) {
+    out += '[';
+    out += name;
+    out += " \"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += "\"]\n";
+}
+
+}  // namespace
+
+void writePgn(const ChessGame& game, const PgnWriteOptions& options, std::string& out) {
+    static const std::string_view kInitialFen =
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    std::string startFen = game.getStartFen();
+    Position pos;
+    if (!Position::fromFen(startFen, pos)) return;
+
+    // Replay first: the result tag may depend on the final position.
+    const std::vector<ChessMove>& history = game.getHistory();
+    size_t first = 0;
+    while (first < history.size() && history[first].isEnd()) first++;
+    Position end = pos;
+    for (size_t i = first; i < history.size(); i++) end.make(PosMove::fromChessMove(history[i]));
+    std::string_view result = options.result;
+    if (result.empty()) {
+        if (!end.hasLegalMove()) {
+            result = !end.inCheck() ? "1/2-1/2" : end.whiteTurn ? "0-1" : "1-0";
+        } else {
+            result = game.isAutomaticDraw() ? "1/2-1/2" : "*";
+        }
+    }
+
+    static const std::pair<std::string_view, std::string_view> kRoster[] = {
+        {"Event", "?"}, {"Site", "?"}, {"Date", "????.??.??"}, {"Round", "?"},
+        {"White", "?"}, {"Black", "?"}};
+    auto given = [&](std::string_view name) {
+        for (const PgnTag& t : options.tags) {
+            if (t.name == name) return &t;
+        }
+        return static_cast<const PgnTag*>(nullptr);
+    };
+    for (const auto& [name, fallback] : kRoster) {
+        const PgnTag* t = given(name);
+        appendTag(name, t != nullptr ? t->value : fallback, out);
+    }
+    appendTag("Result", result, out);
+    if (startFen != kInitialFen) {
+        appendTag("SetUp", "1", out);
+        appendTag("FEN", startFen, out);
+    }
+    for (const PgnTag& t : options.tags) {
+        bool written = t.name == "Result" || t.name == "SetUp" || t.name == "FEN";
+        for (const auto& r : kRoster) written = written || t.name == r.first;
+        if (!written) appendTag(t.name, t.value, out);
+    }
+    out += '\n';
+
+    MovetextWriter text(out);
+    int moveNumber = pos.fullmoveNumber;
+    bool numberNext = true;  // the first move, and Black's after a comment
+    for (size_t i = first; i < history.size(); i++) {
+        size_t ply = i - first;
+        PosMove m = PosMove::fromChessMove(history[i]);
+        text.begin();
+        if (pos.whiteTurn || numberNext) text.number(moveNumber, !pos.whiteTurn);
+        appendSan(pos, m, out);
+        text.end();
+
+        bool hasEval = ply < options.evals.size() && options.evals[ply] != PGN_NO_EVAL;
+        bool hasClock = ply < options.clocksMs.size() && options.clocksMs[ply] >= 0;
+        if (hasEval || hasClock) {
+            text.begin();
+            out += '{';
+            if (hasEval) appendEvalTag(options.evals[ply], out);
+            if (hasEval && hasClock) out += ' ';
+            if (hasClock) appendClockTag(options.clocksMs[ply], out);
+            out += '}';
+            text.end();
+        }
+        numberNext = hasEval || hasClock;
+        if (!pos.whiteTurn) moveNumber++;
+        pos.make(m);
+    }
+    text.begin();
+    out += result;
+    text.end();
+    out += "\n\n";
+}
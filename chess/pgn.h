@@ -0,0 +1,137 @@
+// PGN input and output. The streaming reader parses games straight out of a
+// memory-mapped file, with tags and move tokens as views into the mapping;
+// the writer renders a ChessGame into a caller's reusable buffer.
+
+#ifndef CHESS_PGN_H
+#define CHESS_PGN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chess.h"
+#include "position.h"
+
+/** A read-only memory mapping of a whole file. */
+class MappedFile {
+   public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Maps path, replacing any earlier mapping, with read-ahead tuned for
+     * sequential or random access. Returns false and sets error on failure.
+     */
+    bool open(const std::string& path, std::string& error, bool sequential = true);
+
+    std::string_view text() const { return {data, size}; }
+
+   private:
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+struct PgnTag {
+    std::string_view name;
+    std::string_view value;  // as written: \" and \\ escapes are left in
+};
+
+/**
+ * One parsed game. Its buffers are reused from game to game, so a reader
+ * loop allocates nothing once they have grown to the largest game.
+ */
+struct PgnGame {
+    uint64_t number = 0;  // 1-based, counting from the reader's start
+    size_t offset = 0;    // byte offset of the game in the reader's text
+    std::vector<PgnTag> tags;  // views into the reader's text
+    Position start;            // from the FEN tag, else the initial position
+    std::vector<PosMove> moves;  // the mainline, replayed from start
+    std::string_view result;     // "1-0", "0-1", "1/2-1/2", "*"; empty if missing
+    // Why the game was rejected, or empty. After an error, moves holds the
+    // legal prefix and the rest of the game is skipped.
+    std::string error;
+
+    /** The value of the named tag, or an empty view. */
+    std::string_view tag(std::string_view name) const;
+};
+
+/**
+ * Parses PGN games one at a time from text, which must outlive the reader.
+ *
+ * Comments, NAGs, move numbers, annotation glyphs ("!?") and variations are
+ * skipped; only the mainline is replayed, SAN being parsed against a
+ * Position with no allocation. A bad game (malformed tag, invalid FEN,
+ * illegal move) is reported through PgnGame::error and reading continues
+ * with the next game. A game without a termination marker ends where the
+ * next game's tags begin.
+ */
+class PgnReader {
+   public:
+    explicit PgnReader(std::string_view text);
+
+    /** Reads the next game into game. Returns false at the end of the text. */
+    bool next(PgnGame& game);
+
+    /** Bytes consumed so far. */
+    size_t position() const { return pos; }
+
+   private:
+    void skipSpace();
+    bool skipComment();
+    bool readTag(PgnGame& game);
+    void readMovetext(PgnGame& game);
+
+    std::string_view text;
+    size_t pos = 0;
+    uint64_t count = 0;
+};
+
+/**
+ * Splits text into at most `parts` consecutive ranges that each start at the
+ * beginning of a game, for parsing with one reader per thread.
+ */
+std::vector<std::string_view> splitPgn(std::string_view text, int parts);
+
+/** Marks a ply without an evaluation in PgnWriteOptions::evals. */
+constexpr int PGN_NO_EVAL = INT32_MIN;
+
+/** What writePgn() adds to a game's moves. Empty members are left out. */
+struct PgnWriteOptions {
+    // Tags to write. Event, Site, Date, Round, White and Black come first, in
+    // that order, as "?" (Date "????.??.??") when not given; the others follow
+    // in the order given. Result, SetUp and FEN are written from the game and
+    // ignored here.
+    std::vector<PgnTag> tags;
+    // Per played ply (a FEN game's placeholder history is not counted): the
+    // mover's remaining clock in milliseconds, as {[%clk h:mm:ss.s]}, or
+    // negative for none.
+    std::vector<int64_t> clocksMs;
+    // Per played ply: the evaluation after the move from White's side, in
+    // search.h score units, as {[%eval 0.35]} or {[%eval #-3]}; PGN_NO_EVAL
+    // for none.
+    std::vector<int> evals;
+    // "1-0", "0-1", "1/2-1/2" or "*"; empty to take it from the final
+    // position (checkmate, stalemate or an automatic draw, else "*"), e.g.
+    // pass "1-0" for a resignation.
+    std::string_view result;
+};
+
+/**
+ * Appends the game as export-format PGN to out: tags, then movetext with
+ * move numbers, SAN and the optional comments, wrapped at 80 columns and
+ * ended by the result and a blank line. out is not cleared, so a batch of
+ * games can share one buffer whose capacity is reused.
+ */
+void writePgn(const ChessGame& game, const PgnWriteOptions& options, std::string& out);
+
+/** Appends "[%eval 0.35]" / "[%eval #-3]" for a White-relative search score. */
+void appendEvalTag(int whiteScore, std::string& out);
+
+/** Appends "[%clk h:mm:ss.s]", truncated to tenths of a second. */
+void appendClockTag(int64_t ms, std::string& out);
+
+#endif  // CHESS_PGN_H
@@ -0,0 +1,139 @@
+// Background analysis of the opponent's replies.
+
+#include "ponder.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Node budget of the first, shallow search of every reply.
+constexpr uint64_t kWideBudget = 4096;
+// Replies searched further, and the budget at which pondering ends.
+constexpr size_t kDeepReplies = 8;
+constexpr uint64_t kMaxBudget = 4 << 20;
+// The cache is cleared when it grows past this many positions.
+constexpr size_t kMaxEntries = 4096;
+
+}  // namespace
+
+Ponderer::Ponderer() : worker(&Ponderer::workerLoop, this) {}
+
+Ponderer::~Ponderer() {
+    stopFlag = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutdown = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void Ponderer::start(const Position& root) {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = root;
+        hasPending = true;
+        stopFlag = false;
+    }
+    wake.notify_one();
+}
+
+void Ponderer::stop() {
+    stopFlag = true;
+    std::unique_lock<std::mutex> lock(mutex);
+    hasPending = false;
+    idle.wait(lock, [this] { return !busy; });
+}
+
+bool Ponderer::lookup(const Position& pos, const SearchLimits& limits, SearchResult& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(pos.key);
+    if (it == cache.end()) return false;
+    const Entry& e = it->second;
+    // A search that found a mate stops there, however large its budget.
+    bool enough = isMateScore(e.result.score) ||
+                  (limits.depth > 0 && e.result.depth >= limits.depth) ||
+                  (limits.nodes > 0 && e.result.nodes >= limits.nodes) ||
+                  (limits.movetimeMs > 0 && e.elapsedMs >= limits.movetimeMs);
+    if (!enough) return false;
+    out = e.result;
+    return true;
+}
+
+size_t Ponderer::cacheSize() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cache.size();
+}
+
+void Ponderer::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return shutdown || hasPending; });
+        if (shutdown) return;
+        Position root = pending;
+        hasPending = false;
+        busy = true;
+        lock.unlock();
+        ponder(root);
+        lock.lock();
+        busy = false;
+        idle.notify_all();
+    }
+}
+
+void Ponderer::ponder(const Position& start) {
+    Position root = start;
+    MoveList list;
+    root.generateLegal(list);
+
+    struct Reply {
+        Position pos;
+        int score = 0;  // for the side to move after the reply
+    };
+    std::vector<Reply> replies;
+    for (const PosMove& m : list) {
+        Reply r;
+        r.pos = root;
+        r.pos.make(m);
+        replies.push_back(r);
+    }
+
+    size_t count = replies.size();
+    for (uint64_t budget = kWideBudget; budget <= kMaxBudget; budget *= 4) {
+        for (size_t i = 0; i < count; i++) {
+            if (stopFlag.load(std::memory_order_relaxed)) return;
+            Reply& r = replies[i];
+            SearchLimits limits;
+            limits.depth = 0;
+            limits.nodes = budget;
+            SearchResult cached;
+            // Work from an earlier pondering of the same position is kept.
+            if (lookup(r.pos, limits, cached)) {
+                r.score = cached.score;
+                continue;
+            }
+            limits.depth = MAX_PLY - 1;
+            limits.stop = &stopFlag;
+            auto t0 = std::chrono::steady_clock::now();
+            SearchResult result = search(r.pos, limits);
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - t0);
+            store(r.pos, result, static_cast<int>(ms.count()));
+            r.score = result.score;
+        }
+        // The replies worst for us are the ones a good opponent plays.
+        std::stable_sort(replies.begin(), replies.begin() + count,
+                         [](const Reply& a, const Reply& b) { return a.score < b.score; });
+        count = std::min(count, kDeepReplies);
+    }
+}
+
+void Ponderer::store(const Position& pos, const SearchResult& result, int elapsedMs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cache.size() >= kMaxEntries) cache.clear();
+    Entry& e = cache[pos.key];
+    // A search cut short by stop() may have got less far than an earlier one.
+    if (e.result.nodes <= result.nodes) e = {result, elapsedMs};
+}
@@ -0,0 +1,74 @@
+// Pondering: speculative analysis of the opponent's replies while the bridge
+// waits for input.
+
+#ifndef CHESS_PONDER_H
+#define CHESS_PONDER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "position.h"
+#include "search.h"
+
+/**
+ * Searches the positions after each legal move of the side to move, on one
+ * background thread, and caches the results by position. Every reply gets
+ * a shallow search first; the likeliest replies (those the shallow search
+ * rates best for the side to move) are then searched again with budgets
+ * growing fourfold, so the position most probably reached next gets the
+ * deepest analysis.
+ *
+ * stop() returns as soon as the running search notices its stop flag, so
+ * pondering between commands costs a command no measurable latency.
+ */
+class Ponderer {
+   public:
+    Ponderer();
+    /** Stops and joins the worker. */
+    ~Ponderer();
+    Ponderer(const Ponderer&) = delete;
+    Ponderer& operator=(const Ponderer&) = delete;
+
+    /** Starts pondering the replies from root, stopping any earlier pondering. */
+    void start(const Position& root);
+    /** Stops pondering and waits until the worker is idle. */
+    void stop();
+
+    /**
+     * The cached search of pos if it went at least as far as limits asks:
+     * to the requested depth, node count or time, whichever the search
+     * would have stopped at first, or until it found a mate. Limits of zero
+     * are ignored.
+     */
+    bool lookup(const Position& pos, const SearchLimits& limits, SearchResult& out) const;
+
+    size_t cacheSize() const;
+
+   private:
+    struct Entry {
+        SearchResult result;
+        int elapsedMs = 0;
+    };
+
+    void workerLoop();
+    void ponder(const Position& root);
+    void store(const Position& pos, const SearchResult& result, int elapsedMs);
+
+    std::atomic<bool> stopFlag{false};
+    mutable std::mutex mutex;
+    std::condition_variable wake;  // a root is pending or shutting down
+    std::condition_variable idle;  // the worker finished pondering
+    Position pending;
+    bool hasPending = false;
+    bool busy = false;
+    bool shutdown = false;
+    std::unordered_map<uint64_t, Entry> cache;  // by Position::key
+    std::thread worker;
+};
+
+#endif  // CHESS_PONDER_H
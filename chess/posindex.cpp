@@ -0,0 +1,208 @@
+// Position index builder and reader.
+
+#include "posindex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "keytable.h"
+
+namespace {
+
+const char magic[4] = {'C', 'H', 'P', 'X'};
+const uint32_t formatVersion = 1;
+
+// One position of one game, as collected before sorting.
+struct Entry {
+    uint64_t key;
+    uint32_t game;
+    uint32_t ply;
+
+    bool operator<(const Entry& o) const {
+        if (key != o.key) return key < o.key;
+        if (game != o.game) return game < o.game;
+        return ply < o.ply;
+    }
+};
+
+}  // namespace
+
+bool buildPositionIndex(std::string_view pgn, const std::string& path, int threads, int maxPly,
+                        std::string& error, PositionIndexStats* stats) {
+    if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(threads, 1);
+    std::vector<std::string_view> parts = splitPgn(pgn, threads);
+    size_t shards = static_cast<size_t>(threads);
+
+    // Parse: each part's positions go to per-shard vectors it alone owns,
+    // with game numbers local to the part until every part is counted.
+    struct Part {
+        std::vector<std::vector<Entry>> shards;
+        uint64_t games = 0, bad = 0;
+    };
+    std::vector<Part> parsed(parts.size());
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < parts.size(); t++) {
+        pool.emplace_back([&, t] {
+            Part& part = parsed[t];
+            part.shards.resize(shards);
+            PgnReader reader(parts[t]);
+            PgnGame game;
+            while (reader.next(game)) {
+                uint32_t id = static_cast<uint32_t>(part.games++);
+                if (!game.error.empty()) {
+                    part.bad++;
+                    continue;
+                }
+                Position pos = game.start;
+                size_t plies = game.moves.size();
+                if (maxPly > 0) plies = std::min(plies, static_cast<size_t>(maxPly));
+                for (size_t ply = 0;; ply++) {
+                    part.shards[keyShard(pos.key, shards)].push_back(
+                        {pos.key, id, static_cast<uint32_t>(ply)});
+                    if (ply == plies) break;
+                    pos.make(game.moves[ply]);
+                }
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+    pool.clear();
+
+    std::vector<uint32_t> base(parsed.size());
+    uint64_t games = 0, bad = 0;
+    for (size_t t = 0; t < parsed.size(); t++) {
+        if (games + parsed[t].games > UINT32_MAX) {
+            error = "too many games for a position index";
+            return false;
+        }
+        base[t] = static_cast<uint32_t>(games);
+        games += parsed[t].games;
+        bad += parsed[t].bad;
+    }
+
+    // Sort: each shard gathers its entries from every part, renumbers the
+    // games and keeps the first ply of each (position, game).
+    std::vector<std::vector<Entry>> sorted(shards);
+    for (size_t s = 0; s < shards; s++) {
+        pool.emplace_back([&, s] {
+            std::vector<Entry>& out = sorted[s];
+            size_t total = 0;
+            for (const Part& part : parsed) total += part.shards[s].size();
+            out.reserve(total);
+            for (size_t t = 0; t < parsed.size(); t++) {
+                std::vector<Entry>& in = parsed[t].shards[s];
+                for (Entry e : in) {
+                    e.game += base[t];
+                    out.push_back(e);
+                }
+                std::vector<Entry>().swap(in);
+            }
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end(),
+                                  [](const Entry& a, const Entry& b) {
+                                      return a.key == b.key && a.game == b.game;
+                                  }),
+                      out.end());
+        });
+    }
+    for (auto& t : pool) t.join();
+
+    // Write: shards are already in key order.
+    uint64_t postingCount = 0;
+    BucketDirectory directory;
+    for (const auto& shard : sorted) {
+        for (size_t i = 0; i < shard.size(); i++) {
+            if (i == 0 || shard[i].key != shard[i - 1].key) directory.add(shard[i].key);
+        }
+        postingCount += shard.size();
+    }
+    directory.finish();
+    uint64_t keyCount = directory.records();
+
+    KeyTableHeader header = {};
+    std::memcpy(header.magic, magic, 4);
+    header.version = formatVersion;
+    header.maxPly = static_cast<uint32_t>(std::max(maxPly, 0));
+    header.counts[0] = keyCount;
+    header.counts[1] = postingCount;
+    header.counts[2] = games;
+    auto writeBody = [&](std::ofstream& out) {
+        std::vector<uint64_t> buffer;
+        buffer.reserve(1 << 14);
+        auto flush = [&] {
+            out.write(reinterpret_cast<const char*>(buffer.data()),
+                      static_cast<std::streamsize>(buffer.size() * sizeof(uint64_t)));
+            buffer.clear();
+        };
+        uint64_t posting = 0;
+        for (const auto& shard : sorted) {
+            for (size_t i = 0; i < shard.size(); i++, posting++) {
+                if (i > 0 && shard[i].key == shard[i - 1].key) continue;
+                buffer.push_back(shard[i].key);
+                buffer.push_back(posting);
+                if (buffer.size() >= buffer.capacity() - 1) flush();
+            }
+        }
+        buffer.push_back(UINT64_MAX);  // sentinel
+        buffer.push_back(postingCount);
+        flush();
+        std::vector<PositionIndex::Posting> postings;
+        postings.reserve(1 << 14);
+        for (auto& shard : sorted) {
+            for (const Entry& e : shard) {
+                postings.push_back({e.game, e.ply});
+                if (postings.size() == postings.capacity()) {
+                    out.write(reinterpret_cast<const char*>(postings.data()),
+                              static_cast<std::streamsize>(postings.size() * sizeof(postings[0])));
+                    postings.clear();
+                }
+            }
+            std::vector<Entry>().swap(shard);
+        }
+        out.write(reinterpret_cast<const char*>(postings.data()),
+                  static_cast<std::streamsize>(postings.size() * sizeof(postings[0])));
+    };
+    if (!writeKeyTable(path, header, directory, writeBody, error)) return false;
+    if (stats != nullptr) *stats = {games, bad, keyCount, postingCount};
+    return true;
+}
+
+bool PositionIndex::open(const std::string& path, std::string& error) {
+    keyCount = gameCount = 0;
+    if (!file.open(path, error, false)) return false;
+    KeyTableView view;
+    if (!openKeyTable(file.text(), path, magic, formatVersion, "a position index", view, error)) {
+        return false;
+    }
+    uint64_t nkeys = view.header.counts[0], npostings = view.header.counts[1];
+    size_t size = view.body.size();
+    // The key count is checked first so that the sizes below cannot overflow.
+    if (nkeys >= size / sizeof(Key) ||
+        (size - (nkeys + 1) * sizeof(Key)) / sizeof(Posting) != npostings ||
+        (size - (nkeys + 1) * sizeof(Key)) % sizeof(Posting) != 0) {
+        error = path + " is truncated or damaged";
+        return false;
+    }
+    buckets = view.buckets;
+    keys = reinterpret_cast<const Key*>(view.body.data());
+    postings = reinterpret_cast<const Posting*>(keys + nkeys + 1);
+    keyCount = nkeys;
+    gameCount = view.header.counts[2];
+    plyLimit = static_cast<int>(view.header.maxPly);
+    return true;
+}
+
+std::span<const PositionIndex::Posting> PositionIndex::find(uint64_t key) const {
+    if (keyCount == 0) return {};
+    size_t bucket = keyBucket(key);
+    const Key* begin = keys + buckets[bucket];
+    const Key* end = keys + buckets[bucket + 1];
+    const Key* it = std::lower_bound(begin, end, key,
+                                     [](const Key& k, uint64_t value) { return k.key < value; });
+    if (it == end || it->key != key) return {};
+    return {postings + it->first, postings + (it + 1)->first};
+}
@@ -0,0 +1,84 @@
+// Position index over a game collection: for each position (by Zobrist key)
+// the games that reached it, and at which ply.
+//
+// File layout (integers little-endian, as written by the host):
+//
+//   header    64 bytes: magic "CHPX", version, max ply, key count, posting
+//             count, game count
+//   buckets   kBuckets + 1 64-bit entries: the first key whose top 16 bits
+//             are >= the bucket number, so a lookup searches one bucket
+//   keys      key count + 1 entries of {key, first posting}, sorted by key;
+//             the last is a sentinel whose first posting is the total
+//   postings  {game, ply} pairs, grouped by key and sorted by game
+//
+// Keys are Position::key, so positions match as repetitions do: side to
+// move, castling rights and a capturable en passant square count, the move
+// counters do not. A 64-bit key collision would add a false match; at the
+// sizes this is meant for the odds are negligible.
+
+#ifndef CHESS_POSINDEX_H
+#define CHESS_POSINDEX_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "pgn.h"
+
+struct PositionIndexStats {
+    uint64_t games = 0;     // games numbered, bad ones included
+    uint64_t badGames = 0;  // games not indexed (see PgnGame::error)
+    uint64_t keys = 0;      // distinct positions
+    uint64_t postings = 0;  // (position, game) pairs
+};
+
+/**
+ * Builds an index of every game in pgn, numbering games from 0 in file
+ * order (as PgnReader reads them, bad games included, so an ID is also the
+ * game's ordinal for --pgn-to-archive when no game is skipped). Each
+ * position is listed once per game, at the first ply that reached it;
+ * ply 0 is the start position. Positions after maxPly plies are left out
+ * (0 indexes whole games).
+ *
+ * Games are parsed on `threads` threads, each sorting its positions into
+ * shards by key; each shard is then sorted by its own thread, and shards are
+ * written in key order. Returns false and sets error on an I/O failure.
+ */
+bool buildPositionIndex(std::string_view pgn, const std::string& path, int threads, int maxPly,
+                        std::string& error, PositionIndexStats* stats = nullptr);
+
+/** A memory-mapped position index. Lookups are thread-safe. */
+class PositionIndex {
+   public:
+    struct Posting {
+        uint32_t game;
+        uint32_t ply;
+    };
+
+    /** Maps and validates path. Returns false and sets error on failure. */
+    bool open(const std::string& path, std::string& error);
+
+    /** The games that reached the position with this key, by game ID. */
+    std::span<const Posting> find(uint64_t key) const;
+
+    uint64_t games() const { return gameCount; }
+    uint64_t positions() const { return keyCount; }
+    int maxPly() const { return plyLimit; }
+
+   private:
+    struct Key {
+        uint64_t key;
+        uint64_t first;
+    };
+
+    MappedFile file;
+    const uint64_t* buckets = nullptr;
+    const Key* keys = nullptr;
+    const Posting* postings = nullptr;
+    uint64_t keyCount = 0;
+    uint64_t gameCount = 0;
+    int plyLimit = 0;
+};
+
+#endif  // CHESS_POSINDEX_H
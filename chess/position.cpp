@@ -0,0 +1,834 @@
+// Compact mailbox position: move generation, make/unmake and hashing.
+
+#include "position.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+
+namespace {
+
+const int knightDx[8] = {1, 1, -1, -1, 2, 2, -2, -2};
+const int knightDy[8] = {2, -2, 2, -2, 1, -1, 1, -1};
+const int kingDx[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+const int kingDy[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+const int rookDx[4] = {1, -1, 0, 0};
+const int rookDy[4] = {0, 0, 1, -1};
+const int bishopDx[4] = {1, 1, -1, -1};
+const int bishopDy[4] = {1, -1, 1, -1};
+
+inline bool onBoard(int x, int y) { return x >= 0 && x < 8 && y >= 0 && y < 8; }
+
+// Zobrist keys, generated deterministically (splitmix64) so hashes are stable
+// across runs and can be stored in on-disk indexes.
+struct ZobristKeys {
+    uint64_t piece[12][64];
+    uint64_t side;
+    uint64_t castling[16];
+    uint64_t epFile[8];
+
+    ZobristKeys() {
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        auto next = [&state]() {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        };
+        for (auto& row : piece)
+            for (auto& k : row) k = next();
+        side = next();
+        for (auto& k : castling) k = next();
+        for (auto& k : epFile) k = next();
+    }
+};
+
+const ZobristKeys& zobrist() {
+    static const ZobristKeys keys;
+    return keys;
+}
+
+// Index into ZobristKeys::piece for a non-empty piece code.
+inline int zIndex(int8_t code) { return code > 0 ? code - 1 : 5 - code; }
+
+// Castling rights that survive a move touching each square.
+uint8_t castleMask(int sq) {
+    switch (sq) {
+        case 0: return static_cast<uint8_t>(~CASTLE_WQ);
+        case 4: return static_cast<uint8_t>(~(CASTLE_WK | CASTLE_WQ));
+        case 7: return static_cast<uint8_t>(~CASTLE_WK);
+        case 56: return static_cast<uint8_t>(~CASTLE_BQ);
+        case 60: return static_cast<uint8_t>(~(CASTLE_BK | CASTLE_BQ));
+        case 63: return static_cast<uint8_t>(~CASTLE_BK);
+        default: return 0xF;
+    }
+}
+
+char pieceLetter(int8_t code) {
+    const char letters[] = {'p', 'r', 'n', 'b', 'k', 'q'};
+    char c = letters[typeOfCode(code)];
+    return code > 0 ? static_cast<char>(c - 32) : c;
+}
+
+}  // namespace
+
+////////////
+// POSMOVE
+
+ChessMove PosMove::toChessMove() const {
+    return ChessMove(rowOf(from), colOf(from), rowOf(to), colOf(to),
+                     static_cast<PieceType>(promo));
+}
+
+PosMove PosMove::fromChessMove(const ChessMove& cm) {
+    PosMove m;
+    m.from = static_cast<uint8_t>(squareOf(cm.getStartX(), cm.getStartY()));
+    m.to = static_cast<uint8_t>(squareOf(cm.getEndX(), cm.getEndY()));
+    m.promo = static_cast<uint8_t>(cm.getPromotion());
+    return m;
+}
+
+////////////
+// POSITION
+
+void Position::clear() {
+    for (auto& c : board) c = 0;
+    whiteTurn = true;
+    castling = 0;
+    epSquare = -1;
+    halfmoveClock = 0;
+    fullmoveNumber = 1;
+    kingSq[0] = kingSq[1] = -1;
+    key = 0;
+}
+
+void Position::put(int sq, int8_t code) {
+    board[sq] = code;
+    if (code != 0 && typeOfCode(code) == KING) kingSq[code > 0 ? 0 : 1] = static_cast<int8_t>(sq);
+}
+
+// The en passant file is only hashed when a pawn of the side to move could
+// capture there, mirroring the position identity rule in SPEC 4.3.
+static bool epCapturable(const Position& p) {
+    if (p.epSquare < 0) return false;
+    int x = rowOf(p.epSquare) + (p.whiteTurn ? -1 : 1);
+    int y = colOf(p.epSquare);
+    int8_t pawn = pieceCode(PAWN, p.whiteTurn);
+    return (y > 0 && p.board[squareOf(x, y - 1)] == pawn) ||
+           (y < 7 && p.board[squareOf(x, y + 1)] == pawn);
+}
+
+void Position::refresh() {
+    const ZobristKeys& z = zobrist();
+    key = 0;
+    kingSq[0] = kingSq[1] = -1;
+    for (int sq = 0; sq < 64; sq++) {
+        if (board[sq] == 0) continue;
+        key ^= z.piece[zIndex(board[sq])][sq];
+        if (typeOfCode(board[sq]) == KING) kingSq[board[sq] > 0 ? 0 : 1] = static_cast<int8_t>(sq);
+    }
+    if (!whiteTurn) key ^= z.side;
+    key ^= z.castling[castling];
+    if (epCapturable(*this)) key ^= z.epFile[colOf(epSquare)];
+}
+
+bool Position::fromFen(std::string_view fen, Position& out) {
+    return parseFen(fen, out) == FenError::None;
+}
+
+bool Position::fromGame(const ChessGame& game, Position& out) {
+    char fen[FEN_BUFFER_SIZE];
+    return fromFen(std::string_view(fen, game.writeFen(fen)), out);
+}
+
+namespace {
+
+bool isFenSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// A move counter: up to six digits.
+bool parseCounter(std::string_view s, int& v) {
+    if (s.empty() || s.size() > 6) return false;
+    v = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
+        v = v * 10 + (c - '0');
+    }
+    return true;
+}
+
+}  // namespace
+
+FenError parseFen(std::string_view fen, Position& out) {
+    std::string_view fields[6];
+    size_t i = 0;
+    for (int n = 0; n <= 6; n++) {
+        while (i < fen.size() && isFenSpace(fen[i])) i++;
+        size_t start = i;
+        while (i < fen.size() && !isFenSpace(fen[i])) i++;
+        if ((i > start) != (n < 6)) return FenError::FieldCount;
+        if (n < 6) fields[n] = fen.substr(start, i - start);
+    }
+
+    out.clear();
+    int pieces[2] = {}, pawns[2] = {}, kings[2] = {};
+    int x = 7, y = 0;
+    bool lastDigit = false;
+    for (char c : fields[0]) {
+        if (c == '/') {
+            if (y != 8 || x == 0) return FenError::Placement;
+            x--;
+            y = 0;
+            lastDigit = false;
+            continue;
+        }
+        if (c >= '1' && c <= '8') {
+            if (lastDigit) return FenError::Placement;
+            y += c - '0';
+            if (y > 8) return FenError::Placement;
+            lastDigit = true;
+            continue;
+        }
+        lastDigit = false;
+        bool white = c >= 'A' && c <= 'Z';
+        PieceType t;
+        switch (white ? static_cast<char>(c + 32) : c) {
+            case 'p': t = PAWN; break;
+            case 'r': t = ROOK; break;
+            case 'n': t = KNIGHT; break;
+            case 'b': t = BISHOP; break;
+            case 'q': t = QUEEN; break;
+            case 'k': t = KING; break;
+            default: return FenError::Placement;
+        }
+        if (y > 7) return FenError::Placement;
+        if (t == PAWN && (x == 0 || x == 7)) return FenError::PawnOnBackRank;
+        int side = white ? 0 : 1;
+        pieces[side]++;
+        if (t == PAWN) pawns[side]++;
+        if (t == KING) kings[side]++;
+        out.board[squareOf(x, y)] = pieceCode(t, white);
+        y++;
+    }
+    if (x != 0 || y != 8) return FenError::Placement;
+    if (kings[0] != 1 || kings[1] != 1) return FenError::KingCount;
+    if (pieces[0] > 16 || pieces[1] > 16 || pawns[0] > 8 || pawns[1] > 8) {
+        return FenError::PieceCount;
+    }
+
+    if (fields[1] != "w" && fields[1] != "b") return FenError::SideToMove;
+    out.whiteTurn = fields[1] == "w";
+
+    if (fields[2] != "-") {
+        const uint8_t bits[4] = {CASTLE_WK, CASTLE_WQ, CASTLE_BK, CASTLE_BQ};
+        int next = 0;
+        for (char c : fields[2]) {
+            size_t k = std::string_view("KQkq").find(c);
+            if (k == std::string_view::npos || static_cast<int>(k) < next) return FenError::Castling;
+            out.castling |= bits[k];
+            next = static_cast<int>(k) + 1;
+        }
+    }
+
+    if (fields[3] != "-") {
+        std::string_view ep = fields[3];
+        // A third-rank target follows a white double push, so Black is to
+        // move; a sixth-rank one, White.
+        if (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' ||
+            ep[1] != (out.whiteTurn ? '6' : '3')) {
+            return FenError::EnPassant;
+        }
+        out.epSquare = static_cast<int8_t>(squareOf(ep[1] - '1', ep[0] - 'a'));
+    }
+
+    if (!parseCounter(fields[4], out.halfmoveClock)) return FenError::HalfmoveClock;
+    if (!parseCounter(fields[5], out.fullmoveNumber) || out.fullmoveNumber < 1) {
+        return FenError::FullmoveNumber;
+    }
+
+    out.refresh();
+    int dx = rowOf(out.kingSq[0]) - rowOf(out.kingSq[1]);
+    int dy = colOf(out.kingSq[0]) - colOf(out.kingSq[1]);
+    if (std::abs(dx) <= 1 && std::abs(dy) <= 1) return FenError::AdjacentKings;
+    if (out.attacked(out.kingSq[out.whiteTurn ? 1 : 0], out.whiteTurn)) {
+        return FenError::OpponentInCheck;
+    }
+    return FenError::None;
+}
+
+size_t writeFen(const Position& pos, char* buf) {
+    char* p = buf;
+    for (int x = 7; x >= 0; x--) {
+        int empty = 0;
+        for (int y = 0; y < 8; y++) {
+            int8_t c = pos.board[squareOf(x, y)];
+            if (c == 0) {
+                empty++;
+                continue;
+            }
+            if (empty > 0) {
+                *p++ = static_cast<char>('0' + empty);
+                empty = 0;
+            }
+            *p++ = pieceLetter(c);
+        }
+        if (empty > 0) *p++ = static_cast<char>('0' + empty);
+        if (x > 0) *p++ = '/';
+    }
+    *p++ = ' ';
+    *p++ = pos.whiteTurn ? 'w' : 'b';
+    *p++ = ' ';
+    if (pos.castling == 0) *p++ = '-';
+    if (pos.castling & CASTLE_WK) *p++ = 'K';
+    if (pos.castling & CASTLE_WQ) *p++ = 'Q';
+    if (pos.castling & CASTLE_BK) *p++ = 'k';
+    if (pos.castling & CASTLE_BQ) *p++ = 'q';
+    *p++ = ' ';
+    if (pos.epSquare < 0) {
+        *p++ = '-';
+    } else {
+        *p++ = ChessMove::fileLetters[colOf(pos.epSquare)];
+        *p++ = static_cast<char>('1' + rowOf(pos.epSquare));
+    }
+    *p++ = ' ';
+    p = std::to_chars(p, buf + FEN_BUFFER_SIZE, pos.halfmoveClock).ptr;
+    *p++ = ' ';
+    p = std::to_chars(p, buf + FEN_BUFFER_SIZE, pos.fullmoveNumber).ptr;
+    return static_cast<size_t>(p - buf);
+}
+
+std::string Position::toFen() const {
+    char buf[FEN_BUFFER_SIZE];
+    return std::string(buf, writeFen(*this, buf));
+}
+
+bool Position::attacked(int sq, bool byWhite) const {
+    if (sq < 0) return true;  // missing king: treat as in check (see ChessBoard::checkCheck)
+    int x = rowOf(sq), y = colOf(sq);
+
+    // Pawns attack diagonally forward, so look one row "behind" sq.
+    int px = byWhite ? x - 1 : x + 1;
+    int8_t pawn = pieceCode(PAWN, byWhite);
+    if (px >= 0 && px < 8) {
+        if (y > 0 && board[squareOf(px, y - 1)] == pawn) return true;
+        if (y < 7 && board[squareOf(px, y + 1)] == pawn) return true;
+    }
+
+    int8_t knight = pieceCode(KNIGHT, byWhite);
+    for (int i = 0; i < 8; i++) {
+        int nx = x + knightDx[i], ny = y + knightDy[i];
+        if (onBoard(nx, ny) && board[squareOf(nx, ny)] == knight) return true;
+    }
+
+    int8_t king = pieceCode(KING, byWhite);
+    for (int i = 0; i < 8; i++) {
+        int nx = x + kingDx[i], ny = y + kingDy[i];
+        if (onBoard(nx, ny) && board[squareOf(nx, ny)] == king) return true;
+    }
+
+    int8_t rook = pieceCode(ROOK, byWhite), bishop = pieceCode(BISHOP, byWhite);
+    int8_t queen = pieceCode(QUEEN, byWhite);
+    for (int d = 0; d < 4; d++) {
+        for (int nx = x + rookDx[d], ny = y + rookDy[d]; onBoard(nx, ny);
+             nx += rookDx[d], ny += rookDy[d]) {
+            int8_t c = board[squareOf(nx, ny)];
+            if (c == 0) continue;
+            if (c == rook || c == queen) return true;
+            break;
+        }
+        for (int nx = x + bishopDx[d], ny = y + bishopDy[d]; onBoard(nx, ny);
+             nx += bishopDx[d], ny += bishopDy[d]) {
+            int8_t c = board[squareOf(nx, ny)];
+            if (c == 0) continue;
+            if (c == bishop || c == queen) return true;
+            break;
+        }
+    }
+    return false;
+}
+
+void Position::generatePseudo(MoveList& list) const {
+    bool w = whiteTurn;
+    for (int sq = 0; sq < 64; sq++) {
+        int8_t c = board[sq];
+        if (c == 0 || (c > 0) != w) continue;
+        int x = rowOf(sq), y = colOf(sq);
+        PieceType t = typeOfCode(c);
+
+        auto target = [&](int nx, int ny) {
+            // Returns 0 = empty, 1 = enemy piece, 2 = own piece/off board.
+            if (!onBoard(nx, ny)) return 2;
+            int8_t d = board[squareOf(nx, ny)];
+            if (d == 0) return 0;
+            return ((d > 0) == w) ? 2 : 1;
+        };
+
+        switch (t) {
+            case PAWN: {
+                int dir = w ? 1 : -1;
+                int nx = x + dir;
+                bool promo = (nx == 0 || nx == 7);
+                auto add = [&](int to) {
+                    if (promo) {
+                        for (PieceType p : {QUEEN, ROOK, KNIGHT, BISHOP}) list.push(sq, to, p);
+                    } else {
+                        list.push(sq, to);
+                    }
+                };
+                if (target(nx, y) == 0) {
+                    add(squareOf(nx, y));
+                    int startRow = w ? 1 : 6;
+                    if (x == startRow && target(nx + dir, y) == 0)
+                        list.push(sq, squareOf(nx + dir, y));
+                }
+                for (int dy : {-1, 1}) {
+                    int ny = y + dy;
+                    if (!onBoard(nx, ny)) continue;
+                    int to = squareOf(nx, ny);
+                    if (target(nx, ny) == 1 || to == epSquare) add(to);
+                }
+                break;
+            }
+            case KNIGHT:
+                for (int i = 0; i < 8; i++) {
+                    int nx = x + knightDx[i], ny = y + knightDy[i];
+                    if (target(nx, ny) != 2) list.push(sq, squareOf(nx, ny));
+                }
+                break;
+            case KING: {
+                for (int i = 0; i < 8; i++) {
+                    int nx = x + kingDx[i], ny = y + kingDy[i];
+                    if (target(nx, ny) != 2) list.push(sq, squareOf(nx, ny));
+                }
+                // Castling: rights, empty path, rook present, and the king may
+                // not start on, pass through or land on an attacked square.
+                int home = w ? 4 : 60;
+                if (sq != home) break;
+                uint8_t ks = w ? CASTLE_WK : CASTLE_BK, qs = w ? CASTLE_WQ : CASTLE_BQ;
+                int8_t rook = pieceCode(ROOK, w);
+                if ((castling & ks) && board[home + 1] == 0 && board[home + 2] == 0 &&
+                    board[home + 3] == rook && !attacked(home, !w) && !attacked(home + 1, !w) &&
+                    !attacked(home + 2, !w))
+                    list.push(sq, home + 2);
+                if ((castling & qs) && board[home - 1] == 0 && board[home - 2] == 0 &&
+                    board[home - 3] == 0 && board[home - 4] == rook && !attacked(home, !w) &&
+                    !attacked(home - 1, !w) && !attacked(home - 2, !w))
+                    list.push(sq, home - 2);
+                break;
+            }
+            case ROOK:
+            case BISHOP:
+            case QUEEN: {
+                for (int d = 0; d < 8; d++) {
+                    int dx, dy;
+                    if (d < 4) {
+                        if (t == BISHOP) continue;
+                        dx = rookDx[d];
+                        dy = rookDy[d];
+                    } else {
+                        if (t == ROOK) continue;
+                        dx = bishopDx[d - 4];
+                        dy = bishopDy[d - 4];
+                    }
+                    for (int nx = x + dx, ny = y + dy;; nx += dx, ny += dy) {
+                        int r = target(nx, ny);
+                        if (r == 2) break;
+                        list.push(sq, squareOf(nx, ny));
+                        if (r == 1) break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+void Position::generateLegal(MoveList& list) {
+    MoveList pseudo;
+    generatePseudo(pseudo);
+    list.size = 0;
+    bool mover = whiteTurn;
+    for (const PosMove& m : pseudo) {
+        PosUndo u = make(m);
+        if (!attacked(kingSq[mover ? 0 : 1], !mover)) list.moves[list.size++] = m;
+        unmake(m, u);
+    }
+    ChessGame::addLegalMovesGenerated(list.size);
+}
+
+bool Position::hasLegalMove() {
+    MoveList pseudo;
+    generatePseudo(pseudo);
+    bool mover = whiteTurn;
+    for (const PosMove& m : pseudo) {
+        PosUndo u = make(m);
+        bool legal = !attacked(kingSq[mover ? 0 : 1], !mover);
+        unmake(m, u);
+        if (legal) {
+            ChessGame::addLegalMovesGenerated(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Position::isCapture(const PosMove& m) const {
+    if (board[m.to] != 0) return true;
+    return m.to == epSquare && board[m.from] != 0 && typeOfCode(board[m.from]) == PAWN;
+}
+
+PosUndo Position::make(const PosMove& m) {
+    const ZobristKeys& z = zobrist();
+    PosUndo u;
+    u.castling = castling;
+    u.epSquare = epSquare;
+    u.halfmoveClock = halfmoveClock;
+    u.key = key;
+
+    int8_t piece = board[m.from];
+    PieceType t = typeOfCode(piece);
+    u.captured = board[m.to];
+    u.capturedSq = m.to;
+    if (t == PAWN && m.to == epSquare && u.captured == 0) {
+        u.capturedSq = static_cast<uint8_t>(whiteTurn ? m.to - 8 : m.to + 8);
+        u.captured = board[u.capturedSq];
+    }
+
+    if (epCapturable(*this)) key ^= z.epFile[colOf(epSquare)];
+    key ^= z.castling[castling];
+
+    if (u.captured != 0) {
+        key ^= z.piece[zIndex(u.captured)][u.capturedSq];
+        board[u.capturedSq] = 0;
+    }
+    key ^= z.piece[zIndex(piece)][m.from];
+    board[m.from] = 0;
+    int8_t placed = (m.promo != PAWN) ? pieceCode(static_cast<PieceType>(m.promo), piece > 0)
+                                      : piece;
+    board[m.to] = placed;
+    key ^= z.piece[zIndex(placed)][m.to];
+
+    if (t == KING) {
+        kingSq[piece > 0 ? 0 : 1] = static_cast<int8_t>(m.to);
+        int diff = m.to - m.from;
+        if (diff == 2 || diff == -2) {
+            int rookFrom = diff > 0 ? m.from + 3 : m.from - 4;
+            int rookTo = diff > 0 ? m.from + 1 : m.from - 1;
+            int8_t rook = board[rookFrom];
+            board[rookFrom] = 0;
+            board[rookTo] = rook;
+            key ^= z.piece[zIndex(rook)][rookFrom] ^ z.piece[zIndex(rook)][rookTo];
+        }
+    }
+
+    castling &= castleMask(m.from) & castleMask(m.to);
+    epSquare = -1;
+    if (t == PAWN && (m.to - m.from == 16 || m.from - m.to == 16))
+        epSquare = static_cast<int8_t>((m.from + m.to) / 2);
+    halfmoveClock = (t == PAWN || u.captured != 0) ? 0 : halfmoveClock + 1;
+    if (!whiteTurn) fullmoveNumber++;
+    whiteTurn = !whiteTurn;
+
+    key ^= z.side;
+    key ^= z.castling[castling];
+    if (epCapturable(*this)) key ^= z.epFile[colOf(epSquare)];
+    return u;
+}
+
+void Position::unmake(const PosMove& m, const PosUndo& u) {
+    whiteTurn = !whiteTurn;
+    if (!whiteTurn) fullmoveNumber--;
+    int8_t placed = board[m.to];
+    int8_t piece = (m.promo != PAWN) ? pieceCode(PAWN, placed > 0) : placed;
+    board[m.to] = 0;
+    board[m.from] = piece;
+    if (u.captured != 0) board[u.capturedSq] = u.captured;
+
+    if (typeOfCode(piece) == KING) {
+        kingSq[piece > 0 ? 0 : 1] = static_cast<int8_t>(m.from);
+        int diff = m.to - m.from;
+        if (diff == 2 || diff == -2) {
+            int rookFrom = diff > 0 ? m.from + 3 : m.from - 4;
+            int rookTo = diff > 0 ? m.from + 1 : m.from - 1;
+            board[rookFrom] = board[rookTo];
+            board[rookTo] = 0;
+        }
+    }
+
+    castling = u.castling;
+    epSquare = u.epSquare;
+    halfmoveClock = u.halfmoveClock;
+    key = u.key;
+}
+
+uint64_t Position::perft(int depth, const std::atomic<bool>* stop) {
+    MoveList list;
+    generateLegal(list);
+    if (depth <= 1) return depth == 1 ? static_cast<uint64_t>(list.size) : 1;
+    uint64_t nodes = 0;
+    for (const PosMove& m : list) {
+        // Polled above the last two plies, where nearly all the work is.
+        if (stop != nullptr && depth >= 3 && stop->load(std::memory_order_relaxed)) break;
+        PosUndo u = make(m);
+        nodes += perft(depth - 1, stop);
+        unmake(m, u);
+    }
+    return nodes;
+}
+
+namespace {
+
+// Squares of pieces with the given code that reach `to` by their own
+// movement, blocked by pieces in between but ignoring pins. This is the
+// geometric test ChessGame::toSan uses for disambiguation.
+uint64_t reachers(const Position& pos, int to, int8_t code) {
+    uint64_t found = 0;
+    int x = rowOf(to), y = colOf(to);
+    auto step = [&](const int* dx, const int* dy, int n, bool slide) {
+        for (int d = 0; d < n; d++) {
+            for (int nx = x + dx[d], ny = y + dy[d]; onBoard(nx, ny);
+                 nx += dx[d], ny += dy[d]) {
+                int8_t c = pos.board[squareOf(nx, ny)];
+                if (c == code) found |= 1ULL << squareOf(nx, ny);
+                if (c != 0 || !slide) break;
+            }
+        }
+    };
+    switch (typeOfCode(code)) {
+        case KNIGHT: step(knightDx, knightDy, 8, false); break;
+        case KING: step(kingDx, kingDy, 8, false); break;
+        case ROOK: step(rookDx, rookDy, 4, true); break;
+        case BISHOP: step(bishopDx, bishopDy, 4, true); break;
+        case QUEEN:
+            step(rookDx, rookDy, 4, true);
+            step(bishopDx, bishopDy, 4, true);
+            break;
+        case PAWN: break;
+    }
+    return found;
+}
+
+// reachers() results for one position, filled in on first use.
+struct ReachCache {
+    uint64_t mask[6][64];
+    uint64_t known[6] = {};  // bit sq set once mask[type][sq] is valid
+};
+
+// Appends the SAN of m to san.
+void appendSanWith(Position& pos, const PosMove& m, ReachCache& cache, std::string& san) {
+    static const char kLetters[] = {'?', 'R', 'N', 'B', 'K', 'Q'};
+    int8_t code = pos.board[m.from];
+    if (code == 0) return;
+    PieceType type = typeOfCode(code);
+    int fx = rowOf(m.from), fy = colOf(m.from);
+    int tx = rowOf(m.to), ty = colOf(m.to);
+
+    if (type == KING && std::abs(fy - ty) == 2) {
+        san += ty > fy ? "O-O" : "O-O-O";
+    } else {
+        if (type != PAWN) {
+            san += kLetters[type];
+            if (!(cache.known[type] >> m.to & 1)) {
+                cache.mask[type][m.to] = reachers(pos, m.to, code);
+                cache.known[type] |= 1ULL << m.to;
+            }
+            uint64_t others = cache.mask[type][m.to] & ~(1ULL << m.from);
+            if (others != 0) {
+                bool sameFile = false, sameRank = false;
+                for (int sq = 0; sq < 64; sq++) {
+                    if (!(others >> sq & 1)) continue;
+                    if (colOf(sq) == fy) sameFile = true;
+                    if (rowOf(sq) == fx) sameRank = true;
+                }
+                if (!sameFile || sameRank) san += static_cast<char>('a' + fy);
+                if (sameFile) san += static_cast<char>('1' + fx);
+            }
+        }
+        bool capture = pos.board[m.to] != 0 || (type == PAWN && fy != ty);
+        if (capture) {
+            if (type == PAWN) san += static_cast<char>('a' + fy);
+            san += 'x';
+        }
+        san += static_cast<char>('a' + ty);
+        san += static_cast<char>('1' + tx);
+        if (m.promo != PAWN) {
+            san += '=';
+            san += kLetters[m.promo];
+        }
+    }
+
+    PosUndo u = pos.make(m);
+    if (pos.inCheck()) san += pos.hasLegalMove() ? '+' : '#';
+    pos.unmake(m, u);
+}
+
+std::string sanWith(Position& pos, const PosMove& m, ReachCache& cache) {
+    std::string san;
+    appendSanWith(pos, m, cache, san);
+    return san;
+}
+
+}  // namespace
+
+SanMoveTable::SanMoveTable(const Position& pos) {
+    MoveList pseudo;
+    pos.generatePseudo(pseudo);
+    // Counting sort by slot: count, turn counts into start offsets, place.
+    uint16_t next[64 * 6 + 1] = {};
+    for (const PosMove& m : pseudo) next[m.to * 6 + typeOfCode(pos.board[m.from]) + 1]++;
+    for (int slot = 0; slot < 64 * 6; slot++) next[slot + 1] += next[slot];
+    std::copy(std::begin(next), std::end(next), first);
+    for (const PosMove& m : pseudo) moves[next[m.to * 6 + typeOfCode(pos.board[m.from])]++] = m;
+}
+
+bool parseSan(Position& pos, std::string_view san, PosMove& out) {
+    return parseSan(pos, SanMoveTable(pos), san, out);
+}
+
+bool parseSan(Position& pos, const SanMoveTable& table, std::string_view san, PosMove& out) {
+    char suffix = 0;
+    if (!san.empty() && (san.back() == '+' || san.back() == '#')) {
+        suffix = san.back();
+        san.remove_suffix(1);
+        if (!san.empty() && (san.back() == '+' || san.back() == '#')) return false;
+    }
+    if (san.empty()) return false;
+
+    int piece = PAWN, promo = PAWN, to, file = -1, rank = -1;
+    bool capture = false;
+    int home = pos.kingSq[pos.whiteTurn ? 0 : 1];
+    if (san == "O-O" || san == "O-O-O") {
+        piece = KING;
+        file = colOf(home);
+        rank = rowOf(home);
+        to = home + (san.size() == 3 ? 2 : -2);
+    } else {
+        if (san.size() >= 2 && san[san.size() - 2] == '=') {
+            switch (san.back()) {
+                case 'Q': promo = QUEEN; break;
+                case 'R': promo = ROOK; break;
+                case 'B': promo = BISHOP; break;
+                case 'N': promo = KNIGHT; break;
+                default: return false;
+            }
+            san.remove_suffix(2);
+        }
+        if (!san.empty() && san[0] >= 'A' && san[0] <= 'Z') {
+            switch (san[0]) {
+                case 'K': piece = KING; break;
+                case 'Q': piece = QUEEN; break;
+                case 'R': piece = ROOK; break;
+                case 'B': piece = BISHOP; break;
+                case 'N': piece = KNIGHT; break;
+                default: return false;
+            }
+            san.remove_prefix(1);
+        }
+        // What remains is [file][rank][x]destination, 'x' allowed anywhere.
+        int destFile = -1, destRank = -1;
+        for (char c : san) {
+            if (c == 'x') {
+                capture = true;
+                continue;
+            }
+            if (destRank >= 0) {
+                // A second square: the first was disambiguation.
+                if (destFile >= 0) file = destFile;
+                rank = destRank;
+                destFile = destRank = -1;
+            }
+            if (c >= 'a' && c <= 'h') {
+                if (destFile >= 0) file = destFile;
+                destFile = c - 'a';
+            } else if (c >= '1' && c <= '8') {
+                if (destFile < 0) {
+                    rank = c - '1';
+                    continue;
+                }
+                destRank = c - '1';
+            } else {
+                return false;
+            }
+        }
+        if (destFile < 0 || destRank < 0) return false;
+        to = squareOf(destRank, destFile);
+    }
+    if (to < 0 || to > 63) return false;
+
+    bool mover = pos.whiteTurn;
+    int matches = 0;
+    for (const PosMove& m : table.find(to, static_cast<PieceType>(piece))) {
+        if (m.promo != promo) continue;
+        if (file >= 0 && colOf(m.from) != file) continue;
+        if (rank >= 0 && rowOf(m.from) != rank) continue;
+        PosUndo u = pos.make(m);
+        bool legal = !pos.attacked(pos.kingSq[mover ? 0 : 1], !mover);
+        pos.unmake(m, u);
+        if (!legal) continue;
+        out = m;
+        if (++matches > 1) return false;
+    }
+    if (matches != 1) return false;
+
+    // 'x' must be a capture: an occupied destination, or en passant.
+    if (capture && pos.board[to] == 0 && !(piece == PAWN && colOf(out.from) != colOf(to))) {
+        return false;
+    }
+    if (suffix != 0) {
+        PosUndo u = pos.make(out);
+        bool check = pos.inCheck();
+        bool mate = check && !pos.hasLegalMove();
+        pos.unmake(out, u);
+        if (suffix == '+' ? !check : !mate) return false;
+    }
+    return true;
+}
+
+std::string sanOf(Position& pos, const PosMove& m) {
+    ReachCache cache;
+    return sanWith(pos, m, cache);
+}
+
+void appendSan(Position& pos, const PosMove& m, std::string& out) {
+    ReachCache cache;
+    appendSanWith(pos, m, cache, out);
+}
+
+std::vector<std::string> sanOf(Position& pos, const std::vector<ChessMove>& moves) {
+    ReachCache cache;
+    std::vector<std::string> out;
+    out.reserve(moves.size());
+    for (const ChessMove& cm : moves) out.push_back(sanWith(pos, PosMove::fromChessMove(cm), cache));
+    return out;
+}
+
+std::vector<std::string> historySan(const ChessGame& game) {
+    std::vector<std::string> out;
+    Position pos;
+    if (!Position::fromFen(game.getStartFen(), pos)) return out;
+    out.reserve(game.getHistory().size());
+    for (const ChessMove& cm : game.getHistory()) {
+        if (cm.isEnd()) {
+            out.push_back(cm.toString());
+            continue;
+        }
+        PosMove m = PosMove::fromChessMove(cm);
+        out.push_back(sanOf(pos, m));
+        pos.make(m);
+    }
+    return out;
+}
+
+std::vector<std::string> sanLine(const ChessGame& game, const std::vector<PosMove>& line) {
+    std::vector<std::string> out;
+    auto copy = ChessGame::fromFen(game.toFen());
+    if (!copy) return out;
+    for (const PosMove& m : line) {
+        ChessMove cm = m.toChessMove();
+        std::string san = copy->toSan(cm);
+        if (!copy->makeMove(cm)) break;
+        out.push_back(san);
+    }
+    return out;
+}
@@ -0,0 +1,198 @@
+// Compact mailbox position used by the search-heavy tools (tablebases,
+// solvers, analysis). ChessGame remains the rules authority for interactive
+// play; a Position is built from a ChessGame or a FEN string when an
+// algorithm needs to make and unmake millions of moves cheaply.
+
+#ifndef CHESS_POSITION_H
+#define CHESS_POSITION_H
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chess.h"
+
+// Squares are numbered sq = x * 8 + y, following the board convention in
+// chess.h (x = row/rank, y = column/file), so a1 = 0, h1 = 7, a8 = 56.
+inline int squareOf(int x, int y) { return x * 8 + y; }
+inline int rowOf(int sq) { return sq >> 3; }
+inline int colOf(int sq) { return sq & 7; }
+
+// Castling right bits stored in Position::castling.
+enum CastlingBits : uint8_t {
+    CASTLE_WK = 1,  // white kingside
+    CASTLE_WQ = 2,  // white queenside
+    CASTLE_BK = 4,  // black kingside
+    CASTLE_BQ = 8,  // black queenside
+};
+
+/**
+ * A move on a Position: from/to squares plus the promotion piece, using the
+ * same "PAWN means no promotion" convention as ChessMove.
+ */
+struct PosMove {
+    uint8_t from = 0;
+    uint8_t to = 0;
+    uint8_t promo = PAWN;
+
+    bool operator==(const PosMove& o) const {
+        return from == o.from && to == o.to && promo == o.promo;
+    }
+
+    ChessMove toChessMove() const;
+    static PosMove fromChessMove(const ChessMove& cm);
+};
+
+/** Fixed-capacity move list; 256 exceeds the legal maximum of 218. */
+struct MoveList {
+    PosMove moves[256];
+    int size = 0;
+
+    void push(int from, int to, int promo = PAWN) {
+        moves[size].from = static_cast<uint8_t>(from);
+        moves[size].to = static_cast<uint8_t>(to);
+        moves[size].promo = static_cast<uint8_t>(promo);
+        size++;
+    }
+    const PosMove* begin() const { return moves; }
+    const PosMove* end() const { return moves + size; }
+};
+
+/** State needed to unmake a move; returned by Position::make. */
+struct PosUndo {
+    int8_t captured = 0;
+    uint8_t capturedSq = 0;
+    uint8_t castling = 0;
+    int8_t epSquare = -1;
+    int halfmoveClock = 0;
+    uint64_t key = 0;
+};
+
+/**
+ * Piece codes on Position::board: 0 is empty, PieceType + 1 for white and
+ * -(PieceType + 1) for black.
+ */
+inline int8_t pieceCode(PieceType t, bool white) {
+    return static_cast<int8_t>(white ? t + 1 : -(t + 1));
+}
+inline PieceType typeOfCode(int8_t code) {
+    return static_cast<PieceType>((code > 0 ? code : -code) - 1);
+}
+
+struct Position {
+    int8_t board[64] = {};
+    bool whiteTurn = true;
+    uint8_t castling = 0;
+    int8_t epSquare = -1;  // en passant target square, -1 if none
+    int halfmoveClock = 0;
+    int fullmoveNumber = 1;
+    int8_t kingSq[2] = {-1, -1};  // [0] = white, [1] = black
+    uint64_t key = 0;             // Zobrist hash, maintained by make/unmake
+
+    /** parseFen() for callers that need no reason for a rejection. */
+    static bool fromFen(std::string_view fen, Position& out);
+    static bool fromGame(const ChessGame& game, Position& out);
+    std::string toFen() const;
+
+    void clear();
+    void put(int sq, int8_t code);
+
+    /** Recomputes key and kingSq from scratch (after manual edits). */
+    void refresh();
+
+    bool attacked(int sq, bool byWhite) const;
+    bool inCheck() const { return attacked(kingSq[whiteTurn ? 0 : 1], !whiteTurn); }
+
+    /** Pseudo-legal moves: legal except that the mover may be left in check. */
+    void generatePseudo(MoveList& list) const;
+    /** Fully legal moves. Makes and unmakes each candidate, so not const. */
+    void generateLegal(MoveList& list);
+    bool hasLegalMove();
+
+    bool isCapture(const PosMove& m) const;
+
+    PosUndo make(const PosMove& m);
+    void unmake(const PosMove& m, const PosUndo& u);
+
+    /**
+     * Number of leaf nodes of the legal move tree to the given depth. Setting
+     * *stop from another thread ends the count early, with a partial total.
+     */
+    uint64_t perft(int depth, const std::atomic<bool>* stop = nullptr);
+};
+
+/**
+ * Parses a FEN into out in one pass; the FEN parser behind ChessGame::fromFen
+ * and Position::fromFen. Checks the syntax of each field, one king per side
+ * that are not adjacent, at most 16 pieces and 8 pawns per side, no pawns
+ * on a back rank, castling rights in "KQkq" order, an en passant square on
+ * the rank the side to move implies, and the side not to move not in check.
+ * Fields may be separated by any whitespace. Allocates nothing.
+ */
+FenError parseFen(std::string_view fen, Position& out);
+
+/** Writes pos's FEN into buf (FEN_BUFFER_SIZE chars) and returns its length. */
+size_t writeFen(const Position& pos, char* buf);
+
+/** SAN of a legal move in pos, exactly as ChessGame::toSan writes it. pos is left unchanged. */
+std::string sanOf(Position& pos, const PosMove& m);
+/** sanOf(pos, m) appended to out, for writers that reuse one buffer. */
+void appendSan(Position& pos, const PosMove& m, std::string& out);
+
+/**
+ * The moves of one position indexed by destination square and moving piece
+ * type, for resolving SAN. Built once per position from its pseudo-legal
+ * moves; parseSan() tests only the candidates a SAN string selects for
+ * legality, so a table costs one move generation however many strings are
+ * read against it.
+ */
+class SanMoveTable {
+   public:
+    explicit SanMoveTable(const Position& pos);
+
+    /** Moves of a `type` piece to `to`, in generation order. */
+    std::span<const PosMove> find(int to, PieceType type) const {
+        int slot = to * 6 + type;
+        return {moves + first[slot], moves + first[slot + 1]};
+    }
+
+   private:
+    PosMove moves[256];
+    uint16_t first[64 * 6 + 1];  // moves of slot to * 6 + type start at first[slot]
+};
+
+/**
+ * Parses SAN for pos: the piece letter, optional file and rank, 'x' for a
+ * capture (which must be one), the destination, "=Q" style promotion, and
+ * "O-O" or "O-O-O". A "+" or "#" suffix must be true of the move, which is
+ * tested by making and unmaking it. Nothing is allocated and pos is left
+ * unchanged. Returns false for an illegal, ambiguous or malformed move.
+ */
+bool parseSan(Position& pos, std::string_view san, PosMove& out);
+/** parseSan() resolving candidates through table, which must be pos's. */
+bool parseSan(Position& pos, const SanMoveTable& table, std::string_view san, PosMove& out);
+
+/**
+ * SAN of each of the moves, all legal in pos (e.g. a legalMoves list), in
+ * order. Disambiguation is worked out once per destination and piece type
+ * and shared by every move that needs it.
+ */
+std::vector<std::string> sanOf(Position& pos, const std::vector<ChessMove>& moves);
+
+/**
+ * SAN of every move in the game's history, replayed from its starting
+ * position. Placeholder entries of a game set up from a FEN are copied as
+ * they appear in the history.
+ */
+std::vector<std::string> historySan(const ChessGame& game);
+
+/**
+ * SAN for a line of moves played from the game's current position. The game
+ * itself is not modified; conversion stops at the first illegal move.
+ */
+std::vector<std::string> sanLine(const ChessGame& game, const std::vector<PosMove>& line);
+
+#endif  // CHESS_POSITION_H
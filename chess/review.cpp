@@ -0,0 +1,185 @@
+// Whole-game review.
+
+#include "review.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "chess.h"
+#include "pgn.h"
+#include "search.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Losses are measured on scores clamped to this range, so that "mate in 3"
+// versus "mate in 5" is not a blunder but throwing away a mate is.
+constexpr int kClampCp = 1000;
+
+int clampForLoss(int score) {
+    return std::clamp(score, -kClampCp, kClampCp);
+}
+
+const char* classify(int loss) {
+    if (loss >= BLUNDER_LOSS) return "blunder";
+    if (loss >= MISTAKE_LOSS) return "mistake";
+    if (loss >= INACCURACY_LOSS) return "inaccuracy";
+    return nullptr;
+}
+
+json scoreToJson(int whiteScore) {
+    if (isMateScore(whiteScore)) return {{"mate", mateInMoves(whiteScore)}};
+    return {{"cp", whiteScore}};
+}
+
+const char* nagFor(const char* classification) {
+    if (classification == nullptr) return "";
+    std::string c = classification;
+    if (c == "blunder") return " $4";
+    if (c == "mistake") return " $2";
+    return " $6";
+}
+
+// One searched position of the game.
+struct Analysis {
+    SearchResult search;
+    std::string bestSan;
+};
+
+}  // namespace
+
+bool reviewGame(const std::string& startFen, const std::vector<std::string>& moves,
+                const ReviewOptions& options, GameReview& out, std::string& error) {
+    auto game = ChessGame::fromFen(startFen);
+    if (!game) {
+        error = "invalid FEN string";
+        return false;
+    }
+
+    // Replay the game once to validate it and collect every position.
+    out = GameReview();
+    out.startFen = game->toFen();  // normalized: fromFen accepts any whitespace
+    bool whiteFirst = game->getTurn();
+    std::vector<std::string> fens = {out.startFen};
+    for (size_t i = 0; i < moves.size(); i++) {
+        ChessMove cm = game->parseMove(moves[i]);
+        PlyReview ply;
+        ply.ply = static_cast<int>(i) + 1;
+        ply.san = game->toSan(cm);
+        if (cm.isEnd() || !game->makeMove(cm)) {
+            error = "illegal or invalid move at ply " + std::to_string(i + 1) + ": " + moves[i];
+            return false;
+        }
+        ply.lan = cm.toString();
+        out.plies.push_back(ply);
+        fens.push_back(game->toFen());
+    }
+    bool toMove = game->getTurn();
+    if (game->checkmate(toMove)) {
+        out.result = toMove ? "0-1" : "1-0";
+    } else if (game->stalemate(toMove) || game->isAutomaticDraw()) {
+        out.result = "1/2-1/2";
+    }
+
+    // Search every position independently on a pool of workers.
+    SearchLimits limits;
+    limits.nodes = options.nodes;
+    limits.movetimeMs = options.movetimeMs;
+    limits.stop = options.stop;
+    std::vector<Analysis> analysis(fens.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < fens.size();) {
+            if (options.stop != nullptr && options.stop->load()) return;
+            Position pos;
+            Position::fromFen(fens[i], pos);
+            analysis[i].search = search(pos, limits);
+            if (analysis[i].search.hasMove) {
+                auto before = ChessGame::fromFen(fens[i]);
+                analysis[i].bestSan = before->toSan(analysis[i].search.best.toChessMove());
+            }
+        }
+    };
+    int threads = options.threads > 0 ? options.threads
+                                      : static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::clamp(threads, 1, static_cast<int>(fens.size()));
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+    if (options.stop != nullptr && options.stop->load()) {
+        error = "review stopped";
+        return false;
+    }
+
+    // Scores come back from the side to move's point of view; a ply's
+    // played score is the negated score of the following position.
+    for (size_t i = 0; i < out.plies.size(); i++) {
+        PlyReview& ply = out.plies[i];
+        const SearchResult& before = analysis[i].search;
+        int best = before.score;
+        int played = -analysis[i + 1].search.score;
+        // Playing the engine's own choice loses nothing, whatever the
+        // deeper look at the next position says.
+        bool playedBest = std::string(before.best.toChessMove().toString()) == ply.lan;
+        int sign = (i % 2 == 0) == whiteFirst ? 1 : -1;
+        ply.bestSan = analysis[i].bestSan;
+        ply.bestLan = before.best.toChessMove().toString();
+        ply.bestScore = sign * best;
+        ply.playedScore = sign * played;
+        ply.loss = playedBest ? 0 : std::max(0, clampForLoss(best) - clampForLoss(played));
+        ply.classification = classify(ply.loss);
+    }
+    return true;
+}
+
+json reviewToJson(const GameReview& review) {
+    json plies = json::array();
+    for (const PlyReview& p : review.plies) {
+        plies.push_back({{"ply", p.ply},
+                         {"san", p.san},
+                         {"lan", p.lan},
+                         {"eval", scoreToJson(p.playedScore)},
+                         {"best", p.bestSan},
+                         {"best_lan", p.bestLan},
+                         {"best_eval", scoreToJson(p.bestScore)},
+                         {"loss", p.loss},
+                         {"classification", p.classification ? json(p.classification) : json()}});
+    }
+    return {{"start_fen", review.startFen}, {"result", review.result}, {"plies", plies}};
+}
+
+std::string reviewToPgn(const GameReview& review) {
+    static const std::string kStartFen =
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    std::string pgn = "[Event \"Game review\"]\n";
+    if (review.startFen != kStartFen) {
+        pgn += "[SetUp \"1\"]\n[FEN \"" + review.startFen + "\"]\n";
+    }
+    pgn += "[Result \"" + review.result + "\"]\n\n";
+
+    Position start;
+    if (!Position::fromFen(review.startFen, start)) Position::fromFen(kStartFen, start);
+    bool whiteFirst = start.whiteTurn;
+    int moveNumber = start.fullmoveNumber;
+    for (size_t i = 0; i < review.plies.size(); i++) {
+        const PlyReview& p = review.plies[i];
+        bool white = (i % 2 == 0) == whiteFirst;
+        if (white) {
+            pgn += std::to_string(moveNumber) + ". ";
+        } else if (i == 0) {
+            pgn += std::to_string(moveNumber) + "... ";
+        }
+        pgn += p.san;
+        pgn += nagFor(p.classification);
+        pgn += " {";
+        appendEvalTag(p.playedScore, pgn);
+        if (p.classification != nullptr) pgn += " " + p.bestSan + " was best.";
+        pgn += "} ";
+        if (!white) moveNumber++;
+    }
+    pgn += review.result + "\n";
+    return pgn;
+}
@@ -0,0 +1,62 @@
+// Whole-game review: per-ply evaluations, mistake flags and best
+// alternatives, with every position searched concurrently.
+
+#ifndef CHESS_REVIEW_H
+#define CHESS_REVIEW_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+// Centipawn losses at which a move is flagged.
+constexpr int INACCURACY_LOSS = 50;
+constexpr int MISTAKE_LOSS = 100;
+constexpr int BLUNDER_LOSS = 300;
+
+struct ReviewOptions {
+    uint64_t nodes = 200000;  // per-position node budget; 0 = unlimited
+    int movetimeMs = 0;       // per-position time budget; 0 = unlimited
+    int threads = 0;          // worker threads; 0 = one per hardware thread
+    const std::atomic<bool>* stop = nullptr;  // set to abandon the review early
+};
+
+struct PlyReview {
+    int ply = 0;  // 1-based half-move number
+    std::string san;
+    std::string lan;
+    std::string bestSan;  // engine's choice in the position before the move
+    std::string bestLan;
+    int bestScore = 0;    // White's point of view, centipawns or mate score
+    int playedScore = 0;  // White's point of view, after the played move
+    int loss = 0;         // centipawns lost by the mover, clamped at zero
+    const char* classification = nullptr;  // "inaccuracy", "mistake", "blunder"
+};
+
+struct GameReview {
+    std::string startFen;  // as ChessGame::toFen writes it
+    std::vector<PlyReview> plies;
+    std::string result = "*";  // PGN result of the final position
+};
+
+/**
+ * Reviews the moves (SAN or LAN, as accepted by make_move) played from
+ * startFen. Each of the positions is searched once with the per-position
+ * budget, spread over a pool of worker threads, so wall time grows with
+ * game length divided by the thread count.
+ *
+ * Returns false and sets error if the FEN is invalid or a move is illegal,
+ * or if options.stop was set before every position had been searched.
+ */
+bool reviewGame(const std::string& startFen, const std::vector<std::string>& moves,
+                const ReviewOptions& options, GameReview& out, std::string& error);
+
+/** Review as JSON: {"startFen", "result", "plies":[{...}]}. */
+nlohmann::json reviewToJson(const GameReview& review);
+
+/** Review as PGN with NAGs on flagged moves and evaluation comments. */
+std::string reviewToPgn(const GameReview& review);
+
+#endif  // CHESS_REVIEW_H
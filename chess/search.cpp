@@ -0,0 +1,366 @@
+// Alpha-beta search and evaluation for Position.
+
+#include "search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace {
+
+// Material values indexed by PieceType (PAWN, ROOK, KNIGHT, BISHOP, KING, QUEEN).
+constexpr int kValue[6] = {100, 500, 320, 330, 0, 900};
+
+// Piece-square tables from White's point of view, written rank 8 first so
+// they read like a board diagram. Index with tableIndex().
+// clang-format off
+constexpr int kPawnTable[64] = {
+     0,  0,  0,  0,  0,  0,  0,  0,
+    50, 50, 50, 50, 50, 50, 50, 50,
+    10, 10, 20, 30, 30, 20, 10, 10,
+     5,  5, 10, 25, 25, 10,  5,  5,
+     0,  0,  0, 20, 20,  0,  0,  0,
+     5, -5,-10,  0,  0,-10, -5,  5,
+     5, 10, 10,-20,-20, 10, 10,  5,
+     0,  0,  0,  0,  0,  0,  0,  0};
+constexpr int kKnightTable[64] = {
+   -50,-40,-30,-30,-30,-30,-40,-50,
+   -40,-20,  0,  0,  0,  0,-20,-40,
+   -30,  0, 10, 15, 15, 10,  0,-30,
+   -30,  5, 15, 20, 20, 15,  5,-30,
+   -30,  0, 15, 20, 20, 15,  0,-30,
+   -30,  5, 10, 15, 15, 10,  5,-30,
+   -40,-20,  0,  5,  5,  0,-20,-40,
+   -50,-40,-30,-30,-30,-30,-40,-50};
+constexpr int kBishopTable[64] = {
+   -20,-10,-10,-10,-10,-10,-10,-20,
+   -10,  0,  0,  0,  0,  0,  0,-10,
+   -10,  0,  5, 10, 10,  5,  0,-10,
+   -10,  5,  5, 10, 10,  5,  5,-10,
+   -10,  0, 10, 10, 10, 10,  0,-10,
+   -10, 10, 10, 10, 10, 10, 10,-10,
+   -10,  5,  0,  0,  0,  0,  5,-10,
+   -20,-10,-10,-10,-10,-10,-10,-20};
+constexpr int kRookTable[64] = {
+     0,  0,  0,  0,  0,  0,  0,  0,
+     5, 10, 10, 10, 10, 10, 10,  5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+    -5,  0,  0,  0,  0,  0,  0, -5,
+     0,  0,  0,  5,  5,  0,  0,  0};
+constexpr int kQueenTable[64] = {
+   -20,-10,-10, -5, -5,-10,-10,-20,
+   -10,  0,  0,  0,  0,  0,  0,-10,
+   -10,  0,  5,  5,  5,  5,  0,-10,
+    -5,  0,  5,  5,  5,  5,  0, -5,
+     0,  0,  5,  5,  5,  5,  0, -5,
+   -10,  5,  5,  5,  5,  5,  0,-10,
+   -10,  0,  5,  0,  0,  0,  0,-10,
+   -20,-10,-10, -5, -5,-10,-10,-20};
+constexpr int kKingMiddleTable[64] = {
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -30,-40,-40,-50,-50,-40,-40,-30,
+   -20,-30,-30,-40,-40,-30,-30,-20,
+   -10,-20,-20,-20,-20,-20,-20,-10,
+    20, 20,  0,  0,  0,  0, 20, 20,
+    20, 30, 10,  0,  0, 10, 30, 20};
+constexpr int kKingEndTable[64] = {
+   -50,-40,-30,-20,-20,-30,-40,-50,
+   -30,-20,-10,  0,  0,-10,-20,-30,
+   -30,-10, 20, 30, 30, 20,-10,-30,
+   -30,-10, 30, 40, 40, 30,-10,-30,
+   -30,-10, 30, 40, 40, 30,-10,-30,
+   -30,-10, 20, 30, 30, 20,-10,-30,
+   -30,-30,  0,  0,  0,  0,-30,-30,
+   -50,-30,-30,-30,-30,-30,-30,-50};
+// clang-format on
+
+int tableIndex(int sq, bool white) {
+    int x = rowOf(sq), y = colOf(sq);
+    return (white ? 7 - x : x) * 8 + y;
+}
+
+int pieceSquare(PieceType t, int idx, bool endgame) {
+    switch (t) {
+        case PAWN: return kPawnTable[idx];
+        case KNIGHT: return kKnightTable[idx];
+        case BISHOP: return kBishopTable[idx];
+        case ROOK: return kRookTable[idx];
+        case QUEEN: return kQueenTable[idx];
+        case KING: return endgame ? kKingEndTable[idx] : kKingMiddleTable[idx];
+    }
+    return 0;
+}
+
+enum Bound : uint8_t { BOUND_NONE, BOUND_EXACT, BOUND_LOWER, BOUND_UPPER };
+
+struct TtEntry {
+    uint64_t key = 0;
+    PosMove move;
+    int8_t depth = -1;
+    uint8_t bound = BOUND_NONE;
+    int16_t score = 0;
+};
+
+constexpr size_t kTtSize = 1 << 16;  // entries; must be a power of two
+
+class Searcher {
+   public:
+    Searcher(const Position& root, const SearchLimits& limits)
+        : pos(root), limits(limits), tt(new TtEntry[kTtSize]) {
+        start = std::chrono::steady_clock::now();
+    }
+
+    SearchResult run() {
+        SearchResult result;
+        MoveList legal;
+        pos.generateLegal(legal);
+        if (legal.size == 0) {
+            result.score = pos.inCheck() ? -MATE_SCORE : 0;
+            return result;
+        }
+        result.hasMove = true;
+        result.best = legal.moves[0];
+        int maxDepth = std::clamp(limits.depth, 1, MAX_PLY - 1);
+        for (int depth = 1; depth <= maxDepth; depth++) {
+            int score = negamax(depth, 0, -MATE_SCORE - 1, MATE_SCORE + 1);
+            if (aborted) break;
+            result.depth = depth;
+            result.score = score;
+            result.pv.assign(pvTable[0], pvTable[0] + pvLength[0]);
+            if (!result.pv.empty()) result.best = result.pv[0];
+            if (isMateScore(score)) break;  // a shorter mate cannot appear deeper
+        }
+        result.nodes = nodes;
+        return result;
+    }
+
+   private:
+    bool outOfBudget() {
+        // Depth 1 always completes so there is a move to report.
+        if (!rootDone) return false;
+        if (limits.stop != nullptr && limits.stop->load(std::memory_order_relaxed)) return true;
+        if (limits.nodes != 0 && nodes >= limits.nodes) return true;
+        if (limits.movetimeMs != 0 && (nodes & 1023) == 0) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed >= std::chrono::milliseconds(limits.movetimeMs)) return true;
+        }
+        return false;
+    }
+
+    bool isRepetition(int ply) const {
+        // Only positions reached inside the search are known; a repeat of
+        // one of them is scored as a draw.
+        for (int i = ply - 2; i >= 0; i -= 2) {
+            if (keys[i] == pos.key) return true;
+        }
+        return false;
+    }
+
+    int scoreMove(const PosMove& m, const PosMove& ttMove, int ply) const {
+        if (m == ttMove) return 1 << 20;
+        if (pos.isCapture(m)) {
+            int victim = pos.board[m.to] != 0 ? kValue[typeOfCode(pos.board[m.to])] : kValue[PAWN];
+            int attacker = kValue[typeOfCode(pos.board[m.from])];
+            return (1 << 16) + victim * 16 - attacker / 16;
+        }
+        if (m.promo != PAWN) return (1 << 15) + kValue[m.promo];
+        if (m == killers[ply][0]) return 1 << 14;
+        if (m == killers[ply][1]) return (1 << 14) - 1;
+        return 0;
+    }
+
+    void orderMoves(MoveList& list, const PosMove& ttMove, int ply) const {
+        int scores[256];
+        for (int i = 0; i < list.size; i++) scores[i] = scoreMove(list.moves[i], ttMove, ply);
+        // Insertion sort: lists are short and mostly need only a few swaps.
+        for (int i = 1; i < list.size; i++) {
+            PosMove m = list.moves[i];
+            int s = scores[i];
+            int j = i - 1;
+            for (; j >= 0 && scores[j] < s; j--) {
+                list.moves[j + 1] = list.moves[j];
+                scores[j + 1] = scores[j];
+            }
+            list.moves[j + 1] = m;
+            scores[j + 1] = s;
+        }
+    }
+
+    bool leavesKingInCheck(bool mover) const {
+        return pos.attacked(pos.kingSq[mover ? 0 : 1], !mover);
+    }
+
+    int quiesce(int alpha, int beta, int ply) {
+        nodes++;
+        if (outOfBudget()) {
+            aborted = true;
+            return 0;
+        }
+        int standPat = evaluate(pos);
+        if (ply >= MAX_PLY - 1 || standPat >= beta) return standPat;
+        alpha = std::max(alpha, standPat);
+
+        MoveList list;
+        pos.generatePseudo(list);
+        orderMoves(list, PosMove(), ply);
+        bool mover = pos.whiteTurn;
+        for (const PosMove& m : list) {
+            if (!pos.isCapture(m) && m.promo != QUEEN) continue;
+            PosUndo u = pos.make(m);
+            if (leavesKingInCheck(mover)) {
+                pos.unmake(m, u);
+                continue;
+            }
+            int score = -quiesce(-beta, -alpha, ply + 1);
+            pos.unmake(m, u);
+            if (aborted) return 0;
+            if (score >= beta) return score;
+            alpha = std::max(alpha, score);
+        }
+        return alpha;
+    }
+
+    int negamax(int depth, int ply, int alpha, int beta) {
+        pvLength[ply] = 0;
+        if (ply > 0) {
+            if (pos.halfmoveClock >= 100 || isRepetition(ply)) return 0;
+            // Mate distance pruning.
+            alpha = std::max(alpha, -MATE_SCORE + ply);
+            beta = std::min(beta, MATE_SCORE - ply - 1);
+            if (alpha >= beta) return alpha;
+        }
+        bool inCheck = pos.inCheck();
+        if (inCheck) depth++;
+        if (depth <= 0 || ply >= MAX_PLY - 1) return quiesce(alpha, beta, ply);
+
+        nodes++;
+        if (outOfBudget()) {
+            aborted = true;
+            return 0;
+        }
+        keys[ply] = pos.key;
+
+        TtEntry& entry = tt[pos.key & (kTtSize - 1)];
+        PosMove ttMove;
+        bool ttHit = entry.key == pos.key && entry.bound != BOUND_NONE;
+        if (ttHit) {
+            ttMove = entry.move;
+            if (ply > 0 && entry.depth >= depth) {
+                int s = fromTt(entry.score, ply);
+                if (entry.bound == BOUND_EXACT ||
+                    (entry.bound == BOUND_LOWER && s >= beta) ||
+                    (entry.bound == BOUND_UPPER && s <= alpha)) {
+                    return s;
+                }
+            }
+        }
+
+        MoveList list;
+        pos.generatePseudo(list);
+        orderMoves(list, ttHit ? ttMove : PosMove(), ply);
+
+        bool mover = pos.whiteTurn;
+        int originalAlpha = alpha;
+        int best = -MATE_SCORE - 1;
+        PosMove bestMove;
+        int legal = 0;
+        for (const PosMove& m : list) {
+            PosUndo u = pos.make(m);
+            if (leavesKingInCheck(mover)) {
+                pos.unmake(m, u);
+                continue;
+            }
+            legal++;
+            int score = -negamax(depth - 1, ply + 1, -beta, -alpha);
+            pos.unmake(m, u);
+            if (aborted) return 0;
+            if (score > best) {
+                best = score;
+                bestMove = m;
+                if (score > alpha) {
+                    alpha = score;
+                    pvTable[ply][0] = m;
+                    std::copy(pvTable[ply + 1], pvTable[ply + 1] + pvLength[ply + 1],
+                              pvTable[ply] + 1);
+                    pvLength[ply] = pvLength[ply + 1] + 1;
+                }
+            }
+            if (alpha >= beta) {
+                if (!pos.isCapture(m) && !(m == killers[ply][0])) {
+                    killers[ply][1] = killers[ply][0];
+                    killers[ply][0] = m;
+                }
+                break;
+            }
+        }
+        if (ply == 0) rootDone = true;
+        if (legal == 0) return inCheck ? -MATE_SCORE + ply : 0;
+
+        entry.key = pos.key;
+        entry.move = bestMove;
+        entry.depth = static_cast<int8_t>(depth);
+        entry.score = static_cast<int16_t>(toTt(best, ply));
+        entry.bound = best >= beta ? BOUND_LOWER
+                                   : (best > originalAlpha ? BOUND_EXACT : BOUND_UPPER);
+        return best;
+    }
+
+    // Mate scores are stored relative to the node, not the root.
+    static int toTt(int score, int ply) {
+        if (score > MATE_SCORE - 1000) return score + ply;
+        if (score < -MATE_SCORE + 1000) return score - ply;
+        return score;
+    }
+    static int fromTt(int score, int ply) {
+        if (score > MATE_SCORE - 1000) return score - ply;
+        if (score < -MATE_SCORE + 1000) return score + ply;
+        return score;
+    }
+
+    Position pos;
+    SearchLimits limits;
+    std::unique_ptr<TtEntry[]> tt;
+    std::chrono::steady_clock::time_point start;
+    uint64_t nodes = 0;
+    bool rootDone = false;
+    bool aborted = false;
+    uint64_t keys[MAX_PLY] = {};
+    PosMove killers[MAX_PLY][2];
+    PosMove pvTable[MAX_PLY][MAX_PLY];
+    int pvLength[MAX_PLY] = {};
+};
+
+}  // namespace
+
+int evaluate(const Position& pos) {
+    // Endgame once neither side has a queen plus more than a minor piece.
+    int nonPawn[2] = {0, 0};
+    for (int sq = 0; sq < 64; sq++) {
+        int8_t c = pos.board[sq];
+        if (c == 0) continue;
+        PieceType t = typeOfCode(c);
+        if (t != PAWN && t != KING) nonPawn[c > 0 ? 0 : 1] += kValue[t];
+    }
+    bool endgame = nonPawn[0] <= 1300 && nonPawn[1] <= 1300;
+
+    int score = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        int8_t c = pos.board[sq];
+        if (c == 0) continue;
+        bool white = c > 0;
+        PieceType t = typeOfCode(c);
+        int v = kValue[t] + pieceSquare(t, tableIndex(sq, white), endgame);
+        score += white ? v : -v;
+    }
+    return pos.whiteTurn ? score : -score;
+}
+
+SearchResult search(const Position& root, const SearchLimits& limits) {
+    Searcher searcher(root, limits);
+    return searcher.run();
+}
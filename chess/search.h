@@ -0,0 +1,64 @@
+// Alpha-beta search on a Position, used by the analysis features (game
+// review, pondering, test suites). The evaluation is deliberately simple:
+// material plus piece-square tables.
+
+#ifndef CHESS_SEARCH_H
+#define CHESS_SEARCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "position.h"
+
+// Scores are centipawns from the side to move's point of view. Mate scores
+// are MATE_SCORE minus the distance to mate in plies.
+constexpr int MATE_SCORE = 32000;
+constexpr int MAX_PLY = 64;
+
+inline bool isMateScore(int score) {
+    return score > MATE_SCORE - 1000 || score < -MATE_SCORE + 1000;
+}
+
+/** Moves to mate for a mate score: positive if the side to move mates. */
+inline int mateInMoves(int score) {
+    return score > 0 ? (MATE_SCORE - score + 1) / 2 : -(MATE_SCORE + score) / 2;
+}
+
+/** The mate score that mateInMoves() maps to moves (nonzero), at the shortest distance. */
+inline int mateScoreIn(int moves) {
+    return moves > 0 ? MATE_SCORE - (2 * moves - 1) : -MATE_SCORE - 2 * moves;
+}
+
+/** Static evaluation from the side to move's point of view. */
+int evaluate(const Position& pos);
+
+/**
+ * Search budget. Zero means "no limit" for nodes and movetimeMs; the search
+ * always completes depth 1 so a move is available whatever the budget.
+ * Setting *stop from another thread ends the search early.
+ */
+struct SearchLimits {
+    int depth = MAX_PLY - 1;
+    uint64_t nodes = 0;
+    int movetimeMs = 0;
+    const std::atomic<bool>* stop = nullptr;
+};
+
+struct SearchResult {
+    bool hasMove = false;  // false when the root has no legal moves
+    PosMove best;
+    int score = 0;   // from the side to move's point of view
+    int depth = 0;   // last fully completed iteration
+    uint64_t nodes = 0;
+    std::vector<PosMove> pv;
+};
+
+/**
+ * Iterative-deepening alpha-beta search with quiescence, a transposition
+ * table and killer moves. Safe to call concurrently from several threads;
+ * each call has its own tables.
+ */
+SearchResult search(const Position& root, const SearchLimits& limits);
+
+#endif  // CHESS_SEARCH_H
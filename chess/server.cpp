@@ -0,0 +1,361 @@
+// Unix-domain-socket server for the JSON bridge (epoll event loop).
+
+#include "server.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+
+namespace {
+
+// A client sending a line (or frame) longer than this is disconnected. It
+// is also the most unprocessed input held per connection: beyond it the
+// server stops reading and leaves the rest in the socket.
+constexpr size_t kMaxLineBytes = 16 << 20;
+// Input is neither processed nor read while this much output is waiting to
+// be sent, so a client that stops reading cannot make the server buffer
+// without bound; the kernel's socket buffers push back on it instead.
+constexpr size_t kMaxPendingOutput = 4 << 20;
+
+volatile std::sig_atomic_t signalled = 0;
+
+void onSignal(int) {
+    signalled = 1;
+}
+
+struct Connection {
+    int fd = -1;
+    std::string in;
+    std::string out;
+    size_t outPos = 0;  // bytes of out already sent
+    std::unique_ptr<ChessGame> game;  // this connection's default game
+    uint64_t client = 0;              // owner tag of the jobs it starts
+    bool closing = false;             // close once out is flushed
+    uint32_t events = 0;              // epoll interest currently registered
+
+    size_t pending() const { return out.size() - outPos; }
+};
+
+class Server {
+   public:
+    Server(BridgeContext& ctx, const std::atomic<bool>* stop) : ctx(ctx), stop(stop) {}
+
+    ~Server() {
+        ctx.jobs.setWakeup(nullptr);
+        if (eventFd >= 0) close(eventFd);
+        for (auto& [fd, conn] : connections) close(fd);
+        if (epollFd >= 0) close(epollFd);
+        if (listenFd >= 0) close(listenFd);
+        if (!path.empty()) unlink(path.c_str());
+    }
+
+    bool listen(const std::string& socketPath, std::string& error) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socketPath.empty() || socketPath.size() >= sizeof(addr.sun_path)) {
+            error = "invalid socket path";
+            return false;
+        }
+        std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+        // Replace a stale socket left by an earlier run, but never a regular file.
+        struct stat st;
+        if (lstat(socketPath.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                error = socketPath + " exists and is not a socket";
+                return false;
+            }
+            unlink(socketPath.c_str());
+        }
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            error = std::string("cannot bind socket: ") + std::strerror(errno);
+            return false;
+        }
+        path = socketPath;
+        if (::listen(listenFd, SOMAXCONN) < 0) {
+            error = std::string("cannot listen: ") + std::strerror(errno);
+            return false;
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            error = std::string("epoll_create1 failed: ") + std::strerror(errno);
+            return false;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+
+        // Finished jobs wake the loop through an eventfd; see deliverEvents().
+        eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventFd < 0) {
+            error = std::string("eventfd failed: ") + std::strerror(errno);
+            return false;
+        }
+        ev.data.fd = eventFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &ev);
+        int fd = eventFd;
+        ctx.jobs.setWakeup([fd] {
+            uint64_t one = 1;
+            ssize_t r = write(fd, &one, sizeof(one));
+            (void)r;  // a full counter already means "wake up"
+        });
+        return true;
+    }
+
+    void run() {
+        epoll_event events[64];
+        auto lastDump = std::chrono::steady_clock::now();
+        while (!signalled && !(stop && stop->load())) {
+            // Wake up periodically when someone may ask us to stop or a
+            // stats dump is due; otherwise sleep until there is traffic.
+            int timeout = -1;
+            if (stop != nullptr) timeout = 50;
+            if (ctx.statsInterval.count() > 0) timeout = timeout < 0 ? 1000 : timeout;
+
+            int n = epoll_wait(epollFd, events, 64, timeout);
+            if (n < 0 && errno != EINTR) break;
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptAll();
+                    continue;
+                }
+                if (fd == eventFd) {
+                    deliverEvents();
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if (it == connections.end()) continue;
+                Connection& c = it->second;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) readFrom(c);
+                serve(c);
+                if (c.closing && c.pending() == 0) {
+                    drop(fd);
+                } else {
+                    updateInterest(c);
+                }
+            }
+            if (ctx.statsInterval.count() > 0 &&
+                std::chrono::steady_clock::now() - lastDump >= ctx.statsInterval) {
+                std::cerr << ctx.stats.toJson().dump() << std::endl;
+                lastDump = std::chrono::steady_clock::now();
+            }
+        }
+    }
+
+   private:
+    void acceptAll() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;  // EAGAIN, or a client that vanished
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+            connections[fd].fd = fd;
+            connections[fd].client = nextClient++;
+            connections[fd].events = ev.events;
+        }
+    }
+
+    // Sends each finished job's event to the connection that started it,
+    // if that connection is still open.
+    void deliverEvents() {
+        uint64_t count;
+        ssize_t r = read(eventFd, &count, sizeof(count));
+        (void)r;
+        for (const JobQueue::Finished& job : ctx.jobs.takeNotifications()) {
+            for (auto& [fd, c] : connections) {
+                if (c.client != job.owner || c.closing) continue;
+                appendJobEvent(job, ctx.format, c.out);
+                flush(c);
+                updateInterest(c);
+                break;
+            }
+        }
+    }
+
+    // True if buf starts with a complete request, or a frame header that
+    // does not exceed the size limit.
+    bool hasRequest(const std::string& buf) const {
+        if (ctx.format == BridgeFormat::Json) return buf.find('\n') != std::string::npos;
+        return buf.size() >= 4 && uint8_t(buf[0]) < (kMaxLineBytes >> 24);
+    }
+
+    // Reads until the socket is drained or the input buffer is full.
+    void readFrom(Connection& c) {
+        char buf[65536];
+        while (!c.closing && c.in.size() <= kMaxLineBytes) {
+            ssize_t r = read(c.fd, buf, sizeof(buf));
+            if (r > 0) {
+                c.in.append(buf, static_cast<size_t>(r));
+                if (c.in.size() > kMaxLineBytes && !hasRequest(c.in)) {
+                    c.closing = true;
+                    c.in.clear();
+                    return;
+                }
+                continue;
+            }
+            if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                c.closing = true;  // peer closed; answer what it already sent
+            }
+            if (r < 0 && errno == EINTR) continue;
+            return;
+        }
+    }
+
+    // Alternates running requests and sending their responses, until the
+    // input holds no complete request or the client is not keeping up.
+    void serve(Connection& c) {
+        while (true) {
+            size_t unprocessed = c.in.size();
+            process(c);
+            flush(c);
+            if (c.in.size() == unprocessed || c.pending() >= kMaxPendingOutput) return;
+        }
+    }
+
+    // Runs complete requests, appending responses to the output buffer,
+    // until the output limit is reached.
+    void process(Connection& c) {
+        size_t start = 0;
+        while (c.pending() < kMaxPendingOutput) {
+            bool quit = false;
+            if (ctx.format == BridgeFormat::Json) {
+                size_t nl = c.in.find('\n', start);
+                if (nl == std::string::npos) break;
+                std::string line = c.in.substr(start, nl - start);
+                start = nl + 1;
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty()) continue;
+
+                ctx.game.swap(c.game);
+                ctx.client = c.client;
+                const std::string& response = handleBridgeCommand(line, ctx, quit);
+                ctx.game.swap(c.game);
+                c.out += response;
+                c.out += '\n';
+            } else {
+                // 4-byte big-endian length, then the encoded request.
+                if (c.in.size() - start < 4) break;
+                auto byte = [&](size_t i) { return uint32_t(uint8_t(c.in[start + i])); };
+                uint32_t size = byte(0) << 24 | byte(1) << 16 | byte(2) << 8 | byte(3);
+                if (c.in.size() - start - 4 < size) break;
+                message.assign(c.in.begin() + start + 4, c.in.begin() + start + 4 + size);
+                start += 4 + size;
+
+                ctx.game.swap(c.game);
+                ctx.client = c.client;
+                const std::string& response = handleBridgeMessage(message, ctx, quit);
+                ctx.game.swap(c.game);
+                uint32_t n = static_cast<uint32_t>(response.size());
+                char header[4] = {char(n >> 24), char(n >> 16), char(n >> 8), char(n)};
+                c.out.append(header, 4);
+                c.out += response;
+            }
+            if (quit) {
+                c.closing = true;
+                c.in.clear();
+                return;
+            }
+        }
+        c.in.erase(0, start);
+    }
+
+    void flush(Connection& c) {
+        while (c.outPos < c.out.size()) {
+            ssize_t w = send(c.fd, c.out.data() + c.outPos, c.out.size() - c.outPos, MSG_NOSIGNAL);
+            if (w > 0) {
+                c.outPos += static_cast<size_t>(w);
+                continue;
+            }
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            // The peer is gone; nothing more can be delivered.
+            c.out.clear();
+            c.outPos = 0;
+            c.closing = true;
+            return;
+        }
+        if (c.outPos == c.out.size()) {
+            c.out.clear();
+            c.outPos = 0;
+        }
+    }
+
+    // Asks for input only while there is room to read and process it, and
+    // never after end of file, which would otherwise keep the level-triggered
+    // EPOLLIN firing; asks for EPOLLOUT while output is waiting.
+    void updateInterest(Connection& c) {
+        bool readable =
+            !c.closing && c.pending() < kMaxPendingOutput && c.in.size() <= kMaxLineBytes;
+        uint32_t events = (readable ? static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP) : 0u) |
+                          (c.pending() > 0 ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        if (events == c.events) return;
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = c.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+        c.events = events;
+    }
+
+    void drop(int fd) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections.erase(fd);
+    }
+
+    BridgeContext& ctx;
+    const std::atomic<bool>* stop;
+    std::string path;
+    int listenFd = -1;
+    int epollFd = -1;
+    int eventFd = -1;
+    uint64_t nextClient = 1;
+    std::map<int, Connection> connections;
+    std::vector<uint8_t> message;  // decoded request frame, reused
+};
+
+}  // namespace
+
+bool runBridgeServer(const std::string& socketPath, BridgeContext& ctx, std::string& error,
+                     const std::atomic<bool>* stop) {
+    Server server(ctx, stop);
+    if (!server.listen(socketPath, error)) {
+        return false;
+    }
+    signalled = 0;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    server.run();
+    return true;
+}
+
+#else  // !__linux__
+
+bool runBridgeServer(const std::string&, BridgeContext&, std::string& error,
+                     const std::atomic<bool>*) {
+    error = "--serve requires Linux (epoll)";
+    return false;
+}
+
+#endif
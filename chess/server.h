@@ -0,0 +1,32 @@
+// Unix-domain-socket server for the JSON bridge.
+
+#ifndef CHESS_SERVER_H
+#define CHESS_SERVER_H
+
+#include <atomic>
+#include <string>
+
+#include "bridge.h"
+
+/**
+ * Serves the bridge protocol to many clients over a Unix domain socket.
+ *
+ * Framing is the same as the stdin/stdout bridge: one JSON command per line
+ * in, one JSON response per line out, or length-prefixed CBOR/MessagePack
+ * frames when ctx.format says so. A single thread multiplexes every
+ * connection with epoll, so clients cost a buffer each rather than a
+ * thread or a process.
+ *
+ * Each connection has its own default game (commands without game_id);
+ * games created with "create", the tablebases and the statistics in ctx
+ * are shared by all connections, as are jobs; the event announcing a job
+ * started with "notify" goes to the connection that started it. "quit"
+ * closes only the sending connection.
+ *
+ * Runs until SIGINT/SIGTERM or until *stop becomes true, then removes the
+ * socket file. Returns false and sets error if the socket cannot be set up.
+ */
+bool runBridgeServer(const std::string& socketPath, BridgeContext& ctx, std::string& error,
+                     const std::atomic<bool>* stop = nullptr);
+
+#endif  // CHESS_SERVER_H
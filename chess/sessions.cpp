@@ -0,0 +1,137 @@
+// Multi-game session store.
+
+#include "sessions.h"
+
+#include <algorithm>
+
+namespace {
+
+// 6 bits from, 6 bits to, 3 bits promotion piece (PAWN = none).
+uint16_t packMove(const ChessMove& m) {
+    int from = m.getStartX() * 8 + m.getStartY();
+    int to = m.getEndX() * 8 + m.getEndY();
+    return static_cast<uint16_t>(from | (to << 6) | (m.getPromotion() << 12));
+}
+
+ChessMove unpackMove(uint16_t v) {
+    int from = v & 63, to = (v >> 6) & 63;
+    return ChessMove(from / 8, from % 8, to / 8, to % 8, static_cast<PieceType>(v >> 12));
+}
+
+}  // namespace
+
+GameSessions::GameSessions(size_t maxLive) : maxLive(std::max<size_t>(maxLive, 1)) {}
+
+uint32_t GameSessions::create(const std::string& fen, FenError* error) {
+    uint32_t id = nextId;
+    records.emplace(id, Record());
+    if (!reset(id, fen, error)) {
+        records.erase(id);
+        return 0;
+    }
+    nextId++;
+    return id;
+}
+
+bool GameSessions::reset(uint32_t id, const std::string& fen, FenError* error) {
+    auto it = records.find(id);
+    if (it == records.end()) return false;
+    auto game = fen.empty() ? std::make_unique<ChessGame>() : ChessGame::fromFen(fen, error);
+    if (!game) return false;
+    Record& r = it->second;
+    r.startFen = fen;
+    r.whiteStarts = game->getTurn();
+    r.setupPlies = game->getHistory().size();
+    r.moves.clear();
+    r.moves.shrink_to_fit();
+    r.stateVersion = game->getStateVersion();
+    cache(id, std::move(game));
+    return true;
+}
+
+bool GameSessions::destroy(uint32_t id) {
+    if (records.erase(id) == 0) return false;
+    auto it = liveIndex.find(id);
+    if (it != liveIndex.end()) {
+        live.erase(it->second);
+        liveIndex.erase(it);
+    }
+    return true;
+}
+
+bool GameSessions::contains(uint32_t id) const {
+    return records.count(id) != 0;
+}
+
+ChessGame* GameSessions::get(uint32_t id) {
+    auto it = liveIndex.find(id);
+    if (it != liveIndex.end()) {
+        live.splice(live.begin(), live, it->second);  // mark most recently used
+        return live.front().second.get();
+    }
+    auto rec = records.find(id);
+    if (rec == records.end()) return nullptr;
+    const Record& r = rec->second;
+    auto game = r.startFen.empty() ? std::make_unique<ChessGame>() : ChessGame::fromFen(r.startFen);
+    if (!game) return nullptr;
+    for (uint16_t m : r.moves) {
+        if (!game->makeMove(unpackMove(m))) return nullptr;
+    }
+    game->setStateVersion(r.stateVersion);
+    return cache(id, std::move(game));
+}
+
+void GameSessions::sync(uint32_t id) {
+    auto it = liveIndex.find(id);
+    auto rec = records.find(id);
+    if (it == liveIndex.end() || rec == records.end()) return;
+    const auto& history = it->second->second->getHistory();
+    std::vector<uint16_t>& moves = rec->second.moves;
+    // The placeholders before setupPlies stand for moves played before the
+    // start FEN; they are not moves and are never stored. undo cannot reach
+    // them, so the history never gets shorter than setupPlies.
+    size_t setup = rec->second.setupPlies;
+    size_t made = history.size() - setup;
+    // Commands between syncs append one move (make_move) or drop moves from
+    // the end (undo); anything else falls back to copying the whole history.
+    if (made == moves.size() + 1) {
+        moves.push_back(packMove(history.back()));
+    } else if (made < moves.size()) {
+        moves.resize(made);
+    } else if (made != moves.size()) {
+        moves.clear();
+        for (size_t i = setup; i < history.size(); i++) moves.push_back(packMove(history[i]));
+    }
+    rec->second.stateVersion = it->second->second->getStateVersion();
+}
+
+std::vector<GameSessions::Summary> GameSessions::list() const {
+    std::vector<Summary> out;
+    out.reserve(records.size());
+    for (const auto& [id, r] : records) {
+        uint32_t plies = static_cast<uint32_t>(r.moves.size());
+        out.push_back({id, plies, r.whiteStarts == (plies % 2 == 0)});
+    }
+    std::sort(out.begin(), out.end(),
+              [](const Summary& a, const Summary& b) { return a.id < b.id; });
+    return out;
+}
+
+size_t GameSessions::size() const {
+    return records.size();
+}
+
+ChessGame* GameSessions::cache(uint32_t id, std::unique_ptr<ChessGame> game) {
+    auto it = liveIndex.find(id);
+    if (it != liveIndex.end()) {
+        live.erase(it->second);
+        liveIndex.erase(it);
+    }
+    live.emplace_front(id, std::move(game));
+    liveIndex[id] = live.begin();
+    while (live.size() > maxLive) {
+        liveIndex.erase(live.back().first);
+        live.pop_back();
+    }
+    return live.front().second.get();
+}
@@ -0,0 +1,85 @@
+// Many concurrent games hosted by one bridge process, keyed by game ID.
+
+#ifndef CHESS_SESSIONS_H
+#define CHESS_SESSIONS_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "chess.h"
+
+/**
+ * Game store for multi-game bridge sessions.
+ *
+ * A ChessGame costs a few kilobytes (piece objects, FEN repetition keys), so
+ * games are stored compactly instead: the starting FEN (empty for the
+ * standard position) plus two bytes per move. Only recently used games are
+ * kept materialized as ChessGame objects, in an LRU cache; any other game
+ * is rebuilt by replaying its moves when a command next touches it. Replay
+ * restores the full history, so repetition and fifty-move state survive
+ * eviction.
+ */
+class GameSessions {
+   public:
+    explicit GameSessions(size_t maxLive = 256);
+
+    /**
+     * Creates a game; an empty FEN means the initial position. Returns 0 on
+     * invalid FEN, setting *error (if given) to the reason.
+     */
+    uint32_t create(const std::string& fen, FenError* error = nullptr);
+    /**
+     * Restarts an existing game from a FEN ("" = initial position). Returns
+     * false for an unknown ID or an invalid FEN, whose reason goes to *error.
+     */
+    bool reset(uint32_t id, const std::string& fen, FenError* error = nullptr);
+    bool destroy(uint32_t id);
+    bool contains(uint32_t id) const;
+
+    /**
+     * The live game for an ID, materializing it if needed; nullptr for an
+     * unknown ID, or if its stored moves do not replay. The pointer is
+     * valid until the next call that may evict.
+     */
+    ChessGame* get(uint32_t id);
+    /**
+     * Stores the live game's move history and state version. Call after
+     * every command that may change the game: only the appended or
+     * removed moves at the end are copied.
+     */
+    void sync(uint32_t id);
+
+    struct Summary {
+        uint32_t id;
+        uint32_t plies;
+        bool whiteToMove;
+    };
+    /** All games, ordered by ID. */
+    std::vector<Summary> list() const;
+    size_t size() const;
+
+   private:
+    struct Record {
+        std::string startFen;         // empty = standard initial position
+        bool whiteStarts = true;
+        size_t setupPlies = 0;        // placeholder history fromFen() adds; not stored
+        std::vector<uint16_t> moves;  // packed from/to/promotion, moves made since
+        uint64_t stateVersion = 0;    // restored when the game is rebuilt
+    };
+    using LiveList = std::list<std::pair<uint32_t, std::unique_ptr<ChessGame>>>;
+
+    ChessGame* cache(uint32_t id, std::unique_ptr<ChessGame> game);
+
+    std::unordered_map<uint32_t, Record> records;
+    LiveList live;  // most recently used first
+    std::unordered_map<uint32_t, LiveList::iterator> liveIndex;
+    size_t maxLive;
+    uint32_t nextId = 1;
+};
+
+#endif  // CHESS_SESSIONS_H
@@ -0,0 +1,80 @@
+// Latency histograms and counters for the JSON bridge.
+
+#include "stats.h"
+
+#include <algorithm>
+#include <bit>
+
+int LatencyHistogram::bucketOf(uint64_t v) {
+    if (v < (1u << kSubBits)) return static_cast<int>(v);
+    int exp = 63 - std::countl_zero(v);  // >= kSubBits
+    int sub = static_cast<int>((v >> (exp - kSubBits)) & ((1u << kSubBits) - 1));
+    return ((exp - kSubBits + 1) << kSubBits) + sub;
+}
+
+uint64_t LatencyHistogram::upperBound(int bucket) {
+    if (bucket < (1 << kSubBits)) return static_cast<uint64_t>(bucket);
+    int exp = (bucket >> kSubBits) + kSubBits - 1;
+    uint64_t sub = bucket & ((1 << kSubBits) - 1);
+    uint64_t width = uint64_t{1} << (exp - kSubBits);
+    return (uint64_t{1} << exp) + (sub + 1) * width - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    counts[bucketOf(nanos)]++;
+    count++;
+    total += static_cast<double>(nanos);
+    if (nanos > max) max = nanos;
+}
+
+void LatencyHistogram::reset() {
+    *this = LatencyHistogram();
+}
+
+uint64_t LatencyHistogram::getCount() const {
+    return count;
+}
+
+uint64_t LatencyHistogram::getMax() const {
+    return max;
+}
+
+double LatencyHistogram::getMean() const {
+    return count == 0 ? 0.0 : total / static_cast<double>(count);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (count == 0) return 0;
+    // Rank of the requested sample, 1-based, rounded up.
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count) + 0.999999);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; b++) {
+        seen += counts[b];
+        if (seen >= rank) return std::min(upperBound(b), max);
+    }
+    return max;
+}
+
+void BridgeStats::reset() {
+    *this = BridgeStats();
+}
+
+nlohmann::json BridgeStats::toJson() const {
+    auto micros = [](double nanos) { return nanos / 1000.0; };
+    nlohmann::json commands = nlohmann::json::object();
+    for (const auto& [name, h] : latency) {
+        commands[name] = {{"count", h.getCount()},
+                          {"mean_us", micros(h.getMean())},
+                          {"p50_us", micros(static_cast<double>(h.percentile(50)))},
+                          {"p90_us", micros(static_cast<double>(h.percentile(90)))},
+                          {"p99_us", micros(static_cast<double>(h.percentile(99)))},
+                          {"max_us", micros(static_cast<double>(h.getMax()))}};
+    }
+    auto uptime = std::chrono::steady_clock::now() - since;
+    return {{"commands", commands},
+            {"legal_moves_generated", legalMovesGenerated},
+            {"bytes_written", bytesWritten},
+            {"uptime_ms",
+             std::chrono::duration_cast<std::chrono::milliseconds>(uptime).count()}};
+}
@@ -0,0 +1,55 @@
+// Latency histograms and counters for the JSON bridge.
+
+#ifndef CHESS_STATS_H
+#define CHESS_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * HDR-style latency histogram: values below 16 ns get their own bucket,
+ * larger values fall into 16 linear sub-buckets per power of two, so any
+ * recorded value is reproduced within 1/16 (about 6%) at every scale.
+ * Recording is a few integer operations and never allocates.
+ */
+class LatencyHistogram {
+   public:
+    void record(uint64_t nanos);
+    void reset();
+
+    uint64_t getCount() const;
+    uint64_t getMax() const;
+    double getMean() const;
+    /** Upper bound of the bucket holding the given percentile (0..100). */
+    uint64_t percentile(double p) const;
+
+   private:
+    static constexpr int kSubBits = 4;
+    static constexpr int kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+    static int bucketOf(uint64_t v);
+    static uint64_t upperBound(int bucket);
+
+    uint64_t counts[kBuckets] = {};
+    uint64_t count = 0;
+    uint64_t max = 0;
+    double total = 0;
+};
+
+/** Per-command latencies plus traffic counters for one bridge session. */
+struct BridgeStats {
+    std::map<std::string, LatencyHistogram> latency;  // keyed by command name
+    uint64_t legalMovesGenerated = 0;  // by commands, on the thread that ran them
+    uint64_t bytesWritten = 0;
+    std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+
+    void reset();
+    /** Summary in microseconds: count, mean, p50, p90, p99, max per command. */
+    nlohmann::json toJson() const;
+};
+
+#endif  // CHESS_STATS_H
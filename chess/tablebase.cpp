@@ -0,0 +1,753 @@
+// Endgame tablebase generation (retrograde analysis) and mmap-based probing.
+//
+// Index layout. The pieces of a table are placed in slots: white king, the
+// other white pieces in signature order, black king, the other black pieces.
+// An index is
+//     (sideToMove * kingSquares + kingSlot) * 64^(n-1) + squares of slots 1..n-1
+// Pawnless tables use the 8 symmetries of the board and restrict the white
+// king to the a1-d1-d4 triangle (10 squares); tables with pawns use only the
+// left-right mirror and restrict it to files a-d (32 squares). Of all
+// symmetric images the smallest index is canonical; other indices are stored
+// as illegal.
+//
+// Value byte: 0 = illegal, 1 = draw, 2 + d = mate in d plies. Odd d means the
+// side to move mates, even d means it gets mated, so one byte carries both
+// WDL and DTM.
+
+#include "tablebase.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char magic[4] = {'C', 'H', 'T', 'B'};
+const uint32_t formatVersion = 1;
+const size_t headerSize = 24;  // magic, version, signature[8], entry count
+
+const uint8_t ILLEGAL = 0;
+const uint8_t UNKNOWN = 1;  // becomes "draw" when generation finishes
+const int maxDtm = 253;
+
+// Non-king pieces, strongest first. Signatures list pieces in this order.
+const char pieceOrder[] = "QRBNP";
+
+int orderOf(char c) { return static_cast<int>(std::strchr(pieceOrder, c) - pieceOrder); }
+
+int valueOf(char c) {
+    switch (c) {
+        case 'Q': return 9;
+        case 'R': return 5;
+        case 'B':
+        case 'N': return 3;
+        default: return 1;
+    }
+}
+
+char letterOf(PieceType t) {
+    const char letters[] = {'P', 'R', 'N', 'B', 'K', 'Q'};
+    return letters[t];
+}
+
+PieceType typeOfLetter(char c) {
+    switch (c) {
+        case 'Q': return QUEEN;
+        case 'R': return ROOK;
+        case 'B': return BISHOP;
+        case 'N': return KNIGHT;
+        case 'P': return PAWN;
+        default: return KING;
+    }
+}
+
+// Orders the non-king pieces of one side (without the leading 'K').
+void sortPieces(std::string& pieces) {
+    std::sort(pieces.begin(), pieces.end(),
+              [](char a, char b) { return orderOf(a) < orderOf(b); });
+}
+
+// > 0 if side a is stronger than side b: by material, then piece count, then
+// by the strongest differing piece. Used only to pick the canonical colouring.
+int compareSides(const std::string& a, const std::string& b) {
+    int va = 0, vb = 0;
+    for (char c : a) va += valueOf(c);
+    for (char c : b) vb += valueOf(c);
+    if (va != vb) return va - vb;
+    if (a.size() != b.size()) return static_cast<int>(a.size()) - static_cast<int>(b.size());
+    for (size_t i = 0; i < a.size(); i++)
+        if (a[i] != b[i]) return orderOf(b[i]) - orderOf(a[i]);
+    return 0;
+}
+
+// Builds the canonical signature from two piece lists (kings excluded).
+std::string canonicalSignature(std::string white, std::string black) {
+    sortPieces(white);
+    sortPieces(black);
+    if (compareSides(black, white) > 0) std::swap(white, black);
+    return "K" + white + "K" + black;
+}
+
+bool isTrivialDraw(const std::string& sig) { return sig == "KK" || sig == "KBK" || sig == "KNK"; }
+
+struct Material {
+    std::string signature;
+    int count = 0;  // pieces including kings
+    bool pawns = false;
+    int8_t codes[4] = {};
+    int kingSquares = 0;
+    uint64_t size = 0;  // number of entries
+};
+
+// Parses "KQKR" style signatures (either colouring) into canonical form.
+bool parseSignature(const std::string& sig, std::string& canonical) {
+    if (sig.size() < 2 || sig[0] != 'K') return false;
+    size_t second = sig.find('K', 1);
+    if (second == std::string::npos || sig.find('K', second + 1) != std::string::npos)
+        return false;
+    std::string white = sig.substr(1, second - 1), black = sig.substr(second + 1);
+    for (char c : white + black)
+        if (std::strchr(pieceOrder, c) == nullptr || c == '\0') return false;
+    if (white.size() + black.size() > 2) return false;
+    canonical = canonicalSignature(white, black);
+    return true;
+}
+
+Material materialOf(const std::string& canonical) {
+    Material m;
+    m.signature = canonical;
+    size_t second = canonical.find('K', 1);
+    bool white = true;
+    for (size_t i = 0; i < canonical.size(); i++) {
+        if (i == second) white = false;
+        m.codes[m.count++] = pieceCode(typeOfLetter(canonical[i]), white);
+        if (canonical[i] == 'P') m.pawns = true;
+    }
+    m.kingSquares = m.pawns ? 32 : 10;
+    m.size = 2 * static_cast<uint64_t>(m.kingSquares);
+    for (int i = 1; i < m.count; i++) m.size *= 64;
+    return m;
+}
+
+// Tables reached from this one by a capture and/or a promotion.
+std::set<std::string> dependenciesOf(const std::string& canonical) {
+    size_t second = canonical.find('K', 1);
+    std::string white = canonical.substr(1, second - 1), black = canonical.substr(second + 1);
+    std::set<std::string> deps;
+    auto add = [&](const std::string& w, const std::string& b) {
+        std::string sig = canonicalSignature(w, b);
+        if (sig != canonical && !isTrivialDraw(sig)) deps.insert(sig);
+    };
+    auto without = [](std::string s, size_t i) { return s.erase(i, 1); };
+    for (int side = 0; side < 2; side++) {
+        const std::string& own = side == 0 ? white : black;
+        const std::string& other = side == 0 ? black : white;
+        auto addSided = [&](const std::string& o, const std::string& t) {
+            side == 0 ? add(o, t) : add(t, o);
+        };
+        for (size_t j = 0; j < other.size(); j++) addSided(own, without(other, j));
+        for (size_t i = 0; i < own.size(); i++) {
+            if (own[i] != 'P') continue;
+            for (char promo : {'Q', 'R', 'B', 'N'}) {
+                std::string promoted = own;
+                promoted[i] = promo;
+                addSided(promoted, other);
+                for (size_t j = 0; j < other.size(); j++)
+                    addSided(promoted, without(other, j));
+            }
+        }
+    }
+    return deps;
+}
+
+// Symmetry s: bit 0 mirrors files, bit 1 mirrors ranks, bit 2 transposes.
+inline int transformSquare(int sq, int s) {
+    int x = rowOf(sq), y = colOf(sq);
+    if (s & 1) y = 7 - y;
+    if (s & 2) x = 7 - x;
+    if (s & 4) std::swap(x, y);
+    return squareOf(x, y);
+}
+
+// White king slot index for a square, or -1 outside the fundamental region.
+inline int kingSlot(const Material& m, int sq) {
+    int x = rowOf(sq), y = colOf(sq);
+    if (m.pawns) return y <= 3 ? x * 4 + y : -1;
+    if (y > 3 || x > y) return -1;
+    // Triangle a1 b1 c1 d1 b2 c2 d2 c3 d3 d4, numbered row by row.
+    static const int rowStart[4] = {0, 4, 7, 9};
+    return rowStart[x] + (y - x);
+}
+
+inline int kingSquareOfSlot(const Material& m, int slot) {
+    if (m.pawns) return squareOf(slot / 4, slot % 4);
+    static const int squares[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+    return squares[slot];
+}
+
+// Canonical index of a placement given in slot order; UINT64_MAX if invalid.
+uint64_t canonicalIndex(const Material& m, const int* squares, bool whiteToMove) {
+    uint64_t best = UINT64_MAX;
+    int symmetries = m.pawns ? 2 : 8;
+    for (int s = 0; s < symmetries; s++) {
+        int t[4];
+        for (int i = 0; i < m.count; i++) t[i] = transformSquare(squares[i], s);
+        int k = kingSlot(m, t[0]);
+        if (k < 0) continue;
+        // Identical pieces are interchangeable; keep them in ascending order.
+        for (int i = 1; i + 1 < m.count; i++)
+            if (m.codes[i] == m.codes[i + 1] && t[i] > t[i + 1]) std::swap(t[i], t[i + 1]);
+        uint64_t idx = (whiteToMove ? 0 : 1) * static_cast<uint64_t>(m.kingSquares) + k;
+        for (int i = 1; i < m.count; i++) idx = idx * 64 + t[i];
+        best = std::min(best, idx);
+    }
+    return best;
+}
+
+// Maps a position to its table: signature, slot squares and side to move,
+// swapping colours (and mirroring ranks) when Black has the stronger side.
+bool locate(const Position& pos, std::string& signature, int* squares, bool& whiteToMove) {
+    std::vector<std::pair<char, int>> white, black;
+    int wk = -1, bk = -1;
+    for (int sq = 0; sq < 64; sq++) {
+        int8_t c = pos.board[sq];
+        if (c == 0) continue;
+        PieceType t = typeOfCode(c);
+        if (t == KING) {
+            (c > 0 ? wk : bk) = sq;
+            continue;
+        }
+        (c > 0 ? white : black).push_back({letterOf(t), sq});
+        if (white.size() + black.size() > 2) return false;
+    }
+    if (wk < 0 || bk < 0) return false;
+
+    std::string ws, bs;
+    for (auto& p : white) ws += p.first;
+    for (auto& p : black) bs += p.first;
+    sortPieces(ws);
+    sortPieces(bs);
+    bool flip = compareSides(bs, ws) > 0;
+    whiteToMove = pos.whiteTurn;
+    if (flip) {
+        std::swap(white, black);
+        std::swap(wk, bk);
+        std::swap(ws, bs);
+        whiteToMove = !whiteToMove;
+        auto mirror = [](int sq) { return squareOf(7 - rowOf(sq), colOf(sq)); };
+        wk = mirror(wk);
+        bk = mirror(bk);
+        for (auto& p : white) p.second = mirror(p.second);
+        for (auto& p : black) p.second = mirror(p.second);
+    }
+    auto byOrder = [](const std::pair<char, int>& a, const std::pair<char, int>& b) {
+        return orderOf(a.first) < orderOf(b.first);
+    };
+    std::sort(white.begin(), white.end(), byOrder);
+    std::sort(black.begin(), black.end(), byOrder);
+
+    signature = "K" + ws + "K" + bs;
+    int n = 0;
+    squares[n++] = wk;
+    for (auto& p : white) squares[n++] = p.second;
+    squares[n++] = bk;
+    for (auto& p : black) squares[n++] = p.second;
+    return true;
+}
+
+// Slot squares of a position known to have the table's own material and
+// colouring (every quiet move and unmove stays inside the table).
+void slotSquares(const Material& m, const Position& pos, int* squares) {
+    int filled = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        int8_t c = pos.board[sq];
+        if (c == 0) continue;
+        for (int i = 0; i < m.count; i++) {
+            if (m.codes[i] == c && (filled & (1 << i)) == 0) {
+                squares[i] = sq;
+                filled |= 1 << i;
+                break;
+            }
+        }
+    }
+}
+
+// Inverse of the index layout. Returns false for overlapping pieces or pawns
+// on the first or last rank; canonicity is checked by the caller.
+bool decodeIndex(const Material& m, uint64_t idx, Position& pos, int* squares) {
+    for (int i = m.count - 1; i >= 1; i--) {
+        squares[i] = static_cast<int>(idx % 64);
+        idx /= 64;
+    }
+    squares[0] = kingSquareOfSlot(m, static_cast<int>(idx % m.kingSquares));
+    bool whiteToMove = (idx / m.kingSquares) == 0;
+
+    pos.clear();
+    for (int i = 0; i < m.count; i++) {
+        int sq = squares[i];
+        if (pos.board[sq] != 0) return false;
+        if (typeOfCode(m.codes[i]) == PAWN && (rowOf(sq) == 0 || rowOf(sq) == 7)) return false;
+        pos.put(sq, m.codes[i]);
+    }
+    pos.whiteTurn = whiteToMove;
+    pos.refresh();
+    return true;
+}
+
+// Calls f(pos) for every position from which the side not to move could have
+// reached pos with a quiet (non-capturing, non-promoting) move. pos is edited
+// in place and restored afterwards.
+template <typename F>
+void forEachUnmove(Position& pos, F f) {
+    static const int kdx[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+    static const int kdy[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+    static const int ndx[8] = {1, 1, -1, -1, 2, 2, -2, -2};
+    static const int ndy[8] = {2, -2, 2, -2, 1, -1, 1, -1};
+    bool mover = !pos.whiteTurn;
+
+    auto visit = [&](int to, int from) {
+        int8_t c = pos.board[to];
+        pos.board[to] = 0;
+        pos.board[from] = c;
+        if (typeOfCode(c) == KING) pos.kingSq[c > 0 ? 0 : 1] = static_cast<int8_t>(from);
+        pos.whiteTurn = mover;
+        f(pos);
+        pos.whiteTurn = !mover;
+        pos.board[from] = 0;
+        pos.board[to] = c;
+        if (typeOfCode(c) == KING) pos.kingSq[c > 0 ? 0 : 1] = static_cast<int8_t>(to);
+    };
+    auto empty = [&](int x, int y) {
+        return x >= 0 && x < 8 && y >= 0 && y < 8 && pos.board[squareOf(x, y)] == 0;
+    };
+
+    for (int sq = 0; sq < 64; sq++) {
+        int8_t c = pos.board[sq];
+        if (c == 0 || (c > 0) != mover) continue;
+        int x = rowOf(sq), y = colOf(sq);
+        PieceType t = typeOfCode(c);
+        switch (t) {
+            case KING:
+            case KNIGHT: {
+                const int* dx = t == KING ? kdx : ndx;
+                const int* dy = t == KING ? kdy : ndy;
+                for (int i = 0; i < 8; i++)
+                    if (empty(x + dx[i], y + dy[i])) visit(sq, squareOf(x + dx[i], y + dy[i]));
+                break;
+            }
+            case PAWN: {
+                int back = mover ? -1 : 1;
+                int px = x + back;
+                if (px < 1 || px > 6 || !empty(px, y)) break;
+                visit(sq, squareOf(px, y));
+                int doubleRow = mover ? 3 : 4;
+                if (x == doubleRow && empty(px + back, y)) visit(sq, squareOf(px + back, y));
+                break;
+            }
+            default: {
+                for (int dx = -1; dx <= 1; dx++) {
+                    for (int dy = -1; dy <= 1; dy++) {
+                        if (dx == 0 && dy == 0) continue;
+                        bool diagonal = dx != 0 && dy != 0;
+                        if (diagonal && t == ROOK) continue;
+                        if (!diagonal && t == BISHOP) continue;
+                        for (int nx = x + dx, ny = y + dy; empty(nx, ny); nx += dx, ny += dy)
+                            visit(sq, squareOf(nx, ny));
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+template <typename F>
+void parallelFor(uint64_t n, int threads, F f) {
+    const uint64_t chunk = 4096;
+    std::atomic<uint64_t> next{0};
+    auto worker = [&]() {
+        for (;;) {
+            uint64_t begin = next.fetch_add(chunk);
+            if (begin >= n) return;
+            uint64_t end = std::min(n, begin + chunk);
+            for (uint64_t i = begin; i < end; i++) f(i);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+}
+
+TbResult decodeValue(uint8_t v) {
+    TbResult r;
+    if (v == ILLEGAL) return r;
+    r.found = true;
+    if (v == UNKNOWN) return r;
+    r.dtm = v - 2;
+    r.wdl = (r.dtm % 2 == 1) ? 1 : -1;
+    return r;
+}
+
+// Result of the parent position implied by a child result, one ply earlier.
+TbResult parentOf(const TbResult& child) {
+    TbResult r = child;
+    r.wdl = -child.wdl;
+    if (child.wdl != 0) r.dtm = child.dtm + 1;
+    return r;
+}
+
+// True if a is a better result than b for the side to move.
+bool better(const TbResult& a, const TbResult& b) {
+    if (a.wdl != b.wdl) return a.wdl > b.wdl;
+    if (a.wdl > 0) return a.dtm < b.dtm;
+    if (a.wdl < 0) return a.dtm > b.dtm;
+    return false;
+}
+
+std::string tablePath(const std::string& dir, const std::string& signature) {
+    return (std::filesystem::path(dir) / (signature + ".tb")).string();
+}
+
+}  // namespace
+
+struct Tablebases::Table {
+    Material material;
+    void* base = nullptr;
+    size_t mappedSize = 0;
+    const uint8_t* data = nullptr;
+
+    ~Table() {
+        if (base != nullptr) munmap(base, mappedSize);
+    }
+};
+
+Tablebases::Tablebases(std::string directory) : dir(std::move(directory)) {}
+
+Tablebases::~Tablebases() {}
+
+const std::string& Tablebases::getDirectory() const { return dir; }
+
+const Tablebases::Table* Tablebases::table(const std::string& signature) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = tables.find(signature);
+    if (it != tables.end()) return it->second.get();
+
+    // A missing or corrupt file is cached as nullptr so it is not retried.
+    std::unique_ptr<Table> t;
+    int fd = open(tablePath(dir, signature).c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        Material m = materialOf(signature);
+        if (fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) == headerSize + m.size) {
+            void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (base != MAP_FAILED) {
+                t = std::make_unique<Table>();
+                t->material = m;
+                t->base = base;
+                t->mappedSize = st.st_size;
+                const char* header = static_cast<const char*>(base);
+                uint32_t version;
+                std::memcpy(&version, header + 4, sizeof(version));
+                if (std::memcmp(header, magic, 4) != 0 || version != formatVersion ||
+                    std::strncmp(header + 8, signature.c_str(), 8) != 0)
+                    t.reset();
+                else
+                    t->data = static_cast<const uint8_t*>(base) + headerSize;
+            }
+        }
+        close(fd);
+    }
+    const Table* result = t.get();
+    tables[signature] = std::move(t);
+    return result;
+}
+
+std::string Tablebases::signatureOf(const Position& pos) {
+    std::string signature;
+    int squares[4];
+    bool whiteToMove;
+    if (!locate(pos, signature, squares, whiteToMove)) return "";
+    return signature;
+}
+
+TbResult Tablebases::probe(const Position& pos) const {
+    if (pos.castling != 0) return TbResult();
+    if (pos.epSquare >= 0) {
+        Position copy = pos;
+        MoveList moves;
+        copy.generateLegal(moves);
+        for (const PosMove& m : moves)
+            if (m.to == pos.epSquare && typeOfCode(pos.board[m.from]) == PAWN)
+                return TbResult();
+    }
+
+    std::string signature;
+    int squares[4];
+    bool whiteToMove;
+    if (!locate(pos, signature, squares, whiteToMove)) return TbResult();
+    if (isTrivialDraw(signature)) {
+        TbResult r;
+        r.found = true;
+        return r;
+    }
+    const Table* t = table(signature);
+    if (t == nullptr) return TbResult();
+    uint64_t idx = canonicalIndex(t->material, squares, whiteToMove);
+    if (idx >= t->material.size) return TbResult();
+    return decodeValue(t->data[idx]);
+}
+
+TbResult Tablebases::probe(const ChessGame& game) const {
+    Position pos;
+    if (!Position::fromGame(game, pos)) return TbResult();
+    return probe(pos);
+}
+
+bool Tablebases::bestMove(Position& pos, PosMove& best, TbResult* result) const {
+    TbResult here = probe(pos);
+    if (result != nullptr) *result = here;
+    if (!here.found) return false;
+
+    MoveList moves;
+    pos.generateLegal(moves);
+    bool have = false;
+    TbResult bestResult;
+    for (const PosMove& m : moves) {
+        PosUndo u = pos.make(m);
+        TbResult child = probe(pos);
+        pos.unmake(m, u);
+        if (!child.found) continue;
+        TbResult r = parentOf(child);
+        if (!have || better(r, bestResult)) {
+            have = true;
+            best = m;
+            bestResult = r;
+        }
+    }
+    return have;
+}
+
+ChessMove Tablebases::bestMove(const ChessGame& game, TbResult* result) const {
+    Position pos;
+    if (!Position::fromGame(game, pos)) {
+        if (result != nullptr) *result = TbResult();
+        return ChessMove();
+    }
+    PosMove best;
+    if (!bestMove(pos, best, result)) return ChessMove();
+    return best.toChessMove();
+}
+
+namespace {
+
+// Retrograde analysis of one table. All tables it can exit into (by capture
+// or promotion) must already be available through deps.
+bool buildTable(const std::string& dir, const Material& m, const Tablebases& deps, int threads,
+                std::string& error, std::ostream* log) {
+    auto started = std::chrono::steady_clock::now();
+    const uint64_t n = m.size;
+    std::unique_ptr<std::atomic<uint8_t>[]> value(new std::atomic<uint8_t>[n]);
+    std::unique_ptr<std::atomic<uint8_t>[]> remaining(new std::atomic<uint8_t>[n]);
+    std::unique_ptr<std::atomic<uint8_t>[]> pendingLoss(new std::atomic<uint8_t>[n]);
+    std::vector<uint8_t> pendingWin(n, 0), lossFloor(n, 0), drawExit(n, 0);
+    std::atomic<bool> missingDependency{false};
+
+    // Pass 0: classify every index, count quiet successors and resolve the
+    // moves that leave the table through the dependency tables.
+    parallelFor(n, threads, [&](uint64_t i) {
+        Position pos;
+        int squares[4];
+        remaining[i].store(0, std::memory_order_relaxed);
+        pendingLoss[i].store(0, std::memory_order_relaxed);
+        value[i].store(ILLEGAL, std::memory_order_relaxed);
+        if (!decodeIndex(m, i, pos, squares)) return;
+        if (canonicalIndex(m, squares, pos.whiteTurn) != i) return;
+        if (pos.attacked(pos.kingSq[pos.whiteTurn ? 1 : 0], pos.whiteTurn)) return;
+
+        MoveList moves;
+        pos.generateLegal(moves);
+        if (moves.size == 0) {
+            value[i].store(pos.inCheck() ? 2 : UNKNOWN, std::memory_order_relaxed);
+            return;
+        }
+
+        uint64_t children[256];
+        int count = 0, bestWin = 0, floor = 0;
+        bool draw = false;
+        for (const PosMove& mv : moves) {
+            bool exits = pos.isCapture(mv) || mv.promo != PAWN;
+            PosUndo u = pos.make(mv);
+            if (exits) {
+                TbResult r = deps.probe(pos);
+                if (!r.found) {
+                    missingDependency = true;
+                } else if (r.wdl < 0) {
+                    bestWin = bestWin == 0 ? r.dtm + 1 : std::min(bestWin, r.dtm + 1);
+                } else if (r.wdl == 0) {
+                    draw = true;
+                } else {
+                    floor = std::max(floor, r.dtm + 1);
+                }
+            } else {
+                int childSquares[4];
+                slotSquares(m, pos, childSquares);
+                children[count++] = canonicalIndex(m, childSquares, pos.whiteTurn);
+            }
+            pos.unmake(mv, u);
+        }
+        std::sort(children, children + count);
+        count = static_cast<int>(std::unique(children, children + count) - children);
+
+        remaining[i].store(static_cast<uint8_t>(count), std::memory_order_relaxed);
+        pendingWin[i] = static_cast<uint8_t>(std::min(bestWin, maxDtm));
+        lossFloor[i] = static_cast<uint8_t>(std::min(floor, maxDtm));
+        drawExit[i] = draw ? 1 : 0;
+        if (count == 0 && bestWin == 0 && !draw)
+            pendingLoss[i].store(lossFloor[i], std::memory_order_relaxed);
+        value[i].store(UNKNOWN, std::memory_order_relaxed);
+    });
+    if (missingDependency) {
+        error = "missing dependency table for " + m.signature;
+        return false;
+    }
+
+    std::atomic<int> maxPending{0};
+    for (uint64_t i = 0; i < n; i++)
+        maxPending = std::max({maxPending.load(), static_cast<int>(pendingWin[i]),
+                               static_cast<int>(pendingLoss[i].load())});
+
+    // Layer d finalizes every position that is mate in exactly d plies. Wins
+    // (odd d) come from predecessors of layer d-1 losses; losses (even d)
+    // from positions whose last undecided quiet move turned out to lose.
+    int deepest = 0;
+    for (int d = 1; d <= maxDtm; d++) {
+        const uint8_t previous = static_cast<uint8_t>(2 + d - 1);
+        const uint8_t current = static_cast<uint8_t>(2 + d);
+        const bool winLayer = (d % 2 == 1);
+        std::atomic<uint64_t> finalized{0};
+        auto settle = [&](uint64_t p) {
+            uint8_t expected = UNKNOWN;
+            if (value[p].compare_exchange_strong(expected, current)) finalized++;
+        };
+
+        parallelFor(n, threads, [&](uint64_t i) {
+            uint8_t v = value[i].load(std::memory_order_relaxed);
+            if (v == UNKNOWN) {
+                if ((winLayer && pendingWin[i] == d) ||
+                    (!winLayer && pendingLoss[i].load(std::memory_order_relaxed) == d))
+                    settle(i);
+                return;
+            }
+            if (v != previous) return;
+
+            Position pos;
+            int squares[4];
+            decodeIndex(m, i, pos, squares);
+            uint64_t preds[512];
+            int count = 0;
+            forEachUnmove(pos, [&](const Position& pred) {
+                int predSquares[4];
+                slotSquares(m, pred, predSquares);
+                if (count < 512) preds[count++] = canonicalIndex(m, predSquares, pred.whiteTurn);
+            });
+            std::sort(preds, preds + count);
+            count = static_cast<int>(std::unique(preds, preds + count) - preds);
+
+            for (int k = 0; k < count; k++) {
+                uint64_t p = preds[k];
+                if (value[p].load(std::memory_order_relaxed) == ILLEGAL) continue;
+                if (winLayer) {
+                    settle(p);
+                } else if (remaining[p].fetch_sub(1) == 1 && pendingWin[p] == 0 && !drawExit[p] &&
+                           value[p].load(std::memory_order_relaxed) == UNKNOWN) {
+                    int loss = std::max(d, static_cast<int>(lossFloor[p]));
+                    if (loss == d) {
+                        settle(p);
+                    } else {
+                        pendingLoss[p].store(static_cast<uint8_t>(loss),
+                                             std::memory_order_relaxed);
+                        int seen = maxPending.load();
+                        while (seen < loss && !maxPending.compare_exchange_weak(seen, loss)) {
+                        }
+                    }
+                }
+            }
+        });
+        if (finalized > 0) deepest = d;
+        if (finalized == 0 && d > maxPending) break;
+    }
+
+    std::filesystem::create_directories(dir);
+    std::string path = tablePath(dir, m.signature);
+    std::string tmp = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        char header[headerSize] = {};
+        std::memcpy(header, magic, 4);
+        std::memcpy(header + 4, &formatVersion, sizeof(formatVersion));
+        std::strncpy(header + 8, m.signature.c_str(), 8);
+        std::memcpy(header + 16, &n, sizeof(n));
+        out.write(header, headerSize);
+        std::vector<char> buffer;
+        buffer.reserve(1 << 16);
+        for (uint64_t i = 0; i < n; i++) {
+            buffer.push_back(static_cast<char>(value[i].load(std::memory_order_relaxed)));
+            if (buffer.size() == buffer.capacity()) {
+                out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        }
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (!out) {
+            error = "failed to write " + tmp;
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        error = "failed to rename " + tmp + ": " + ec.message();
+        return false;
+    }
+
+    if (log != nullptr) {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - started)
+                          .count();
+        *log << m.signature << ": " << n << " entries, longest mate " << deepest
+             << " plies, " << secs << " s\n";
+    }
+    return true;
+}
+
+}  // namespace
+
+bool Tablebases::generate(const std::string& directory, const std::string& signature,
+                          int threads, std::string& error, std::ostream* log) {
+    std::string canonical;
+    if (!parseSignature(signature, canonical)) {
+        error = "invalid material signature: " + signature;
+        return false;
+    }
+    if (isTrivialDraw(canonical)) return true;
+    if (std::filesystem::exists(tablePath(directory, canonical))) return true;
+
+    for (const std::string& dep : dependenciesOf(canonical))
+        if (!generate(directory, dep, threads, error, log)) return false;
+
+    if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    Tablebases deps(directory);
+    return buildTable(directory, materialOf(canonical), deps, threads, error, log);
+}
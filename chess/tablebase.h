@@ -0,0 +1,83 @@
+// Endgame tablebases for positions with up to four pieces (kings included).
+//
+// Tables are produced offline by retrograde analysis (Tablebases::generate)
+// and stored one file per material signature ("KQK.tb", "KBNK.tb", ...).
+// Each position is a single byte holding both WDL and DTM, and files are
+// memory-mapped on first use, so probing costs one index computation and one
+// byte read.
+
+#ifndef CHESS_TABLEBASE_H
+#define CHESS_TABLEBASE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "chess.h"
+#include "position.h"
+
+/** Result of a tablebase probe, from the side to move's point of view. */
+struct TbResult {
+    bool found = false;
+    int wdl = 0;  // +1 win, 0 draw, -1 loss
+    int dtm = 0;  // plies to mate with best play; 0 for draws
+};
+
+/**
+ * Prober (and generator) for a directory of tablebase files.
+ *
+ * Tables ignore castling rights, en passant and the fifty-move rule, the
+ * usual convention for endgame tables. Positions with castling rights or a
+ * legal en passant capture are reported as not found.
+ *
+ * Probing is thread-safe; tables are loaded lazily and stay mapped for the
+ * lifetime of the object.
+ */
+class Tablebases {
+   public:
+    explicit Tablebases(std::string directory);
+    ~Tablebases();
+
+    Tablebases(const Tablebases&) = delete;
+    Tablebases& operator=(const Tablebases&) = delete;
+
+    const std::string& getDirectory() const;
+
+    TbResult probe(const ChessGame& game) const;
+    TbResult probe(const Position& pos) const;
+
+    /**
+     * Returns the move that realizes the probed result (fastest mate when
+     * winning, slowest when losing), or ChessMove::end if the position is not
+     * in the tables or has no legal moves. The position's own result is
+     * written to *result when given.
+     */
+    ChessMove bestMove(const ChessGame& game, TbResult* result = nullptr) const;
+    bool bestMove(Position& pos, PosMove& best, TbResult* result = nullptr) const;
+
+    /**
+     * Generates the table for a material signature such as "KQK" or "KRKN",
+     * together with every table it depends on (captures and promotions), into
+     * the given directory. Existing files are reused. Signatures are
+     * canonicalized, so "KKQ" generates "KQK". Progress goes to *log if set.
+     *
+     * Returns false and sets error on an invalid signature or I/O failure.
+     */
+    static bool generate(const std::string& directory, const std::string& signature,
+                         int threads, std::string& error, std::ostream* log = nullptr);
+
+    /** Canonical material signature of a position, e.g. "KRK". */
+    static std::string signatureOf(const Position& pos);
+
+   private:
+    struct Table;
+    const Table* table(const std::string& signature) const;
+
+    std::string dir;
+    mutable std::mutex mutex;
+    mutable std::map<std::string, std::unique_ptr<Table>> tables;
+};
+
+#endif  // CHESS_TABLEBASE_H
@@ -3,11 +3,40 @@
 // Coverage: make coverage
 
 #include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include <memory>
+#include <random>
 #include <string>
+#include <thread>
 
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "archive.h"
 #include "bridge.h"
+#include "batch.h"
 #include "chess.h"
+#include "encoding.h"
+#include "epd.h"
+#include "explorer.h"
+#include "mate.h"
+#include "pgn.h"
+#include "ponder.h"
+#include "posindex.h"
+#include "position.h"
+#include "review.h"
+#include "search.h"
+#include "server.h"
+#include "sessions.h"
+#include "stats.h"
+#include "tablebase.h"
 #include <nlohmann/json.hpp>
 
 // ============================================================================
@@ -814,6 +843,58 @@ TEST_CASE("Not stalemate when king has legal moves", "[ChessGame]") {
     REQUIRE(!game.checkmate(WHITE));
 }
 
+TEST_CASE("LegalMoves: lazy range matches getMoves", "[ChessGame]") {
+    // Playouts through castling, en passant and promotion: the range gives
+    // getMoves() in the same order, and the count and early-exit test agree.
+    std::mt19937 rng(50);
+    for (const char* fen : {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                            "r3k2r/1P4P1/8/3pP3/8/8/1p4p1/R3K2R w KQkq d6 0 12"}) {
+        auto game = ChessGame::fromFen(fen);
+        for (int ply = 0; ply < 80; ply++) {
+            bool turn = game->getTurn();
+            auto moves = game->getMoves(turn);
+            std::vector<std::string> lazy;
+            for (const ChessMove& m : game->legalMoves(turn)) lazy.push_back(m.toString());
+            REQUIRE(lazy.size() == moves.size());
+            for (size_t i = 0; i < moves.size(); i++) REQUIRE(lazy[i] == moves[i].toString());
+            REQUIRE(game->countLegalMoves(turn) == static_cast<int>(moves.size()));
+            REQUIRE(game->hasLegalMove(turn) == !moves.empty());
+            if (moves.empty()) break;
+            REQUIRE(game->makeMove(moves[rng() % moves.size()]));
+        }
+    }
+}
+
+TEST_CASE("LegalMoves: status checks stop at the first legal move", "[ChessGame]") {
+    ChessGame game;
+    uint64_t before = ChessGame::legalMovesGenerated();
+    REQUIRE(game.hasLegalMove(WHITE));
+    REQUIRE_FALSE(game.stalemate(WHITE));
+    REQUIRE_FALSE(game.checkmate(WHITE));  // not in check: no moves looked at
+    REQUIRE_FALSE(game.canClaimDraw());    // no draw due: no moves looked at
+    REQUIRE(ChessGame::legalMovesGenerated() == before + 2);
+
+    before = ChessGame::legalMovesGenerated();
+    std::string state;
+    game.appendJson(state, STATE_IS_CHECKMATE | STATE_IS_STALEMATE);
+    REQUIRE(state == R"({"isCheckmate":false,"isStalemate":false})");
+    REQUIRE(ChessGame::legalMovesGenerated() == before + 1);
+}
+
+TEST_CASE("LegalMoves: the generated count is per thread and includes Position", "[ChessGame]") {
+    uint64_t before = ChessGame::legalMovesGenerated();
+    Position pos;
+    REQUIRE(parseFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", pos) ==
+            FenError::None);
+    MoveList list;
+    pos.generateLegal(list);
+    REQUIRE(ChessGame::legalMovesGenerated() == before + 20);
+
+    before = ChessGame::legalMovesGenerated();
+    std::thread([] { ChessGame().getMoves(WHITE); }).join();
+    REQUIRE(ChessGame::legalMovesGenerated() == before);
+}
+
 // ============================================================================
 // ChessGame rules
 // ============================================================================
@@ -988,6 +1069,54 @@ TEST_CASE("ChessGame: rules-off moves are not recorded in history", "[ChessGame]
     REQUIRE(game.getHistory().empty());
 }
 
+TEST_CASE("ChessGame: undoMove restores every earlier state exactly", "[ChessGame][History]") {
+    // Playouts through captures, castling, en passant and promotion, then
+    // back again; each state must match the one recorded on the way out.
+    std::mt19937 rng(7);
+    for (const char* fen : {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                            "r3k2r/1P4P1/8/3pP3/8/8/1p4p1/R3K2R w KQkq d6 0 12"}) {
+        auto game = ChessGame::fromFen(fen);
+        std::vector<std::string> states = {game->toJson() + game->getBoard()};
+        for (int ply = 0; ply < 60; ply++) {
+            auto moves = game->getMoves(game->getTurn());
+            if (moves.empty()) break;
+            REQUIRE(game->makeMove(moves[rng() % moves.size()]));
+            states.push_back(game->toJson() + game->getBoard());
+        }
+        REQUIRE(game->undoableMoves() == states.size() - 1);
+        while (game->undoMove()) {
+            states.pop_back();
+            REQUIRE(game->toJson() + game->getBoard() == states.back());
+        }
+        REQUIRE(states.size() == 1);
+        // Moves before the FEN position cannot be taken back.
+        REQUIRE_FALSE(game->undoMove());
+    }
+}
+
+TEST_CASE("ChessGame: undoMove restores repetition and castling state", "[ChessGame][History]") {
+    ChessGame game;
+    for (const char* san : {"Nf3", "Nf6", "Ng1", "Ng8", "Nf3", "Nf6", "Ng1", "Ng8"}) {
+        REQUIRE(game.makeMove(game.parseSan(san)));
+    }
+    REQUIRE(game.canClaimDraw());
+    REQUIRE(game.undoMove());
+    REQUIRE_FALSE(game.canClaimDraw());
+    REQUIRE(game.makeMove(game.parseSan("Ng8")));
+    REQUIRE(game.canClaimDraw());
+
+    for (const char* san : {"e4", "e5", "Nf3", "Nc6", "Bc4", "Bc5", "O-O"}) {
+        REQUIRE(game.makeMove(game.parseSan(san)));
+    }
+    REQUIRE(game.undoMove());
+    REQUIRE(game.toFen().find(" w KQkq ") != std::string::npos);  // rights restored
+    REQUIRE(game.undoMove());
+    REQUIRE(game.makeMove(game.parseSan("Nf6")));
+    REQUIRE(game.makeMove(game.parseSan("O-O")));
+    REQUIRE(game.getPiece(0, 6)->getType() == KING);
+    REQUIRE(game.getPiece(0, 5)->getType() == ROOK);
+}
+
 // ============================================================================
 // FEN Serialization
 // ============================================================================
@@ -1400,6 +1529,42 @@ TEST_CASE("ChessGame: toSan disambiguation by rank R1e3", "[ChessGame][SAN]") {
     REQUIRE(cb.game.toSan(ChessMove(0, 0, 2, 0)) == "R1a3");
 }
 
+TEST_CASE("Position: batch SAN matches toSan move by move", "[ChessGame][SAN]") {
+    // Random playouts reach captures, checks, castling, en passant, promotion
+    // and disambiguation; the batch must agree with toSan on all of them.
+    std::mt19937 rng(2024);
+    for (const char* fen : {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                            "r3k2r/1P4P1/8/3pP3/8/8/1p4p1/R3K2R w KQkq d6 0 12",
+                            "4k3/8/8/8/8/Q7/8/Q1Q1K3 w - - 0 1"}) {
+        for (int game = 0; game < 2; game++) {
+            auto g = ChessGame::fromFen(fen);
+            REQUIRE(g);
+            std::vector<std::string> played;
+            for (int ply = 0; ply < 60; ply++) {
+                auto moves = g->getMoves(g->getTurn());
+                if (moves.empty() || g->isAutomaticDraw()) break;
+                Position pos;
+                REQUIRE(Position::fromGame(*g, pos));
+                auto batch = sanOf(pos, moves);
+                REQUIRE(batch.size() == moves.size());
+                for (size_t i = 0; i < moves.size(); i++) {
+                    REQUIRE(batch[i] == g->toSan(moves[i]));
+                }
+                size_t pick = rng() % moves.size();
+                played.push_back(batch[pick]);
+                REQUIRE(g->makeMove(moves[pick]));
+            }
+            auto history = historySan(*g);
+            size_t placeholders = history.size() - played.size();
+            REQUIRE(std::vector<std::string>(history.begin() + placeholders, history.end()) ==
+                    played);
+        }
+    }
+    Position pos;
+    Position::fromFen("4k3/8/8/8/8/Q7/8/Q1Q1K3 w - - 0 1", pos);
+    REQUIRE(sanOf(pos, PosMove::fromChessMove(ChessMove(0, 0, 1, 1))) == "Qa1b2");
+}
+
 // ============================================================================
 // SAN Suffix Validation (SPEC 6.2.8)
 // ============================================================================
@@ -1549,6 +1714,16 @@ TEST_CASE("ChessGame: parseSan rejects lowercase promotion =q", "[ChessGame][SAN
     REQUIRE(move.isEnd());
 }
 
+TEST_CASE("ChessGame: parseMove accepts SAN and LAN forms", "[ChessGame][SAN]") {
+    ChessGame game;
+    ChessMove san = game.parseMove("Nf3");
+    REQUIRE(std::string(san.toString()) == "g1f3");
+    REQUIRE(std::string(game.parseMove("g1f3").toString()) == "g1f3");
+    REQUIRE(std::string(game.parseMove("g1-f3").toString()) == "g1f3");
+    REQUIRE(game.parseMove("z9f3").isEnd());
+    REQUIRE(game.parseMove("Nf4").isEnd());
+}
+
 // ============================================================================
 // Draw Detection
 // ============================================================================
@@ -1823,6 +1998,13 @@ TEST_CASE("toJson: initial position contains correct FEN", "[ChessGame][JSON]")
             std::string::npos);
 }
 
+TEST_CASE("appendJson: appends the toJson object to a buffer", "[ChessGame][JSON]") {
+    ChessGame game;
+    std::string buffer = "prefix:";
+    game.appendJson(buffer);
+    REQUIRE(buffer == "prefix:" + game.toJson());
+}
+
 TEST_CASE("toJson: initial position has turn white", "[ChessGame][JSON]") {
     ChessGame game;
     std::string json = game.toJson();
@@ -2174,6 +2356,93 @@ TEST_CASE("ChessGame::fromFen: rejects non-integer fullmove number", "[ChessGame
     REQUIRE(game == nullptr);
 }
 
+// --- Structured errors and the allocation-free reader/writer ---
+
+TEST_CASE("parseFen: reports why a FEN was rejected", "[Position][FEN]") {
+    const std::pair<const char*, FenError> cases[] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0", FenError::FieldCount},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1", FenError::Placement},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1", FenError::SideToMove},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KKkq - 0 1", FenError::Castling},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e9 0 1", FenError::EnPassant},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - +0 1", FenError::HalfmoveClock},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 0", FenError::FullmoveNumber},
+        {"8/8/8/8/8/8/8/4K3 w - - 0 1", FenError::KingCount},
+        {"QRRNNBBQ/PPPPPPPP/8/8/8/8/1K6/7k w - - 0 1", FenError::PieceCount},
+        {"4k3/8/8/8/8/8/8/P3K3 w - - 0 1", FenError::PawnOnBackRank},
+        {"8/8/8/8/8/8/3kK3/8 w - - 0 1", FenError::AdjacentKings},
+        {"4k3/8/8/8/8/8/8/4RK2 w - - 0 1", FenError::OpponentInCheck},
+    };
+    for (const auto& [fen, expected] : cases) {
+        Position pos;
+        INFO(fen);
+        REQUIRE(parseFen(fen, pos) == expected);
+        FenError error = FenError::None;
+        REQUIRE(ChessGame::fromFen(fen, &error) == nullptr);
+        REQUIRE(error == expected);
+        REQUIRE(std::string(fenErrorMessage(error)).size() > 0);
+    }
+    FenError error = FenError::Placement;
+    REQUIRE(ChessGame::fromFen("4k3/8/8/8/8/8/8/4K3 w - - 0 1", &error) != nullptr);
+    REQUIRE(error == FenError::None);
+}
+
+TEST_CASE("parseFen: fields may be separated by any whitespace", "[Position][FEN]") {
+    Position pos;
+    REQUIRE(parseFen("  4k3/8/8/8/8/8/8/4K3\tb  -  - 3\t7 \r\n", pos) == FenError::None);
+    REQUIRE(pos.toFen() == "4k3/8/8/8/8/8/8/4K3 b - - 3 7");
+    auto game = ChessGame::fromFen("4k3/8/8/8/8/8/8/4K3\tb - -\t3 7");
+    REQUIRE(game != nullptr);
+    REQUIRE(game->toFen() == "4k3/8/8/8/8/8/8/4K3 b - - 3 7");
+}
+
+TEST_CASE("parseFen: rejects oversized move counters", "[Position][FEN]") {
+    Position pos;
+    REQUIRE(parseFen("4k3/8/8/8/8/8/8/4K3 w - - 999999 1", pos) == FenError::None);
+    REQUIRE(parseFen("4k3/8/8/8/8/8/8/4K3 w - - 1000000 1", pos) == FenError::HalfmoveClock);
+    REQUIRE(parseFen("4k3/8/8/8/8/8/8/4K3 w - - 0 99999999999999999999", pos) ==
+            FenError::FullmoveNumber);
+}
+
+TEST_CASE("Position::fromFen: validates as parseFen does", "[Position][FEN]") {
+    Position pos;
+    REQUIRE(Position::fromFen("4k3/8/8/8/8/8/8/4K3 b - - 3 7", pos));
+    REQUIRE(pos.toFen() == "4k3/8/8/8/8/8/8/4K3 b - - 3 7");
+    REQUIRE_FALSE(Position::fromFen("4k3/8/8/8/8/8/8/4RK2 w - - 0 1", pos));
+    REQUIRE_FALSE(Position::fromFen("r3k2r/8/8/8/8/8/8/R3K2R w qkQK - 0 1", pos));
+    REQUIRE_FALSE(Position::fromFen("4k3/8/8/8/8/8/8/4K3 w - - 0 0", pos));
+}
+
+TEST_CASE("writeFen: matches toFen through random playouts", "[Position][FEN]") {
+    // ChessGame and Position play the same moves; both writers, and both
+    // readers of the written FEN, must agree at every ply.
+    std::mt19937 rng(48);
+    char buf[FEN_BUFFER_SIZE];
+    for (const char* fen : {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                            "r3k2r/1P4P1/8/3pP3/8/8/1p4p1/R3K2R w KQkq d6 0 12"}) {
+        for (int playout = 0; playout < 10; playout++) {
+            auto game = ChessGame::fromFen(fen);
+            Position pos;
+            REQUIRE(parseFen(fen, pos) == FenError::None);
+            for (int ply = 0; ply < 80; ply++) {
+                std::string expected = game->toFen();
+                REQUIRE(std::string_view(buf, game->writeFen(buf)) == expected);
+                REQUIRE(std::string_view(buf, writeFen(pos, buf)) == expected);
+                Position reread;
+                REQUIRE(parseFen(expected, reread) == FenError::None);
+                REQUIRE(reread.toFen() == expected);
+                REQUIRE(ChessGame::fromFen(expected)->toFen() == expected);
+
+                auto moves = game->getMoves(game->getTurn());
+                if (moves.empty()) break;
+                const ChessMove& move = moves[rng() % moves.size()];
+                pos.make(PosMove::fromChessMove(move));
+                REQUIRE(game->makeMove(move));
+            }
+        }
+    }
+}
+
 // ============================================================================
 // Independent castling rights
 // ============================================================================
@@ -2368,7 +2637,7 @@ TEST_CASE("Bridge: from_fen with invalid FEN returns ok:false", "[bridge]") {
     BridgeContext ctx;
     auto resp = bridgeCmd(ctx, {{"command", "from_fen"}, {"fen", "not a valid fen"}});
     REQUIRE(resp["ok"] == false);
-    REQUIRE(resp.contains("error"));
+    REQUIRE(resp["error"] == "invalid FEN string: a FEN has six fields");
 }
 
 TEST_CASE("Bridge: parse_san 'Nf3' returns LAN 'g1f3'", "[bridge]") {
@@ -2441,3 +2710,2059 @@ TEST_CASE("Bridge: invalid JSON returns error", "[bridge]") {
     REQUIRE(resp["ok"] == false);
     REQUIRE(resp.contains("error"));
 }
+
+TEST_CASE("Bridge: an array of commands runs in order as one batch", "[bridge]") {
+    BridgeContext ctx;
+    json batch = json::array({{{"command", "new_game"}},
+                              {{"command", "make_move"}, {"move", "e4"}},
+                              {{"command", "make_move"}, {"move", "e4"}},  // illegal now
+                              {{"command", "make_move"}, {"move", "e5"}},
+                              {"not a command"}});
+    auto resp = bridgeCmd(ctx, batch);
+    REQUIRE(resp.is_array());
+    REQUIRE(resp.size() == 5);
+    REQUIRE(resp[0]["ok"] == true);
+    REQUIRE(resp[1]["move_lan"] == "e2e4");
+    REQUIRE(resp[2]["ok"] == false);
+    REQUIRE(resp[3]["state"]["moveHistory"] == json::array({"e2e4", "e7e5"}));
+    REQUIRE(resp[4]["ok"] == false);
+    REQUIRE(ctx.stats.latency["make_move"].getCount() == 3);
+
+    REQUIRE(bridgeCmd(ctx, json::array()) == json::array());
+
+    bool quit = false;
+    std::string response = handleBridgeCommand(
+        R"([{"command":"quit"},{"command":"new_game"}])", ctx, quit);
+    REQUIRE(quit);
+    REQUIRE(json::parse(response).size() == 1);
+    REQUIRE(ctx.game->getHistory().size() == 2);
+}
+
+TEST_CASE("Bridge: CBOR and MessagePack requests get responses in kind", "[bridge]") {
+    BridgeContext ctx;
+    bool quit = false;
+    ctx.format = BridgeFormat::Cbor;
+    auto resp = json::from_cbor(
+        handleBridgeMessage(json::to_cbor({{"command", "new_game"}}), ctx, quit));
+    REQUIRE(resp["ok"] == true);
+    REQUIRE(resp["state"]["legalMoves"].size() == 20);
+
+    ctx.format = BridgeFormat::MsgPack;
+    json batch = json::array({{{"command", "make_move"}, {"move", "e4"}},
+                              {{"command", "parse_san"}, {"san", "e5"}}});
+    resp = json::from_msgpack(handleBridgeMessage(json::to_msgpack(batch), ctx, quit));
+    REQUIRE(resp.size() == 2);
+    REQUIRE(resp[0]["move_lan"] == "e2e4");
+    REQUIRE(resp[1]["lan"] == "e7e5");
+
+    resp = json::from_msgpack(handleBridgeMessage({0xc1}, ctx, quit));  // never used
+    REQUIRE(resp["ok"] == false);
+
+    BridgeFormat format;
+    REQUIRE(parseBridgeFormat("cbor", format));
+    REQUIRE(format == BridgeFormat::Cbor);
+    REQUIRE_FALSE(parseBridgeFormat("bson", format));
+}
+
+TEST_CASE("Bridge: binary responses carry the same documents as JSON text", "[bridge]") {
+    for (BridgeFormat format : {BridgeFormat::Cbor, BridgeFormat::MsgPack}) {
+        BridgeContext text, binary;
+        binary.format = format;
+        bool quit = false;
+        for (const json& cmd : {json{{"command", "new_game"}},
+                                json{{"command", "make_move"}, {"move", "e4"}},
+                                json{{"command", "make_move"}, {"move", "e5"}, {"delta", true}},
+                                json{{"command", "get_state"}, {"fields", {"fen", "legalMovesSan"}}},
+                                json{{"command", "make_move"}, {"move", "Ke9"}},
+                                json{{"command", "perft"}, {"depth", 2}},
+                                json{{"command", "undo"}, {"count", 2}},
+                                json::array({{{"command", "create"}}, {{"command", "list"}}})}) {
+            json expected = json::parse(handleBridgeCommand(cmd.dump(), text, quit));
+            const std::string& encoded = handleBridgeMessage(
+                format == BridgeFormat::Cbor ? json::to_cbor(cmd) : json::to_msgpack(cmd),
+                binary, quit);
+            json actual = format == BridgeFormat::Cbor ? json::from_cbor(encoded)
+                                                       : json::from_msgpack(encoded);
+            // Versions come from a process-wide counter, so the two games differ.
+            for (json* r : {&expected, &actual}) {
+                json& first = r->is_array() ? (*r)[0] : *r;
+                first.erase("state_version");
+                first.erase("base_version");
+            }
+            REQUIRE(actual == expected);
+        }
+    }
+}
+
+// Writes a DOM with DocumentWriter, in the DOM's (sorted) member order.
+static void writeDom(DocumentWriter& w, const json& value) {
+    if (value.is_object()) {
+        w.beginObject();
+        for (const auto& [key, member] : value.items()) {
+            w.key(key);
+            writeDom(w, member);
+        }
+        w.endObject();
+    } else if (value.is_array()) {
+        w.beginArray();
+        for (const json& element : value) writeDom(w, element);
+        w.endArray();
+    } else if (value.is_string()) {
+        w.string(value.get_ref<const std::string&>());
+    } else if (value.is_boolean()) {
+        w.boolean(value.get<bool>());
+    } else if (value.is_number_unsigned()) {
+        w.number(value.get<uint64_t>());
+    } else if (value.is_number_integer()) {
+        w.number(value.get<int64_t>());
+    } else {
+        w.null();
+    }
+}
+
+TEST_CASE("DocumentWriter: output matches nlohmann::json's encoders", "[bridge]") {
+    json doc = {{"small", json::array({1, -1, 0, nullptr, true, false})},
+                {"ints", json::array({23, 24, 127, 128, 255, 256, 65535, 65536, 4294967296ULL,
+                                      -24, -25, -32, -33, -128, -129, -40000, -3000000000LL})},
+                {"short", "e4"},
+                {"text", std::string(40, 'x')},
+                {"long", std::string(300, 'y')},
+                {"huge", std::string(70000, 'z')},
+                {"escapes", "a\"b\\c\nd\te\x01"}};
+    doc["many"] = json::array();
+    for (int i = 0; i < 300; i++) doc["many"].push_back(i);
+    for (int i = 0; i < 20; i++) doc["members"]["m" + std::to_string(i)] = {{"nested", i}};
+
+    std::string out;
+    DocumentWriter cbor(out, Encoding::Cbor);
+    writeDom(cbor, doc);
+    std::vector<uint8_t> expected = json::to_cbor(doc);
+    REQUIRE(out == std::string(expected.begin(), expected.end()));
+
+    out.clear();
+    DocumentWriter msgpack(out, Encoding::MsgPack);
+    writeDom(msgpack, doc);
+    expected = json::to_msgpack(doc);
+    REQUIRE(out == std::string(expected.begin(), expected.end()));
+
+    out.clear();
+    DocumentWriter text(out, Encoding::Json);
+    writeDom(text, doc);
+    REQUIRE(out == doc.dump());
+}
+
+TEST_CASE("Bridge: state matches ChessGame::toJson", "[bridge]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    auto resp = bridgeCmd(ctx, {{"command", "make_move"}, {"move", "e4"}});
+    REQUIRE(resp["state"] == json::parse(ctx.game->toJson()));
+    REQUIRE(resp["move_lan"] == "e2e4");
+}
+
+TEST_CASE("Bridge: fields limits the state to the requested members", "[bridge]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    uint64_t before = ChessGame::legalMovesGenerated();
+    auto resp = bridgeCmd(ctx, {{"command", "make_move"}, {"move", "e4"},
+                                {"fields", {"moveHistory", "fen"}}});
+    REQUIRE(ChessGame::legalMovesGenerated() == before);  // SAN is resolved on a Position
+    json full = json::parse(ctx.game->toJson());
+    REQUIRE(resp["state"] == json({{"fen", full["fen"]}, {"moveHistory", full["moveHistory"]}}));
+    REQUIRE(resp["state"].begin().key() == "fen");  // usual order, not request order
+
+    resp = bridgeCmd(ctx, {{"command", "get_state"}, {"fields", {"isCheckmate"}}});
+    REQUIRE(resp["state"] == json({{"isCheckmate", false}}));
+    resp = bridgeCmd(ctx, {{"command", "get_state"}, {"fields", json::array()}});
+    REQUIRE(resp["state"] == json::object());
+
+    REQUIRE(bridgeCmd(ctx, {{"command", "get_state"}, {"fields", {"bogus"}}})["ok"] == false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "get_state"}, {"fields", "fen"}})["ok"] == false);
+}
+
+TEST_CASE("Bridge: delta make_move patches a client copy to the full state", "[bridge]") {
+    BridgeContext ctx;
+    json copy = bridgeCmd(ctx, {{"command", "new_game"}});
+    uint64_t version = copy["state_version"];
+    json state = copy["state"];
+    // Castling moves two pieces, en passant removes a third square's pawn.
+    for (const char* san : {"e4", "Nf6", "Nf3", "Nxe4", "Be2", "d5", "O-O", "d4", "c4", "dxc3"}) {
+        auto resp = bridgeCmd(ctx, {{"command", "make_move"}, {"move", san}, {"delta", true}});
+        REQUIRE(resp["ok"] == true);
+        REQUIRE(resp["base_version"] == version);
+        REQUIRE_FALSE(resp["state"].contains("board"));
+        REQUIRE_FALSE(resp["state"].contains("moveHistory"));
+        for (const json& change : resp["changed"]) {
+            std::string sq = change["square"];
+            state["board"][7 - (sq[1] - '1')][sq[0] - 'a'] = change["piece"];
+        }
+        state["moveHistory"].push_back(resp["move_lan"]);
+        for (auto& [key, value] : resp["state"].items()) state[key] = value;
+        version = resp["state_version"];
+        REQUIRE(version > resp["base_version"].get<uint64_t>());
+    }
+    auto full = bridgeCmd(ctx, {{"command", "get_state"}});
+    REQUIRE(full["state"] == state);
+    REQUIRE(full["state_version"] == version);
+
+    REQUIRE(bridgeCmd(ctx, {{"command", "make_move"}, {"move", "Nc3"}, {"delta", 1}})["ok"] == false);
+}
+
+TEST_CASE("Bridge: state_version survives session eviction", "[bridge][sessions]") {
+    BridgeContext ctx;
+    ctx.sessions = GameSessions(1);
+    json a = bridgeCmd(ctx, {{"command", "create"}})["game_id"];
+    auto moved = bridgeCmd(ctx, {{"command", "make_move"}, {"game_id", a}, {"move", "e4"}});
+    bridgeCmd(ctx, {{"command", "create"}});  // evicts game a
+    auto state = bridgeCmd(ctx, {{"command", "get_state"}, {"game_id", a}});
+    REQUIRE(state["state_version"] == moved["state_version"]);
+}
+
+TEST_CASE("Bridge: SAN for the played move, legal moves and history", "[bridge]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    REQUIRE(bridgeCmd(ctx, {{"command", "make_move"}, {"move", "g1f3"}})["move_san"] == "Nf3");
+    bridgeCmd(ctx, {{"command", "make_move"}, {"move", "e5"}});
+    auto resp = bridgeCmd(ctx, {{"command", "get_state"},
+                                {"fields", {"legalMoves", "legalMovesSan", "moveHistorySan"}}});
+    const json& state = resp["state"];
+    REQUIRE(state["moveHistorySan"] == json::array({"Nf3", "e5"}));
+    REQUIRE(state["legalMovesSan"].size() == state["legalMoves"].size());
+    for (size_t i = 0; i < state["legalMoves"].size(); i++) {
+        ChessMove cm = ctx.game->parseMove(state["legalMoves"][i]);
+        REQUIRE(state["legalMovesSan"][i] == ctx.game->toSan(cm));
+    }
+    // Not part of the default state.
+    REQUIRE_FALSE(bridgeCmd(ctx, {{"command", "get_state"}})["state"].contains("legalMovesSan"));
+    resp = bridgeCmd(ctx, {{"command", "get_state"}, {"fields", {"moveHistorySan"}}});
+    REQUIRE(resp["state"] == json({{"moveHistorySan", {"Nf3", "e5"}}}));
+}
+
+TEST_CASE("Bridge: undo takes back moves, all or nothing", "[bridge]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    for (const char* san : {"e4", "e5", "Nf3"}) {
+        bridgeCmd(ctx, {{"command", "make_move"}, {"move", san}});
+    }
+    auto resp = bridgeCmd(ctx, {{"command", "undo"}});
+    REQUIRE(resp["state"]["moveHistory"] == json::array({"e2e4", "e7e5"}));
+    REQUIRE(bridgeCmd(ctx, {{"command", "undo"}, {"count", 3}})["ok"] == false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "undo"}, {"count", 0}})["ok"] == false);
+    resp = bridgeCmd(ctx, {{"command", "undo"}, {"count", 2}});
+    REQUIRE(resp["state"]["fen"] == "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+    json id = bridgeCmd(ctx, {{"command", "create"}})["game_id"];
+    bridgeCmd(ctx, {{"command", "make_move"}, {"game_id", id}, {"move", "d4"}});
+    bridgeCmd(ctx, {{"command", "make_move"}, {"game_id", id}, {"move", "d5"}});
+    bridgeCmd(ctx, {{"command", "undo"}, {"game_id", id}});
+    REQUIRE(ctx.sessions.list()[0].plies == 1);
+}
+
+TEST_CASE("Bridge: error messages are JSON-escaped", "[bridge]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    auto resp = bridgeCmd(ctx, {{"command", "make_move"}, {"move", "e\"4\\\n\u0001"}});
+    REQUIRE(resp["ok"] == false);
+    REQUIRE(resp["error"] == "illegal or invalid move: e\"4\\\n\u0001");
+}
+
+TEST_CASE("Bridge: response buffer is reused between commands", "[bridge]") {
+    BridgeContext ctx;
+    bool quit = false;
+    const std::string& first = handleBridgeCommand(R"({"command":"new_game"})", ctx, quit);
+    const std::string& second = handleBridgeCommand(R"({"command":"get_state"})", ctx, quit);
+    REQUIRE(&first == &second);
+    REQUIRE(json::parse(second)["ok"] == true);
+}
+
+// ============================================================================
+// Position (compact board used by the analysis tools)
+// ============================================================================
+
+TEST_CASE("Position: perft from the initial position", "[Position]") {
+    Position pos;
+    REQUIRE(Position::fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", pos));
+    REQUIRE(pos.perft(1) == 20);
+    REQUIRE(pos.perft(2) == 400);
+    REQUIRE(pos.perft(3) == 8902);
+}
+
+TEST_CASE("Position: perft covers castling, en passant and promotion", "[Position]") {
+    // "Kiwipete" and the promotion-heavy position 4 from the standard perft suite.
+    Position pos;
+    REQUIRE(Position::fromFen(
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", pos));
+    REQUIRE(pos.perft(2) == 2039);
+    REQUIRE(Position::fromFen(
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", pos));
+    REQUIRE(pos.perft(3) == 9467);
+}
+
+TEST_CASE("Position: legal moves agree with ChessGame", "[Position]") {
+    for (const char* fen : {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+                            "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+                            "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"}) {
+        auto game = ChessGame::fromFen(fen);
+        REQUIRE(game != nullptr);
+        Position pos;
+        REQUIRE(Position::fromGame(*game, pos));
+        MoveList list;
+        pos.generateLegal(list);
+        REQUIRE(static_cast<size_t>(list.size) == game->getMoves(game->getTurn()).size());
+        for (const PosMove& m : list) {
+            auto copy = ChessGame::fromFen(fen);
+            REQUIRE(copy->makeMove(m.toChessMove()));
+        }
+    }
+}
+
+TEST_CASE("Position: make and unmake restore FEN and hash", "[Position]") {
+    std::string fen = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+    Position pos;
+    REQUIRE(Position::fromFen(fen, pos));
+    uint64_t key = pos.key;
+    MoveList list;
+    pos.generateLegal(list);
+    for (const PosMove& m : list) {
+        PosUndo u = pos.make(m);
+        Position fresh;
+        REQUIRE(Position::fromFen(pos.toFen(), fresh));
+        REQUIRE(fresh.key == pos.key);  // incremental hash matches a full recompute
+        pos.unmake(m, u);
+        REQUIRE(pos.toFen() == fen);
+        REQUIRE(pos.key == key);
+    }
+}
+
+// ============================================================================
+// Endgame tablebases
+// ============================================================================
+
+// Tables are generated once into a temp directory and reused by later tests
+// (and later runs) because generation skips files that already exist.
+static const std::string& testTablebaseDir() {
+    static const std::string dir = [] {
+        auto path = std::filesystem::temp_directory_path() / "chess_tb_test_v1";
+        std::string error;
+        for (const char* sig : {"KQK", "KRK", "KPK"})
+            REQUIRE(Tablebases::generate(path.string(), sig, 2, error));
+        return path.string();
+    }();
+    return dir;
+}
+
+static TbResult tbProbe(const Tablebases& tb, const std::string& fen) {
+    auto game = ChessGame::fromFen(fen);
+    REQUIRE(game != nullptr);
+    return tb.probe(*game);
+}
+
+TEST_CASE("Tablebases: KQK mate in one is found with best move", "[tablebase]") {
+    Tablebases tb(testTablebaseDir());
+    auto game = ChessGame::fromFen("k7/8/1K6/8/8/8/8/6Q1 w - - 0 1");
+    REQUIRE(game != nullptr);
+    TbResult r;
+    ChessMove best = tb.bestMove(*game, &r);
+    REQUIRE(r.found);
+    REQUIRE(r.wdl == 1);
+    REQUIRE(r.dtm == 1);
+    REQUIRE(game->makeMove(best));
+    REQUIRE(game->checkmate(game->getTurn()));
+}
+
+TEST_CASE("Tablebases: colour-flipped material probes the same table", "[tablebase]") {
+    Tablebases tb(testTablebaseDir());
+    // Same mate in one with colours and ranks swapped: Black has the queen.
+    TbResult r = tbProbe(tb, "6q1/8/8/8/8/1k6/8/K7 b - - 0 1");
+    REQUIRE(r.found);
+    REQUIRE(r.wdl == 1);
+    REQUIRE(r.dtm == 1);
+    r = tbProbe(tb, "6q1/8/8/8/8/1k6/8/K7 w - - 0 1");
+    REQUIRE(r.found);
+    REQUIRE(r.wdl == -1);
+}
+
+TEST_CASE("Tablebases: checkmated side reports loss in zero", "[tablebase]") {
+    Tablebases tb(testTablebaseDir());
+    TbResult r = tbProbe(tb, "k6R/8/1K6/8/8/8/8/8 b - - 0 1");
+    REQUIRE(r.found);
+    REQUIRE(r.wdl == -1);
+    REQUIRE(r.dtm == 0);
+}
+
+TEST_CASE("Tablebases: KRK with hanging rook is a draw", "[tablebase]") {
+    Tablebases tb(testTablebaseDir());
+    TbResult r = tbProbe(tb, "8/8/8/8/8/8/kR6/7K b - - 0 1");
+    REQUIRE(r.found);
+    REQUIRE(r.wdl == 0);
+}
+
+TEST_CASE("Tablebases: KPK wins and stalemates", "[tablebase]") {
+    Tablebases tb(testTablebaseDir());
+    TbResult r = tbProbe(tb, "4k3/8/4K3/4P3/8/8/8/8 w - - 0 1");
+    REQUIRE(r.found);
+    REQUIRE(r.wdl == 1);
+    r = tbProbe(tb, "4k3/8/4K3/4P3/8/8/8/8 b - - 0 1");
+    REQUIRE(r.wdl == -1);
+    r = tbProbe(tb, "4k3/4P3/4K3/8/8/8/8/8 b - - 0 1");  // stalemate
+    REQUIRE(r.found);
+    REQUIRE(r.wdl == 0);
+}
+
+TEST_CASE("Tablebases: positions outside the tables are not found", "[tablebase]") {
+    Tablebases tb(testTablebaseDir());
+    ChessGame game;
+    REQUIRE(!tb.probe(game).found);
+    REQUIRE(!tbProbe(tb, "k7/8/1K6/8/8/8/8/6RR w - - 0 1").found);  // KRRK not generated
+    REQUIRE(tbProbe(tb, "k7/8/1K6/8/8/8/8/6B1 w - - 0 1").found);    // KBK is a known draw
+}
+
+TEST_CASE("Tablebases: generate rejects invalid signatures", "[tablebase]") {
+    std::string error;
+    REQUIRE(!Tablebases::generate(testTablebaseDir(), "QKK", 1, error));
+    REQUIRE(!error.empty());
+    REQUIRE(!Tablebases::generate(testTablebaseDir(), "KQRKR", 1, error));
+}
+
+TEST_CASE("Bridge: tb_probe reports result and best move", "[bridge][tablebase]") {
+    BridgeContext ctx;
+    ctx.tablebases = std::make_shared<Tablebases>(testTablebaseDir());
+    bridgeCmd(ctx, {{"command", "from_fen"}, {"fen", "k7/8/1K6/8/8/8/8/6Q1 w - - 0 1"}});
+    auto resp = bridgeCmd(ctx, {{"command", "tb_probe"}});
+    REQUIRE(resp["ok"] == true);
+    REQUIRE(resp["found"] == true);
+    REQUIRE(resp["wdl"] == "win");
+    REQUIRE(resp["dtm"] == 1);
+    std::string san = resp["bestMove"];
+    REQUIRE(san.back() == '#');
+}
+
+TEST_CASE("Bridge: tb_probe without tablebases returns error", "[bridge][tablebase]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    auto resp = bridgeCmd(ctx, {{"command", "tb_probe"}});
+    REQUIRE(resp["ok"] == false);
+}
+
+// ============================================================================
+// Mate solver
+// ============================================================================
+
+static MateResult solveMate(const std::string& fen, int maxMoves, uint64_t maxNodes = 1000000,
+                            bool checksOnly = true) {
+    Position pos;
+    REQUIRE(Position::fromFen(fen, pos));
+    return findMate(pos, maxMoves, maxNodes, checksOnly);
+}
+
+TEST_CASE("findMate: mate in one", "[mate]") {
+    auto r = solveMate("6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1", 3);
+    REQUIRE(r.found);
+    REQUIRE(r.moves == 1);
+    REQUIRE(r.line.size() == 1);
+}
+
+TEST_CASE("findMate: forcing line is returned in SAN", "[mate]") {
+    std::string fen = "r5rk/5p1p/5R2/4B3/8/8/7P/7K w - - 0 1";
+    auto r = solveMate(fen, 5);
+    REQUIRE(r.found);
+    REQUIRE(r.moves == 3);
+    auto game = ChessGame::fromFen(fen);
+    auto san = sanLine(*game, r.line);
+    REQUIRE(san.size() == 5);
+    REQUIRE(san.front() == "Ra6+");
+    REQUIRE(san.back().back() == '#');
+}
+
+TEST_CASE("findMate: quiet moves are tried when checksOnly is off", "[mate]") {
+    std::string fen = "8/8/8/8/8/5K2/6R1/7k w - - 0 1";
+    REQUIRE(!solveMate(fen, 3).found);
+    auto r = solveMate(fen, 3, 1000000, false);
+    REQUIRE(r.found);
+    REQUIRE(r.moves == 3);
+}
+
+TEST_CASE("findMate: stalemate is not mate", "[mate]") {
+    // Kf2 stalemates instead of mating; there is no mate in two.
+    auto r = solveMate("8/8/8/8/8/5K2/6R1/7k w - - 0 1", 2, 1000000, false);
+    REQUIRE(!r.found);
+    REQUIRE(r.disproven);
+}
+
+TEST_CASE("findMate: node limit stops the search", "[mate]") {
+    auto r = solveMate("r5rk/5p1p/5R2/4B3/8/8/7P/7K w - - 0 1", 5, 10);
+    REQUIRE(!r.found);
+    REQUIRE(!r.disproven);
+}
+
+TEST_CASE("Bridge: find_mate returns the forcing line", "[bridge][mate]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "from_fen"}, {"fen", "r5rk/5p1p/5R2/4B3/8/8/7P/7K w - - 0 1"}});
+    auto resp = bridgeCmd(ctx, {{"command", "find_mate"}, {"max_moves", 5}});
+    REQUIRE(resp["ok"] == true);
+    REQUIRE(resp["found"] == true);
+    REQUIRE(resp["mate_in"] == 3);
+    REQUIRE(resp["line"].size() == 5);
+    REQUIRE(resp["line_lan"][0] == "f6a6");
+}
+
+TEST_CASE("Bridge: find_mate rejects invalid limits", "[bridge][mate]") {
+    BridgeContext ctx;
+    auto resp = bridgeCmd(ctx, {{"command", "find_mate"}});
+    REQUIRE(resp["ok"] == false);
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    resp = bridgeCmd(ctx, {{"command", "find_mate"}, {"max_moves", 0}});
+    REQUIRE(resp["ok"] == false);
+    resp = bridgeCmd(ctx, {{"command", "find_mate"}, {"max_nodes", "many"}});
+    REQUIRE(resp["ok"] == false);
+    resp = bridgeCmd(ctx, {{"command", "find_mate"}, {"max_moves", 2}});
+    REQUIRE(resp["ok"] == true);
+    REQUIRE(resp["found"] == false);
+    REQUIRE(resp["disproven"] == true);
+}
+
+// ============================================================================
+// Search
+// ============================================================================
+
+static SearchResult searchFen(const std::string& fen, uint64_t nodes) {
+    Position pos;
+    REQUIRE(Position::fromFen(fen, pos));
+    SearchLimits limits;
+    limits.nodes = nodes;
+    return search(pos, limits);
+}
+
+TEST_CASE("search: takes a hanging queen", "[search]") {
+    auto r = searchFen("4k3/8/8/3q4/8/8/8/3RK3 w - - 0 1", 20000);
+    REQUIRE(r.hasMove);
+    REQUIRE(std::string(r.best.toChessMove().toString()) == "d1d5");
+    REQUIRE(r.score > 0);
+}
+
+TEST_CASE("search: finds mate and reports a mate score", "[search]") {
+    auto r = searchFen("r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4", 20000);
+    REQUIRE(std::string(r.best.toChessMove().toString()) == "h5f7");
+    REQUIRE(isMateScore(r.score));
+    REQUIRE(mateInMoves(r.score) == 1);
+}
+
+TEST_CASE("search: no legal moves", "[search]") {
+    auto mated = searchFen("k6R/8/1K6/8/8/8/8/8 b - - 0 1", 1000);
+    REQUIRE(!mated.hasMove);
+    REQUIRE(mated.score == -MATE_SCORE);
+    auto stalemate = searchFen("k7/8/1Q6/8/8/8/8/7K b - - 0 1", 1000);
+    REQUIRE(!stalemate.hasMove);
+    REQUIRE(stalemate.score == 0);
+}
+
+TEST_CASE("search: node budget is respected after depth one", "[search]") {
+    auto r = searchFen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+                       5000);
+    REQUIRE(r.hasMove);
+    REQUIRE(r.depth >= 1);
+    REQUIRE(r.nodes < 20000);
+}
+
+TEST_CASE("Bridge: analyze and perft", "[bridge][search]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "from_fen"},
+                    {"fen", "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4"}});
+    auto resp = bridgeCmd(ctx, {{"command", "analyze"}, {"nodes", 20000}});
+    REQUIRE(resp["ok"] == true);
+    REQUIRE(resp["best"] == "Qxf7#");
+    REQUIRE(resp["best_lan"] == "h5f7");
+    REQUIRE(resp["score"]["mate"] == 1);
+    REQUIRE(resp["pv"][0] == "Qxf7#");
+    REQUIRE(bridgeCmd(ctx, {{"command", "analyze"}, {"depth", 0}})["ok"] == false);
+
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    resp = bridgeCmd(ctx, {{"command", "perft"}, {"depth", 3}});
+    REQUIRE(resp["nodes"] == 8902);
+    REQUIRE(bridgeCmd(ctx, {{"command", "perft"}})["ok"] == false);
+}
+
+// ============================================================================
+// Game review
+// ============================================================================
+
+static const std::string kInitialFen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+TEST_CASE("reviewGame: flags the blunder and records the result", "[review]") {
+    ReviewOptions options;
+    options.nodes = 20000;
+    GameReview review;
+    std::string error;
+    REQUIRE(reviewGame(kInitialFen, {"e4", "e5", "Qh5", "Nc6", "Bc4", "Nf6", "h5f7"}, options,
+                       review, error));
+    REQUIRE(review.plies.size() == 7);
+    REQUIRE(review.result == "1-0");
+    REQUIRE(review.plies[5].san == "Nf6");
+    REQUIRE(std::string(review.plies[5].classification) == "blunder");
+    REQUIRE(review.plies[6].san == "Qxf7#");
+    REQUIRE(review.plies[6].loss == 0);
+    REQUIRE(isMateScore(review.plies[6].playedScore));
+    REQUIRE(review.plies[6].playedScore > 0);  // White's point of view
+}
+
+TEST_CASE("reviewGame: result does not depend on thread count", "[review]") {
+    std::vector<std::string> moves = {"d4", "d5", "c4", "e6", "Nc3", "Nf6", "Bg5", "Be7"};
+    ReviewOptions options;
+    options.nodes = 10000;
+    GameReview one, many;
+    std::string error;
+    options.threads = 1;
+    REQUIRE(reviewGame(kInitialFen, moves, options, one, error));
+    options.threads = 4;
+    REQUIRE(reviewGame(kInitialFen, moves, options, many, error));
+    REQUIRE(reviewToJson(one) == reviewToJson(many));
+}
+
+TEST_CASE("reviewGame: rejects illegal moves and bad FEN", "[review]") {
+    GameReview review;
+    std::string error;
+    REQUIRE(!reviewGame(kInitialFen, {"e4", "e4"}, ReviewOptions(), review, error));
+    REQUIRE(error.find("ply 2") != std::string::npos);
+    REQUIRE(!reviewGame("not a fen", {}, ReviewOptions(), review, error));
+}
+
+TEST_CASE("reviewToPgn: NAGs, eval comments and FEN header", "[review]") {
+    ReviewOptions options;
+    options.nodes = 5000;
+    GameReview review;
+    std::string error;
+    REQUIRE(reviewGame("k7/8/1K6/8/8/8/8/6Q1 w - - 0 40", {"Qg8#"}, options, review, error));
+    std::string pgn = reviewToPgn(review);
+    REQUIRE(pgn.find("[FEN \"k7/8/1K6/8/8/8/8/6Q1 w - - 0 40\"]") != std::string::npos);
+    REQUIRE(pgn.find("40. Qg8# {[%eval #0]} 1-0") != std::string::npos);
+
+    // Any whitespace separates FEN fields; the review keeps the normal form.
+    REQUIRE(reviewGame("7K/8/6k1/8/8/8/8/1q6\tb\t-\t-\t0\t12", {"b1b8"}, options, review,
+                       error));
+    REQUIRE(review.startFen == "7K/8/6k1/8/8/8/8/1q6 b - - 0 12");
+    REQUIRE(review.plies[0].bestScore < 0);
+    pgn = reviewToPgn(review);
+    REQUIRE(pgn.find("[FEN \"7K/8/6k1/8/8/8/8/1q6 b - - 0 12\"]") != std::string::npos);
+    REQUIRE(pgn.find("12... Qb8# {[%eval #0]} 0-1") != std::string::npos);
+}
+
+TEST_CASE("Bridge: review_game returns JSON or PGN", "[bridge][review]") {
+    BridgeContext ctx;
+    json cmd = {{"command", "review_game"},
+                {"moves", {"e2e4", "e7e5", "d1h5", "b8c6", "f1c4", "g8f6", "h5f7"}},
+                {"nodes", 5000}};
+    auto resp = bridgeCmd(ctx, cmd);
+    REQUIRE(resp["ok"] == true);
+    REQUIRE(resp["review"]["plies"].size() == 7);
+    REQUIRE(resp["review"]["result"] == "1-0");
+    REQUIRE(resp["review"]["plies"][6]["san"] == "Qxf7#");
+    cmd["format"] = "pgn";
+    resp = bridgeCmd(ctx, cmd);
+    REQUIRE(resp["ok"] == true);
+    REQUIRE(resp["pgn"].get<std::string>().find("4. Qxf7#") != std::string::npos);
+}
+
+TEST_CASE("Bridge: review_game validates parameters", "[bridge][review]") {
+    BridgeContext ctx;
+    REQUIRE(bridgeCmd(ctx, {{"command", "review_game"}})["ok"] == false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "review_game"}, {"moves", {"e4", 5}}})["ok"] == false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "review_game"}, {"moves", {"e4"}}, {"nodes", -1}})["ok"] ==
+            false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "review_game"}, {"moves", {"e4"}}, {"format", 3}})["ok"] ==
+            false);
+    auto resp = bridgeCmd(ctx, {{"command", "review_game"}, {"moves", {"e4", "Ke3"}}});
+    REQUIRE(resp["ok"] == false);
+}
+
+// ============================================================================
+// Bridge statistics
+// ============================================================================
+
+TEST_CASE("LatencyHistogram: percentiles within bucket precision", "[stats]") {
+    LatencyHistogram h;
+    REQUIRE(h.percentile(99) == 0);
+    for (uint64_t v = 1; v <= 1000; v++) h.record(v * 1000);  // 1..1000 us
+    REQUIRE(h.getCount() == 1000);
+    REQUIRE(h.getMax() == 1000000);
+    uint64_t p50 = h.percentile(50);
+    uint64_t p99 = h.percentile(99);
+    REQUIRE(p50 >= 500000);
+    REQUIRE(p50 <= 500000 + 500000 / 16);
+    REQUIRE(p99 >= 990000);
+    REQUIRE(p99 <= 1000000);
+    REQUIRE(h.percentile(100) == 1000000);
+    h.reset();
+    REQUIRE(h.getCount() == 0);
+}
+
+TEST_CASE("LatencyHistogram: small and huge values", "[stats]") {
+    LatencyHistogram h;
+    h.record(0);
+    h.record(7);
+    h.record(UINT64_MAX);
+    REQUIRE(h.percentile(1) == 0);
+    REQUIRE(h.percentile(50) == 7);
+    REQUIRE(h.percentile(100) == UINT64_MAX);
+}
+
+TEST_CASE("Bridge: stats reports per-command latency and counters", "[bridge][stats]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    bridgeCmd(ctx, {{"command", "make_move"}, {"move", "e4"}});
+    bridgeCmd(ctx, {{"command", "make_move"}, {"move", "e5"}});
+    bridgeCmd(ctx, {{"command", "bogus"}});
+    // Names that are not commands never get entries of their own, whatever
+    // else is wrong with the request.
+    REQUIRE(bridgeCmd(ctx, {{"command", "junk0"}, {"game_id", "x"}})["error"] ==
+            "unknown command: junk0");
+    bridgeCmd(ctx, {{"command", "junk1"}, {"fields", 5}});
+    auto resp = bridgeCmd(ctx, {{"command", "stats"}});
+    REQUIRE(resp["ok"] == true);
+    auto& stats = resp["stats"];
+    REQUIRE(stats["commands"]["new_game"]["count"] == 1);
+    REQUIRE(stats["commands"]["make_move"]["count"] == 2);
+    REQUIRE(stats["commands"]["unknown"]["count"] == 3);
+    REQUIRE(stats["commands"].size() == 3);
+    REQUIRE(stats["commands"]["make_move"]["p99_us"].get<double>() > 0);
+    REQUIRE(stats["legal_moves_generated"].get<uint64_t>() >= 20);
+    REQUIRE(stats["bytes_written"].get<uint64_t>() > 100);
+}
+
+TEST_CASE("Bridge: stats reset clears the counters", "[bridge][stats]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    REQUIRE(bridgeCmd(ctx, {{"command", "stats"}, {"reset", "yes"}})["ok"] == false);
+    bridgeCmd(ctx, {{"command", "stats"}, {"reset", true}});
+    auto resp = bridgeCmd(ctx, {{"command", "stats"}});
+    REQUIRE(!resp["stats"]["commands"].contains("new_game"));
+    REQUIRE(resp["stats"]["commands"]["stats"]["count"] == 1);
+}
+
+// ============================================================================
+// Multi-game sessions
+// ============================================================================
+
+TEST_CASE("GameSessions: evicted games are replayed with full history", "[sessions]") {
+    GameSessions sessions(1);  // at most one live game
+    uint32_t a = sessions.create("");
+    uint32_t b = sessions.create("");
+    REQUIRE(a != 0);
+    REQUIRE(b != a);
+    // Knight shuffles to reach a threefold repetition in game a.
+    for (const char* m : {"Nf3", "Nf6", "Ng1", "Ng8", "Nf3", "Nf6", "Ng1", "Ng8"}) {
+        ChessGame* game = sessions.get(a);
+        REQUIRE(game->makeMove(game->parseMove(m)));
+        sessions.sync(a);
+        sessions.get(b);  // evicts a
+    }
+    ChessGame* game = sessions.get(a);
+    REQUIRE(game->getHistory().size() == 8);
+    REQUIRE(game->canClaimDraw());
+    REQUIRE(sessions.get(b)->getHistory().empty());
+}
+
+TEST_CASE("GameSessions: a FEN past move one replays only the moves made", "[sessions]") {
+    GameSessions sessions(1);
+    // fromFen() pads the history for the fullmove number; the padding must
+    // not be stored, or replay would try it as a move (here h7-h8).
+    uint32_t a = sessions.create("k7/7P/8/8/8/8/8/K7 w - - 0 2");
+    uint32_t b = sessions.create("4k3/8/8/8/8/8/4P3/4K3 b - - 0 7");
+    REQUIRE(a != 0);
+    REQUIRE(b != 0);
+    ChessGame* game = sessions.get(a);
+    REQUIRE(game->makeMove(game->parseMove("Kb1")));
+    sessions.sync(a);
+    game = sessions.get(b);
+    REQUIRE(game->makeMove(game->parseMove("Kd7")));
+    sessions.sync(b);
+
+    auto games = sessions.list();
+    REQUIRE(games.size() == 2);
+    REQUIRE(games[0].plies == 1);
+    REQUIRE(!games[0].whiteToMove);
+    REQUIRE(games[1].plies == 1);
+    REQUIRE(games[1].whiteToMove);
+
+    game = sessions.get(a);  // rebuilt: b was live
+    REQUIRE(game != nullptr);
+    REQUIRE(game->toFen() == "k7/7P/8/8/8/8/8/1K6 b - - 1 2");
+    REQUIRE(game->undoMove());
+    sessions.sync(a);
+    sessions.get(b);
+    REQUIRE(sessions.get(a)->toFen() == "k7/7P/8/8/8/8/8/K7 w - - 0 2");
+    REQUIRE(sessions.get(b)->toFen() == "8/3k4/8/8/8/8/4P3/4K3 w - - 1 8");
+}
+
+TEST_CASE("GameSessions: FEN start, list and destroy", "[sessions]") {
+    GameSessions sessions;
+    REQUIRE(sessions.create("not a fen") == 0);
+    uint32_t id = sessions.create("4k3/8/8/8/8/8/4P3/4K3 b - - 0 1");
+    REQUIRE(id != 0);
+    auto games = sessions.list();
+    REQUIRE(games.size() == 1);
+    REQUIRE(games[0].id == id);
+    REQUIRE(!games[0].whiteToMove);
+    REQUIRE(sessions.destroy(id));
+    REQUIRE(!sessions.destroy(id));
+    REQUIRE(sessions.get(id) == nullptr);
+    REQUIRE(sessions.size() == 0);
+}
+
+TEST_CASE("Bridge: create, list and destroy games", "[bridge][sessions]") {
+    BridgeContext ctx;
+    auto a = bridgeCmd(ctx, {{"command", "create"}});
+    auto b = bridgeCmd(ctx, {{"command", "create"}, {"fen", "4k3/8/8/8/8/8/4P3/4K3 w - - 0 1"}});
+    REQUIRE(a["ok"] == true);
+    REQUIRE(b["state"]["fen"] == "4k3/8/8/8/8/8/4P3/4K3 w - - 0 1");
+    auto list = bridgeCmd(ctx, {{"command", "list"}});
+    REQUIRE(list["count"] == 2);
+    REQUIRE(list["games"][0]["game_id"] == a["game_id"]);
+    REQUIRE(list["games"][1]["turn"] == "white");
+    REQUIRE(bridgeCmd(ctx, {{"command", "destroy"}, {"game_id", a["game_id"]}})["ok"] == true);
+    REQUIRE(bridgeCmd(ctx, {{"command", "list"}})["count"] == 1);
+    auto resp = bridgeCmd(ctx, {{"command", "get_state"}, {"game_id", a["game_id"]}});
+    REQUIRE(resp["ok"] == false);
+}
+
+TEST_CASE("Bridge: game_id keeps games independent", "[bridge][sessions]") {
+    BridgeContext ctx;
+    json a = bridgeCmd(ctx, {{"command", "create"}})["game_id"];
+    json b = bridgeCmd(ctx, {{"command", "create"}})["game_id"];
+    bridgeCmd(ctx, {{"command", "make_move"}, {"game_id", a}, {"move", "e4"}});
+    bridgeCmd(ctx, {{"command", "make_move"}, {"game_id", b}, {"move", "d4"}});
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    auto stateA = bridgeCmd(ctx, {{"command", "get_state"}, {"game_id", a}})["state"];
+    auto stateB = bridgeCmd(ctx, {{"command", "get_state"}, {"game_id", b}})["state"];
+    REQUIRE(stateA["moveHistory"] == json::array({"e2e4"}));
+    REQUIRE(stateB["moveHistory"] == json::array({"d2d4"}));
+    REQUIRE(ctx.game->getHistory().empty());
+    auto reset = bridgeCmd(ctx, {{"command", "new_game"}, {"game_id", a}});
+    REQUIRE(reset["state"]["moveHistory"].empty());
+    auto fen = bridgeCmd(ctx, {{"command", "from_fen"}, {"game_id", b},
+                               {"fen", "4k3/8/8/8/8/8/4P3/4K3 w - - 0 1"}});
+    REQUIRE(fen["state"]["fen"] == "4k3/8/8/8/8/8/4P3/4K3 w - - 0 1");
+}
+
+TEST_CASE("Bridge: invalid game_id values are rejected", "[bridge][sessions]") {
+    BridgeContext ctx;
+    REQUIRE(bridgeCmd(ctx, {{"command", "get_state"}, {"game_id", 99}})["ok"] == false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "get_state"}, {"game_id", "1"}})["ok"] == false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "get_state"}, {"game_id", -1}})["ok"] == false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "destroy"}})["ok"] == false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "create"}, {"fen", "bad"}})["ok"] == false);
+}
+
+TEST_CASE("Bridge: sessions report why a FEN was rejected", "[bridge][sessions]") {
+    BridgeContext ctx;
+    auto resp = bridgeCmd(ctx, {{"command", "create"}, {"fen", "8/8/8/8/8/8/8/4K3 w - - 0 1"}});
+    REQUIRE(resp["ok"] == false);
+    REQUIRE(resp["error"] == "invalid FEN string: each side needs exactly one king");
+    json id = bridgeCmd(ctx, {{"command", "create"}})["game_id"];
+    resp = bridgeCmd(ctx, {{"command", "from_fen"}, {"game_id", id},
+                           {"fen", "4k3/8/8/8/8/8/8/4K3 w - - 0 0"}});
+    REQUIRE(resp["ok"] == false);
+    REQUIRE(resp["error"] == "invalid FEN string: invalid fullmove number");
+    resp = bridgeCmd(ctx, {{"command", "from_fen"}, {"game_id", id}, {"fen", ""}});
+    REQUIRE(resp["error"] == "invalid FEN string: a FEN has six fields");
+
+    GameSessions sessions;
+    FenError error = FenError::None;
+    REQUIRE(sessions.create("4k3/8/8/8/8/8/8/P3K3 w - - 0 1", &error) == 0);
+    REQUIRE(error == FenError::PawnOnBackRank);
+}
+
+// ============================================================
+// Socket server
+// ============================================================
+
+static int connectTo(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path.c_str());
+    for (int attempt = 0; attempt < 200; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) return fd;
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// Reads until `lines` newline-terminated responses have arrived.
+static std::vector<json> readResponses(int fd, size_t lines) {
+    std::vector<json> out;
+    std::string buf;
+    char chunk[4096];
+    while (out.size() < lines) {
+        ssize_t r = read(fd, chunk, sizeof(chunk));
+        if (r <= 0) break;
+        buf.append(chunk, static_cast<size_t>(r));
+        size_t nl;
+        while ((nl = buf.find('\n')) != std::string::npos) {
+            out.push_back(json::parse(buf.substr(0, nl)));
+            buf.erase(0, nl + 1);
+        }
+    }
+    return out;
+}
+
+static void sendAll(int fd, const std::string& data) {
+    REQUIRE(write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+}
+
+TEST_CASE("Server: clients share game_id games but not the default game", "[server]") {
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("chess_test_" + std::to_string(getpid()) + ".sock")).string();
+    BridgeContext ctx;
+    std::atomic<bool> stop{false};
+    std::string error;
+    bool served = false;
+    std::thread server([&] { served = runBridgeServer(path, ctx, error, &stop); });
+
+    int a = connectTo(path);
+    int b = connectTo(path);
+    REQUIRE(a >= 0);
+    REQUIRE(b >= 0);
+
+    // Pipelined commands, with one line split across two writes.
+    sendAll(a, "{\"command\":\"new_game\"}\n{\"command\":\"make_move\",");
+    sendAll(a, "\"move\":\"e4\"}\n{\"command\":\"create\"}\n");
+    auto ra = readResponses(a, 3);
+    REQUIRE(ra.size() == 3);
+    REQUIRE(ra[1]["state"]["moveHistory"] == json::array({"e2e4"}));
+    uint32_t id = ra[2]["game_id"];
+
+    sendAll(b, "{\"command\":\"get_state\"}\n");
+    sendAll(b, json({{"command", "make_move"}, {"game_id", id}, {"move", "d4"}}).dump() + "\n");
+    auto rb = readResponses(b, 2);
+    REQUIRE(rb.size() == 2);
+    REQUIRE(rb[0]["ok"] == false);  // b has no default game of its own
+    REQUIRE(rb[1]["state"]["moveHistory"] == json::array({"d2d4"}));
+
+    // quit closes only the sender's connection.
+    sendAll(b, "{\"command\":\"quit\"}\n");
+    REQUIRE(readResponses(b, 1).size() == 1);
+    char c;
+    REQUIRE(read(b, &c, 1) == 0);
+    sendAll(a, "{\"command\":\"get_state\"}\n");
+    auto again = readResponses(a, 1);
+    REQUIRE(again.size() == 1);
+    REQUIRE(again[0]["state"]["moveHistory"] == json::array({"e2e4"}));
+
+    close(a);
+    close(b);
+    stop = true;
+    server.join();
+    REQUIRE(served);
+    REQUIRE_FALSE(std::filesystem::exists(path));
+}
+
+TEST_CASE("Server: a client that does not read is pushed back on", "[server]") {
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("chess_test_" + std::to_string(getpid()) + ".slow.sock")).string();
+    BridgeContext ctx;
+    std::atomic<bool> stop{false};
+    std::string error;
+    std::thread server([&] { runBridgeServer(path, ctx, error, &stop); });
+    int fd = connectTo(path);
+    REQUIRE(fd >= 0);
+
+    // Pipeline requests without reading until the server stops accepting
+    // them: its buffers are bounded, so writes soon block.
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    std::string chunk;
+    while (chunk.size() < 65536) chunk += "{\"command\":\"bogus\"}\n";
+    size_t sent = 0;
+    int stalls = 0;  // consecutive blocked writes
+    while (sent < (64u << 20) && stalls < 10) {
+        size_t at = sent % chunk.size();  // writes may be partial
+        ssize_t w = write(fd, chunk.data() + at, chunk.size() - at);
+        if (w > 0) {
+            sent += static_cast<size_t>(w);
+            stalls = 0;
+            continue;
+        }
+        stalls++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    REQUIRE(sent < (32u << 20));
+
+    // After a half-close every complete request is still answered.
+    size_t requests = sent / 20;  // each request line is 20 bytes
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    shutdown(fd, SHUT_WR);
+    size_t lines = 0;
+    char buf[65536];
+    ssize_t r;
+    while ((r = read(fd, buf, sizeof(buf))) > 0) {
+        lines += static_cast<size_t>(std::count(buf, buf + r, '\n'));
+    }
+    REQUIRE(lines == requests);
+
+    close(fd);
+    stop = true;
+    server.join();
+}
+
+TEST_CASE("Server: refuses to replace a regular file", "[server]") {
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("chess_test_" + std::to_string(getpid()) + ".file")).string();
+    { std::ofstream(path) << "keep"; }
+    BridgeContext ctx;
+    std::string error;
+    REQUIRE_FALSE(runBridgeServer(path, ctx, error));
+    REQUIRE_FALSE(error.empty());
+    REQUIRE(std::filesystem::exists(path));
+    std::filesystem::remove(path);
+}
+
+// ============================================================================
+// Background jobs
+// ============================================================================
+
+// Polls a job until it leaves the queued/running states.
+static json waitForJob(BridgeContext& ctx, const json& id) {
+    for (int i = 0; i < 2000; i++) {
+        json resp = bridgeCmd(ctx, {{"command", "poll_job"}, {"job_id", id}});
+        if (resp["status"] != "queued" && resp["status"] != "running") return resp;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    FAIL("job did not finish");
+    return {};
+}
+
+TEST_CASE("JobQueue: a queued job is cancelled at once", "[jobs]") {
+    JobQueue jobs(1);
+    std::atomic<bool> release{false};
+    uint32_t first = jobs.start([&](const std::atomic<bool>&) {
+        while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return std::string("first");
+    });
+    uint32_t second = jobs.start([](const std::atomic<bool>&) { return std::string("second"); });
+    REQUIRE(jobs.cancel(second));
+    JobStatus status;
+    std::string result = "unset";
+    REQUIRE(jobs.poll(second, status, result));
+    REQUIRE(status == JobStatus::Cancelled);
+    REQUIRE(result.empty());
+    REQUIRE_FALSE(jobs.poll(second, status, result));  // collected
+
+    release = true;
+    do {
+        REQUIRE(jobs.poll(first, status, result));
+    } while (status != JobStatus::Done);
+    REQUIRE(result == "first");
+    REQUIRE(jobs.size() == 0);
+}
+
+TEST_CASE("JobQueue: uncollected results are dropped oldest first", "[jobs]") {
+    JobQueue jobs(1, 2);
+    std::vector<uint32_t> ids;
+    for (int i = 0; i < 4; i++) {
+        ids.push_back(jobs.start([i](const std::atomic<bool>&) { return std::to_string(i); }));
+    }
+    // The queue shrinks to two only once the last job has finished.
+    for (int i = 0; i < 2000 && jobs.size() > 2; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(jobs.size() == 2);
+    JobStatus status;
+    std::string result;
+    REQUIRE_FALSE(jobs.poll(ids[0], status, result));
+    REQUIRE_FALSE(jobs.poll(ids[1], status, result));
+    REQUIRE(jobs.poll(ids[3], status, result));
+    REQUIRE(status == JobStatus::Done);
+    REQUIRE(result == "3");
+}
+
+TEST_CASE("Bridge: a job answers like the command, on the position it started from",
+          "[bridge][jobs]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "from_fen"}, {"fen", "r5rk/5p1p/5R2/4B3/8/8/7P/7K w - - 0 1"}});
+    auto started = bridgeCmd(
+        ctx, {{"command", "start_job"}, {"job", {{"command", "find_mate"}, {"max_moves", 5}}}});
+    REQUIRE(started["ok"] == true);
+    // The default game moves on while the job runs.
+    bridgeCmd(ctx, {{"command", "make_move"}, {"move", "h2h3"}});
+
+    auto done = waitForJob(ctx, started["job_id"]);
+    REQUIRE(done["status"] == "done");
+    REQUIRE(done["result"]["mate_in"] == 3);
+    REQUIRE(done["result"]["line_lan"][0] == "f6a6");
+    REQUIRE(bridgeCmd(ctx, {{"command", "poll_job"}, {"job_id", started["job_id"]}})["ok"] == false);
+
+    // Errors come back in the result, as the command would return them.
+    started = bridgeCmd(ctx, {{"command", "start_job"}, {"job", {{"command", "perft"}}}});
+    REQUIRE(waitForJob(ctx, started["job_id"])["result"]["ok"] == false);
+}
+
+TEST_CASE("Bridge: cancel_job stops a running analysis", "[bridge][jobs]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    auto started = bridgeCmd(
+        ctx, {{"command", "start_job"}, {"job", {{"command", "analyze"}, {"depth", 60}}}});
+    json id = started["job_id"];
+    // The bridge keeps answering while the search runs.
+    REQUIRE(bridgeCmd(ctx, {{"command", "make_move"}, {"move", "e4"}})["ok"] == true);
+    REQUIRE(bridgeCmd(ctx, {{"command", "cancel_job"}, {"job_id", id}})["ok"] == true);
+    REQUIRE(waitForJob(ctx, id)["status"] == "cancelled");
+    REQUIRE(bridgeCmd(ctx, {{"command", "cancel_job"}, {"job_id", id}})["ok"] == false);
+}
+
+TEST_CASE("Bridge: notifying jobs are announced by an event", "[bridge][jobs]") {
+    BridgeContext ctx;
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    auto started = bridgeCmd(ctx, {{"command", "start_job"},
+                                   {"notify", true},
+                                   {"job", {{"command", "perft"}, {"depth", 2}}}});
+    std::vector<JobQueue::Finished> finished;
+    for (int i = 0; i < 2000 && finished.empty(); i++) {
+        finished = ctx.jobs.takeNotifications();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(finished.size() == 1);
+    std::string line;
+    appendJobEvent(finished[0], BridgeFormat::Json, line);
+    REQUIRE(line.back() == '\n');
+    json event = json::parse(line);
+    REQUIRE(event["event"] == "job_finished");
+    REQUIRE(event["job_id"] == started["job_id"]);
+    REQUIRE(event["result"]["nodes"] == 400);
+
+    REQUIRE(bridgeCmd(ctx, {{"command", "start_job"}, {"job", {{"command", "undo"}}}})["ok"] ==
+            false);
+    REQUIRE(bridgeCmd(ctx, {{"command", "start_job"}})["ok"] == false);
+}
+
+// ============================================================================
+// Pondering
+// ============================================================================
+
+TEST_CASE("Ponderer: caches a search of every reply", "[ponder]") {
+    Position root;
+    REQUIRE(Position::fromFen("4k3/8/8/3q4/8/8/8/3RK3 b - - 0 1", root));
+    MoveList replies;
+    root.generateLegal(replies);
+
+    Ponderer ponderer;
+    ponderer.start(root);
+    for (int i = 0; i < 2000 && ponderer.cacheSize() < static_cast<size_t>(replies.size); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    ponderer.stop();
+    REQUIRE(ponderer.cacheSize() >= static_cast<size_t>(replies.size));
+
+    for (const PosMove& m : replies) {
+        Position child = root;
+        child.make(m);
+        SearchLimits limits;
+        limits.nodes = 4096;
+        SearchResult cached;
+        REQUIRE(ponderer.lookup(child, limits, cached));
+        REQUIRE(cached.hasMove);
+        REQUIRE(cached.nodes >= 4096);
+        limits.nodes = uint64_t(1) << 40;
+        limits.depth = 0;
+        REQUIRE_FALSE(ponderer.lookup(child, limits, cached));
+    }
+    REQUIRE_FALSE(ponderer.lookup(root, SearchLimits(), *std::make_unique<SearchResult>()));
+}
+
+TEST_CASE("Bridge: analyze answers from pondered work", "[bridge][ponder]") {
+    BridgeContext ctx;
+    ctx.ponderer = std::make_unique<Ponderer>();
+    bridgeCmd(ctx, {{"command", "from_fen"}, {"fen", "4k3/8/8/3q4/8/8/8/3RK3 b - - 0 1"}});
+    Position pos;
+    Position::fromGame(*ctx.game, pos);
+    ctx.ponderer->start(pos);
+    for (int i = 0; i < 2000 && ctx.ponderer->cacheSize() < 14; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    ctx.ponderer->stop();
+
+    bridgeCmd(ctx, {{"command", "make_move"}, {"move", "Qd2+"}});
+    auto resp = bridgeCmd(ctx, {{"command", "analyze"}, {"nodes", 4096}});
+    REQUIRE(resp["pondered"] == true);
+    REQUIRE(resp["best_lan"].get<std::string>().ends_with("d2"));  // takes the queen
+    // More than was pondered: searched afresh.
+    resp = bridgeCmd(ctx, {{"command", "analyze"}, {"movetime_ms", 1000}, {"nodes", 1 << 16}});
+    REQUIRE(resp["ok"] == true);
+    REQUIRE_FALSE(resp.contains("pondered"));
+}
+
+// ============================================================================
+// PGN
+// ============================================================================
+
+TEST_CASE("Position: parseSan agrees with ChessGame::parseSan", "[Position][SAN]") {
+    // Every legal move's SAN round-trips; malformed and ambiguous strings are
+    // rejected by both parsers alike.
+    std::mt19937 rng(41);
+    const char* bad[] = {"", "e5", "Nf4", "N", "exd5", "e4+", "e4#", "O-O", "O-O-O", "Qxh7",
+                         "e8=Q", "Kf8", "Nbd2", "N1f3", "xe4", "Ne", "e4e5", "0-0", "O-O+"};
+    for (const char* fen : {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                            "r3k2r/1P4P1/8/3pP3/8/8/1p4p1/R3K2R w KQkq d6 0 12",
+                            "4k3/8/8/8/8/Q7/8/Q1Q1K3 w - - 0 1"}) {
+        auto g = ChessGame::fromFen(fen);
+        REQUIRE(g);
+        for (int ply = 0; ply < 60; ply++) {
+            auto moves = g->getMoves(g->getTurn());
+            if (moves.empty() || g->isAutomaticDraw()) break;
+            Position pos;
+            REQUIRE(Position::fromGame(*g, pos));
+            std::string before = pos.toFen();
+            for (const ChessMove& cm : moves) {
+                std::string san = g->toSan(cm);
+                PosMove m;
+                REQUIRE(parseSan(pos, san, m));
+                REQUIRE(m == PosMove::fromChessMove(cm));
+            }
+            for (const char* s : bad) {
+                PosMove m;
+                bool ok = parseSan(pos, s, m);
+                ChessMove cm = g->parseSan(s);
+                REQUIRE(ok == !cm.isEnd());
+                if (ok) REQUIRE(m == PosMove::fromChessMove(cm));
+            }
+            REQUIRE(pos.toFen() == before);  // legality checks leave pos untouched
+            REQUIRE(g->makeMove(moves[rng() % moves.size()]));
+        }
+    }
+}
+
+TEST_CASE("SanMoveTable: indexes every pseudo-legal move once", "[Position][SAN]") {
+    // One table serves every SAN string read in a position, and parsing
+    // through it matches parsing without one.
+    std::mt19937 rng(49);
+    for (const char* fen : {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                            "r3k2r/1P4P1/8/3pP3/8/8/1p4p1/R3K2R w KQkq d6 0 12"}) {
+        Position pos;
+        REQUIRE(Position::fromFen(fen, pos));
+        for (int ply = 0; ply < 60; ply++) {
+            MoveList pseudo, legal;
+            pos.generatePseudo(pseudo);
+            pos.generateLegal(legal);
+            if (legal.size == 0) break;
+            SanMoveTable table(pos);
+            int indexed = 0;
+            for (int to = 0; to < 64; to++) {
+                for (int type = PAWN; type <= QUEEN; type++) {
+                    for (const PosMove& m : table.find(to, static_cast<PieceType>(type))) {
+                        REQUIRE(m.to == to);
+                        REQUIRE(typeOfCode(pos.board[m.from]) == type);
+                        indexed++;
+                    }
+                }
+            }
+            REQUIRE(indexed == pseudo.size);
+            for (const PosMove& m : legal) {
+                PosMove shared, single;
+                std::string san = sanOf(pos, m);
+                REQUIRE(parseSan(pos, table, san, shared));
+                REQUIRE(parseSan(pos, san, single));
+                REQUIRE(shared == m);
+                REQUIRE(single == m);
+            }
+            pos.make(legal.moves[rng() % legal.size]);
+        }
+    }
+}
+
+TEST_CASE("ChessGame::parseSan: checks a suffix without copying the game", "[ChessGame][SAN]") {
+    auto game = ChessGame::fromFen("6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1");
+    uint64_t version = game->getStateVersion();
+    REQUIRE(std::string(game->parseSan("Ra8#").toString()) == "a1a8");
+    REQUIRE_FALSE(game->parseSan("Ra8+").isEnd());  // a mate is also a check
+    REQUIRE(game->parseSan("Ra7+").isEnd());
+    REQUIRE(game->parseSan("Ra7#").isEnd());
+    REQUIRE(std::string(game->parseSan("Ra7").toString()) == "a1a7");
+    REQUIRE(game->getStateVersion() == version);
+    REQUIRE(game->toSan(ChessMove("a1a8")) == "Ra8#");
+
+    // Pieces placed without both kings have no checks, so no SAN either.
+    CustomBoard cb;
+    cb.place(0, 0, new Rook(WHITE, false, cb.b));
+    cb.activate();
+    REQUIRE(cb.game.parseSan("Ra8").isEnd());
+    REQUIRE(cb.game.toSan(ChessMove("a1a8")).empty());
+}
+
+TEST_CASE("PgnReader: tags, comments, variations and results", "[PGN]") {
+    std::string text =
+        "% an escaped line\n"
+        "[Event \"Casual \\\"blitz\\\"\"]\n"
+        "[White \"A\"]\n"
+        "[Result \"1-0\"]\n"
+        "\n"
+        "1. e4 {best by test} e5 2.Nf3 $1 (2. f4 exf4 (2... d5) 3. Nf3) Nc6 ; rest of line\n"
+        "3. Bb5!? a6 4.Ba4 0-0? 1-0\n"
+        "\n"
+        "[FEN \"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1\"]\n"
+        "\n"
+        "1... e5 2. Nf3 *\n"
+        "\n"
+        "[Event \"no result\"]\n"
+        "\n"
+        "1. d4 d5\n"
+        "[Event \"last\"]\n"
+        "\n"
+        "1. c4 1/2-1/2\n";
+    PgnReader reader(text);
+    PgnGame game;
+
+    REQUIRE(reader.next(game));
+    REQUIRE(game.number == 1);
+    REQUIRE(game.offset == text.find("[Event"));  // after the escape line
+    REQUIRE(game.tags.size() == 3);
+    REQUIRE(game.tag("Event") == "Casual \\\"blitz\\\"");
+    REQUIRE(game.tag("Round").empty());
+    REQUIRE(game.result == "1-0");
+    // "0-0" is not legal for Black here, so the game stops at the illegal move.
+    REQUIRE(game.moves.size() == 7);
+    REQUIRE(game.error == "illegal or invalid move '0-0?' at ply 8");
+
+    REQUIRE(reader.next(game));
+    REQUIRE(game.error.empty());
+    REQUIRE(game.start.toFen() ==
+            "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1");
+    REQUIRE(game.moves.size() == 2);
+    REQUIRE(game.result == "*");
+
+    REQUIRE(reader.next(game));
+    REQUIRE(game.tag("Event") == "no result");
+    REQUIRE(game.error.empty());
+    REQUIRE(game.moves.size() == 2);
+    REQUIRE(game.result.empty());
+
+    REQUIRE(reader.next(game));
+    REQUIRE(game.number == 4);
+    REQUIRE(text.substr(game.offset, 14) == "[Event \"last\"]");
+    REQUIRE(game.moves.size() == 1);
+    REQUIRE(game.result == "1/2-1/2");
+
+    REQUIRE_FALSE(reader.next(game));
+    REQUIRE(reader.position() == text.size());
+}
+
+TEST_CASE("PgnReader: a bad game does not stop the reader", "[PGN]") {
+    std::string text =
+        "[FEN \"not a fen\"]\n\n1. e4 *\n\n"
+        "[Event \"x\" broken\n\n1. e4 *\n\n"
+        "[Event \"ok\"]\n\n1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7# 1-0\n";
+    PgnReader reader(text);
+    PgnGame game;
+    REQUIRE(reader.next(game));
+    REQUIRE(game.error == "invalid FEN tag");
+    REQUIRE(reader.next(game));
+    REQUIRE(game.error == "malformed tag");
+    REQUIRE(reader.next(game));
+    REQUIRE(game.error.empty());
+    REQUIRE(game.moves.size() == 7);
+    Position end = game.start;
+    for (const PosMove& m : game.moves) end.make(m);
+    REQUIRE(end.inCheck());
+    REQUIRE_FALSE(end.hasLegalMove());
+    REQUIRE_FALSE(reader.next(game));
+}
+
+TEST_CASE("splitPgn: ranges cover the text and start at a game", "[PGN]") {
+    std::string text;
+    for (int i = 0; i < 50; i++) {
+        text += "[Event \"g" + std::to_string(i) + "\"]\n[Result \"*\"]\n\n1. e4 e5 2. Nf3 *\n\n";
+    }
+    for (int parts : {1, 2, 7, 50, 200}) {
+        auto ranges = splitPgn(text, parts);
+        REQUIRE(!ranges.empty());
+        REQUIRE(ranges.size() <= static_cast<size_t>(parts));
+        size_t covered = 0;
+        int games = 0;
+        for (std::string_view r : ranges) {
+            REQUIRE(r.data() == text.data() + covered);
+            REQUIRE(r.substr(0, 7) == "[Event ");
+            covered += r.size();
+            PgnReader reader(r);
+            PgnGame game;
+            while (reader.next(game)) {
+                REQUIRE(game.error.empty());
+                games++;
+            }
+        }
+        REQUIRE(covered == text.size());
+        REQUIRE(games == 50);
+    }
+}
+
+TEST_CASE("splitPgn: a comment line that opens with a bracket is not a game", "[PGN]") {
+    // Wrapped comments often put [%clk ...] or [%eval ...] at a line start.
+    std::string text;
+    for (int i = 0; i < 40; i++) {
+        text += "[Event \"g" + std::to_string(i) + "\"]\n\n1. e4 {comment\n[%clk 0:01:00]} e5 {\n"
+                "[%eval 0.25]} 2. Nf3 {\n[Event \"not a tag\"} 1-0\n\n";
+    }
+    for (int parts : {1, 2, 3, 7, 40, 200}) {
+        int games = 0;
+        for (std::string_view r : splitPgn(text, parts)) {
+            REQUIRE(r.substr(0, 7) == "[Event ");
+            PgnReader reader(r);
+            PgnGame game;
+            while (reader.next(game)) {
+                REQUIRE(game.error.empty());
+                REQUIRE(game.moves.size() == 3);
+                games++;
+            }
+        }
+        REQUIRE(games == 40);
+    }
+}
+
+TEST_CASE("writePgn: clock and eval comments", "[PGN]") {
+    std::string out;
+    appendClockTag(5400000, out);
+    REQUIRE(out == "[%clk 1:30:00.0]");
+    out.clear();
+    appendClockTag(299599, out);  // truncated, not rounded
+    REQUIRE(out == "[%clk 0:04:59.5]");
+    out.clear();
+    appendEvalTag(-35, out);
+    appendEvalTag(mateScoreIn(-3), out);
+    appendEvalTag(mateScoreIn(2), out);
+    REQUIRE(out == "[%eval -0.35][%eval #-3][%eval #2]");
+}
+
+TEST_CASE("writePgn: tags, numbering, result and wrapping", "[PGN]") {
+    ChessGame game;
+    for (const char* san : {"e4", "e5", "Bc4", "Nc6", "Qh5", "Nf6", "Qxf7#"}) {
+        REQUIRE(game.makeMove(game.parseSan(san)));
+    }
+    PgnWriteOptions options;
+    options.tags = {{"Annotator", "x"}, {"White", "A \"B\""}, {"Result", "0-1"}};
+    options.clocksMs = {295000, 298000};
+    options.evals = {PGN_NO_EVAL, PGN_NO_EVAL, 40};
+    std::string out = "kept";
+    writePgn(game, options, out);
+    REQUIRE(out ==
+            "kept[Event \"?\"]\n[Site \"?\"]\n[Date \"????.??.??\"]\n[Round \"?\"]\n"
+            "[White \"A \\\"B\\\"\"]\n[Black \"?\"]\n[Result \"1-0\"]\n[Annotator \"x\"]\n\n"
+            "1. e4 {[%clk 0:04:55.0]} 1... e5 {[%clk 0:04:58.0]} 2. Bc4 {[%eval 0.40]}\n"
+            "2... Nc6 3. Qh5 Nf6 4. Qxf7# 1-0\n\n");
+
+    // A FEN game starts with the FEN's move number; an explicit result wins.
+    auto fromFen = ChessGame::fromFen("4k3/8/8/8/8/8/4P3/4K3 b - - 0 40");
+    REQUIRE(fromFen->makeMove(fromFen->parseSan("Kd7")));
+    REQUIRE(fromFen->makeMove(fromFen->parseSan("e4")));
+    out.clear();
+    options = {};
+    options.result = "1/2-1/2";
+    writePgn(*fromFen, options, out);
+    REQUIRE(out.find("[SetUp \"1\"]\n[FEN \"4k3/8/8/8/8/8/4P3/4K3 b - - 0 40\"]\n\n"
+                     "40... Kd7 41. e4 1/2-1/2\n\n") != std::string::npos);
+}
+
+TEST_CASE("writePgn: output reads back through PgnReader", "[PGN]") {
+    std::mt19937 rng(42);
+    std::string out;
+    std::vector<std::vector<PosMove>> played;
+    for (int g = 0; g < 20; g++) {
+        ChessGame game;
+        PgnWriteOptions options;
+        for (int ply = 0; ply < 120; ply++) {
+            auto moves = game.getMoves(game.getTurn());
+            if (moves.empty() || game.isAutomaticDraw()) break;
+            REQUIRE(game.makeMove(moves[rng() % moves.size()]));
+            options.clocksMs.push_back(rng() % 2 ? static_cast<int64_t>(rng() % 10000000) : -1);
+            options.evals.push_back(rng() % 2 ? static_cast<int>(rng() % 2000) - 1000 : PGN_NO_EVAL);
+        }
+        std::vector<PosMove> line;
+        for (const ChessMove& cm : game.getHistory()) line.push_back(PosMove::fromChessMove(cm));
+        played.push_back(line);
+        writePgn(game, options, out);
+    }
+    size_t from = 0, to;
+    while ((to = out.find('\n', from)) != std::string::npos) {
+        REQUIRE(to - from <= 80);
+        from = to + 1;
+    }
+    PgnReader reader(out);
+    PgnGame game;
+    for (const auto& line : played) {
+        REQUIRE(reader.next(game));
+        REQUIRE(game.error.empty());
+        REQUIRE(game.moves == line);
+        REQUIRE(!game.result.empty());
+    }
+    REQUIRE_FALSE(reader.next(game));
+}
+
+TEST_CASE("Bridge: export_pgn", "[bridge][PGN]") {
+    BridgeContext ctx;
+    REQUIRE(bridgeCmd(ctx, {{"command", "export_pgn"}})["ok"] == false);
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    for (const char* san : {"f3", "e5", "g4", "Qh4#"}) {
+        bridgeCmd(ctx, {{"command", "make_move"}, {"move", san}});
+    }
+    auto resp = bridgeCmd(ctx, {{"command", "export_pgn"},
+                                {"tags", {{"White", "W"}, {"Black", "B"}}},
+                                {"clocks", {60000, nullptr, 59000}},
+                                {"evals", {nullptr, json{{"cp", -50}}, -300, json{{"mate", -1}}}}});
+    REQUIRE(resp["ok"] == true);
+    std::string pgn = resp["pgn"];
+    REQUIRE(pgn.find("[White \"W\"]\n[Black \"B\"]\n[Result \"0-1\"]\n") != std::string::npos);
+    REQUIRE(pgn.find("1. f3 {[%clk 0:01:00.0]} 1... e5 {[%eval -0.50]} 2. g4\n"
+                     "{[%eval -3.00] [%clk 0:00:59.0]} 2... Qh4# {[%eval #-1]} 0-1\n") !=
+            std::string::npos);
+
+    for (json bad : {json{{"tags", {{"Bad tag", "x"}}}}, json{{"tags", {{"White", 1}}}},
+                     json{{"clocks", {-1}}}, json{{"evals", {"0.3"}}},
+                     json{{"evals", {json{{"mate", 0}}}}}, json{{"result", "1-1"}}}) {
+        bad["command"] = "export_pgn";
+        REQUIRE(bridgeCmd(ctx, bad)["ok"] == false);
+    }
+    json id = bridgeCmd(ctx, {{"command", "create"}})["game_id"];
+    bridgeCmd(ctx, {{"command", "make_move"}, {"game_id", id}, {"move", "d4"}});
+    resp = bridgeCmd(ctx, {{"command", "export_pgn"}, {"game_id", id}, {"result", "1-0"}});
+    REQUIRE(resp["pgn"].get<std::string>().find("\n1. d4 1-0\n") != std::string::npos);
+}
+
+// ============================================================================
+// Game archive
+// ============================================================================
+
+// Random games, some from a FEN and some with long tag values, as PgnGames.
+std::vector<PgnGame> archiveTestGames(int count) {
+    std::mt19937 rng(43);
+    std::vector<PgnGame> games;
+    static std::vector<std::string> values;  // backs the tag views
+    values.reserve(count);
+    for (int g = 0; g < count; g++) {
+        const char* fen = g % 3 == 0 ? "r3k2r/1P4P1/8/3pP3/8/8/1p4p1/R3K2R w KQkq d6 0 12"
+                                     : "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+        auto chess = ChessGame::fromFen(fen);
+        PgnGame game;
+        REQUIRE(Position::fromFen(fen, game.start));
+        for (int ply = 0; ply < 150; ply++) {
+            auto moves = chess->getMoves(chess->getTurn());
+            if (moves.empty() || chess->isAutomaticDraw()) break;
+            ChessMove cm = moves[rng() % moves.size()];
+            REQUIRE(chess->makeMove(cm));
+            game.moves.push_back(PosMove::fromChessMove(cm));
+        }
+        values.push_back(std::string(g % 7 == 0 ? 3000 : 5, static_cast<char>('a' + g % 26)));
+        game.tags = {{"Event", values.back()}, {"Round", g % 2 ? "1" : "2"}};
+        game.result = g % 4 == 0 ? "1-0" : g % 4 == 1 ? "*" : g % 4 == 2 ? "1/2-1/2" : "";
+        games.push_back(std::move(game));
+    }
+    return games;
+}
+
+TEST_CASE("Archive: games round-trip in both encodings", "[archive]") {
+    std::vector<PgnGame> games = archiveTestGames(60);
+    for (ArchiveEncoding encoding : {ArchiveEncoding::MoveIndex, ArchiveEncoding::Move16}) {
+        std::string path = (std::filesystem::temp_directory_path() /
+                            ("chess_archive_test_" + std::to_string(getpid()) + ".cga"))
+                               .string();
+        // Small blocks, so that records are padded and some span blocks.
+        ArchiveWriter writer(encoding, 2048);
+        std::string error;
+        REQUIRE(writer.open(path, error));
+        for (const PgnGame& g : games) REQUIRE(writer.add(g, error));
+        REQUIRE(writer.games() == games.size());
+        REQUIRE(writer.close(error));
+
+        ArchiveReader reader;
+        REQUIRE(reader.open(path, error));
+        REQUIRE(reader.size() == games.size());
+        REQUIRE(reader.encoding() == encoding);
+        PgnGame game;
+        // Out of order, as a seek by number would.
+        for (size_t k = 0; k < games.size(); k++) {
+            size_t i = (k * 37) % games.size();
+            REQUIRE(reader.read(i, game));
+            REQUIRE(game.number == i + 1);
+            REQUIRE(game.moves == games[i].moves);
+            REQUIRE(game.start.toFen() == games[i].start.toFen());
+            REQUIRE(game.result == games[i].result);
+            REQUIRE(game.tags.size() == 2);
+            REQUIRE(game.tag("Event") == games[i].tag("Event"));
+            REQUIRE(game.tag("Round") == games[i].tag("Round"));
+            // Records never straddle a block boundary unless they must.
+            size_t blockOffset = game.offset % 2048;
+            REQUIRE((blockOffset == 0 || games[i].tag("Event").size() < 2048));
+        }
+        REQUIRE(reader.read(4, game, false));
+        REQUIRE(game.moves.empty());
+        REQUIRE(game.tag("Round") == "2");
+        REQUIRE_FALSE(reader.read(games.size(), game));
+        REQUIRE(!game.error.empty());
+
+        // The block index names the first game starting in each block.
+        REQUIRE(reader.blocks() > 1);
+        uint64_t previous = 0;
+        for (uint64_t b = 0; b < reader.blocks(); b++) {
+            uint64_t first = reader.firstGameOfBlock(b);
+            REQUIRE(first >= previous);
+            if (first < reader.size()) {
+                REQUIRE(reader.read(first, game, false));
+                REQUIRE(game.offset / 2048 >= b);
+                if (first > 0) {
+                    REQUIRE(reader.read(first - 1, game, false));
+                    REQUIRE(game.offset / 2048 < b);
+                }
+            }
+            previous = first;
+        }
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_CASE("Archive: damaged files are rejected", "[archive]") {
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("chess_archive_bad_" + std::to_string(getpid()) + ".cga"))
+                           .string();
+    std::string error;
+    ArchiveReader reader;
+    REQUIRE_FALSE(reader.open(path, error));  // missing
+
+    std::vector<PgnGame> games = archiveTestGames(5);
+    {
+        ArchiveWriter writer;
+        REQUIRE(writer.open(path, error));
+        for (const PgnGame& g : games) REQUIRE(writer.add(g, error));
+        REQUIRE(writer.close(error));
+    }
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    auto rewrite = [&](const std::string& data) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    };
+
+    rewrite(bytes.substr(0, bytes.size() - 1));  // truncated trailer
+    REQUIRE_FALSE(reader.open(path, error));
+    std::string badMagic = bytes;
+    badMagic[0] = 'X';
+    rewrite(badMagic);
+    REQUIRE_FALSE(reader.open(path, error));
+
+    // A move index past the legal moves is caught when the game is read.
+    std::string badMove = bytes;
+    size_t lastMove = 32;
+    uint32_t length;
+    std::memcpy(&length, &bytes[lastMove], sizeof(length));
+    lastMove += sizeof(length) + length - 1;  // the first game's last move
+    badMove[lastMove] = static_cast<char>(250);
+    rewrite(badMove);
+    REQUIRE(reader.open(path, error));
+    PgnGame game;
+    REQUIRE_FALSE(reader.read(0, game));
+    REQUIRE(game.error == "corrupt record for game 0");
+    REQUIRE(reader.read(1, game));
+
+    // An unfinished writer leaves nothing behind.
+    std::string unfinished = path + ".unfinished";
+    {
+        ArchiveWriter writer;
+        REQUIRE(writer.open(unfinished, error));
+        REQUIRE(writer.add(games[0], error));
+    }
+    REQUIRE_FALSE(std::filesystem::exists(unfinished));
+    std::filesystem::remove(path);
+}
+
+// ============================================================================
+// Position index
+// ============================================================================
+
+namespace {
+
+uint64_t keyOfFen(const char* fen) {
+    Position pos;
+    REQUIRE(Position::fromFen(fen, pos));
+    return pos.key;
+}
+
+// Games 0-4; game 2 is bad. 1. Nf3 d5 2. d4 and 1. d4 d5 2. Nf3 transpose,
+// and game 3 repeats its start position.
+const char* kIndexPgn =
+    "[Event \"0\"]\n\n1. Nf3 d5 2. d4 Nf6 *\n\n"
+    "[Event \"1\"]\n\n1. d4 d5 2. Nf3 *\n\n"
+    "[Event \"2\"]\n\n1. d4 Ke7 *\n\n"
+    "[Event \"3\"]\n\n1. Nf3 Nf6 2. Ng1 Ng8 3. d4 *\n\n"
+    "[Event \"4\"]\n[FEN \"4k3/8/8/8/8/8/8/4K2R w K - 0 1\"]\n\n1. O-O Kd7 *\n\n";
+
+}  // namespace
+
+TEST_CASE("PositionIndex: postings by position", "[posindex]") {
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("chess_posindex_" + std::to_string(getpid()) + ".pidx"))
+                           .string();
+    for (int threads : {1, 3}) {
+        std::string error;
+        PositionIndexStats stats;
+        REQUIRE(buildPositionIndex(kIndexPgn, path, threads, 0, error, &stats));
+        REQUIRE(stats.games == 5);
+        REQUIRE(stats.badGames == 1);
+
+        PositionIndex index;
+        REQUIRE(index.open(path, error));
+        REQUIRE(index.games() == 5);
+        REQUIRE(index.positions() == stats.keys);
+
+        auto ids = [&](const char* fen) {
+            std::vector<std::pair<uint32_t, uint32_t>> out;
+            for (const auto& p : index.find(keyOfFen(fen))) out.push_back({p.game, p.ply});
+            return out;
+        };
+        using Found = std::vector<std::pair<uint32_t, uint32_t>>;
+        // The initial position: once per game, at ply 0, even for game 3.
+        REQUIRE(ids("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1") ==
+                Found{{0, 0}, {1, 0}, {3, 0}});
+        // Reached by both move orders, at ply 3.
+        REQUIRE(ids("rnbqkbnr/ppp1pppp/8/3p4/3P4/5N2/PPP1PPPP/RNBQKB1R b KQkq - 1 2") ==
+                Found{{0, 3}, {1, 3}});
+        // Move counters do not matter.
+        REQUIRE(ids("rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b KQkq - 7 30") ==
+                Found{{1, 1}, {3, 5}});
+        REQUIRE(ids("4k3/8/8/8/8/8/8/5RK1 b - - 1 1") == Found{{4, 1}});
+        REQUIRE(ids("8/8/8/8/8/8/8/K6k w - - 0 1").empty());
+    }
+
+    // With a ply limit only the first plies are indexed.
+    std::string error;
+    REQUIRE(buildPositionIndex(kIndexPgn, path, 2, 1, error));
+    PositionIndex index;
+    REQUIRE(index.open(path, error));
+    REQUIRE(index.maxPly() == 1);
+    REQUIRE(index.find(keyOfFen("rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b KQkq - 0 1"))
+                .size() == 1);
+    REQUIRE(index.find(keyOfFen("rnbqkbnr/ppp1pppp/8/3p4/3P4/8/PPP1PPPP/RNBQKBNR w KQkq - 0 2"))
+                .empty());
+
+    // Damaged files are refused.
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+    REQUIRE_FALSE(index.open(path, error));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Bridge: find_games", "[bridge][posindex]") {
+    BridgeContext ctx;
+    const char* start = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    REQUIRE(bridgeCmd(ctx, {{"command", "find_games"}, {"fen", start}})["ok"] == false);
+
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("chess_find_games_" + std::to_string(getpid()) + ".pidx"))
+                           .string();
+    std::string error;
+    REQUIRE(buildPositionIndex(kIndexPgn, path, 1, 0, error));
+    auto index = std::make_shared<PositionIndex>();
+    REQUIRE(index->open(path, error));
+    ctx.positionIndex = index;
+
+    auto resp = bridgeCmd(ctx, {{"command", "find_games"}, {"fen", start}});
+    REQUIRE(resp["total"] == 3);
+    REQUIRE(resp["games"] == json::parse(R"([{"game":0,"ply":0},{"game":1,"ply":0},)"
+                                         R"({"game":3,"ply":0}])"));
+    resp = bridgeCmd(ctx, {{"command", "find_games"}, {"fen", start}, {"offset", 1}, {"limit", 1}});
+    REQUIRE(resp["total"] == 3);
+    REQUIRE(resp["games"] == json::parse(R"([{"game":1,"ply":0}])"));
+
+    // Without a FEN, the game's current position.
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    bridgeCmd(ctx, {{"command", "make_move"}, {"move", "Nf3"}});
+    resp = bridgeCmd(ctx, {{"command", "find_games"}});
+    REQUIRE(resp["games"] == json::parse(R"([{"game":0,"ply":1},{"game":3,"ply":1}])"));
+
+    resp = bridgeCmd(ctx, {{"command", "find_games"}, {"fen", "4k3/8/8/8/8/8/8/4RK2 w - - 0 1"}});
+    REQUIRE(resp["ok"] == false);
+    REQUIRE(resp["error"] == "invalid FEN string: side not to move is in check");
+    REQUIRE(bridgeCmd(ctx, {{"command", "find_games"}, {"limit", -1}})["ok"] == false);
+    std::filesystem::remove(path);
+}
+
+// ============================================================================
+// Opening explorer
+// ============================================================================
+
+namespace {
+
+const char* kExplorerPgn =
+    "[Result \"1-0\"]\n\n1. e4 e5 2. Nf3 1-0\n\n"
+    "[Result \"0-1\"]\n\n1. e4 c5 0-1\n\n"
+    "[Result \"1/2-1/2\"]\n\n1. e4 e5 2. Bc4 1/2-1/2\n\n"
+    "[Result \"*\"]\n\n1. e4 e5 *\n\n"  // unfinished: skipped
+    "1. d4 Ke7 1-0\n\n"                      // illegal: skipped
+    "[Result \"1-0\"]\n\n1. d4 d5 1-0\n";
+
+}  // namespace
+
+TEST_CASE("OpeningExplorer: counts per position and move", "[explorer]") {
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("chess_explorer_" + std::to_string(getpid()) + ".cex"))
+                           .string();
+    for (int threads : {1, 4}) {
+        std::string error;
+        ExplorerStats stats;
+        REQUIRE(buildExplorer(kExplorerPgn, path, threads, 0, error, &stats));
+        REQUIRE(stats.games == 4);
+        REQUIRE(stats.skipped == 2);
+
+        OpeningExplorer explorer;
+        REQUIRE(explorer.open(path, error));
+        REQUIRE(explorer.games() == 4);
+        Position pos;
+        REQUIRE(Position::fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", pos));
+        auto root = explorer.find(pos.key);
+        REQUIRE(root.size() == 2);  // d4 (d2d4) and e4 (e2e4), by move code
+        const auto& d4 = root[0].toMove().to == squareOf(3, 3) ? root[0] : root[1];
+        const auto& e4 = &d4 == &root[0] ? root[1] : root[0];
+        REQUIRE(sanOf(pos, e4.toMove()) == "e4");
+        REQUIRE((e4.white == 1 && e4.draws == 1 && e4.black == 1 && e4.games() == 3));
+        REQUIRE((d4.white == 1 && d4.draws == 0 && d4.black == 0));
+
+        pos.make(e4.toMove());
+        auto afterE4 = explorer.find(pos.key);
+        REQUIRE(afterE4.size() == 2);
+        uint64_t games = 0;
+        for (const auto& e : afterE4) games += e.games();
+        REQUIRE(games == 3);
+        REQUIRE(explorer.find(pos.key ^ 1).empty());
+    }
+
+    // The ply limit drops later moves.
+    std::string error;
+    REQUIRE(buildExplorer(kExplorerPgn, path, 2, 1, error));
+    OpeningExplorer explorer;
+    REQUIRE(explorer.open(path, error));
+    Position pos;
+    REQUIRE(Position::fromFen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1", pos));
+    REQUIRE(explorer.find(pos.key).empty());
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    REQUIRE_FALSE(explorer.open(path, error));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Bridge: explorer", "[bridge][explorer]") {
+    BridgeContext ctx;
+    REQUIRE(bridgeCmd(ctx, {{"command", "explorer"}})["ok"] == false);
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("chess_explorer_bridge_" + std::to_string(getpid()) + ".cex"))
+                           .string();
+    std::string error;
+    REQUIRE(buildExplorer(kExplorerPgn, path, 1, 0, error));
+    auto explorer = std::make_shared<OpeningExplorer>();
+    REQUIRE(explorer->open(path, error));
+    ctx.explorer = explorer;
+
+    bridgeCmd(ctx, {{"command", "new_game"}});
+    auto resp = bridgeCmd(ctx, {{"command", "explorer"}});
+    REQUIRE(resp["games"] == 4);
+    REQUIRE(resp["moves"] == json::parse(
+        R"([{"san":"e4","lan":"e2e4","games":3,"white":1,"draws":1,"black":1},)"
+        R"({"san":"d4","lan":"d2d4","games":1,"white":1,"draws":0,"black":0}])"));
+    resp = bridgeCmd(ctx, {{"command", "explorer"},
+                           {"fen", "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2"}});
+    REQUIRE(resp["games"] == 2);
+    REQUIRE(resp["moves"].size() == 2);
+    resp = bridgeCmd(ctx, {{"command", "explorer"}, {"fen", "8/8/8/8/8/8/8/K6k w - - 0 1"}});
+    REQUIRE(resp["games"] == 0);
+    REQUIRE(resp["moves"].empty());
+    REQUIRE(bridgeCmd(ctx, {{"command", "explorer"}, {"fen", 7}})["ok"] == false);
+    std::filesystem::remove(path);
+}
+
+// ============================================================================
+// Batch processing
+// ============================================================================
+
+TEST_CASE("processBatchLine: one record per output kind", "[batch]") {
+    const std::string start = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    BatchOptions options;
+    std::string out;
+    REQUIRE(processBatchLine(start, 1, options, out));
+    auto record = json::parse(out);
+    REQUIRE(record["moves"].size() == 20);
+    REQUIRE(record["moves"][0].is_string());
+    REQUIRE(out.back() == '\n');
+
+    out.clear();
+    options.output = BatchOutput::San;
+    REQUIRE(processBatchLine("5k2/8/8/8/8/8/8/4K2R w K - 0 1", 1, options, out));
+    record = json::parse(out);
+    REQUIRE(std::find(record["moves"].begin(), record["moves"].end(), "O-O+") != record["moves"].end());
+
+    out.clear();
+    options.output = BatchOutput::Status;
+    REQUIRE(processBatchLine("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3", 1,
+                             options, out));
+    REQUIRE(json::parse(out) ==
+            json::parse(R"({"status":"checkmate","in_check":true,"legal_moves":0})"));
+    out.clear();
+    REQUIRE(processBatchLine("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", 1, options, out));
+    REQUIRE(json::parse(out)["status"] == "stalemate");
+
+    // EPD: four position fields, then operations.
+    out.clear();
+    options.output = BatchOutput::Perft;
+    options.depth = 2;
+    REQUIRE(processBatchLine(
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - bm Qxa3; id \"p4\";", 1,
+        options, out));
+    REQUIRE(json::parse(out) == json::parse(R"({"depth":2,"nodes":264})"));
+
+    out.clear();
+    options.output = BatchOutput::Eval;
+    REQUIRE(processBatchLine(start, 1, options, out));
+    REQUIRE(json::parse(out)["eval"].is_number_integer());
+
+    out.clear();
+    REQUIRE_FALSE(processBatchLine("not a fen", 7, options, out));
+    REQUIRE(json::parse(out) == json::parse(R"({"line":7,"error":"invalid FEN"})"));
+    out.clear();
+    REQUIRE_FALSE(processBatchLine("4k3/8/8/8/8/8/8/R3K2P w - - 0 1", 8, options, out));
+    REQUIRE(json::parse(out)["error"] == "pawn on a back rank");
+    out.clear();
+    REQUIRE_FALSE(processBatchLine("4k3/8/8/8/8/8/8/4RK2 w - - 0 1", 9, options, out));
+    REQUIRE(json::parse(out)["error"] == "side not to move is in check");
+}
+
+TEST_CASE("runBatch: keeps input order across threads and a small window", "[batch]") {
+    const char* fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+        "bad",
+        "",
+    };
+    std::string input;
+    for (int i = 0; i < 2000; i++) {
+        input += fens[i % 5];
+        input += i % 5 == 4 ? "  \r\n" : "\n";
+    }
+
+    BatchOptions options;
+    options.output = BatchOutput::Status;
+    std::string expected;
+    for (int i = 0; i < 2000; i++) {
+        if (i % 5 != 4) processBatchLine(fens[i % 5], i + 1, options, expected);
+    }
+
+    for (int threads : {1, 3}) {
+        // Windows smaller than a chunk, than a chunk per thread, and larger.
+        for (size_t window : {1, 2, 7, 300, 65536}) {
+            options.threads = threads;
+            options.window = window;
+            std::istringstream in(input);
+            std::ostringstream out;
+            BatchStats stats = runBatch(in, out, options);
+            REQUIRE(stats.records == 1600);
+            REQUIRE(stats.errors == 400);
+            REQUIRE(out.str() == expected);
+        }
+    }
+
+    std::istringstream empty("");
+    std::ostringstream out;
+    REQUIRE(runBatch(empty, out, options).records == 0);
+    REQUIRE(out.str().empty());
+}
+
+// ============================================================================
+// EPD suites
+// ============================================================================
+
+TEST_CASE("parseEpd: position and operations", "[epd]") {
+    EpdRecord record;
+    std::string error;
+    REQUIRE(parseEpd("r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - "
+                     "bm Bb5! Bc4; am Qe2; id \"a; b\"; c0 \"two words\"; hmvc 2;",
+                     record, error));
+    REQUIRE(record.pos.toFen() == "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 0 1");
+    REQUIRE(record.best.size() == 2);
+    REQUIRE(sanOf(record.pos, record.best[0]) == "Bb5");
+    REQUIRE(sanOf(record.pos, record.best[1]) == "Bc4");
+    REQUIRE(record.avoid.size() == 1);
+    REQUIRE(record.id == "a; b");
+    REQUIRE(record.comment == "two words");
+    REQUIRE(record.tested());
+
+    // Both perft spellings; a full FEN keeps its move counters.
+    REQUIRE(parseEpd("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 3 9 ;D1 20 ;D2 400",
+                     record, error));
+    REQUIRE(record.pos.halfmoveClock == 3);
+    REQUIRE(record.pos.fullmoveNumber == 9);
+    REQUIRE(record.perft.size() == 2);
+    REQUIRE((record.perft[1].depth == 2 && record.perft[1].nodes == 400));
+    REQUIRE(parseEpd("8/8/8/8/8/8/6k1/4K3 w - - perft 3 99", record, error));
+    REQUIRE((record.perft.size() == 1 && record.perft[0].depth == 3 && record.perft[0].nodes == 99));
+
+    REQUIRE(parseEpd("8/8/8/8/8/8/6k1/4K3 w - -", record, error));
+    REQUIRE_FALSE(record.tested());
+
+    REQUIRE_FALSE(parseEpd("8/8/8/8/8/8/6k1/4K3 w - - bm Qh5;", record, error));
+    REQUIRE(error == "bm: illegal or invalid move Qh5");
+    REQUIRE_FALSE(parseEpd("8/8/8/8/8/8/6k1/4K3 w - - bm;", record, error));
+    REQUIRE_FALSE(parseEpd("8/8/8/8/8/8/6k1/4K3 w - - perft x 3;", record, error));
+    REQUIRE_FALSE(parseEpd("8/8/8/8/8/8/6k1/4K3 w", record, error));
+    REQUIRE(error == "invalid FEN");
+}
+
+TEST_CASE("runEpdSuite: pass rate, failures and perft", "[epd]") {
+    const char* lines[] = {
+        "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - bm Rd8#; id \"mate\";",
+        "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - am Rd8#; id \"avoid mate\";",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - perft 2 400; perft 3 8902;",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - perft 2 190; id \"wrong count\";",
+        "8/8/8/8/8/8/6k1/4K3 w - -",
+    };
+    std::vector<EpdRecord> records;
+    for (const char* line : lines) {
+        std::string error;
+        records.emplace_back();
+        REQUIRE(parseEpd(line, records.back(), error));
+    }
+    for (int threads : {1, 3}) {
+        EpdSuiteOptions options;
+        options.nodes = 20000;
+        options.threads = threads;
+        EpdSuiteReport report = runEpdSuite(records, options);
+        REQUIRE(report.results.size() == 5);
+        REQUIRE(report.tested == 4);
+        REQUIRE(report.passed == 2);
+        REQUIRE(report.results[0].passed);
+        REQUIRE(report.results[0].searched);
+        REQUIRE_FALSE(report.results[1].passed);
+        REQUIRE(report.results[2].passed);
+        REQUIRE(report.results[2].perftNodes == std::vector<uint64_t>{400, 8902});
+        REQUIRE_FALSE(report.results[3].passed);
+        REQUIRE(report.perftNodes == 400 + 8902 + 191);
+        REQUIRE(report.nodes > 0);
+
+        json summary = epdReportToJson(records, report);
+        REQUIRE(summary["positions"] == 5);
+        REQUIRE(summary["pass_rate"] == 0.5);
+        REQUIRE(summary["failures"].size() == 2);
+        REQUIRE(summary["failures"][0]["id"] == "avoid mate");
+        REQUIRE(summary["failures"][0]["move"] == "Rd8#");
+        REQUIRE(summary["failures"][0]["avoid"] == json::array({"Rd8#"}));
+        REQUIRE(summary["failures"][1]["index"] == 3);
+        REQUIRE(summary["failures"][1]["perft"] ==
+                json::parse(R"([{"depth":2,"expected":190,"nodes":191}])"));
+    }
+}
+
+TEST_CASE("epdReportToJson: a search with no legal move reports a null move", "[epd]") {
+    std::vector<EpdRecord> records(1);
+    std::string error;
+    REQUIRE(parseEpd("R5k1/5ppp/8/8/8/8/8/6K1 b - - perft 1 1;", records[0], error));
+    EpdSuiteReport report;
+    report.results.resize(1);
+    EpdResult& result = report.results[0];
+    result.searched = true;
+    result.perftNodes = {0};
+    json summary = epdReportToJson(records, report);
+    REQUIRE(summary["failures"].size() == 1);
+    REQUIRE(summary["failures"][0]["move"].is_null());
+}